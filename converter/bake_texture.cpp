@@ -0,0 +1,92 @@
+#include <iostream>
+#include <string>
+#include <vector>
+#include <string.h>
+#include <stdlib.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#include "ctex.h"
+
+// Guesses what a texture is for from the repo's naming (name_DIFF, name_NORM, name_SPEC)
+static TX::Usage usageFromName(const std::string& path) {
+   if (path.find("_NORM") != std::string::npos)
+      return TX::NORMAL;
+   if (path.find("_SPEC") != std::string::npos)
+      return TX::SPECULAR;
+   return TX::DIFFUSE;
+}
+
+static const char * formatName(TX::Format format) {
+   switch (format) {
+      case TX::BC1: return "BC1";
+      case TX::BC3: return "BC3";
+      case TX::BC4: return "BC4";
+      case TX::BC5: return "BC5";
+      default:      return "RGB8";
+   }
+}
+
+int main(int argc, char** argv) {
+   bool usageGiven = false;
+   TX::Usage usage = TX::DIFFUSE;
+
+   // PARSE COMMAND LINE ARGS
+   int argNdx = 1;
+   for (; argNdx < argc && argv[argNdx][0] == '-'; argNdx++) {
+      usageGiven = true;
+      if (strcmp(argv[argNdx], "-d") == 0) {
+         usage = TX::DIFFUSE;
+      } else if (strcmp(argv[argNdx], "-n") == 0) {
+         usage = TX::NORMAL;
+      } else if (strcmp(argv[argNdx], "-s") == 0) {
+         usage = TX::SPECULAR;
+      } else {
+         std::cerr << "Unknown option " << argv[argNdx] << "\n";
+         exit(1);
+      }
+   }
+
+   if (argc - argNdx != 1 && argc - argNdx != 2) {
+      std::cerr << "Usage: [-d|-n|-s](optional) [image_path] [out_path](optional)\n";
+      std::cerr << "  -d diffuse (BC1, BC3 with alpha), -n normal map (BC5), -s specular map (BC4),\n";
+      std::cerr << "  guessed from a _NORM or _SPEC in the name if not given.\n";
+      std::cerr << "  The output defaults to [image_path].ctex, which the game loads in place of the image.\n";
+      exit(1);
+   }
+   std::string imagePath = argv[argNdx];
+   std::string outPath = argc - argNdx == 2 ? argv[argNdx+1] : imagePath + ".ctex";
+   if (!usageGiven)
+      usage = usageFromName(imagePath);
+
+   // LOAD THE IMAGE AS RGBA
+   int width, height, ncomps;
+   unsigned char * pixels = stbi_load(imagePath.c_str(), &width, &height, &ncomps, 4);
+   if (!pixels) {
+      std::cerr << "Error loading " << imagePath << ": " << stbi_failure_reason() << "\n";
+      exit(1);
+   }
+
+   // Flip the image for opengl
+   int rowSize = 4 * width;
+   std::vector<unsigned char> flipped(rowSize * height);
+   for (int i = 0; i < height; i++)
+      memcpy(& flipped[rowSize * i], & pixels[rowSize * (height-1-i)], rowSize);
+   stbi_image_free(pixels);
+
+   // MIPMAP, COMPRESS AND WRITE
+   TX::Format format;
+   std::vector<TX::Level> levels;
+   std::vector<unsigned char> data;
+   TX::Bake(flipped.data(), width, height, usage, format, levels, data);
+
+   if (!TX::WriteFile(outPath.c_str(), format, levels, data)) {
+      std::cerr << "Error writing " << outPath << "\n";
+      exit(1);
+   }
+
+   std::cout << imagePath << " -> " << outPath << " (" << formatName(format) << ", "
+             << levels.size() << " levels, " << data.size() / 1024 << " KB)\n";
+   return 0;
+}
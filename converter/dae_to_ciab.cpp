@@ -5,6 +5,10 @@
 #include <iostream>
 #include <vector>
 #include <map>
+#include <cmath>
+
+#include "progressive.h"
+#include "anim_compress.h"
 
 #define GLM_FORCE_RADIANS
 #include "glm/glm.hpp"
@@ -23,11 +27,32 @@ typedef enum {
    BONE_WEIGHTS = 9,
    BONE_NUM_INF = 10,
    BONE_TREE = 11,
-   ANIMATIONS = 12
+   ANIMATIONS = 12,
+   VERTEX_BLOCK = 13,
+   KEYFRAMES_Q16 = 14,
+   KEYFRAMES_COMPRESSED = 15
 } modelFieldType;
 
 #define MAX_INFLUENCES 4
 
+// Must match the ciab2 layout in src/include/ciab.h (see CIAB2_FORMAT.txt)
+#define CIAB2_VERSION 2
+#define CIAB2_ALIGNMENT 16
+#define VB_BONE_INDICES 80
+
+typedef struct {
+   unsigned int type;
+   unsigned int format;
+   unsigned long long offset;
+   unsigned long long size;
+} Section;
+
+typedef struct {
+   aiVector3D position;
+   aiQuaternion rotation;
+   aiVector3D scale;
+} AnimKey;
+
 typedef struct {
    unsigned int index;
    float weight;
@@ -41,6 +66,9 @@ typedef std::map<std::string, uint> BoneMap;
 typedef std::map<std::string, uint>::iterator BoneIterator;
 
 bool blenderCorrect = false;
+bool writeVersion2 = false;
+bool writeVBV = false;
+bool compressAnimations = false;
 
 FILE * safe_fopen(const char * path, const char * mode) {
    FILE * fp = fopen(path, mode);
@@ -234,6 +262,21 @@ void writeUVs(FILE * fp, aiMesh& mesh) {
    }
 }
 
+void calcTangentSpace(aiMesh& mesh, int i, aiVector3D& t, aiVector3D& b) {
+   aiVector3D n = mesh.mNormals[i];
+   t = mesh.mTangents[i];
+   b = n^t;
+
+   // make tangents orthogonal
+   t = (t - n * (n*t)).Normalize();
+
+   // make sure tangents are right handed
+   if ((n^t)*b < 0.0f)
+      t = t * -1.0f;
+
+   b = n^t;
+}
+
 void writeTangentsAndBitangents(FILE * fp, aiMesh& mesh) {
    if (mesh.HasTangentsAndBitangents()) {
       std::cerr << "Writing tangents...\n";
@@ -242,19 +285,9 @@ void writeTangentsAndBitangents(FILE * fp, aiMesh& mesh) {
       std::vector<aiVector3D> bitangents = std::vector<aiVector3D>(mesh.mNumVertices);
 
       for (int i = 0; i < mesh.mNumVertices; i++) {
-         aiVector3D n = mesh.mNormals[i];
-         aiVector3D t = mesh.mTangents[i];
-         aiVector3D b = n^t;
-
-         // make tangents orthogonal
-         t = (t - n * (n*t)).Normalize();
-
-         // make sure tangents are right handed
-         if ((n^t)*b < 0.0f)
-            t = t * -1.0f;
-
+         aiVector3D t;
+         calcTangentSpace(mesh, i, t, bitangents[i]);
          writeVector3D(fp, blend2oglVec3(t));
-         bitangents[i] = n^t;
       }
 
       std::cerr << "Writing bitangents...\n";
@@ -265,16 +298,19 @@ void writeTangentsAndBitangents(FILE * fp, aiMesh& mesh) {
    }
 }
 
+void writeIndexData(FILE * fp, aiMesh& mesh) {
+   for (int i = 0; i < mesh.mNumFaces; i++) {
+      writeUInt(fp, mesh.mFaces[i].mIndices[0]);
+      writeUInt(fp, mesh.mFaces[i].mIndices[1]);
+      writeUInt(fp, mesh.mFaces[i].mIndices[2]);
+   }
+}
+
 void writeIndices(FILE * fp, aiMesh& mesh) {
    if (mesh.HasFaces()) {
       std::cerr << "Writing face indices...\n";
       writeTypeField(fp, INDICES);
-
-      for (int i = 0; i < mesh.mNumFaces; i++) {
-         writeUInt(fp, mesh.mFaces[i].mIndices[0]);
-         writeUInt(fp, mesh.mFaces[i].mIndices[1]);
-         writeUInt(fp, mesh.mFaces[i].mIndices[2]);
-     }
+      writeIndexData(fp, mesh);
    }
 }
 
@@ -351,14 +387,21 @@ void writeBoneWeights(FILE * fp, aiMesh& mesh) {
    }
 }
 
-void writeBoneTree(FILE * fp, aiMesh& mesh, aiNode * root) {
-   std::cerr << "Writing bone tree...\n";
-   writeTypeField(fp, BONE_TREE);
+void writeBoneIndex(FILE * fp, int index, bool shortIndices) {
+   if (shortIndices) {
+      short s = index;
+      fwrite(& s, sizeof(short), 1, fp);
+   } else {
+      writeInt(fp, index);
+   }
+}
 
+// The ciab formats store the tree's indices as 32 bit ints, vbv as 16 bit
+void writeBoneTreeData(FILE * fp, aiMesh& mesh, aiNode * root, bool shortIndices = false) {
    BoneMap nameToIndexMap = createBoneName2IndexMap(mesh);
 
    // write the bone root index
-   writeUInt(fp, findRootBoneIndex(mesh, & nameToIndexMap, root));
+   writeBoneIndex(fp, findRootBoneIndex(mesh, & nameToIndexMap, root), shortIndices);
 
    // Write each bone to file
    for (uint i = 0; i < mesh.mNumBones; i++) {
@@ -369,14 +412,14 @@ void writeBoneTree(FILE * fp, aiMesh& mesh, aiNode * root) {
       int parentIndex = -1;
       if (it != nameToIndexMap.end())
          parentIndex = it->second;
-      writeInt(fp, parentIndex);
+      writeBoneIndex(fp, parentIndex, shortIndices);
 
       // Write the children
-      writeUInt(fp, node->mNumChildren);
+      writeBoneIndex(fp, node->mNumChildren, shortIndices);
       for (int j = 0; j < node->mNumChildren; j++) {
          BoneIterator it = nameToIndexMap.find(node->mChildren[j]->mName.C_Str());
          assert (it != nameToIndexMap.end());
-         writeInt(fp, it->second);
+         writeBoneIndex(fp, it->second, shortIndices);
       }
 
       // Write the inverse bindPose and parentBone transform matrices
@@ -387,6 +430,12 @@ void writeBoneTree(FILE * fp, aiMesh& mesh, aiNode * root) {
    }
 }
 
+void writeBoneTree(FILE * fp, aiMesh& mesh, aiNode * root) {
+   std::cerr << "Writing bone tree...\n";
+   writeTypeField(fp, BONE_TREE);
+   writeBoneTreeData(fp, mesh, root);
+}
+
 void writeBones(FILE * fp, aiMesh& mesh, aiNode * root) {
    if (mesh.HasBones()) {
       writeBoneWeights(fp, mesh);
@@ -421,57 +470,436 @@ void checkIfKeysAligned(aiNodeAnim * nodeAnim) {
              nodeAnim->mPositionKeys[k].mTime == nodeAnim->mScalingKeys[k].mTime);
 }
 
+// Returns the keys of every bone channel of an animation, in file order
+std::vector<std::vector<AnimKey> > readAnimationKeys(aiAnimation * anim, aiMesh& mesh,
+                                                     unsigned int& fps, unsigned int& numKeys) {
+   BoneMap boneMap = createBoneName2IndexMap(mesh);
+   int rootNdx = getAnimIndexRoot(mesh, anim);
+
+   assert(anim->mTicksPerSecond != 0);
+   assert(anim->mNumChannels > 0);
+
+   numKeys = anim->mChannels[rootNdx]->mNumPositionKeys;
+   float duration = anim->mDuration;
+   fps = (numKeys-1) / duration;
+
+   std::vector<std::vector<AnimKey> > tracks;
+   aiMatrix4x4 * matKeys = (aiMatrix4x4 *)malloc(sizeof(aiMatrix4x4) * numKeys);
+
+   for (int chanNdx = 0; chanNdx < anim->mNumChannels; chanNdx++) {
+      const char * chanName = anim->mChannels[chanNdx]->mNodeName.C_Str();
+
+      if (isInMap(chanName, boneMap)) {
+         aiNodeAnim * nodeAnim = anim->mChannels[chanNdx];
+
+         checkIfKeysAligned(nodeAnim);
+         animKeysToMatrices(nodeAnim, matKeys);
+
+         std::vector<AnimKey> keys = std::vector<AnimKey>(numKeys);
+         for (int keyNdx = 0; keyNdx < numKeys; keyNdx++) {
+            matKeys[keyNdx] = blend2oglMat4(matKeys[keyNdx]);
+            matKeys[keyNdx].Decompose(keys[keyNdx].scale, keys[keyNdx].rotation, keys[keyNdx].position);
+         }
+         tracks.push_back(keys);
+      }
+   }
+
+   free(matKeys);
+   return tracks;
+}
+
+void writeAnimationData(FILE * fp, const aiScene * scene, aiMesh& mesh) {
+   for (int i = 0; i < scene->mNumAnimations; i++) {
+      unsigned int fps, numKeys;
+      std::vector<std::vector<AnimKey> > tracks = readAnimationKeys(scene->mAnimations[i], mesh, fps, numKeys);
+
+      writeUInt(fp, fps);
+      writeUInt(fp, numKeys);
+
+      // Write the animations for each bone
+      for (int t = 0; t < tracks.size(); t++) {
+         for (int keyNdx = 0; keyNdx < numKeys; keyNdx++) {
+            float time = 1.0 * keyNdx / fps;
+            writeFloat(fp, time);
+            writeVector3D(fp, tracks[t][keyNdx].position);
+            writeQuaternion(fp, tracks[t][keyNdx].rotation);
+            writeVector3D(fp, tracks[t][keyNdx].scale);
+         }
+      }
+   }
+}
+
 void writeAnimations(FILE * fp, const aiScene * scene, aiMesh& mesh) {
    int numAnims = scene->mNumAnimations;
 
    if (numAnims > 0) {
       std::cerr << "Writing " << numAnims << " animation" << (numAnims == 1 ? "" : "s") << "...\n";
       writeTypeField(fp, ANIMATIONS);
+      writeAnimationData(fp, scene, mesh);
+   }
+}
+
+// CIAB2 WRITE FUNCTIONS
+
+void writeUShort(FILE * fp, unsigned short s) {
+   fwrite(& s, sizeof(unsigned short), 1, fp);
+}
+
+void writeUChar(FILE * fp, unsigned char c) {
+   fwrite(& c, sizeof(unsigned char), 1, fp);
+}
 
-      for (int i = 0; i < numAnims; i++) {
-         aiAnimation * anim = scene->mAnimations[i];
-         BoneMap boneMap = createBoneName2IndexMap(mesh);
-         int rootNdx = getAnimIndexRoot(mesh, anim);
+void writePadding(FILE * fp, long alignment) {
+   for (long pos = ftell(fp); pos % alignment; pos++)
+      writeUChar(fp, 0);
+}
 
-         assert(anim->mTicksPerSecond != 0);
-         assert(anim->mNumChannels > 0);
+void beginSection(FILE * fp, std::vector<Section>& sections, unsigned int type, unsigned int format) {
+   writePadding(fp, CIAB2_ALIGNMENT);
+   Section section = {type, format, (unsigned long long)ftell(fp), 0};
+   sections.push_back(section);
+}
+
+void endSection(FILE * fp, std::vector<Section>& sections) {
+   sections.back().size = ftell(fp) - sections.back().offset;
+}
+
+unsigned int fieldBit(modelFieldType field) {
+   return 1 << (field-1);
+}
+
+// Flags the vertex attributes that hold real data in the vertex block
+unsigned int presentFlags(aiMesh& mesh) {
+   unsigned int flags = fieldBit(POSITIONS);
+   if (mesh.HasNormals())
+      flags |= fieldBit(NORMALS);
+   if (mesh.HasVertexColors(0))
+      flags |= fieldBit(COLORS);
+   if (mesh.HasTextureCoords(0))
+      flags |= fieldBit(TEXCOORDS);
+   if (mesh.HasTangentsAndBitangents())
+      flags |= fieldBit(TANGENTS) | fieldBit(BITANGENTS);
+   if (mesh.HasBones())
+      flags |= fieldBit(BONE_INDICES) | fieldBit(BONE_WEIGHTS) | fieldBit(BONE_NUM_INF);
+   return flags;
+}
 
-         unsigned int numKeys = anim->mChannels[rootNdx]->mNumPositionKeys;
-         float duration = anim->mDuration;
-         unsigned int fps = (numKeys-1) / duration;
+void writeHeader2(FILE * fp, aiMesh& mesh, int animCount, std::vector<Section>& sections) {
+   fseek(fp, 0, SEEK_SET);
+   fwrite("CIAB", 1, 4, fp);
+   writeUInt(fp, CIAB2_VERSION);
+   writeUInt(fp, mesh.mNumVertices);
+   writeUInt(fp, mesh.mNumFaces);
+   writeUInt(fp, mesh.mNumBones);
+   writeUInt(fp, animCount);
+   writeUInt(fp, presentFlags(mesh));
+   writeUInt(fp, sections.size());
 
-         writeUInt(fp, fps);
-         writeUInt(fp, numKeys);
+   for (int i = 0; i < sections.size(); i++) {
+      writeUInt(fp, sections[i].type);
+      writeUInt(fp, sections[i].format);
+      fwrite(& sections[i].offset, sizeof(unsigned long long), 1, fp);
+      fwrite(& sections[i].size, sizeof(unsigned long long), 1, fp);
+   }
+}
 
-         aiMatrix4x4 * matKeys = (aiMatrix4x4 *)malloc(sizeof(aiMatrix4x4) * numKeys);
+void writeVertexBlock(FILE * fp, aiMesh& mesh, std::vector<Section>& sections) {
+   unsigned int indexSize = mesh.mNumBones <= 256 ? 1 : 2;
+   unsigned int stride = (VB_BONE_INDICES + MAX_INFLUENCES * indexSize + 3) & ~3u;
+   aiVector3D zero = aiVector3D(0,0,0);
 
-         // Write the animations for each bone
-         for (int chanNdx = 0; chanNdx < anim->mNumChannels; chanNdx++) {
-            const char * chanName = anim->mChannels[chanNdx]->mNodeName.C_Str();
+   std::cerr << "Writing interleaved vertices...\n";
+   beginSection(fp, sections, VERTEX_BLOCK, indexSize);
 
-            if (isInMap(chanName, boneMap)) {
-               aiNodeAnim * nodeAnim = anim->mChannels[chanNdx];
+   Vertex * verts = new Vertex[mesh.mNumVertices];
+   if (mesh.HasBones())
+      arrangeBoneWeights(mesh, verts);
 
-               checkIfKeysAligned(nodeAnim);
-               animKeysToMatrices(nodeAnim, matKeys);
+   for (int i = 0; i < mesh.mNumVertices; i++) {
+      long start = ftell(fp);
 
-               for (int keyNdx = 0; keyNdx < numKeys; keyNdx++) {
-                  aiVector3D scl, pos;
-                  aiQuaternion rot;
-                  matKeys[keyNdx] = blend2oglMat4(matKeys[keyNdx]);
-                  matKeys[keyNdx].Decompose(scl, rot, pos);
+      aiVector3D t = zero, b = zero;
+      if (mesh.HasTangentsAndBitangents())
+         calcTangentSpace(mesh, i, t, b);
 
-                  float time = 1.0 * keyNdx / fps;
-                  writeFloat(fp, time);
-                  writeVector3D(fp, pos);
-                  writeQuaternion(fp, rot);
-                  writeVector3D(fp, scl);
-               }
+      writeVector3D(fp, blend2oglVec3(mesh.mVertices[i]));
+      writeVector3D(fp, mesh.HasNormals() ? blend2oglVec3(mesh.mNormals[i]) : zero);
+      if (mesh.HasVertexColors(0)) {
+         writeFloat(fp, mesh.mColors[0][i].r);
+         writeFloat(fp, mesh.mColors[0][i].g);
+         writeFloat(fp, mesh.mColors[0][i].b);
+      } else {
+         writeVector3D(fp, zero);
+      }
+      writeFloat(fp, mesh.HasTextureCoords(0) ? mesh.mTextureCoords[0][i].x : 0);
+      writeFloat(fp, mesh.HasTextureCoords(0) ? mesh.mTextureCoords[0][i].y : 0);
+      writeVector3D(fp, blend2oglVec3(t));
+      writeVector3D(fp, blend2oglVec3(b));
+
+      // Weights as normalized uint16, then the influence count and indices
+      std::vector<BoneWeight>& bws = verts[i].boneWeights;
+      unsigned char numInf = 0;
+      for (int j = 0; j < MAX_INFLUENCES; j++) {
+         float w = j < bws.size() ? std::min(std::max(bws[j].weight, 0.0f), 1.0f) : 0;
+         writeUShort(fp, (unsigned short)roundf(w * 65535.0f));
+         if (w > 0.0f)
+            numInf = j+1;
+      }
+      writeUChar(fp, numInf);
+      writePadding(fp, 4);
+
+      for (int j = 0; j < MAX_INFLUENCES; j++) {
+         unsigned int index = j < bws.size() ? bws[j].index : 0;
+         if (indexSize == 1)
+            writeUChar(fp, index);
+         else
+            writeUShort(fp, index);
+      }
+
+      while (ftell(fp) - start < stride)
+         writeUChar(fp, 0);
+   }
+
+   delete[] verts;
+   endSection(fp, sections);
+}
+
+// Each channel's positions and scales are stored as 16 bit steps between
+// their min and max, rotations as 16 bit signed fractions of 1
+void writeQuantizedAnimations(FILE * fp, const aiScene * scene, aiMesh& mesh, std::vector<Section>& sections) {
+   int numAnims = scene->mNumAnimations;
+
+   std::cerr << "Writing " << numAnims << " quantized animation" << (numAnims == 1 ? "" : "s") << "...\n";
+   beginSection(fp, sections, KEYFRAMES_Q16, 0);
+
+   for (int i = 0; i < numAnims; i++) {
+      unsigned int fps, numKeys;
+      std::vector<std::vector<AnimKey> > tracks = readAnimationKeys(scene->mAnimations[i], mesh, fps, numKeys);
+      std::vector<aiVector3D> posMin, posStep, sclMin, sclStep;
+
+      writeUInt(fp, fps);
+      writeUInt(fp, numKeys);
+      writeUInt(fp, 0);
+      writeUInt(fp, 0);
+
+      for (int t = 0; t < tracks.size(); t++) {
+         aiVector3D pMin = tracks[t][0].position, pMax = pMin;
+         aiVector3D sMin = tracks[t][0].scale, sMax = sMin;
+         for (int k = 1; k < numKeys; k++)
+            for (int c = 0; c < 3; c++) {
+               pMin[c] = std::min(pMin[c], tracks[t][k].position[c]);
+               pMax[c] = std::max(pMax[c], tracks[t][k].position[c]);
+               sMin[c] = std::min(sMin[c], tracks[t][k].scale[c]);
+               sMax[c] = std::max(sMax[c], tracks[t][k].scale[c]);
             }
-         }
 
-         free(matKeys);
+         posMin.push_back(pMin);
+         posStep.push_back((pMax - pMin) / 65535.0f);
+         sclMin.push_back(sMin);
+         sclStep.push_back((sMax - sMin) / 65535.0f);
+
+         writeVector3D(fp, posMin[t]);
+         writeVector3D(fp, posStep[t]);
+         writeVector3D(fp, sclMin[t]);
+         writeVector3D(fp, sclStep[t]);
       }
+
+      for (int t = 0; t < tracks.size(); t++) {
+         for (int k = 0; k < numKeys; k++) {
+            AnimKey& key = tracks[t][k];
+            for (int c = 0; c < 3; c++)
+               writeUShort(fp, posStep[t][c] > 0 ? roundf((key.position[c] - posMin[t][c]) / posStep[t][c]) : 0);
+
+            float rot[4] = {key.rotation.x, key.rotation.y, key.rotation.z, key.rotation.w};
+            for (int c = 0; c < 4; c++)
+               writeUShort(fp, (short)roundf(std::min(std::max(rot[c], -1.0f), 1.0f) * 32767.0f));
+
+            for (int c = 0; c < 3; c++)
+               writeUShort(fp, sclStep[t][c] > 0 ? roundf((key.scale[c] - sclMin[t][c]) / sclStep[t][c]) : 0);
+         }
+      }
+
+      writePadding(fp, CIAB2_ALIGNMENT);
+   }
+
+   endSection(fp, sections);
+}
+
+// Each animation is cut down to the keys needed to stay within AC's default
+// tolerance, then quantized, in the same layout the game samples from
+void writeCompressedAnimations(FILE * fp, const aiScene * scene, aiMesh& mesh, std::vector<Section>& sections) {
+   int numAnims = scene->mNumAnimations;
+
+   std::cerr << "Writing " << numAnims << " compressed animation" << (numAnims == 1 ? "" : "s") << "...\n";
+   beginSection(fp, sections, KEYFRAMES_COMPRESSED, 0);
+
+   for (int i = 0; i < numAnims; i++) {
+      unsigned int fps, numKeys;
+      std::vector<std::vector<AnimKey> > tracks = readAnimationKeys(scene->mAnimations[i], mesh, fps, numKeys);
+      std::vector<LocalTransform> frames = std::vector<LocalTransform>(tracks.size() * numKeys);
+
+      for (int t = 0; t < tracks.size(); t++)
+         for (int k = 0; k < numKeys; k++) {
+            AnimKey& key = tracks[t][k];
+            LocalTransform * frame = & frames[t * numKeys + k];
+            frame->position = Eigen::Vector3f(key.position.x, key.position.y, key.position.z);
+            frame->rotation = Eigen::Quaternionf(key.rotation.w, key.rotation.x, key.rotation.y, key.rotation.z);
+            frame->scale = Eigen::Vector3f(key.scale.x, key.scale.y, key.scale.z);
+         }
+
+      std::vector<unsigned char> clip;
+      AC::Compress(frames.data(), tracks.size(), numKeys, fps, AC::DefaultTolerance(), clip);
+      fwrite(clip.data(), 1, clip.size(), fp);
+      writePadding(fp, CIAB2_ALIGNMENT);
+
+      // Plain keys are a time, position, rotation and scale, 11 floats
+      size_t plainSize = tracks.size() * numKeys * 11 * sizeof(float);
+      std::cerr << "  animation " << i << ": " << plainSize << " bytes of keys down to " << clip.size() << "\n";
+   }
+
+   endSection(fp, sections);
+}
+
+void writeCIAB2(FILE * fp, const aiScene * scene, aiMesh& mesh, aiNode * root) {
+   int numAnims = mesh.HasBones() ? scene->mNumAnimations : 0;
+   std::vector<Section> sections;
+
+   // Reserve room for the header and directory, they are filled in once the
+   // section offsets are known
+   int sectionCount = 2 + (mesh.HasBones() ? 1 : 0) + (numAnims > 0 ? 1 : 0);
+   std::vector<Section> placeholder = std::vector<Section>(sectionCount);
+   std::cerr << "Writing ciab2 header...\n";
+   writeHeader2(fp, mesh, numAnims, placeholder);
+
+   writeVertexBlock(fp, mesh, sections);
+
+   std::cerr << "Writing face indices...\n";
+   beginSection(fp, sections, INDICES, 0);
+   writeIndexData(fp, mesh);
+   endSection(fp, sections);
+
+   if (mesh.HasBones()) {
+      std::cerr << "Writing bone tree...\n";
+      beginSection(fp, sections, BONE_TREE, 0);
+      writeBoneTreeData(fp, mesh, root);
+      endSection(fp, sections);
+   }
+
+   if (numAnims > 0 && compressAnimations)
+      writeCompressedAnimations(fp, scene, mesh, sections);
+   else if (numAnims > 0)
+      writeQuantizedAnimations(fp, scene, mesh, sections);
+
+   writeHeader2(fp, mesh, numAnims, sections);
+}
+
+// VBV WRITE FUNCTIONS
+
+void writeVBVVertex(FILE * fp, aiMesh& mesh, Vertex * verts, unsigned int i) {
+   aiVector3D zero = aiVector3D(0,0,0);
+   aiVector3D t = zero, b = zero;
+   if (mesh.HasTangentsAndBitangents())
+      calcTangentSpace(mesh, i, t, b);
+
+   writeVector3D(fp, blend2oglVec3(mesh.mVertices[i]));
+   writeVector3D(fp, mesh.HasNormals() ? blend2oglVec3(mesh.mNormals[i]) : zero);
+   if (mesh.HasVertexColors(0)) {
+      writeFloat(fp, mesh.mColors[0][i].r);
+      writeFloat(fp, mesh.mColors[0][i].g);
+      writeFloat(fp, mesh.mColors[0][i].b);
+   } else {
+      writeVector3D(fp, zero);
+   }
+   writeFloat(fp, mesh.HasTextureCoords(0) ? mesh.mTextureCoords[0][i].x : 0);
+   writeFloat(fp, mesh.HasTextureCoords(0) ? mesh.mTextureCoords[0][i].y : 0);
+   writeVector3D(fp, blend2oglVec3(t));
+   writeVector3D(fp, blend2oglVec3(b));
+
+   std::vector<BoneWeight>& bws = verts[i].boneWeights;
+   unsigned short numInf = 0;
+   for (int j = 0; j < MAX_INFLUENCES; j++)
+      writeUShort(fp, j < bws.size() ? bws[j].index : 0);
+   for (int j = 0; j < MAX_INFLUENCES; j++) {
+      float w = j < bws.size() ? bws[j].weight : 0;
+      writeFloat(fp, w);
+      if (w > 0.0f)
+         numInf = j+1;
+   }
+   writeUShort(fp, numInf);
+}
+
+void writeVertexSplit(FILE * fp, const PM::VertexSplit& split) {
+   unsigned int numNewFaces = split.newFaces.size() / 3;
+   assert(numNewFaces <= 255);
+
+   writeUInt(fp, split.baseVertex);
+   writeUChar(fp, numNewFaces);
+   for (int i = 0; i < split.newFaces.size(); i++)
+      writeUInt(fp, split.newFaces[i]);
+
+   writeUInt(fp, split.updatedFaces.size());
+   for (int i = 0; i < split.updatedFaces.size(); i++) {
+      writeUInt(fp, split.updatedFaces[i].face);
+      writeUChar(fp, split.updatedFaces[i].corner);
+   }
+}
+
+// Vertices are written coarse to fine, each with the split that brings it back
+void writeVBVFile(FILE * fp, const aiScene * scene, aiMesh& mesh, aiNode * root) {
+   int numAnims = mesh.HasBones() ? scene->mNumAnimations : 0;
+
+   std::vector<Eigen::Vector3f> positions = std::vector<Eigen::Vector3f>(mesh.mNumVertices);
+   for (int i = 0; i < mesh.mNumVertices; i++) {
+      aiVector3D p = blend2oglVec3(mesh.mVertices[i]);
+      positions[i] = Eigen::Vector3f(p.x, p.y, p.z);
+   }
+
+   std::vector<unsigned int> indices;
+   for (int i = 0; i < mesh.mNumFaces; i++)
+      for (int j = 0; j < 3; j++)
+         indices.push_back(mesh.mFaces[i].mIndices[j]);
+
+   std::cerr << "Ordering vertices by edge collapse...\n";
+   std::vector<unsigned int> order, faces;
+   std::vector<PM::VertexSplit> splits;
+   PM::BuildProgressiveMesh(positions, indices, order, splits, faces);
+
+   unsigned int flags = presentFlags(mesh);
+   if (mesh.HasBones())
+      flags |= fieldBit(BONE_TREE);
+   if (numAnims > 0)
+      flags |= fieldBit(ANIMATIONS);
+
+   std::cerr << "Writing vbv header...\n";
+   writeUInt(fp, mesh.mNumVertices);
+   writeUInt(fp, faces.size() / 3);
+   writeUInt(fp, mesh.mNumBones);
+   writeUInt(fp, numAnims);
+   writeUInt(fp, flags);
+
+   std::cerr << "Writing vertex splits...\n";
+   Vertex * verts = new Vertex[mesh.mNumVertices];
+   if (mesh.HasBones())
+      arrangeBoneWeights(mesh, verts);
+
+   for (int i = 0; i < mesh.mNumVertices; i++) {
+      writeVBVVertex(fp, mesh, verts, order[i]);
+      writeVertexSplit(fp, splits[i]);
+   }
+   delete[] verts;
+
+   std::cerr << "Writing face indices...\n";
+   for (int i = 0; i < faces.size(); i++)
+      writeUInt(fp, faces[i]);
+
+   if (mesh.HasBones()) {
+      std::cerr << "Writing bone tree...\n";
+      writeBoneTreeData(fp, mesh, root, true);
+   }
+
+   if (numAnims > 0) {
+      std::cerr << "Writing " << numAnims << " animation" << (numAnims == 1 ? "" : "s") << "...\n";
+      writeAnimationData(fp, scene, mesh);
    }
 }
 
@@ -479,20 +907,30 @@ int main(int argc, char** argv) {
    char * modelPath, * outPath;
 
    // PARSE COMMAND LINE ARGS
-   if (argc < 3 || argc > 4) {
-      std::cerr << "Usage: [-b](optional) [dae_path] [ciab_path]\n";
-      exit(1);
-   } else if (argc == 3) {
-      modelPath = argv[1];
-      outPath = argv[2];
-   } else if (strcmp(argv[1], "-b") == 0) {
-      blenderCorrect = true;
-      modelPath = argv[2];
-      outPath = argv[3];
-   } else {
-      std::cerr << "\"-b\" option must be specified first if you want to correct for blender orientation\n";
+   int argNdx = 1;
+   for (; argNdx < argc && argv[argNdx][0] == '-'; argNdx++) {
+      if (strcmp(argv[argNdx], "-b") == 0) {
+         blenderCorrect = true;
+      } else if (strcmp(argv[argNdx], "-2") == 0) {
+         writeVersion2 = true;
+      } else if (strcmp(argv[argNdx], "-v") == 0) {
+         writeVBV = true;
+      } else if (strcmp(argv[argNdx], "-c") == 0) {
+         compressAnimations = true;
+      } else {
+         std::cerr << "Unknown option " << argv[argNdx] << "\n";
+         exit(1);
+      }
+   }
+
+   if (argc - argNdx != 2) {
+      std::cerr << "Usage: [-b](optional) [-2|-v](optional) [-c](optional) [dae_path] [out_path]\n";
+      std::cerr << "  -b corrects for blender orientation, -2 writes the aligned ciab2 format,\n";
+      std::cerr << "  -v writes the progressive vbv format, -c compresses ciab2 animations\n";
       exit(1);
    }
+   modelPath = argv[argNdx];
+   outPath = argv[argNdx+1];
 
    // SETUP ASSIMP
    Assimp::Importer importer;
@@ -515,6 +953,15 @@ int main(int argc, char** argv) {
    FILE * outFile = safe_fopen(outPath, "wb");
 
    // WRITE THE DATA
+   if (writeVersion2) {
+      writeCIAB2(outFile, scene, mesh, root);
+      return 0;
+   }
+   if (writeVBV) {
+      writeVBVFile(outFile, scene, mesh, root);
+      return 0;
+   }
+
    writeHeader(outFile, mesh, numAnims);
    writePositions(outFile, mesh);
    writeNormals(outFile, mesh);
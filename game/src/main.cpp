@@ -9,6 +9,11 @@
 #include "entity.h"
 #include "entity_ik.h"
 #include "terrain.h"
+#include "asset_loader.h"
+#include "resources.h"
+#include "pose_cache.h"
+#include "anim_scheduler.h"
+#include "ik_scheduler.h"
 
 #include <vector>
 
@@ -42,6 +47,11 @@ TextureShader * texShader;
 
 
 TerrainGenerator * terrainGenerator;
+AssetLoader * assetLoader;
+ResourceRegistry * resources;
+PoseCache * poseCache;
+AnimScheduler * animScheduler;
+IKScheduler * ikScheduler;
 
 Eigen::Vector3f mouseDirection;
 Eigen::Vector3f camGoal;
@@ -132,6 +142,9 @@ static void key_callback(GLFWwindow* window, int key, int scancode, int action,
             break;
          case GLFW_KEY_G:
             break;
+         case GLFW_KEY_P:
+            resources->report(stdout);
+            break;
          default:
             keyToggles[key] = false;
             break;
@@ -221,56 +234,81 @@ static void initialize() {
    camera->setFOVY(fov);
    setupLights();
 
+   // Every file decodes in parallel on the loader's threads
+   assetLoader = new AssetLoader(0);
+
+   ModelAsset skyAsset  = {"assets/models/skybox.ciab",     NULL, NULL, NULL, 0, 0};
+   ModelAsset bookAsset = {"assets/models/book.ciab",       NULL, NULL, NULL, 4, 0.5f};
+   ModelAsset chebAsset = {"assets/cheb/cheb2.obj",
+                           "assets/cheb/cheb_attachment.txt",
+                           "assets/cheb/cheb_skel_walkAndSkip.txt", NULL, 4, 0.5f};
+   ModelAsset trexAsset = {"assets/models/trex.ciab",       NULL, NULL, NULL, 4, 0.5f};
+   ModelAsset jackAsset = {"assets/models/lumberJack.ciab", NULL, NULL, NULL, 4, 0.5f};
+   ModelAsset guyAsset  = {"assets/models/guy.ciab",        NULL, NULL, "assets/joints/guy.jnt", 0, 0};
+
+   // Entities sharing a file share its Model, and models sharing an image share its Texture
+   resources = new ResourceRegistry(assetLoader);
+   std::vector<AssetHandle> modelHandles = std::vector<AssetHandle>(6);
+
+   ModelHandle skyModel  = resources->model(skyAsset,  & modelHandles[0]);
+   ModelHandle bookModel = resources->model(bookAsset, & modelHandles[1]);
+   ModelHandle chebModel = resources->model(chebAsset, & modelHandles[2]);
+   ModelHandle trexModel = resources->model(trexAsset, & modelHandles[3]);
+   jackModel = resources->model(jackAsset, & modelHandles[4]).get();
+   guyModel  = resources->model(guyAsset,  & modelHandles[5]).get();
+   // The registry holds on to every model, so the entities can keep plain pointers
+
+   // Textures aren't waited for, they show up once update() has uploaded them
+   skyModel->texture    = resources->texture("assets/textures/night_DIFF.png", false);
+   bookModel->texture   = resources->texture("assets/textures/book_DIFF.png", false);
+   trexModel->texture   = resources->texture("assets/textures/masonry_DIFF.png", false);
+   trexModel->normalMap = resources->texture("assets/textures/masonry_NORM.png", false);
+   jackModel->texture   = resources->texture("assets/textures/lumberJack_DIFF.png", true);
+   jackModel->normalMap = resources->texture("assets/textures/lumberJack_NORM.png", true);
+   guyModel->texture    = resources->texture("assets/textures/guy_DIFF.bmp", false);
+
+   // Terrain Stuff, generated here while the files decode
+   terrainGenerator = new TerrainGenerator();
+   Model * terrainModel = terrainGenerator->GenerateModel();
+   terrainModel->texture     = resources->texture("assets/textures/rock_DIFF.png", true);
+   terrainModel->normalMap   = resources->texture("assets/textures/rock_NORM.png", true);
+   terrainModel->specularMap = resources->texture("assets/textures/rock_SPEC.png", true);
+   terrainEnt = new StaticEntity(Eigen::Vector3f(0, 0, 0), terrainModel);
+
+   // The entities need the models' bones and animations
+   for (int i = 0; i < modelHandles.size(); i++)
+      assetLoader->wait(modelHandles[i]);
+   resources->report(stdout);
+
    // Skybox
-   Model * skyModel = new Model();
-   skyModel->loadCIAB("assets/models/skybox.ciab");
-   skyModel->loadTexture("assets/textures/night_DIFF.png", false);
    skyEnt = new StaticEntity(Eigen::Vector3f(0,-250,0),
                             Eigen::Quaternionf(1,0,0,0),
                             Eigen::Vector3f(500,500,500),
-                            skyModel);
-
-   // Terrain Stuff
-   terrainGenerator = new TerrainGenerator();
-   Model * terrainModel = terrainGenerator->GenerateModel();
-   terrainModel->loadTexture("assets/textures/rock_DIFF.png", true);
-   terrainModel->loadNormalMap("assets/textures/rock_NORM.png", true);
-   terrainModel->loadSpecularMap("assets/textures/rock_SPEC.png", true);
-   terrainEnt = new StaticEntity(Eigen::Vector3f(0, 0, 0), terrainModel);
+                            skyModel.get());
 
    // Rigid Body
-   Model * bookModel = new Model();
-   bookModel->loadCIAB("assets/models/book.ciab");
-   bookModel->loadTexture("assets/textures/book_DIFF.png", false);
-   bookEnt = new StaticEntity(Eigen::Vector3f(0,50,0), bookModel);
-
-   // Animated Entities
-   Model * chebModel = new Model();
-   chebModel->loadOBJ("assets/cheb/cheb2.obj");
-   chebModel->loadSkinningPIN("assets/cheb/cheb_attachment.txt");
-   chebModel->loadAnimationPIN("assets/cheb/cheb_skel_walkAndSkip.txt");
-   chebEnt = new MocapEntity(Eigen::Vector3f(-10, 0, 20), chebModel);
+   bookEnt = new StaticEntity(Eigen::Vector3f(0,50,0), bookModel.get());
+
+   // Animated Entities, sharing poses with whoever plays the same clip in step
+   poseCache = new PoseCache();
+
+   chebEnt = new MocapEntity(Eigen::Vector3f(-10, 0, 20), chebModel.get());
+   chebEnt->poseCache = poseCache;
    chebEnt->playAnimation(0);
 
-   Model * trexModel = new Model();
-   trexModel->loadCIAB("assets/models/trex.ciab");
-   trexModel->loadTexture("assets/textures/masonry_DIFF.png", false);
-   trexModel->loadNormalMap("assets/textures/masonry_NORM.png", false);
-   trexEnt = new SkinnedEntity(Eigen::Vector3f(10, 0, 20), trexModel);
+   trexEnt = new SkinnedEntity(Eigen::Vector3f(10, 0, 20), trexModel.get());
+   trexEnt->poseCache = poseCache;
    trexEnt->playAnimation(0);
 
+   // Ticked at 30 a second whatever the display rate, less when far away
+   animScheduler = new AnimScheduler(30);
+   animScheduler->add(chebEnt);
+   animScheduler->add(trexEnt);
+
    // Lumberjack
-   jackModel = new Model();
-   jackModel->loadCIAB("assets/models/lumberJack.ciab");
-   jackModel->loadTexture("assets/textures/lumberJack_DIFF.png", true);
-   jackModel->loadNormalMap("assets/textures/lumberJack_NORM.png", true);
    jackEnt = new SkinnedEntity(Eigen::Vector3f(0, 0, 20), jackModel);
 
    // The main character
-   guyModel = new Model();
-   guyModel->loadCIAB("assets/models/guy.ciab");
-   guyModel->loadTexture("assets/textures/guy_DIFF.bmp", false);
-   guyModel->loadConstraints("assets/joints/guy.jnt");
    climberEnt = new IKEntity(Eigen::Vector3f(0, 0, 5), guyModel);
    climberEnt->playAnimation(0);
 
@@ -317,6 +355,12 @@ static void initialize() {
    boneIndices.push_back(30);
    climberEnt->addLimb(boneIndices, Eigen::Vector3f(0, 0, 0), true);
    boneIndices.clear();
+
+   // Climbers' IK is solved together at the start of each update. Base limbs
+   // put a climber's limbs in one job, so with a single climber there is
+   // nothing to hand to a pool yet.
+   ikScheduler = new IKScheduler(NULL);
+   ikScheduler->add(climberEnt);
 }
 
 // ======================================================================== //
@@ -372,11 +416,12 @@ static void updateEntities(GLFWwindow * window, double timePassed) {
       Eigen::Vector2f ndc = calculateNDC(window);
       Geom::Rayf mouseRay(camera->position, camera->rayFromNDCToWorld(ndc(0), -ndc(1)));
 
-      for (int i = 0; i < terrainGenerator->model->faces.size(); i++) {
-         Face * f = terrainGenerator->model->faces[i];
-         Eigen::Vector3f pnt = f->intersectRay(mouseRay);
+      Mesh * terrainMesh = & terrainGenerator->model->mesh;
+      for (int i = 0; i < terrainMesh->faceCount(); i++) {
+         MeshFace f = terrainMesh->face(i);
+         Eigen::Vector3f pnt = f.intersectRay(mouseRay);
 
-         if (f->pointCheckInside(pnt)) {
+         if (f.pointCheckInside(pnt)) {
             climberEnt->setLimbGoal(goalIndex, pnt);
             camGoal = pnt;
             break;
@@ -405,8 +450,9 @@ static void updateEntities(GLFWwindow * window, double timePassed) {
    bookEnt->physicsStep(timePassed);
    trexEnt->physicsStep(timePassed);
 
-   chebEnt->update(timePassed);
-   trexEnt->update(timePassed);
+   poseCache->beginFrame();
+   ikScheduler->solve();
+   animScheduler->update(camera, timePassed);
    climberEnt->update(timePassed);
 
    // chebEnt->position += Eigen::Vector3f(0.01, 0, 0);
@@ -434,6 +480,7 @@ static void draw(double deltaTime) {
 }
 
 static void updateLoop(GLFWwindow * window, double deltaTime) {
+   assetLoader->update(UPLOAD_FRAME_BUDGET);
    updateCamera(window, deltaTime);
    updateEntities(window, deltaTime);
    draw(deltaTime);
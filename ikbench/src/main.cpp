@@ -0,0 +1,157 @@
+// Times the climber's IK with each solver backend, for one climber and for a
+// crowd solved on one thread and on a pool. The guy model's four limbs follow
+// goals wandering around where they start, as a climber reaching from hold to
+// hold would, and the frame time and distance left to each goal are printed.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+
+#include "safe_gl.h"
+#include "model.h"
+#include "entity_ik.h"
+#include "ik_scheduler.h"
+#include "thread_pool.h"
+
+#include <vector>
+
+#define BENCH_FRAMES 600
+#define BENCH_CROWD 24         // climbers solved together by an IKScheduler
+#define BENCH_TIME_STEP (1.0f / 60)
+#define BENCH_DRIFT 0.01f      // how far a goal moves in a frame, as a fraction of its limb's reach
+#define BENCH_WANDER 0.3f      // how far a goal gets from where its limb started, as a fraction of its reach
+
+static float randomFloat() {
+   return 2.0f * rand() / RAND_MAX - 1;
+}
+
+static void addLimb(IKEntity * entity, const int * bones, int boneCount) {
+   entity->addLimb(std::vector<int>(bones, bones + boneCount), Eigen::Vector3f(0, 0, 0), true);
+}
+
+// The same limbs the game gives the climber
+static void addClimberLimbs(IKEntity * entity) {
+   const int rightArm[] = {0, 1, 2, 3, 9, 10, 11, 12, 13};
+   const int leftArm[] = {0, 1, 2, 3, 15, 16, 17, 18, 19};
+   const int rightLeg[] = {0, 21, 22, 23, 24, 25};
+   const int leftLeg[] = {0, 26, 27, 28, 29, 30};
+
+   addLimb(entity, rightArm, 9);
+   addLimb(entity, leftArm, 9);
+   addLimb(entity, rightLeg, 6);
+   addLimb(entity, leftLeg, 6);
+}
+
+// Length of the limb stretched out straight
+static float limbReach(Model * model, IKLimb * limb) {
+   float reach = 0;
+   for (int i = 1; i < limb->boneIndices.size(); i++)
+      reach += model->bones[limb->boneIndices[i]].parentOffset.block<3,1>(0,3).norm();
+   return reach;
+}
+
+static void benchmark(const char * name, Model * model, IKMethod method, int climberCount, ThreadPool * pool) {
+   srand(7);
+
+   std::vector<IKEntity *> climbers;
+   std::vector<Eigen::Vector3f> starts, goals;
+   std::vector<float> reaches;
+   IKScheduler scheduler(pool);
+
+   for (int c = 0; c < climberCount; c++) {
+      IKEntity * climber = new IKEntity(Eigen::Vector3f(2.0f * c, 0, 5), model);
+      addClimberLimbs(climber);
+      for (int i = 0; i < climber->ikLimbs.size(); i++)
+         climber->setLimbMethod(i, method);
+
+      // Goals start where the limbs end in the rest pose
+      climber->animateWithKeyframes();
+      climber->update(0);
+      for (int i = 0; i < climber->ikLimbs.size(); i++) {
+         starts.push_back(climber->limbEnd(i));
+         goals.push_back(starts.back());
+         reaches.push_back(limbReach(model, climber->ikLimbs[i]));
+      }
+      climber->animateWithIK();
+
+      climbers.push_back(climber);
+      scheduler.add(climber);
+   }
+
+   double seconds = 0, worstFrame = 0, errorSum = 0, worstError = 0;
+   for (int frame = 0; frame < BENCH_FRAMES; frame++) {
+      for (int g = 0, c = 0; c < climberCount; c++) {
+         for (int i = 0; i < climbers[c]->ikLimbs.size(); i++, g++) {
+            Eigen::Vector3f step = Eigen::Vector3f(randomFloat(), randomFloat(), randomFloat());
+            goals[g] += BENCH_DRIFT * reaches[g] * step;
+
+            Eigen::Vector3f away = goals[g] - starts[g];
+            if (away.norm() > BENCH_WANDER * reaches[g])
+               goals[g] = starts[g] + BENCH_WANDER * reaches[g] * away.normalized();
+            climbers[c]->setLimbGoal(i, goals[g]);
+         }
+      }
+
+      std::chrono::high_resolution_clock::time_point begin = std::chrono::high_resolution_clock::now();
+      scheduler.solve();
+      for (int c = 0; c < climberCount; c++)
+         climbers[c]->update(BENCH_TIME_STEP);
+      std::chrono::duration<double> taken = std::chrono::high_resolution_clock::now() - begin;
+      seconds += taken.count();
+      worstFrame = fmax(worstFrame, taken.count());
+
+      for (int g = 0, c = 0; c < climberCount; c++) {
+         for (int i = 0; i < climbers[c]->ikLimbs.size(); i++, g++) {
+            double error = (climbers[c]->limbEnd(i) - goals[g]).norm() / reaches[g];
+            errorSum += error;
+            worstError = fmax(worstError, error);
+         }
+      }
+   }
+
+   printf("%-32s %8.3f ms/frame (worst %7.3f)   error %6.2f%% of reach (worst %6.2f%%)\n", name,
+          1000 * seconds / BENCH_FRAMES, 1000 * worstFrame,
+          100 * errorSum / (BENCH_FRAMES * goals.size()), 100 * worstError);
+
+   for (int c = 0; c < climberCount; c++)
+      delete climbers[c];
+}
+
+int main(int argc, char ** argv) {
+   // Models own GL buffers, so there has to be a context even though nothing is drawn
+   if (!glfwInit())
+      exit(EXIT_FAILURE);
+
+   glfwWindowHint(GLFW_VISIBLE, GL_FALSE);
+   glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 2);
+   glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 0);
+
+   GLFWwindow * window = glfwCreateWindow(64, 64, "IK Benchmark", NULL, NULL);
+   if (!window) {
+      glfwTerminate();
+      exit(EXIT_FAILURE);
+   }
+   glfwMakeContextCurrent(window);
+
+   Model * guyModel = new Model();
+   guyModel->loadCIAB("assets/models/guy.ciab");
+   guyModel->loadConstraints("assets/joints/guy.jnt");
+
+   printf("%d frames, 4 limbs on guy.jnt\n", BENCH_FRAMES);
+   benchmark("ceres", guyModel, IK_CERES, 1, NULL);
+   benchmark("damped least squares", guyModel, IK_DAMPED_LEAST_SQUARES, 1, NULL);
+
+   // A wall of climbers, on this thread and then spread over a pool
+   ThreadPool pool(0);
+   printf("\n%d climbers, %d threads\n", BENCH_CROWD, pool.threadCount() + 1);
+   benchmark("ceres", guyModel, IK_CERES, BENCH_CROWD, NULL);
+   benchmark("ceres, pooled", guyModel, IK_CERES, BENCH_CROWD, & pool);
+   benchmark("damped least squares", guyModel, IK_DAMPED_LEAST_SQUARES, BENCH_CROWD, NULL);
+   benchmark("damped least squares, pooled", guyModel, IK_DAMPED_LEAST_SQUARES, BENCH_CROWD, & pool);
+
+   delete guyModel;
+   glfwDestroyWindow(window);
+   glfwTerminate();
+   exit(EXIT_SUCCESS);
+}
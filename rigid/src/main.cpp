@@ -42,12 +42,6 @@ static void key_callback(GLFWwindow* window, int key, int scancode, int action,
          case GLFW_KEY_ESCAPE:
             glfwSetWindowShouldClose(window, GL_TRUE);
             break;
-         case GLFW_KEY_ENTER:
-            cubeEnt->bodies[0].torque = camera->getForward();
-            break;
-         case GLFW_KEY_RIGHT_SHIFT:
-            cubeEnt->bodies[0].force = camera->getForward();
-            break;
          case GLFW_KEY_T:
          case GLFW_KEY_L:
          case GLFW_KEY_C:
@@ -60,12 +54,6 @@ static void key_callback(GLFWwindow* window, int key, int scancode, int action,
       }
    } else if (action == GLFW_RELEASE) {
       switch (key) {
-         case GLFW_KEY_ENTER:
-            cubeEnt->bodies[0].torque = Eigen::Vector3f(0,0,0);
-            break;
-         case GLFW_KEY_RIGHT_SHIFT:
-            cubeEnt->bodies[0].force = Eigen::Vector3f(0,0,0);
-            break;
          case GLFW_KEY_T:
             keyToggles[key] = !keyToggles[key];
             keyToggles[key] ?
@@ -208,6 +196,11 @@ static void updateCamera(GLFWwindow * window, double timePassed) {
 }
 
 static void updateEntities(GLFWwindow * window, double deltaTime) {
+   // Held down, enter twists the root bone and right shift pushes it away from the camera
+   if (keyToggles[GLFW_KEY_ENTER])
+      cubeEnt->applyTorque(cubeModel->boneRoot, camera->getForward());
+   if (keyToggles[GLFW_KEY_RIGHT_SHIFT])
+      cubeEnt->applyForce(cubeModel->boneRoot, camera->getForward());
    cubeEnt->update(deltaTime);
 }
 
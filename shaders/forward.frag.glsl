@@ -39,7 +39,14 @@ void main(void) {
       viewDirection = normalize(vWorldPosition - uCameraPosition);
 
       mat3 TBN = mat3(normalize(vWorldTangent), normalize(vWorldBitangent), normalize(vWorldNormal));
-      normal = uHasNormalMap ? TBN * normalize(texture2D(uNormalMap, vUV).rgb * 2.0 - 1.0) : normalize(vWorldNormal);
+      // Only x and y are read, so baked two channel (BC5) normal maps work too
+      if (uHasNormalMap) {
+         vec2 tangentXY = texture2D(uNormalMap, vUV).rg * 2.0 - 1.0;
+         vec3 tangentNormal = vec3(tangentXY, sqrt(max(0.0, 1.0 - dot(tangentXY, tangentXY))));
+         normal = normalize(TBN * tangentNormal);
+      } else {
+         normal = normalize(vWorldNormal);
+      }
       shine = uHasSpecularMap ? texture2D(uSpecularMap, vUV).r * 255.0 + 1.0: 1.0;
 
       ambient = skinColor * 0.25;
@@ -1,7 +1,7 @@
 
 uniform mat4 uModelM;
 uniform mat4 uProjViewM;
-uniform mat4 uAnimMs[100];
+uniform vec4 uBoneMs[3 * BONE_CAPACITY];   // 3x4 column major matrices, 3 vec4s a bone
 
 attribute vec3 aPosition;
 attribute vec3 aTangent;
@@ -31,7 +31,9 @@ void main(void) {
    int index;
    float weight;
 
-   mat4 animMatrix = mat4(0.0);
+   vec4 bone0 = vec4(0.0);
+   vec4 bone1 = vec4(0.0);
+   vec4 bone2 = vec4(0.0);
    int numInfluences = int(aNumInfluences);
 
    for (int i = 0; i < numInfluences; i++) {
@@ -49,9 +51,16 @@ void main(void) {
          weight = aBoneWeights3[i-12];
       }
 
-      animMatrix += weight * uAnimMs[index];
+      bone0 += weight * uBoneMs[3 * index];
+      bone1 += weight * uBoneMs[3 * index + 1];
+      bone2 += weight * uBoneMs[3 * index + 2];
    }
 
+   mat4 animMatrix = mat4(bone0.xyz, 0.0,
+                          bone0.w, bone1.xy, 0.0,
+                          bone1.zw, bone2.x, 0.0,
+                          bone2.yzw, 1.0);
+
    mat4 modelM = uModelM * animMatrix;
 
    vWorldPosition = vec3(modelM * vec4(aPosition, 1.0));
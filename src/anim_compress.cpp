@@ -0,0 +1,480 @@
+#include "anim_compress.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <utility>
+
+// Order of a bone's tracks in the track table
+typedef enum {
+   TRACK_POSITION = 0,
+   TRACK_ROTATION = 1,
+   TRACK_SCALE = 2,
+   TRACKS_PER_BONE = 3
+} TrackKind;
+
+typedef struct TrackEntry {
+   unsigned int keyCount;     // 0 for the identity value, 1 for a constant
+   unsigned int offset;       // bytes from the start of the clip
+} TrackEntry;
+
+static_assert(sizeof(AC::ClipHeader) == AC_HEADER_SIZE, "ClipHeader must match the clip layout");
+static_assert(sizeof(TrackEntry) == AC_TRACK_ENTRY_SIZE, "TrackEntry must match the clip layout");
+
+#define VALUE_MAX 65535            // 16 bit position and scale values
+#define COMPONENT_MAX 32767        // 15 bit rotation components
+#define COMPONENT_RANGE 0.70710678f // only the largest component can be over 1/sqrt(2)
+
+// ========================================================== //
+// ==================== STATIC FUNCTIONS ==================== //
+// ========================================================== //
+
+template <typename T>
+static void append(std::vector<unsigned char>& out, const T * values, size_t count) {
+   const unsigned char * bytes = (const unsigned char *)values;
+   out.insert(out.end(), bytes, bytes + count * sizeof(T));
+}
+
+static size_t trackSize(int kind, unsigned int keyCount) {
+   if (keyCount == 0)
+      return 0;
+   if (kind == TRACK_ROTATION)
+      return keyCount == 1 ? 4 * sizeof(unsigned short) : keyCount * 4 * sizeof(unsigned short);
+   return keyCount == 1 ? 3 * sizeof(float) : 6 * sizeof(float) + keyCount * 4 * sizeof(unsigned short);
+}
+
+// Drops the largest component, which is made positive and rebuilt from the
+// other three. 2 bits say which was dropped, then 15 bits for each of the rest.
+static void encodeRotation(const Eigen::Quaternionf& q, unsigned short out[3]) {
+   Eigen::Vector4f c = q.coeffs().normalized();
+   int largest = 0;
+   for (int i = 1; i < 4; i++)
+      if (fabs(c(i)) > fabs(c(largest)))
+         largest = i;
+   if (c(largest) < 0)
+      c = -c;
+
+   unsigned long long bits = largest;
+   for (int i = 0; i < 4; i++) {
+      if (i == largest)
+         continue;
+      float unit = Mmath::clamp(0.0f, 1.0f, (c(i) / COMPONENT_RANGE + 1) * 0.5f);
+      bits = (bits << 15) | (unsigned long long)lroundf(unit * COMPONENT_MAX);
+   }
+
+   out[0] = bits & 0xffff;
+   out[1] = (bits >> 16) & 0xffff;
+   out[2] = (bits >> 32) & 0xffff;
+}
+
+static Eigen::Quaternionf decodeRotation(const unsigned short in[3]) {
+   unsigned long long bits = in[0] | ((unsigned long long)in[1] << 16) | ((unsigned long long)in[2] << 32);
+   int largest = (bits >> 45) & 3;
+   float c[4], sum = 0;
+
+   for (int i = 3; i >= 0; i--) {
+      if (i == largest)
+         continue;
+      c[i] = ((bits & 0x7fff) * (2.0f / COMPONENT_MAX) - 1) * COMPONENT_RANGE;
+      sum += c[i] * c[i];
+      bits >>= 15;
+   }
+   c[largest] = sqrtf(fmax(0, 1 - sum));
+
+   return Eigen::Quaternionf(c[3], c[0], c[1], c[2]);
+}
+
+// The same approximated slerp as the SIMD sampler in animation.cpp, so
+// compressed and plain clips move alike between keys
+static Eigen::Quaternionf interpolateRotation(const Eigen::Quaternionf& q0, const Eigen::Quaternionf& q1,
+                                              float ratio) {
+   Eigen::Vector4f c0 = q0.coeffs(), c1 = q1.coeffs();
+   float d = c0.dot(c1);
+   if (d < 0) {
+      c1 = -c1;
+      d = -d;
+   }
+
+   float a = 1.0904f + d * (-3.2452f + d * (3.55645f - d * 1.43519f));
+   float b = 0.848013f + d * (-1.06021f + d * 0.215638f);
+   float centered = ratio - 0.5f;
+   float bent = ratio + ratio * centered * (ratio - 1) * (a * centered * centered + b);
+
+   Eigen::Vector4f c = c0 + bent * (c1 - c0);
+   return Eigen::Quaternionf(c.normalized());
+}
+
+// Angle of the rotation from a to b, for unit quaternions. Done through the
+// chord rather than acos of the dot product, which is too coarse near 0.
+static float angleBetween(const Eigen::Quaternionf& a, const Eigen::Quaternionf& b) {
+   float chord = fmin((a.coeffs() - b.coeffs()).norm(), (a.coeffs() + b.coeffs()).norm());
+   return 4 * asinf(fmin(1.0f, chord * 0.5f));
+}
+
+typedef struct VectorSpans {
+   const std::vector<Eigen::Vector3f> * source;
+   const std::vector<Eigen::Vector3f> * decoded;
+
+   float error(unsigned int first, unsigned int last, unsigned int frame) const {
+      float ratio = float(frame - first) / (last - first);
+      Eigen::Vector3f v = (*decoded)[first] + ratio * ((*decoded)[last] - (*decoded)[first]);
+      return (v - (*source)[frame]).norm();
+   }
+} VectorSpans;
+
+typedef struct RotationSpans {
+   const std::vector<Eigen::Quaternionf> * source;
+   const std::vector<Eigen::Quaternionf> * decoded;
+
+   float error(unsigned int first, unsigned int last, unsigned int frame) const {
+      float ratio = float(frame - first) / (last - first);
+      Eigen::Quaternionf q = interpolateRotation((*decoded)[first], (*decoded)[last], ratio);
+      return angleBetween(q, (*source)[frame]);
+   }
+} RotationSpans;
+
+// Picks the frames to keep so interpolating between them stays within
+// tolerance of every source frame, splitting each span at its worst frame
+// until none is off by more. The ends are always kept.
+template <typename Spans>
+static std::vector<unsigned int> reduceKeys(const Spans& spans, unsigned int frameCount, float tolerance) {
+   std::vector<unsigned int> keys;
+   std::vector<std::pair<unsigned int, unsigned int> > open;
+
+   keys.push_back(0);
+   keys.push_back(frameCount - 1);
+   open.push_back(std::make_pair(0u, frameCount - 1));
+
+   while (!open.empty()) {
+      unsigned int first = open.back().first, last = open.back().second;
+      unsigned int worstFrame = 0;
+      float worst = 0;
+      open.pop_back();
+
+      for (unsigned int f = first + 1; f < last; f++) {
+         float error = spans.error(first, last, f);
+         if (error > worst) {
+            worst = error;
+            worstFrame = f;
+         }
+      }
+
+      if (worst > tolerance) {
+         keys.push_back(worstFrame);
+         open.push_back(std::make_pair(first, worstFrame));
+         open.push_back(std::make_pair(worstFrame, last));
+      }
+   }
+
+   std::sort(keys.begin(), keys.end());
+   return keys;
+}
+
+static void appendFrames(std::vector<unsigned char>& data, const std::vector<unsigned int>& keys) {
+   for (unsigned int i = 0; i < keys.size(); i++) {
+      unsigned short frame = keys[i];
+      append(data, & frame, 1);
+   }
+}
+
+static TrackEntry writeVectorTrack(const std::vector<Eigen::Vector3f>& source, const Eigen::Vector3f& identity,
+                                   float tolerance, size_t base, std::vector<unsigned char>& data) {
+   TrackEntry entry = {0, 0};
+   unsigned int frameCount = source.size();
+   Eigen::Vector3f low = source[0], high = source[0];
+   float fromIdentity = 0;
+
+   for (unsigned int f = 0; f < frameCount; f++) {
+      low = low.cwiseMin(source[f]);
+      high = high.cwiseMax(source[f]);
+      fromIdentity = fmax(fromIdentity, (source[f] - identity).norm());
+   }
+   if (fromIdentity <= tolerance)
+      return entry;
+
+   entry.offset = base + data.size();
+   if ((high - low).norm() * 0.5f <= tolerance) {
+      Eigen::Vector3f middle = (low + high) * 0.5f;
+      entry.keyCount = 1;
+      append(data, middle.data(), 3);
+      return entry;
+   }
+
+   Eigen::Vector3f step = (high - low) / VALUE_MAX;
+   std::vector<unsigned short> quantized = std::vector<unsigned short>(3 * frameCount);
+   std::vector<Eigen::Vector3f> decoded = std::vector<Eigen::Vector3f>(frameCount);
+   for (unsigned int f = 0; f < frameCount; f++)
+      for (int i = 0; i < 3; i++) {
+         long q = step(i) > 0 ? lroundf((source[f](i) - low(i)) / step(i)) : 0;
+         quantized[3*f+i] = Mmath::clamp(0L, (long)VALUE_MAX, q);
+         decoded[f](i) = low(i) + step(i) * quantized[3*f+i];
+      }
+
+   VectorSpans spans = {& source, & decoded};
+   std::vector<unsigned int> keys = reduceKeys(spans, frameCount, tolerance);
+   entry.keyCount = keys.size();
+
+   append(data, low.data(), 3);
+   append(data, step.data(), 3);
+   appendFrames(data, keys);
+   for (unsigned int i = 0; i < keys.size(); i++)
+      append(data, & quantized[3 * keys[i]], 3);
+   return entry;
+}
+
+static TrackEntry writeRotationTrack(const std::vector<Eigen::Quaternionf>& source, float tolerance,
+                                     size_t base, std::vector<unsigned char>& data) {
+   TrackEntry entry = {0, 0};
+   unsigned int frameCount = source.size();
+   float fromIdentity = 0;
+
+   for (unsigned int f = 0; f < frameCount; f++)
+      fromIdentity = fmax(fromIdentity, angleBetween(source[f], Eigen::Quaternionf::Identity()));
+   if (fromIdentity <= tolerance)
+      return entry;
+
+   std::vector<unsigned short> encoded = std::vector<unsigned short>(3 * frameCount);
+   std::vector<Eigen::Quaternionf> decoded = std::vector<Eigen::Quaternionf>(frameCount);
+   for (unsigned int f = 0; f < frameCount; f++) {
+      encodeRotation(source[f], & encoded[3*f]);
+      decoded[f] = decodeRotation(& encoded[3*f]);
+   }
+
+   float fromFirst = 0;
+   for (unsigned int f = 0; f < frameCount; f++)
+      fromFirst = fmax(fromFirst, angleBetween(decoded[0], source[f]));
+
+   entry.offset = base + data.size();
+   if (fromFirst <= tolerance || frameCount == 1) {
+      unsigned short padding = 0;
+      entry.keyCount = 1;
+      append(data, & encoded[0], 3);
+      append(data, & padding, 1);
+      return entry;
+   }
+
+   RotationSpans spans = {& source, & decoded};
+   std::vector<unsigned int> keys = reduceKeys(spans, frameCount, tolerance);
+   entry.keyCount = keys.size();
+
+   appendFrames(data, keys);
+   for (unsigned int i = 0; i < keys.size(); i++)
+      append(data, & encoded[3 * keys[i]], 3);
+   return entry;
+}
+
+static const TrackEntry * trackTable(const unsigned char * clip) {
+   return (const TrackEntry *)(clip + AC_HEADER_SIZE);
+}
+
+// Index of the key at or before frame, always one before the last key, and
+// how far frame is from it toward the next key. cursor is the track's entry of
+// a KeyCursor, or NULL.
+static unsigned int findSpan(const unsigned short * frames, unsigned int keyCount, float frame,
+                             unsigned int * cursor, float& ratio) {
+   unsigned int k = AC::FindKey(frames, keyCount, frame, cursor ? *cursor : 0);
+   if (cursor)
+      *cursor = k;
+
+   ratio = Mmath::clamp(0.0f, 1.0f, (frame - frames[k]) / (frames[k+1] - frames[k]));
+   return k;
+}
+
+static Eigen::Vector3f sampleVector(const unsigned char * clip, const TrackEntry& entry, float frame,
+                                    unsigned int * cursor, const Eigen::Vector3f& identity) {
+   if (entry.keyCount == 0)
+      return identity;
+
+   const float * range = (const float *)(clip + entry.offset);   // low xyz, step xyz
+   if (entry.keyCount == 1)
+      return Eigen::Vector3f(range[0], range[1], range[2]);
+
+   const unsigned short * frames = (const unsigned short *)(range + 6);
+   const unsigned short * values = frames + entry.keyCount;
+   float ratio;
+   unsigned int k = findSpan(frames, entry.keyCount, frame, cursor, ratio);
+
+   Eigen::Vector3f v;
+   for (int i = 0; i < 3; i++) {
+      float a = values[3*k+i], b = values[3*k+3+i];
+      v(i) = range[i] + range[3+i] * (a + ratio * (b - a));
+   }
+   return v;
+}
+
+static Eigen::Quaternionf sampleRotation(const unsigned char * clip, const TrackEntry& entry, float frame,
+                                         unsigned int * cursor) {
+   if (entry.keyCount == 0)
+      return Eigen::Quaternionf::Identity();
+
+   const unsigned short * frames = (const unsigned short *)(clip + entry.offset);
+   if (entry.keyCount == 1)
+      return decodeRotation(frames);
+
+   const unsigned short * values = frames + entry.keyCount;
+   float ratio;
+   unsigned int k = findSpan(frames, entry.keyCount, frame, cursor, ratio);
+   return interpolateRotation(decodeRotation(& values[3*k]), decodeRotation(& values[3*k+3]), ratio);
+}
+
+static float clipFrame(const AC::ClipHeader& header, float time) {
+   return Mmath::clamp(0.0f, float(header.frameCount - 1), time * header.fps);
+}
+
+// Cursor entries of a bone's tracks, sized for the clip, or NULL without a cursor
+static unsigned int * boneCursor(KeyCursor * cursor, const AC::ClipHeader& header, unsigned int bone) {
+   if (!cursor)
+      return NULL;
+   if (cursor->keys.size() != TRACKS_PER_BONE * header.boneCount)
+      cursor->keys = std::vector<unsigned int>(TRACKS_PER_BONE * header.boneCount, 0);
+   return & cursor->keys[TRACKS_PER_BONE * bone];
+}
+
+static LocalTransform sampleTransform(const unsigned char * clip, unsigned int bone, float frame,
+                                      unsigned int * cursor) {
+   const TrackEntry * entries = trackTable(clip) + TRACKS_PER_BONE * bone;
+   LocalTransform t;
+   t.position = sampleVector(clip, entries[TRACK_POSITION], frame, cursor ? & cursor[TRACK_POSITION] : NULL,
+                             Eigen::Vector3f(0, 0, 0));
+   t.rotation = sampleRotation(clip, entries[TRACK_ROTATION], frame, cursor ? & cursor[TRACK_ROTATION] : NULL);
+   t.scale = sampleVector(clip, entries[TRACK_SCALE], frame, cursor ? & cursor[TRACK_SCALE] : NULL,
+                          Eigen::Vector3f(1, 1, 1));
+   return t;
+}
+
+// ========================================================== //
+// ==================== PUBLIC FUNCTIONS ==================== //
+// ========================================================== //
+
+namespace AC {
+
+   Tolerance DefaultTolerance() {
+      Tolerance tolerance;
+      tolerance.position = 1e-3f;
+      tolerance.rotation = 1e-3f;
+      tolerance.scale = 1e-3f;
+      return tolerance;
+   }
+
+   void Compress(const LocalTransform * frames, unsigned int boneCount, unsigned int frameCount,
+                 unsigned int fps, const Tolerance& tolerance, std::vector<unsigned char>& out) {
+      if (frameCount == 0 || frameCount > AC_MAX_FRAMES || fps == 0) {
+         fprintf(stderr, "Can't compress an animation of %u frames at %u fps\n", frameCount, fps);
+         exit(1);
+      }
+
+      std::vector<TrackEntry> table = std::vector<TrackEntry>(TRACKS_PER_BONE * boneCount);
+      std::vector<unsigned char> data;
+      size_t base = AC_HEADER_SIZE + table.size() * AC_TRACK_ENTRY_SIZE;
+
+      std::vector<Eigen::Vector3f> positions = std::vector<Eigen::Vector3f>(frameCount);
+      std::vector<Eigen::Vector3f> scales = std::vector<Eigen::Vector3f>(frameCount);
+      std::vector<Eigen::Quaternionf> rotations = std::vector<Eigen::Quaternionf>(frameCount);
+
+      for (unsigned int j = 0; j < boneCount; j++) {
+         const LocalTransform * boneFrames = & frames[(size_t)j * frameCount];
+         for (unsigned int f = 0; f < frameCount; f++) {
+            positions[f] = boneFrames[f].position;
+            rotations[f] = Eigen::Quaternionf(boneFrames[f].rotation).normalized();
+            scales[f] = boneFrames[f].scale;
+         }
+
+         TrackEntry * entries = & table[TRACKS_PER_BONE * j];
+         entries[TRACK_POSITION] = writeVectorTrack(positions, Eigen::Vector3f(0, 0, 0), tolerance.position,
+                                                    base, data);
+         entries[TRACK_ROTATION] = writeRotationTrack(rotations, tolerance.rotation, base, data);
+         entries[TRACK_SCALE] = writeVectorTrack(scales, Eigen::Vector3f(1, 1, 1), tolerance.scale,
+                                                 base, data);
+      }
+
+      ClipHeader header;
+      header.fps = fps;
+      header.frameCount = frameCount;
+      header.boneCount = boneCount;
+      header.size = base + data.size();
+
+      out.reserve(out.size() + header.size);
+      append(out, & header, 1);
+      append(out, table.data(), table.size());
+      append(out, data.data(), data.size());
+   }
+
+   ClipHeader ReadHeader(const unsigned char * clip) {
+      ClipHeader header;
+      memcpy(& header, clip, sizeof(ClipHeader));
+      return header;
+   }
+
+   bool Parse(const unsigned char * clip, size_t size, const char *& error) {
+      if (size < AC_HEADER_SIZE) {
+         error = "clip is too short for its header";
+         return false;
+      }
+      if ((size_t)clip % sizeof(float)) {
+         error = "clip is misaligned";
+         return false;
+      }
+
+      ClipHeader header = ReadHeader(clip);
+      size_t tableEnd = AC_HEADER_SIZE + size_t(header.boneCount) * TRACKS_PER_BONE * AC_TRACK_ENTRY_SIZE;
+      if (header.size < AC_HEADER_SIZE || header.size > size || tableEnd > header.size) {
+         error = "clip or its track table runs past the end of the buffer";
+         return false;
+      }
+      if (header.fps == 0 || header.frameCount == 0 || header.frameCount > AC_MAX_FRAMES) {
+         error = "clip has no frames or too many";
+         return false;
+      }
+
+      const TrackEntry * table = trackTable(clip);
+      for (unsigned int i = 0; i < TRACKS_PER_BONE * header.boneCount; i++) {
+         TrackEntry entry = table[i];
+         int kind = i % TRACKS_PER_BONE;
+         size_t bytes = trackSize(kind, entry.keyCount);
+
+         if (entry.keyCount == 0)
+            continue;
+         if (entry.keyCount > header.frameCount || entry.offset % sizeof(float) || entry.offset < tableEnd ||
+             entry.offset > header.size || bytes > header.size - entry.offset) {
+            error = "track is misaligned or runs past the end of the clip";
+            return false;
+         }
+         if (entry.keyCount == 1)
+            continue;
+
+         // Sampling counts on frames going up, or a span could be empty
+         const unsigned char * start = clip + entry.offset + (kind == TRACK_ROTATION ? 0 : 6 * sizeof(float));
+         const unsigned short * frames = (const unsigned short *)start;
+         for (unsigned int k = 0; k < entry.keyCount; k++)
+            if (frames[k] >= header.frameCount || (k > 0 && frames[k] <= frames[k-1])) {
+               error = "track frames are out of order or past the last frame";
+               return false;
+            }
+      }
+
+      return true;
+   }
+
+   void SamplePose(const unsigned char * clip, float time, LocalTransform * out, KeyCursor * cursor) {
+      ClipHeader header = ReadHeader(clip);
+      float frame = clipFrame(header, time);
+
+      for (unsigned int j = 0; j < header.boneCount; j++)
+         out[j] = sampleTransform(clip, j, frame, boneCursor(cursor, header, j));
+   }
+
+   LocalTransform SampleBone(const unsigned char * clip, unsigned int bone, float time, KeyCursor * cursor) {
+      ClipHeader header = ReadHeader(clip);
+      if (bone >= header.boneCount) {
+         LocalTransform t;
+         t.position = Eigen::Vector3f(0, 0, 0);
+         t.rotation = Eigen::Quaternionf::Identity();
+         t.scale = Eigen::Vector3f(1, 1, 1);
+         return t;
+      }
+      return sampleTransform(clip, bone, clipFrame(header, time), boneCursor(cursor, header, bone));
+   }
+}
@@ -0,0 +1,71 @@
+#include "anim_scheduler.h"
+
+#include <math.h>
+
+// ========================================================== //
+// =================== ANIM SCHEDULER METHODS =============== //
+// ========================================================== //
+
+AnimScheduler::AnimScheduler(float tickRate)
+: tickRate(tickRate), fullRateSize(0.25f), maxSlowdown(8), hiddenRate(2) {}
+
+AnimScheduler::~AnimScheduler() {}
+
+void AnimScheduler::add(AnimatedEntity * entity) {
+   Scheduled scheduled = {entity, 0};
+   _entities.push_back(scheduled);
+
+   // Ticked once so there is a pose to draw before its first tick is due
+   entity->update(0);
+   entity->endTick();
+}
+
+void AnimScheduler::remove(AnimatedEntity * entity) {
+   for (unsigned int i = 0; i < _entities.size(); i++) {
+      if (_entities[i].entity == entity) {
+         _entities.erase(_entities.begin() + i);
+         return;
+      }
+   }
+}
+
+void AnimScheduler::update(Camera * camera, float timeDelta) {
+   for (unsigned int i = 0; i < _entities.size(); i++) {
+      Scheduled * scheduled = & _entities[i];
+      AnimatedEntity * entity = scheduled->entity;
+      float rate = rateFor(entity, camera);
+
+      scheduled->elapsed += timeDelta;
+      if (rate <= 0)
+         continue;
+
+      float step = 1 / rate;
+      for (unsigned int ticks = 0; scheduled->elapsed >= step && ticks < ANIM_MAX_CATCH_UP; ticks++) {
+         entity->update(step);
+         entity->endTick();
+         scheduled->elapsed -= step;
+      }
+
+      // After a stall (or a long time out of view) the rest goes in one tick,
+      // the clip times wrap however far they are moved
+      if (scheduled->elapsed >= step) {
+         float behind = scheduled->elapsed - fmod(scheduled->elapsed, step);
+         entity->update(behind);
+         entity->endTick();
+         scheduled->elapsed -= behind;
+      }
+
+      entity->interpolatePose(scheduled->elapsed / step);
+   }
+}
+
+float AnimScheduler::rateFor(AnimatedEntity * entity, Camera * camera) {
+   if (!entity->inView(camera))
+      return hiddenRate;
+
+   float size = entity->screenSize(camera);
+   unsigned int slowdown = 1;
+   while (slowdown < maxSlowdown && size < fullRateSize / slowdown)
+      slowdown *= 2;
+   return tickRate / slowdown;
+}
@@ -1,40 +1,522 @@
-
 #include "animation.h"
 
 #include "matrix_math.h"
+#include "lanes.h"
+
+#include <math.h>
+
+// Channels of one key in the tracks, see AnimTracks
+typedef enum {
+   TRACK_TIME = 0,
+   TRACK_POSITION = 1,
+   TRACK_ROTATION = 4,
+   TRACK_SCALE = 8
+} TrackChannel;
+
+#define AFFINE_ENTRIES 12
+#define TRS_ENTRIES 10   // position, rotation and scale of one bone
 
-static Eigen::Vector3f lerpVec3(Eigen::Vector3f begin, Eigen::Vector3f end, float ratio) {
-   return begin + ratio * (end - begin);
+// ========================================================== //
+// ==================== STATIC FUNCTIONS ==================== //
+// ========================================================== //
+
+// The key at or before tickTime (and before the last key), found from the
+// cursor's last key if there is one
+static unsigned int findEarlyKeyIndex(const Animation& anim, float tickTime, KeyCursor * cursor) {
+   unsigned int hint = cursor && !cursor->keys.empty() ? cursor->keys[0] : 0;
+   unsigned int index = AC::FindKey(anim.tracks.times.data(), anim.keyCount, tickTime, hint);
+   if (cursor)
+      cursor->keys.assign(1, index);
+   return index;
 }
 
-static int findEarlyKeyIndex(int keyCount, float tickTime, float duration) {
-   int index = tickTime * (keyCount-1) / duration;
-   return index < keyCount-1 ? index : keyCount - 2;
+// Interpolates L::WIDTH bones between two keys, k0 and k1 point at the first
+// bone's time channel in each key. The rotations come out unnormalized.
+template <typename L>
+static void interpolateLanes(const float * k0, const float * k1, unsigned int stride, float tickTime,
+                             typename L::T pos[3], typename L::T rot[4], typename L::T scl[3]) {
+   typedef typename L::T T;
+   const T zero = L::set(0), one = L::set(1), half = L::set(0.5f);
+
+   // Where tickTime falls between each bone's two keys
+   T t0 = L::load(k0), t1 = L::load(k1);
+   T span = L::max(L::sub(t1, t0), L::set(1e-6f));
+   T ratio = L::div(L::sub(L::set(tickTime), t0), span);
+   ratio = L::min(one, L::max(zero, ratio));
+
+   T rot0[4], rot1[4];
+   for (int i = 0; i < 3; i++) {
+      T a = L::load(k0 + (TRACK_POSITION + i) * stride);
+      T b = L::load(k1 + (TRACK_POSITION + i) * stride);
+      pos[i] = L::add(a, L::mul(ratio, L::sub(b, a)));
+
+      a = L::load(k0 + (TRACK_SCALE + i) * stride);
+      b = L::load(k1 + (TRACK_SCALE + i) * stride);
+      scl[i] = L::add(a, L::mul(ratio, L::sub(b, a)));
+   }
+
+   T cosine = zero;
+   for (int i = 0; i < 4; i++) {
+      rot0[i] = L::load(k0 + (TRACK_ROTATION + i) * stride);
+      rot1[i] = L::load(k1 + (TRACK_ROTATION + i) * stride);
+      cosine = L::add(cosine, L::mul(rot0[i], rot1[i]));
+   }
+
+   // Neighboring keys are in the same hemisphere (see BuildTracks), so this is
+   // a plain nlerp with its ratio bent toward slerp's constant angular speed
+   // (the fit from Kapoulkine's "Approximating slerp")
+   T d = L::max(zero, cosine);
+   T a = L::add(L::set(1.0904f), L::mul(d, L::add(L::set(-3.2452f),
+         L::mul(d, L::sub(L::set(3.55645f), L::mul(d, L::set(1.43519f)))))));
+   T b = L::add(L::set(0.848013f), L::mul(d, L::add(L::set(-1.06021f), L::mul(d, L::set(0.215638f)))));
+   T centered = L::sub(ratio, half);
+   T k = L::add(L::mul(a, L::mul(centered, centered)), b);
+   T bent = L::add(ratio, L::mul(L::mul(ratio, centered), L::mul(L::sub(ratio, one), k)));
+
+   for (int i = 0; i < 4; i++)
+      rot[i] = L::add(rot0[i], L::mul(bent, L::sub(rot1[i], rot0[i])));
 }
 
-static Key interpolateKeys(Key earlyKey, Key lateKey, float tickTime) {
-   Key key;
-   tickTime = fmax(earlyKey.time, fmin(lateKey.time, tickTime));
-   float ratio = (tickTime - earlyKey.time) / (lateKey.time - earlyKey.time);
+// Writes the 12 entries of each bone's 3x4 transform (row major) to affine,
+// L::WIDTH floats per entry
+template <typename L>
+static void composeLanes(const typename L::T pos[3], const typename L::T q[4], const typename L::T scl[3],
+                         float * affine) {
+   typedef typename L::T T;
+   const T one = L::set(1);
 
-   key.position = lerpVec3(earlyKey.position, lateKey.position, ratio);
-   key.rotation = earlyKey.rotation.slerp(ratio, lateKey.rotation);
-   key.scale = lerpVec3(earlyKey.scale, lateKey.scale, ratio);
-   return key;
+   // Rotation matrix of the unnormalized quaternion, 2 / |q|^2 takes the place of normalizing it
+   T s = L::div(L::set(2), L::add(L::add(L::mul(q[0], q[0]), L::mul(q[1], q[1])),
+                                  L::add(L::mul(q[2], q[2]), L::mul(q[3], q[3]))));
+   T x = q[0], y = q[1], z = q[2], w = q[3];
+   T xs = L::mul(x, s), ys = L::mul(y, s), zs = L::mul(z, s);
+   T xx = L::mul(x, xs), yy = L::mul(y, ys), zz = L::mul(z, zs);
+   T xy = L::mul(x, ys), xz = L::mul(x, zs), yz = L::mul(y, zs);
+   T wx = L::mul(w, xs), wy = L::mul(w, ys), wz = L::mul(w, zs);
+
+   // (translation * rotation * scale) with the scale folded into the rotation's columns
+   T m[AFFINE_ENTRIES] = {
+      L::mul(L::sub(one, L::add(yy, zz)), scl[0]), L::mul(L::sub(xy, wz), scl[1]), L::mul(L::add(xz, wy), scl[2]), pos[0],
+      L::mul(L::add(xy, wz), scl[0]), L::mul(L::sub(one, L::add(xx, zz)), scl[1]), L::mul(L::sub(yz, wx), scl[2]), pos[1],
+      L::mul(L::sub(xz, wy), scl[0]), L::mul(L::add(yz, wx), scl[1]), L::mul(L::sub(one, L::add(xx, yy)), scl[2]), pos[2]
+   };
+
+   for (int i = 0; i < AFFINE_ENTRIES; i++)
+      L::store(affine + i * L::WIDTH, m[i]);
+}
+
+// Writes position, normalized rotation (xyzw) and scale, L::WIDTH floats per component
+template <typename L>
+static void storeLanes(const typename L::T pos[3], const typename L::T q[4], const typename L::T scl[3],
+                       float * trs) {
+   typedef typename L::T T;
+   T length = L::sqrt(L::add(L::add(L::mul(q[0], q[0]), L::mul(q[1], q[1])),
+                             L::add(L::mul(q[2], q[2]), L::mul(q[3], q[3]))));
+   T inverse = L::div(L::set(1), length);
+
+   for (int i = 0; i < 3; i++) {
+      L::store(trs + (TRACK_POSITION - 1 + i) * L::WIDTH, pos[i]);
+      L::store(trs + (TRACK_SCALE - 1 + i) * L::WIDTH, scl[i]);
+   }
+   for (int i = 0; i < 4; i++)
+      L::store(trs + (TRACK_ROTATION - 1 + i) * L::WIDTH, L::mul(q[i], inverse));
 }
 
+static LocalTransform unpackTransform(const float * trs, unsigned int width, unsigned int lane) {
+   LocalTransform t;
+   for (int i = 0; i < 3; i++) {
+      t.position(i) = trs[(TRACK_POSITION - 1 + i) * width + lane];
+      t.scale(i) = trs[(TRACK_SCALE - 1 + i) * width + lane];
+   }
+   for (int i = 0; i < 4; i++)
+      t.rotation.coeffs()(i) = trs[(TRACK_ROTATION - 1 + i) * width + lane];
+   return t;
+}
+
+static const float * keyChannels(const Animation& anim, unsigned int key) {
+   const AnimTracks * tracks = & anim.tracks;
+   return & tracks->data[(size_t)key * ANIM_TRACK_CHANNELS * tracks->boneStride];
+}
+
+static Eigen::Quaternionf alignedRotation(const LocalTransform& t, const Eigen::Quaternionf& reference) {
+   Eigen::Quaternionf q = t.rotation;
+   if (q.coeffs().dot(reference.coeffs()) < 0)
+      q.coeffs() = -q.coeffs();
+   return q;
+}
+
+// a moved toward b by ratio, rotations by nlerp, which is close enough for blending poses
+static void blendTransform(LocalTransform * a, const LocalTransform& b, float ratio) {
+   Eigen::Quaternionf from = a->rotation;
+   Eigen::Quaternionf to = alignedRotation(b, from);
+
+   a->position += ratio * (b.position - a->position);
+   a->scale += ratio * (b.scale - a->scale);
+   a->rotation.coeffs() = (from.coeffs() + ratio * (to.coeffs() - from.coeffs())).normalized();
+}
+
+// The weighted average of the layer's clips at their own times (or at their
+// first keys), total is the sum of the weights
+static void blendClips(AnimLayer * layer, const std::vector<Animation>& animations, unsigned int boneCount,
+                       bool firstKeys, float total, PoseArena * arena, LocalTransform * out) {
+   bool first = true;
+   LocalTransform * sampled = NULL;
+
+   for (unsigned int i = 0; i < layer->clips.size(); i++) {
+      ClipState * clip = & layer->clips[i];
+      if (clip->weight <= 0)
+         continue;
+
+      // The first keys are a jump back, which would only throw the cursor off
+      float time = firstKeys ? 0 : clip->time;
+      KeyCursor * cursor = firstKeys ? NULL : & clip->cursor;
+      if (first) {
+         AN::SamplePose(animations[clip->animNum], time, out, cursor);
+         if (clip->weight >= total)
+            return;
+         for (unsigned int j = 0; j < boneCount; j++) {
+            out[j].position *= clip->weight;
+            out[j].scale *= clip->weight;
+            out[j].rotation.coeffs() *= clip->weight;
+         }
+         first = false;
+         continue;
+      }
+
+      if (!sampled)
+         sampled = arena->take(boneCount);
+      AN::SamplePose(animations[clip->animNum], time, sampled, cursor);
+
+      for (unsigned int j = 0; j < boneCount; j++) {
+         Eigen::Quaternionf q = alignedRotation(sampled[j], out[j].rotation);
+         out[j].position += clip->weight * sampled[j].position;
+         out[j].scale += clip->weight * sampled[j].scale;
+         out[j].rotation.coeffs() += clip->weight * q.coeffs();
+      }
+   }
+
+   for (unsigned int j = 0; j < boneCount; j++) {
+      out[j].position /= total;
+      out[j].scale /= total;
+      out[j].rotation.normalize();
+   }
+}
+
+// ========================================================== //
+// ==================== PUBLIC FUNCTIONS ==================== //
+// ========================================================== //
+
 namespace AN {
 
-   // Assuming keyCount >= 1
-   Eigen::Matrix4f ComputeKeyframeTransform(AnimBone * animBone, int keyCount, float tickTime, float duration) {
-      std::vector<Key>& keys = animBone->keys;
+   void BuildTracks(Animation * anim, unsigned int boneCount) {
+      AnimTracks * tracks = & anim->tracks;
+      unsigned int stride = (boneCount + ANIM_TRACK_LANES - 1) / ANIM_TRACK_LANES * ANIM_TRACK_LANES;
+      tracks->boneCount = boneCount;
+      tracks->boneStride = stride;
+      tracks->data = std::vector<float>((size_t)anim->keyCount * ANIM_TRACK_CHANNELS * stride, 0);
+
+      tracks->times = std::vector<float>(anim->keyCount);
+      for (unsigned int k = 0; k < anim->keyCount; k++) {
+         float * channels = & tracks->data[(size_t)k * ANIM_TRACK_CHANNELS * stride];
+         tracks->times[k] = boneCount ? anim->animBones[0].keys[k].time : k;
+
+         // Padding lanes hold identity keys so they sample to something finite
+         for (unsigned int j = boneCount; j < stride; j++) {
+            channels[TRACK_TIME * stride + j] = k;
+            channels[(TRACK_ROTATION + 3) * stride + j] = 1;
+            for (int i = 0; i < 3; i++)
+               channels[(TRACK_SCALE + i) * stride + j] = 1;
+         }
+      }
+
+      for (unsigned int j = 0; j < boneCount; j++) {
+         const Key * keys = anim->animBones[j].keys;
+         Eigen::Vector4f last = Eigen::Vector4f(0, 0, 0, 1);
+
+         for (unsigned int k = 0; k < anim->keyCount; k++) {
+            float * channels = & tracks->data[(size_t)k * ANIM_TRACK_CHANNELS * stride];
+            const Key * key = & keys[k];
+
+            // q and -q are the same rotation, keeping each key on the same side
+            // as the one before means interpolating never has to check
+            Eigen::Vector4f rotation = key->rotation.coeffs();
+            if (k > 0 && rotation.dot(last) < 0)
+               rotation = -rotation;
+            last = rotation;
+
+            channels[TRACK_TIME * stride + j] = key->time;
+            for (int i = 0; i < 3; i++) {
+               channels[(TRACK_POSITION + i) * stride + j] = key->position(i);
+               channels[(TRACK_SCALE + i) * stride + j] = key->scale(i);
+            }
+            for (int i = 0; i < 4; i++)
+               channels[(TRACK_ROTATION + i) * stride + j] = rotation(i);
+         }
+      }
+   }
+
+   void SampleAnimation(const Animation& anim, float tickTime, Mmath::Matrix3x4f * out, KeyCursor * cursor) {
+      const AnimTracks * tracks = & anim.tracks;
+      if (!anim.compressed.empty()) {
+         unsigned int boneCount = AC::ReadHeader(anim.compressed.data()).boneCount;
+         for (unsigned int j = 0; j < boneCount; j++) {
+            LocalTransform t = AC::SampleBone(anim.compressed.data(), j, tickTime, cursor);
+            ComposePose(& t, 1, & out[j]);
+         }
+         return;
+      }
+      if (!anim.keyCount || !tracks->boneCount)
+         return;
+
+      unsigned int early = findEarlyKeyIndex(anim, tickTime, cursor);
+      unsigned int late = anim.keyCount > 1 ? early + 1 : early;
+      const float * k0 = keyChannels(anim, early);
+      const float * k1 = keyChannels(anim, late);
+
+      float affine[AFFINE_ENTRIES * WideLanes::WIDTH];
+      for (unsigned int first = 0; first < tracks->boneCount; first += WideLanes::WIDTH) {
+         WideLanes::T pos[3], rot[4], scl[3];
+         interpolateLanes<WideLanes>(k0 + first, k1 + first, tracks->boneStride, tickTime, pos, rot, scl);
+         composeLanes<WideLanes>(pos, rot, scl, affine);
 
-      int earlyNdx = findEarlyKeyIndex(keyCount, tickTime, duration);
-      int lateNdx = earlyNdx + 1;
+         unsigned int count = tracks->boneCount - first < (unsigned int)WideLanes::WIDTH ?
+                              tracks->boneCount - first : WideLanes::WIDTH;
+         for (unsigned int lane = 0; lane < count; lane++) {
+            Mmath::Matrix3x4f * m = & out[first + lane];
+            for (int row = 0; row < 3; row++)
+               for (int col = 0; col < 4; col++)
+                  (*m)(row, col) = affine[(4 * row + col) * WideLanes::WIDTH + lane];
+         }
+      }
+   }
+
+   Mmath::Matrix3x4f SampleBone(const Animation& anim, unsigned int bone, float tickTime, KeyCursor * cursor) {
+      Mmath::Matrix3x4f m = Mmath::Matrix3x4f::Identity();
+      if (!anim.compressed.empty()) {
+         LocalTransform t = AC::SampleBone(anim.compressed.data(), bone, tickTime, cursor);
+         ComposePose(& t, 1, & m);
+         return m;
+      }
+      if (!anim.keyCount || bone >= anim.tracks.boneCount)
+         return m;
+
+      unsigned int early = findEarlyKeyIndex(anim, tickTime, cursor);
+      unsigned int late = anim.keyCount > 1 ? early + 1 : early;
+
+      float affine[AFFINE_ENTRIES];
+      float pos[3], rot[4], scl[3];
+      interpolateLanes<ScalarLanes>(keyChannels(anim, early) + bone, keyChannels(anim, late) + bone,
+                                    anim.tracks.boneStride, tickTime, pos, rot, scl);
+      composeLanes<ScalarLanes>(pos, rot, scl, affine);
+      for (int row = 0; row < 3; row++)
+         for (int col = 0; col < 4; col++)
+            m(row, col) = affine[4 * row + col];
+      return m;
+   }
+   void SamplePose(const Animation& anim, float tickTime, LocalTransform * out, KeyCursor * cursor) {
+      const AnimTracks * tracks = & anim.tracks;
+      if (!anim.compressed.empty()) {
+         AC::SamplePose(anim.compressed.data(), tickTime, out, cursor);
+         return;
+      }
+      if (!anim.keyCount || !tracks->boneCount)
+         return;
+
+      unsigned int early = findEarlyKeyIndex(anim, tickTime, cursor);
+      unsigned int late = anim.keyCount > 1 ? early + 1 : early;
+      const float * k0 = keyChannels(anim, early);
+      const float * k1 = keyChannels(anim, late);
+
+      float trs[TRS_ENTRIES * WideLanes::WIDTH];
+      for (unsigned int first = 0; first < tracks->boneCount; first += WideLanes::WIDTH) {
+         WideLanes::T pos[3], rot[4], scl[3];
+         interpolateLanes<WideLanes>(k0 + first, k1 + first, tracks->boneStride, tickTime, pos, rot, scl);
+         storeLanes<WideLanes>(pos, rot, scl, trs);
 
-      Key interpKey = (keyCount == 1) ? keys[earlyNdx] :
-         interpolateKeys(keys[earlyNdx], keys[lateNdx], tickTime);
+         unsigned int count = tracks->boneCount - first < (unsigned int)WideLanes::WIDTH ?
+                              tracks->boneCount - first : WideLanes::WIDTH;
+         for (unsigned int lane = 0; lane < count; lane++)
+            out[first + lane] = unpackTransform(trs, WideLanes::WIDTH, lane);
+      }
+   }
+
+   LocalTransform SampleBonePose(const Animation& anim, unsigned int bone, float tickTime,
+                                 KeyCursor * cursor) {
+      if (!anim.compressed.empty())
+         return AC::SampleBone(anim.compressed.data(), bone, tickTime, cursor);
+
+      LocalTransform t;
+      t.position = Eigen::Vector3f(0, 0, 0);
+      t.rotation = Eigen::Quaternionf::Identity();
+      t.scale = Eigen::Vector3f(1, 1, 1);
+      if (!anim.keyCount || bone >= anim.tracks.boneCount)
+         return t;
+
+      unsigned int early = findEarlyKeyIndex(anim, tickTime, cursor);
+      unsigned int late = anim.keyCount > 1 ? early + 1 : early;
+
+      float trs[TRS_ENTRIES];
+      float pos[3], rot[4], scl[3];
+      interpolateLanes<ScalarLanes>(keyChannels(anim, early) + bone, keyChannels(anim, late) + bone,
+                                    anim.tracks.boneStride, tickTime, pos, rot, scl);
+      storeLanes<ScalarLanes>(pos, rot, scl, trs);
+      return unpackTransform(trs, 1, 0);
+   }
 
-      return Mmath::TransformationMatrix(interpKey.position, interpKey.rotation, interpKey.scale);
+   void ComposePose(const LocalTransform * pose, unsigned int boneCount, Mmath::Matrix3x4f * out) {
+      for (unsigned int i = 0; i < boneCount; i++) {
+         Eigen::Quaternionf rotation = pose[i].rotation;
+         out[i].leftCols<3>() = rotation.toRotationMatrix() * pose[i].scale.asDiagonal();
+         out[i].col(3) = pose[i].position;
+      }
    }
+
+   float WrapTime(float time, float duration) {
+      if (duration > 0 && time > duration)
+         return fmod(time, duration);
+      return time;
+   }
+
+   Eigen::Vector3f TrackDisplacement(const Animation& anim, unsigned int bone, float fromTime, float timeDelta) {
+      float toTime = fromTime + timeDelta;
+      Eigen::Vector3f moved = SampleBonePose(anim, bone, WrapTime(toTime, anim.duration)).position -
+                              SampleBonePose(anim, bone, fromTime).position;
+
+      // Every time around the loop adds one whole pass of the track
+      if (anim.duration > 0 && toTime > anim.duration) {
+         float loops = floorf(toTime / anim.duration);
+         moved += loops * (SampleBonePose(anim, bone, anim.duration).position -
+                           SampleBonePose(anim, bone, 0).position);
+      }
+      return moved;
+   }
+
+   void FadeClip(AnimLayer * layer, int animNum, float weight, float seconds) {
+      ClipState * clip = NULL;
+      for (unsigned int i = 0; i < layer->clips.size() && !clip; i++)
+         if (layer->clips[i].animNum == animNum)
+            clip = & layer->clips[i];
+
+      if (!clip) {
+         ClipState added = {animNum, 0, 0, 0, 0};
+         layer->clips.push_back(added);
+         clip = & layer->clips.back();
+      }
+
+      clip->targetWeight = weight;
+      if (seconds > 0) {
+         clip->fadeRate = fabs(weight - clip->weight) / seconds;
+      } else {
+         clip->weight = weight;
+         clip->fadeRate = 0;
+      }
+   }
+
+   void Crossfade(AnimLayer * layer, int animNum, float seconds) {
+      for (unsigned int i = 0; i < layer->clips.size(); i++)
+         if (layer->clips[i].animNum != animNum)
+            FadeClip(layer, layer->clips[i].animNum, 0, seconds);
+      FadeClip(layer, animNum, 1, seconds);
+   }
+
+   void AdvanceLayer(AnimLayer * layer, const std::vector<Animation>& animations, float timeDelta) {
+      unsigned int kept = 0;
+
+      for (unsigned int i = 0; i < layer->clips.size(); i++) {
+         ClipState clip = layer->clips[i];
+         clip.time = WrapTime(clip.time + timeDelta, animations[clip.animNum].duration);
+
+         float step = clip.fadeRate * timeDelta;
+         if (fabs(clip.targetWeight - clip.weight) <= step) {
+            clip.weight = clip.targetWeight;
+            clip.fadeRate = 0;
+         } else {
+            clip.weight += clip.targetWeight > clip.weight ? step : -step;
+         }
+
+         if (clip.weight > 0 || clip.targetWeight > 0)
+            layer->clips[kept++] = clip;
+      }
+
+      layer->clips.resize(kept);
+   }
+
+   void ApplyLayer(AnimLayer * layer, const std::vector<Animation>& animations,
+                   unsigned int boneCount, PoseArena * arena, LocalTransform * pose) {
+      float total = 0;
+      for (unsigned int i = 0; i < layer->clips.size(); i++)
+         total += fmax(0, layer->clips[i].weight);
+      if (total <= 0 || layer->weight <= 0)
+         return;
+
+      float layerWeight = layer->weight * fmin(1, total);
+      LocalTransform * blended = arena->take(boneCount);
+      blendClips(layer, animations, boneCount, false, total, arena, blended);
+
+      LocalTransform * reference = NULL;
+      if (layer->mode == LAYER_ADDITIVE) {
+         reference = arena->take(boneCount);
+         blendClips(layer, animations, boneCount, true, total, arena, reference);
+      }
+
+      for (unsigned int j = 0; j < boneCount; j++) {
+         float weight = layerWeight * (j < layer->boneWeights.size() ? layer->boneWeights[j] :
+                                      layer->boneWeights.empty() ? 1 : 0);
+         if (weight <= 0)
+            continue;
+
+         if (layer->mode == LAYER_OVERRIDE) {
+            blendTransform(& pose[j], blended[j], weight);
+            continue;
+         }
+
+         // The clip's motion since its first key, scaled down by the weight
+         Eigen::Quaternionf delta = Eigen::Quaternionf(reference[j].rotation).conjugate() *
+                                    Eigen::Quaternionf(blended[j].rotation);
+         Eigen::Quaternionf partial = Eigen::Quaternionf::Identity().slerp(weight, delta);
+
+         pose[j].position += weight * (blended[j].position - reference[j].position);
+         pose[j].scale = pose[j].scale.cwiseProduct(Eigen::Vector3f(1, 1, 1) + weight *
+            (blended[j].scale.cwiseQuotient(reference[j].scale) - Eigen::Vector3f(1, 1, 1)));
+         pose[j].rotation = (Eigen::Quaternionf(pose[j].rotation) * partial).normalized();
+      }
+   }
+}
+
+// ======================================================== //
+// ================== POSE ARENA METHODS ================== //
+// ======================================================== //
+
+PoseArena::PoseArena()
+: _block(0), _used(0) {}
+
+LocalTransform * PoseArena::take(unsigned int count) {
+   if (!count)
+      return NULL;
+
+   while (_block < _blocks.size()) {
+      if (_used + count <= _blocks[_block].size()) {
+         LocalTransform * taken = & _blocks[_block][_used];
+         _used += count;
+         return taken;
+      }
+      _block++;
+      _used = 0;
+   }
+
+   // Only the first frames get here, until there are enough blocks for a whole evaluation
+   _blocks.push_back(std::vector<LocalTransform>(count > POSE_ARENA_BLOCK ? count : POSE_ARENA_BLOCK));
+   _block = _blocks.size() - 1;
+   _used = count;
+   return & _blocks[_block][0];
+}
+
+void PoseArena::reset() {
+   _block = 0;
+   _used = 0;
+}
+
+PoseArena * PoseArena::local() {
+   static thread_local PoseArena arena;
+   return & arena;
 }
@@ -0,0 +1,344 @@
+#include "articulated.h"
+
+#include <math.h>
+
+// ========================================================== //
+// ==================== STATIC FUNCTIONS ==================== //
+// ========================================================== //
+
+static Mmath::Matrix3x4f hingeM(float angle, const Eigen::Vector3f& axis) {
+   Mmath::Matrix3x4f m;
+   m.leftCols<3>() = Mmath::AngleAxisMatrix3<float>(angle, axis);
+   m.col(3) = Eigen::Vector3f(0,0,0);
+   return m;
+}
+
+// S times a rate, a hinge's motion subspace S being [axis; 0]
+static SpatialVector hingeMotion(const Eigen::Vector3f& axis, float rate) {
+   SpatialVector m;
+   m << rate * axis, Eigen::Vector3f(0,0,0);
+   return m;
+}
+
+// ========================================================== //
+// ===================== ARTICULATED BODY =================== //
+// ========================================================== //
+
+ArticulatedBody::ArticulatedBody(const std::vector<Bone>& bones, const std::vector<BoneStep>& order)
+: gravity(0, ARTICULATED_GRAVITY, 0), damping(ARTICULATED_DAMPING), fixedRoot(false), bones(& bones) {
+   boneLinks = std::vector<int>(bones.size(), -1);
+   firstLinks = std::vector<int>(bones.size(), -1);
+   boneInLinks = std::vector<Mmath::Matrix3x4f>(bones.size(), Mmath::Matrix3x4f::Identity());
+   boneForces = std::vector<Eigen::Vector3f>(bones.size(), Eigen::Vector3f(0,0,0));
+   boneTorques = std::vector<Eigen::Vector3f>(bones.size(), Eigen::Vector3f(0,0,0));
+
+   rootRotation = Eigen::Quaternionf(1,0,0,0);
+   rootPosition = Eigen::Vector3f(0,0,0);
+
+   // Parents come first in the order, so a bone's parent always has its link already
+   for (unsigned int i = 0; i < order.size(); i++) {
+      const BoneStep& step = order[i];
+      const Bone * bone = & bones[step.bone];
+
+      Link link;
+      link.bone = step.bone;
+      link.axis = Eigen::Vector3f(0,0,0);
+      link.minAngle = link.maxAngle = 0;
+      link.inertia = SpatialMatrix::Zero();
+      link.mass = 0;
+      link.massMoment = Eigen::Vector3f(0,0,0);
+
+      if (step.parent < 0) {
+         link.parent = -1;
+         link.joint = -1;
+         link.treeM = Mmath::Matrix3x4f::Identity();
+         boneLinks[step.bone] = links.size();
+         links.push_back(link);
+
+         Eigen::Matrix3f rootRotationM = bone->parentOffset.topLeftCorner<3,3>();
+         rootRotation = Eigen::Quaternionf(rootRotationM).normalized();
+         rootPosition = bone->parentOffset.block<3,1>(0,3);
+      }
+      else {
+         Mmath::Matrix3x4f treeM = Mmath::ComposeAffine(boneInLinks[step.parent], bone->parentOffset.topRows<3>());
+
+         if (bone->joints.empty()) {
+            boneLinks[step.bone] = boneLinks[step.parent];
+            boneInLinks[step.bone] = treeM;
+         }
+         else {
+            // One link per hinge, each hanging straight off the one before
+            for (unsigned int j = 0; j < bone->joints.size(); j++) {
+               link.joint = j;
+               link.treeM = j == 0 ? treeM : Mmath::Matrix3x4f::Identity();
+               link.axis = bone->joints[j].axis.normalized();
+               link.minAngle = bone->joints[j].minAngle;
+               link.maxAngle = bone->joints[j].maxAngle;
+
+               if (j == 0) {
+                  link.parent = boneLinks[step.parent];
+                  firstLinks[step.bone] = links.size();
+               }
+               else
+                  link.parent = links.size() - 1;
+               links.push_back(link);
+            }
+            boneLinks[step.bone] = links.size() - 1;
+         }
+      }
+
+      addBoneMass(step.bone);
+   }
+
+   angles = std::vector<float>(links.size(), 0);
+   velocities = std::vector<float>(links.size(), 0);
+   torques = std::vector<float>(links.size(), 0);
+   accelerations = std::vector<float>(links.size(), 0);
+   states = std::vector<LinkState>(links.size());
+
+   rootVelocity = SpatialVector::Zero();
+   rootAcceleration = SpatialVector::Zero();
+}
+
+// Bones are kept as their mass, center of mass and inertia about it, in bone space
+void ArticulatedBody::addBoneMass(int bone) {
+   const Bone * b = & (*bones)[bone];
+   Link * link = & links[boneLinks[bone]];
+   const Mmath::Matrix3x4f& m = boneInLinks[bone];
+
+   Eigen::Matrix3f rotationM = m.leftCols<3>();
+   Eigen::Vector3f com = rotationM * b->com + m.col(3);
+   Eigen::Matrix3f inertiaAtCom = rotationM * b->inertiaTensor * rotationM.transpose();
+
+   link->inertia += SV::Inertia(b->mass, com, inertiaAtCom);
+   link->mass += b->mass;
+   link->massMoment += b->mass * com;
+}
+
+unsigned int ArticulatedBody::linkCount() {
+   return links.size();
+}
+
+int ArticulatedBody::linkOf(int bone, int joint) {
+   if (firstLinks[bone] < 0 || joint < 0 || joint >= (int)(*bones)[bone].joints.size())
+      return -1;
+   return firstLinks[bone] + joint;
+}
+
+void ArticulatedBody::applyForce(int bone, const Eigen::Vector3f& force) {
+   boneForces[bone] += force;
+}
+
+void ArticulatedBody::applyTorque(int bone, const Eigen::Vector3f& torque) {
+   boneTorques[bone] += torque;
+}
+
+void ArticulatedBody::clearForces() {
+   for (unsigned int i = 0; i < boneForces.size(); i++) {
+      boneForces[i] = Eigen::Vector3f(0,0,0);
+      boneTorques[i] = Eigen::Vector3f(0,0,0);
+   }
+}
+
+float ArticulatedBody::hingeTorque(int link) {
+   return torques[link] - damping * velocities[link];
+}
+
+// Transforms, velocities and outside forces of every link, parents first
+void ArticulatedBody::computeKinematics() {
+   for (unsigned int i = 0; i < links.size(); i++) {
+      const Link * link = & links[i];
+      LinkState * s = & states[i];
+
+      if (link->parent < 0) {
+         s->X.E = rootRotation.toRotationMatrix().transpose();
+         s->X.r = rootPosition;
+         s->modelE = s->X.E;
+         s->origin = rootPosition;
+         s->v = fixedRoot ? SpatialVector(SpatialVector::Zero()) : rootVelocity;
+         s->c = SpatialVector::Zero();
+      }
+      else {
+         const LinkState * p = & states[link->parent];
+         SpatialVector vJ = hingeMotion(link->axis, velocities[i]);
+
+         s->X = SV::FromLocal(Mmath::ComposeAffine(link->treeM, hingeM(angles[i], link->axis)));
+         s->modelE = s->X.E * p->modelE;
+         s->origin = p->origin + p->modelE.transpose() * s->X.r;
+         s->v = SV::ApplyMotion(s->X, p->v) + vJ;
+         s->c = SV::CrossMotion(s->v, vJ);
+      }
+
+      // Gravity pulls on the center of mass, so it's the inertia times a linear acceleration
+      SpatialVector g;
+      g << Eigen::Vector3f(0,0,0), s->modelE * gravity;
+      s->fExt = link->inertia * g;
+   }
+
+   for (unsigned int b = 0; b < boneForces.size(); b++) {
+      if (boneLinks[b] < 0 || (boneForces[b].isZero() && boneTorques[b].isZero()))
+         continue;
+
+      LinkState * s = & states[boneLinks[b]];
+      const Mmath::Matrix3x4f& m = boneInLinks[b];
+      Eigen::Vector3f com = m.leftCols<3>() * (*bones)[b].com + m.col(3);
+      Eigen::Vector3f force = s->modelE * boneForces[b];
+
+      s->fExt.head<3>() += com.cross(force) + s->modelE * boneTorques[b];
+      s->fExt.tail<3>() += force;
+   }
+}
+
+// Featherstone's three passes: velocities out from the root, articulated
+// inertias and bias forces back in, accelerations out again
+void ArticulatedBody::forwardDynamics() {
+   if (links.empty())
+      return;
+
+   computeKinematics();
+
+   for (unsigned int i = 0; i < links.size(); i++) {
+      LinkState * s = & states[i];
+      s->IA = links[i].inertia;
+      s->pA = SV::CrossForce(s->v, links[i].inertia * s->v) - s->fExt;
+   }
+
+   for (int i = links.size() - 1; i > 0; i--) {
+      const Link * link = & links[i];
+      LinkState * s = & states[i];
+      LinkState * p = & states[link->parent];
+
+      s->U = s->IA.leftCols<3>() * link->axis;
+      s->D = link->axis.dot(s->U.head<3>()) + ARTICULATED_ARMATURE;
+      s->u = hingeTorque(i) - link->axis.dot(s->pA.head<3>());
+
+      // What the parent feels through the hinge, with the hinge free to turn
+      SpatialMatrix Ia = s->IA - s->U * s->U.transpose() / s->D;
+      SpatialVector pa = s->pA + Ia * s->c + s->U * (s->u / s->D);
+      p->IA += SV::TransformInertia(s->X, Ia);
+      p->pA += SV::ApplyForceTranspose(s->X, pa);
+   }
+
+   LinkState * root = & states[0];
+   if (fixedRoot)
+      root->a = SpatialVector::Zero();
+   else
+      root->a = -root->IA.ldlt().solve(root->pA);
+   rootAcceleration = root->a;
+
+   for (unsigned int i = 1; i < links.size(); i++) {
+      const Link * link = & links[i];
+      LinkState * s = & states[i];
+
+      s->a = SV::ApplyMotion(s->X, states[link->parent].a) + s->c;
+      accelerations[i] = (s->u - s->U.dot(s->a)) / s->D;
+      s->a.head<3>() += accelerations[i] * link->axis;
+   }
+}
+
+// Recursive Newton-Euler, the net force on each link found on the way out and
+// summed into the hinges on the way back
+void ArticulatedBody::inverseDynamics(std::vector<float>& linkTorques, SpatialVector& rootForce) {
+   linkTorques = std::vector<float>(links.size(), 0);
+   rootForce = SpatialVector::Zero();
+   if (links.empty())
+      return;
+
+   computeKinematics();
+
+   for (unsigned int i = 0; i < links.size(); i++) {
+      const Link * link = & links[i];
+      LinkState * s = & states[i];
+
+      if (link->parent < 0)
+         s->a = fixedRoot ? SpatialVector(SpatialVector::Zero()) : rootAcceleration;
+      else
+         s->a = SV::ApplyMotion(s->X, states[link->parent].a) + hingeMotion(link->axis, accelerations[i]) + s->c;
+
+      SpatialVector momentum = link->inertia * s->v;
+      s->pA = link->inertia * s->a + SV::CrossForce(s->v, momentum) - s->fExt;
+   }
+
+   for (int i = links.size() - 1; i > 0; i--) {
+      const Link * link = & links[i];
+      LinkState * s = & states[i];
+
+      linkTorques[i] = link->axis.dot(s->pA.head<3>()) + ARTICULATED_ARMATURE * accelerations[i] +
+                       damping * velocities[i];
+      states[link->parent].pA += SV::ApplyForceTranspose(s->X, s->pA);
+   }
+
+   rootForce = states[0].pA;
+}
+
+void ArticulatedBody::step(float timeDelta) {
+   if (links.empty())
+      return;
+
+   forwardDynamics();
+
+   // A hinge running into its limit stops dead there
+   for (unsigned int i = 1; i < links.size(); i++) {
+      const Link * link = & links[i];
+      velocities[i] += timeDelta * accelerations[i];
+      angles[i] += timeDelta * velocities[i];
+
+      if (angles[i] < link->minAngle) {
+         angles[i] = link->minAngle;
+         velocities[i] = fmax(velocities[i], 0);
+      }
+      else if (angles[i] > link->maxAngle) {
+         angles[i] = link->maxAngle;
+         velocities[i] = fmin(velocities[i], 0);
+      }
+   }
+
+   // The root's velocity is in its own coordinates, which turn along with it
+   if (!fixedRoot) {
+      rootVelocity += timeDelta * rootAcceleration;
+      Eigen::Vector3f angular = rootVelocity.head<3>();
+      Eigen::Vector3f linear = rootVelocity.tail<3>();
+
+      rootPosition += timeDelta * (rootRotation * linear);
+      float turn = timeDelta * angular.norm();
+      if (turn > 0)
+         rootRotation = rootRotation * Eigen::Quaternionf(Eigen::AngleAxisf(turn, angular.normalized()));
+      rootRotation.normalize();
+   }
+}
+
+Mmath::Matrix3x4f ArticulatedBody::localM(int bone) {
+   const Bone * b = & (*bones)[bone];
+   Mmath::Matrix3x4f m;
+
+   if (!links.empty() && links[0].bone == bone) {
+      m.leftCols<3>() = rootRotation.toRotationMatrix();
+      m.col(3) = rootPosition;
+      return m;
+   }
+
+   m = b->parentOffset.topRows<3>();
+   if (firstLinks[bone] >= 0)
+      for (unsigned int j = 0, link = firstLinks[bone]; j < b->joints.size(); j++, link++)
+         m = Mmath::ComposeAffine(m, hingeM(angles[link], links[link].axis));
+   return m;
+}
+
+float ArticulatedBody::energy() {
+   if (links.empty())
+      return 0;
+
+   computeKinematics();
+
+   float energy = 0;
+   for (unsigned int i = 0; i < links.size(); i++) {
+      const Link * link = & links[i];
+      const LinkState * s = & states[i];
+
+      Eigen::Vector3f massMoment = link->mass * s->origin + s->modelE.transpose() * link->massMoment;
+      energy += 0.5f * s->v.dot(link->inertia * s->v) - gravity.dot(massMoment);
+      if (i > 0)
+         energy += 0.5f * ARTICULATED_ARMATURE * velocities[i] * velocities[i];
+   }
+   return energy;
+}
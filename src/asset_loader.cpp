@@ -0,0 +1,177 @@
+#include "asset_loader.h"
+#include "model.h"
+
+#include <stdio.h>
+#include <chrono>
+#include <string>
+
+static bool hasExtension(const std::string& path, const char * extension) {
+   std::string ext = extension;
+   return path.size() >= ext.size() && path.compare(path.size() - ext.size(), ext.size(), ext) == 0;
+}
+
+// ======================================================== //
+// ================= ASSET LOADER METHODS ================= //
+// ======================================================== //
+
+AssetLoader::AssetLoader(unsigned int threadCount)
+: _pending(0), _pool(threadCount) {}
+
+AssetLoader::~AssetLoader() {}
+
+AssetHandle AssetLoader::submit(const std::function<void()>& decode, const std::function<void()>& upload) {
+   std::shared_ptr<std::promise<void> > done = std::make_shared<std::promise<void> >();
+   AssetHandle handle = done->get_future().share();
+
+   {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _pending++;
+   }
+
+   // Copies the worker can let go of, the parameters are const
+   std::function<void()> decodeJob = decode;
+   std::function<void()> uploadJob = upload;
+
+   _pool.submit([this, decodeJob, uploadJob, done]() mutable {
+      Upload next;
+      next.run = std::move(uploadJob);
+      next.done = done;
+
+      try {
+         decodeJob();
+      } catch (...) {
+         next.error = std::current_exception();
+      }
+
+      // The closures can hold the last reference to a Model or Texture, whose
+      // destructor frees GL objects, so none of them may stay with the worker.
+      // The upload moves into the queue and is let go of on the GL thread.
+      decodeJob = std::function<void()>();
+      uploadJob = std::function<void()>();
+
+      {
+         std::lock_guard<std::mutex> lock(_mutex);
+         _uploads.push_back(std::move(next));
+      }
+      _uploadQueued.notify_one();
+   });
+
+   return handle;
+}
+
+AssetHandle AssetLoader::loadModel(const std::shared_ptr<Model>& model, const ModelAsset& asset) {
+   std::string mesh = asset.mesh ? asset.mesh : "";
+   std::string skinning = asset.skinningPIN ? asset.skinningPIN : "";
+   std::string animation = asset.animationPIN ? asset.animationPIN : "";
+   std::string constraints = asset.constraints ? asset.constraints : "";
+   unsigned int lodLevels = asset.lodLevels;
+   float lodRatio = asset.lodRatio;
+
+   // The steps depend on each other, so a model decodes on a single worker
+   std::function<void()> decode = [=]() {
+      if (hasExtension(mesh, ".obj"))
+         model->decodeOBJ(mesh.c_str());
+      else
+         model->decodeCIAB(mesh.c_str());
+
+      if (!skinning.empty())
+         model->decodeSkinningPIN(skinning.c_str());
+      if (!animation.empty())
+         model->decodeAnimationPIN(animation.c_str());
+      if (!constraints.empty())
+         model->loadConstraints(constraints.c_str());
+      if (lodLevels > 1)
+         model->simplifyLODs(lodLevels, lodRatio);
+   };
+
+   std::function<void()> upload = [=]() {
+      model->upload();
+      fprintf(stderr, "Loaded model: %s\n", mesh.c_str());
+   };
+
+   return submit(decode, upload);
+}
+
+AssetHandle AssetLoader::loadTexture(const std::shared_ptr<Texture>& texture, const char * path, bool repeat) {
+   std::string file = path;
+   std::shared_ptr<Image> image = std::make_shared<Image>();
+
+   std::function<void()> decode = [=]() {
+      image->decode(file.c_str());
+   };
+
+   std::function<void()> upload = [=]() {
+      texture->upload(*image, repeat);
+
+      // The texture is on the GPU now
+      std::vector<unsigned char>().swap(image->data);
+      fprintf(stderr, "Loaded texture: %s\n", file.c_str());
+   };
+
+   return submit(decode, upload);
+}
+
+void AssetLoader::runNextUpload() {
+   Upload next;
+
+   {
+      std::unique_lock<std::mutex> lock(_mutex);
+      while (_uploads.empty())
+         _uploadQueued.wait(lock);
+
+      next = _uploads.front();
+      _uploads.pop_front();
+   }
+
+   if (next.error) {
+      next.done->set_exception(next.error);
+   } else {
+      next.run();
+      next.done->set_value();
+   }
+
+   std::lock_guard<std::mutex> lock(_mutex);
+   _pending--;
+}
+
+unsigned int AssetLoader::update(double budget) {
+   typedef std::chrono::steady_clock Clock;
+   Clock::time_point start = Clock::now();
+   unsigned int count = 0;
+
+   // Uploads can't be split, so the one that crosses the budget still runs whole
+   while (true) {
+      {
+         std::lock_guard<std::mutex> lock(_mutex);
+         if (_uploads.empty())
+            break;
+      }
+
+      runNextUpload();
+      count++;
+
+      if (std::chrono::duration<double>(Clock::now() - start).count() >= budget)
+         break;
+   }
+
+   return count;
+}
+
+void AssetLoader::wait(const AssetHandle& handle) {
+   while (!isReady(handle))
+      runNextUpload();
+}
+
+void AssetLoader::finish() {
+   while (pendingCount() > 0)
+      runNextUpload();
+}
+
+unsigned int AssetLoader::pendingCount() {
+   std::lock_guard<std::mutex> lock(_mutex);
+   return _pending;
+}
+
+bool AssetLoader::isReady(const AssetHandle& handle) {
+   return handle.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
@@ -2,15 +2,38 @@
 #include <cstdlib>
 #include <cstring>
 #include <cassert>
+#include <cmath>
+#include <cstdio>
 
 #include <string>
 #include <vector>
-#include <map>
-#include <fstream>
-#include <sstream>
 #include <iostream>
 
+#include <sys/stat.h>
+
 #include "attachment_loader.h"
+#include "mapped_file.h"
+
+// Parsed files are cached next to the text as <path>.pinc, keyed by the text
+// file's size and modification time. A stale or broken cache is just reparsed.
+#define PIN_CACHE_EXTENSION ".pinc"
+#define PIN_CACHE_VERSION 1
+
+typedef struct PINCacheHeader {
+   char magic[4];                   // 'P' 'I' 'N' 'C'
+   unsigned int version;
+   unsigned long long sourceSize;
+   long long sourceTime;
+   int numBones;
+   unsigned int bindPoseCount;      // floats in the bind pose (0 for weights)
+   unsigned int valueCount;         // floats in the frames or weights
+   unsigned int reserved[3];        // keeps the floats 16 byte aligned
+} PINCacheHeader;
+
+static const double powersOf10[] = {
+   1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+   1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
 
 static inline bool isSpace(const char c) {
   return (c == ' ') || (c == '\t');
@@ -20,193 +43,224 @@ static inline bool isNewLine(const char c) {
   return (c == '\r') || (c == '\n') || (c == '\0');
 }
 
-static inline int parseInt(const char*& token)
-{
-  token += strspn(token, " \t");
-  int i = atoi(token);
-  token += strcspn(token, " \t\r");
-  return i;
+static inline bool isDigit(const char c) {
+  return c >= '0' && c <= '9';
 }
 
-static inline float parseFloat(const char*& token)
+// Reads one decimal number without going through the locale or errno like
+// atof. Up to 19 significant digits are kept in an integer and scaled by an
+// exact power of ten, so the usual "0.123456" values round the same as atof.
+static inline bool parseDecimal(const char*& token, const char * end, float& value)
 {
-  token += strspn(token, " \t");
-  float f = (float)atof(token);
-  token += strcspn(token, " \t\r");
-  return f;
+  const char * p = token;
+  bool negative = false;
+  if (p < end && (*p == '-' || *p == '+')) {
+    negative = (*p == '-');
+    p++;
+  }
+
+  unsigned long long mantissa = 0;
+  int digits = 0, exponent = 0;
+  bool any = false;
+
+  for (; p < end && isDigit(*p); p++, any = true) {
+    if (digits < 19) {
+      mantissa = 10 * mantissa + (*p - '0');
+      digits += (mantissa != 0);
+    } else {
+      exponent++;
+    }
+  }
+
+  if (p < end && *p == '.') {
+    for (p++; p < end && isDigit(*p); p++, any = true) {
+      if (digits < 19) {
+        mantissa = 10 * mantissa + (*p - '0');
+        digits += (mantissa != 0);
+        exponent--;
+      }
+    }
+  }
+
+  if (!any)
+    return false;
+
+  if (p < end && (*p == 'e' || *p == 'E')) {
+    const char * e = p + 1;
+    bool negativeExp = false;
+    if (e < end && (*e == '-' || *e == '+')) {
+      negativeExp = (*e == '-');
+      e++;
+    }
+    if (e < end && isDigit(*e)) {
+      int exp = 0;
+      for (; e < end && isDigit(*e); e++)
+        exp = exp < 10000 ? 10 * exp + (*e - '0') : exp;
+      exponent += negativeExp ? -exp : exp;
+      p = e;
+    }
+  }
+
+  double d = (double)mantissa;
+  if (exponent < 0)
+    d = exponent >= -22 ? d / powersOf10[-exponent] : d * pow(10.0, exponent);
+  else if (exponent > 0)
+    d = exponent <= 22 ? d * powersOf10[exponent] : d * pow(10.0, exponent);
+
+  value = (float)(negative ? -d : d);
+  token = p;
+  return true;
 }
 
-static inline void parseFloat3(
-  float& x, float& y, float& z,
-  const char*& token)
-{
-  x = parseFloat(token);
-  y = parseFloat(token);
-  z = parseFloat(token);
+static inline const char * skipSpaces(const char * p, const char * end) {
+  while (p < end && isSpace(*p))
+    p++;
+  return p;
 }
 
-static void trimNewLine(std::string& linebuf) {
-   // Trim newline '\r\n' or '\n'
-   if (linebuf.size() > 0) {
-      if (linebuf[linebuf.size()-1] == '\n')
-         linebuf.erase(linebuf.size()-1);
-   }
-   if (linebuf.size() > 0) {
-      if (linebuf[linebuf.size()-1] == '\r')
-         linebuf.erase(linebuf.size()-1);
-   }
+static inline const char * nextLine(const char * p, const char * end) {
+  while (p < end && *p != '\n')
+    p++;
+  return p < end ? p + 1 : end;
 }
 
-static void parseNumBones(int& numBones, std::istream& inStream) {
-   int maxchars = 8192;  // Alloc enough size.
-   std::vector<char> buf(maxchars);  // Alloc enough size.
-
-   while (inStream.peek() != -1) {
-      inStream.getline(&buf[0], maxchars);
-      std::string linebuf(&buf[0]);
+// Reads every number on the line starting at p, returns the start of the next line
+static const char * parseLineFloats(std::vector<float>& values, const char * p, const char * end) {
+   for (p = skipSpaces(p, end); p < end && !isNewLine(*p); p = skipSpaces(p, end)) {
+      float val;
+      if (!parseDecimal(p, end, val)) {
+         // Whatever this is, atof would have read it as 0
+         val = 0;
+         while (p < end && !isSpace(*p) && !isNewLine(*p))
+            p++;
+      }
+      values.push_back(val);
+   }
+   return nextLine(p, end);
+}
 
-      trimNewLine(linebuf);
+static bool isSkippedLine(const char * p, const char * end) {
+   p = skipSpaces(p, end);
+   return p == end || isNewLine(*p) || *p == '#';
+}
 
-      // Skip if empty line.
-      if (linebuf.empty())
+// The first line that isn't a comment holds "count numBones"
+static const char * parseNumBones(int& numBones, const char * p, const char * end) {
+   for (; p < end; p = nextLine(p, end)) {
+      if (isSkippedLine(p, end))
          continue;
 
-      // Skip leading space.
-      const char* token = linebuf.c_str();
-      token += strspn(token, " \t");
-
-      assert(token);
-      if (token[0] == '\0') continue; // empty line
-      if (token[0] == '#') continue;  // comment line
-
-      // parse the bones count
-      parseInt(token);
-      token++;
-      numBones = parseInt(token);
-      break;
+      std::vector<float> counts;
+      p = parseLineFloats(counts, p, end);
+      numBones = counts.size() > 1 ? (int)counts[1] : 0;
+      return p;
    }
+   return p;
 }
 
-void PIN_loadWeights(std::vector<float>& boneWeights,
-                     int& numBones,
-                     const char * path) {
-
-   std::stringstream err;
-   std::ifstream ifsATT(path);
-   if (!ifsATT) {
-      err << "Cannot open file [" << path << "]" << std::endl;
-      std::cerr << err.str();
+// Skeleton files have the bind pose on the line right after the counts, then
+// one frame per line. Weight files have one vertex per line after the counts.
+static void parsePIN(const char * path, bool hasBindPose, int& numBones,
+                     std::vector<float>& bindPose, std::vector<float>& values) {
+   MappedFile file;
+   if (!file.open(path)) {
+      std::cerr << "Cannot open file [" << path << "]" << std::endl;
       exit(1);
    }
 
-   std::istream& inStream = ifsATT;
-
-   parseNumBones(numBones, inStream);
+   const char * p = (const char *)file.data();
+   const char * end = p + file.size();
 
-   int maxchars = 8192;  // Alloc enough size.
-   std::vector<char> buf(maxchars);  // Alloc enough size.
+   numBones = 0;
+   p = parseNumBones(numBones, p, end);
+   if (hasBindPose)
+      p = parseLineFloats(bindPose, p, end);
 
-   while (inStream.peek() != -1) {
-      inStream.getline(&buf[0], maxchars);
-
-      std::string linebuf(&buf[0]);
-
-      trimNewLine(linebuf);
-
-      // Skip if empty line.
-      if (linebuf.empty())
-         continue;
-
-      // Skip leading space.
-      const char* token = linebuf.c_str();
-      token += strspn(token, " \t");
-
-      assert(token);
-      if (token[0] == '\0') continue; // empty line
-      if (token[0] == '#') continue;  // comment line
-
-      // Read the floats
-      while (!isNewLine(token[0])) {
-         if (!isSpace(token[0])) {
-            float val = parseFloat(token);
-            boneWeights.push_back(val);
-         } else
-            token++;
-      }
+   while (p < end) {
+      if (isSkippedLine(p, end))
+         p = nextLine(p, end);
+      else
+         p = parseLineFloats(values, p, end);
    }
 }
 
-static void parseBindPose(std::vector<float>& bindPose,
-                          std::istream& inStream) {
+static bool readCache(const std::string& cachePath, const struct stat& source, int& numBones,
+                      std::vector<float>& bindPose, std::vector<float>& values) {
+   MappedFile cache;
+   if (!cache.open(cachePath.c_str()) || cache.size() < sizeof(PINCacheHeader))
+      return false;
+
+   PINCacheHeader header;
+   memcpy(& header, cache.data(), sizeof(PINCacheHeader));
+
+   unsigned long long expected = sizeof(PINCacheHeader) +
+      sizeof(float) * ((unsigned long long)header.bindPoseCount + header.valueCount);
+   if (memcmp(header.magic, "PINC", 4) != 0 || header.version != PIN_CACHE_VERSION ||
+       header.sourceSize != (unsigned long long)source.st_size ||
+       header.sourceTime != (long long)source.st_mtime || cache.size() != expected)
+      return false;
+
+   const float * floats = (const float *)(cache.data() + sizeof(PINCacheHeader));
+   numBones = header.numBones;
+   bindPose.assign(floats, floats + header.bindPoseCount);
+   values.assign(floats + header.bindPoseCount, floats + header.bindPoseCount + header.valueCount);
+   return true;
+}
 
-   int maxchars = 8192;  // Alloc enough size.
-   std::vector<char> buf(maxchars);  // Alloc enough size.
+// Written to a temporary file first, so a cache is either complete or absent.
+// Not being able to write one (say a read only asset folder) is not an error.
+static void writeCache(const std::string& cachePath, const struct stat& source, int numBones,
+                       const std::vector<float>& bindPose, const std::vector<float>& values) {
+   std::string tempPath = cachePath + ".tmp";
+   FILE * fp = fopen(tempPath.c_str(), "wb");
+   if (!fp)
+      return;
+
+   PINCacheHeader header;
+   memset(& header, 0, sizeof(PINCacheHeader));
+   memcpy(header.magic, "PINC", 4);
+   header.version = PIN_CACHE_VERSION;
+   header.sourceSize = source.st_size;
+   header.sourceTime = source.st_mtime;
+   header.numBones = numBones;
+   header.bindPoseCount = bindPose.size();
+   header.valueCount = values.size();
+
+   bool ok = fwrite(& header, sizeof(PINCacheHeader), 1, fp) == 1;
+   ok = ok && fwrite(bindPose.data(), sizeof(float), bindPose.size(), fp) == bindPose.size();
+   ok = ok && fwrite(values.data(), sizeof(float), values.size(), fp) == values.size();
+   ok = (fclose(fp) == 0) && ok;
+
+   if (!ok || rename(tempPath.c_str(), cachePath.c_str()) != 0)
+      remove(tempPath.c_str());
+}
 
-   inStream.getline(&buf[0], maxchars);
-   std::string linebuf(&buf[0]);
+static void loadPIN(const char * path, bool hasBindPose, int& numBones,
+                    std::vector<float>& bindPose, std::vector<float>& values) {
+   struct stat source;
+   if (stat(path, & source) != 0) {
+      std::cerr << "Cannot open file [" << path << "]" << std::endl;
+      exit(1);
+   }
 
-   trimNewLine(linebuf);
+   std::string cachePath = std::string(path) + PIN_CACHE_EXTENSION;
+   if (readCache(cachePath, source, numBones, bindPose, values))
+      return;
 
-   // Skip leading space.
-   const char* token = linebuf.c_str();
-   token += strspn(token, " \t");
+   parsePIN(path, hasBindPose, numBones, bindPose, values);
+   writeCache(cachePath, source, numBones, bindPose, values);
+}
 
-   while (!isNewLine(token[0])) {
-      if (!isSpace(token[0])) {
-         float val = parseFloat(token);
-         bindPose.push_back(val);
-      } else
-         token++;
-   }
+void PIN_loadWeights(std::vector<float>& boneWeights,
+                     int& numBones,
+                     const char * path) {
+   std::vector<float> bindPose;
+   loadPIN(path, false, numBones, bindPose, boneWeights);
 }
 
 void PIN_loadSkeleton(std::vector<float>& frames,
                       std::vector<float>& bindPose,
                       int& numBones,
                       const char * path) {
-
-   std::stringstream err;
-   std::ifstream ifsSKEL(path);
-   if (!ifsSKEL) {
-      err << "Cannot open file [" << path << "]" << std::endl;
-      std::cerr << err.str();
-      exit(1);
-   }
-
-   std::istream& inStream = ifsSKEL;
-
-   parseNumBones(numBones, inStream);
-
-   int maxchars = 8192;  // Alloc enough size.
-   std::vector<char> buf(maxchars);  // Alloc enough size.
-
-   parseBindPose(bindPose, inStream);
-
-   while (inStream.peek() != -1) {
-      inStream.getline(&buf[0], maxchars);
-      std::string linebuf(&buf[0]);
-
-      trimNewLine(linebuf);
-
-      // Skip if empty line.
-      if (linebuf.empty())
-         continue;
-
-      // Skip leading space.
-      const char* token = linebuf.c_str();
-      token += strspn(token, " \t");
-
-      assert(token);
-      if (token[0] == '\0') continue; // empty line
-      if (token[0] == '#') continue;  // comment line
-
-      // Read the floats
-      while (!isNewLine(token[0])) {
-         if (!isSpace(token[0])) {
-            float val = parseFloat(token);
-            frames.push_back(val);
-         } else
-            token++;
-      }
-   }
+   loadPIN(path, true, numBones, bindPose, frames);
 }
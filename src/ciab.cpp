@@ -0,0 +1,398 @@
+#include "ciab.h"
+#include "anim_compress.h"
+
+#include <string.h>
+
+static_assert(sizeof(Key) == 11 * sizeof(float), "Key must match the ciab key layout");
+static_assert(sizeof(Eigen::Vector3f) == 3 * sizeof(float), "Vector3f must be packed");
+static_assert(sizeof(Eigen::Vector2f) == 2 * sizeof(float), "Vector2f must be packed");
+
+#define CIAB_MATRIX_SIZE (16 * sizeof(float))
+
+// Size of one ciab2 directory entry
+#define CIAB2_SECTION_SIZE (2 * sizeof(unsigned int) + 2 * sizeof(unsigned long long))
+
+// keyframes_q16 record sizes
+#define Q16_ANIM_HEADER_SIZE (4 * sizeof(unsigned int))
+#define Q16_BONE_RANGE_SIZE (12 * sizeof(float))
+#define Q16_KEY_SIZE (10 * sizeof(unsigned short))
+
+// Cursor over the file that refuses to step past the end of the buffer
+class FieldReader {
+public:
+   const unsigned char * ptr;
+   const unsigned char * end;
+
+   FieldReader(const unsigned char * data, size_t size)
+   : ptr(data), end(data + size) {}
+
+   bool canRead(size_t numBytes) const {
+      return numBytes <= size_t(end - ptr);
+   }
+
+   // Returns the current position and skips count elements of elemSize bytes
+   const unsigned char * take(size_t elemSize, size_t count) {
+      if (count && elemSize > size_t(end - ptr) / count)
+         return NULL;
+      const unsigned char * start = ptr;
+      ptr += elemSize * count;
+      return start;
+   }
+
+   bool readUint(unsigned int& val) {
+      const unsigned char * p = take(sizeof(unsigned int), 1);
+      if (!p)
+         return false;
+      memcpy(& val, p, sizeof(unsigned int));
+      return true;
+   }
+};
+
+CIABView::CIABView()
+: version(0), vertexCount(0), faceCount(0), boneCount(0), animationCount(0), presentFlags(0), error(NULL),
+  positions(NULL), normals(NULL), colors(NULL), uvs(NULL), tangents(NULL), bitangents(NULL),
+  indices(NULL), boneIndices(NULL), boneWeights(NULL), boneInfCounts(NULL),
+  vertexBlock(NULL), vertexStride(0), boneIndexSize(0),
+  boneTree(NULL), boneTreeSize(0) {}
+
+bool CIABView::hasField(int field) const {
+   return presentFlags & (1 << (field-1));
+}
+
+unsigned int CIABVertexStride(unsigned int boneIndexSize) {
+   return (VB_BONE_INDICES + MAX_INFLUENCES * boneIndexSize + 3) & ~3u;
+}
+
+static bool skipBoneTree(FieldReader& reader, unsigned int boneCount) {
+   unsigned int boneRoot;
+   if (!reader.readUint(boneRoot) || boneRoot >= boneCount)
+      return false;
+
+   for (unsigned int i = 0; i < boneCount; i++) {
+      unsigned int parent, childCount;
+      if (!reader.readUint(parent) || !reader.readUint(childCount))
+         return false;
+      if (parent != (unsigned int)-1 && parent >= boneCount)
+         return false;
+
+      const unsigned char * children = reader.take(sizeof(int), childCount);
+      if (!children || !reader.take(CIAB_MATRIX_SIZE, 2))
+         return false;
+
+      for (unsigned int j = 0; j < childCount; j++) {
+         unsigned int child;
+         memcpy(& child, children + j * sizeof(int), sizeof(int));
+         if (child >= boneCount)
+            return false;
+      }
+   }
+   return true;
+}
+
+static bool viewAnimations(FieldReader& reader, CIABView& view) {
+   for (unsigned int i = 0; i < view.animationCount; i++) {
+      CIABAnimationView anim;
+      if (!reader.readUint(anim.fps) || !reader.readUint(anim.keyCount))
+         return false;
+      anim.keys = (const Key *)reader.take(sizeof(Key), size_t(view.boneCount) * anim.keyCount);
+      anim.quantized = NULL;
+      anim.compressed = NULL;
+      anim.compressedSize = 0;
+      if (!anim.keys || anim.keyCount == 0 || anim.fps == 0)
+         return false;
+      view.animations.push_back(anim);
+   }
+   return true;
+}
+
+static bool viewQuantizedAnimations(FieldReader& reader, CIABView& view) {
+   for (unsigned int i = 0; i < view.animationCount; i++) {
+      CIABAnimationView anim;
+      anim.quantized = reader.ptr;
+      anim.keys = NULL;
+      anim.compressed = NULL;
+      anim.compressedSize = 0;
+      if (!reader.readUint(anim.fps) || !reader.readUint(anim.keyCount) ||
+          !reader.take(sizeof(unsigned int), 2))
+         return false;
+      if (anim.keyCount == 0 || anim.fps == 0)
+         return false;
+
+      size_t recordSize = Q16_ANIM_HEADER_SIZE + view.boneCount * Q16_BONE_RANGE_SIZE +
+                          size_t(view.boneCount) * anim.keyCount * Q16_KEY_SIZE;
+      size_t padding = (CIAB2_ALIGNMENT - recordSize % CIAB2_ALIGNMENT) % CIAB2_ALIGNMENT;
+      if (!reader.take(Q16_BONE_RANGE_SIZE, view.boneCount) ||
+          !reader.take(Q16_KEY_SIZE, size_t(view.boneCount) * anim.keyCount) ||
+          !reader.take(1, padding))
+         return false;
+      view.animations.push_back(anim);
+   }
+   return true;
+}
+
+static bool viewCompressedAnimations(FieldReader& reader, CIABView& view) {
+   for (unsigned int i = 0; i < view.animationCount; i++) {
+      CIABAnimationView anim;
+      const char * error;
+      anim.keys = NULL;
+      anim.quantized = NULL;
+      anim.compressed = reader.ptr;
+      if (!reader.canRead(AC_HEADER_SIZE))
+         return false;
+
+      AC::ClipHeader header = AC::ReadHeader(anim.compressed);
+      if (!AC::Parse(anim.compressed, reader.end - reader.ptr, error) || header.boneCount != view.boneCount)
+         return false;
+      anim.compressedSize = header.size;
+      anim.fps = header.fps;
+      anim.keyCount = header.frameCount;
+
+      size_t padding = (CIAB2_ALIGNMENT - header.size % CIAB2_ALIGNMENT) % CIAB2_ALIGNMENT;
+      if (!reader.take(1, header.size) || !reader.take(1, padding))
+         return false;
+      view.animations.push_back(anim);
+   }
+   return true;
+}
+
+// Points the view at one field or section, consuming it from the reader.
+// Returns false if the field doesn't fit in the reader or is malformed.
+static bool viewField(CIABView& view, int fieldType, FieldReader& reader, unsigned int format) {
+   unsigned int numVerts = view.vertexCount;
+   const unsigned char * field = NULL;
+
+   switch (fieldType) {
+      case POSITIONS:
+         field = reader.take(sizeof(Eigen::Vector3f), numVerts);
+         view.positions = (const Eigen::Vector3f *)field;
+         break;
+      case NORMALS:
+         field = reader.take(sizeof(Eigen::Vector3f), numVerts);
+         view.normals = (const Eigen::Vector3f *)field;
+         break;
+      case COLORS:
+         field = reader.take(sizeof(Eigen::Vector3f), numVerts);
+         view.colors = (const Eigen::Vector3f *)field;
+         break;
+      case TEXCOORDS:
+         field = reader.take(sizeof(Eigen::Vector2f), numVerts);
+         view.uvs = (const Eigen::Vector2f *)field;
+         break;
+      case TANGENTS:
+         field = reader.take(sizeof(Eigen::Vector3f), numVerts);
+         view.tangents = (const Eigen::Vector3f *)field;
+         break;
+      case BITANGENTS:
+         field = reader.take(sizeof(Eigen::Vector3f), numVerts);
+         view.bitangents = (const Eigen::Vector3f *)field;
+         break;
+      case INDICES:
+         field = reader.take(NUM_FACE_EDGES * sizeof(unsigned int), view.faceCount);
+         view.indices = (const unsigned int *)field;
+         break;
+      case BONE_INDICES:
+         field = reader.take(MAX_INFLUENCES * sizeof(unsigned int), numVerts);
+         view.boneIndices = (const unsigned int *)field;
+         break;
+      case BONE_WEIGHTS:
+         field = reader.take(MAX_INFLUENCES * sizeof(float), numVerts);
+         view.boneWeights = (const float *)field;
+         break;
+      case BONE_NUM_INF:
+         field = reader.take(sizeof(unsigned int), numVerts);
+         view.boneInfCounts = (const unsigned int *)field;
+         break;
+      case BONE_TREE:
+         field = reader.ptr;
+         if (!skipBoneTree(reader, view.boneCount))
+            return false;
+         view.boneTree = field;
+         view.boneTreeSize = reader.ptr - field;
+         break;
+      case ANIMATIONS:
+         field = reader.ptr;
+         if (!viewAnimations(reader, view))
+            return false;
+         break;
+      case VERTEX_BLOCK:
+         if (view.version < CIAB2_VERSION || (format != 1 && format != 2))
+            return false;
+         view.boneIndexSize = format;
+         view.vertexStride = CIABVertexStride(format);
+         field = reader.take(view.vertexStride, numVerts);
+         view.vertexBlock = field;
+         break;
+      case KEYFRAMES_Q16:
+         field = reader.ptr;
+         if (view.version < CIAB2_VERSION || !viewQuantizedAnimations(reader, view))
+            return false;
+         break;
+      case KEYFRAMES_COMPRESSED:
+         field = reader.ptr;
+         if (view.version < CIAB2_VERSION || !viewCompressedAnimations(reader, view))
+            return false;
+         break;
+      default:
+         return false;
+   }
+
+   return field != NULL;
+}
+
+// Revision 1, a stream of tagged fields after the counts
+static bool parseFields(CIABView& view, FieldReader& reader) {
+   while (reader.canRead(1)) {
+      int fieldType = *reader.take(1, 1);
+
+      if (fieldType >= VERTEX_BLOCK || !viewField(view, fieldType, reader, 0)) {
+         view.error = "invalid field tag, or field runs past the end of the file";
+         return false;
+      }
+      view.presentFlags |= 1 << (fieldType-1);
+   }
+   return true;
+}
+
+// Revision 2, a directory of aligned sections found by offset
+static bool parseSections(CIABView& view, const unsigned char * data, size_t size) {
+   FieldReader reader(data, size);
+   unsigned int sectionCount;
+
+   reader.take(1, 4); // magic
+   if (!reader.readUint(view.version) || view.version != CIAB2_VERSION) {
+      view.error = "unsupported ciab version";
+      return false;
+   }
+   if (!reader.readUint(view.vertexCount) || !reader.readUint(view.faceCount) ||
+       !reader.readUint(view.boneCount) || !reader.readUint(view.animationCount) ||
+       !reader.readUint(view.presentFlags) || !reader.readUint(sectionCount) ||
+       !reader.canRead(size_t(sectionCount) * CIAB2_SECTION_SIZE)) {
+      view.error = "file is too short for the ciab2 header";
+      return false;
+   }
+
+   // The header flags which vertex attributes hold real data, since the vertex
+   // block always has room for all of them. Sections get flagged as they are found.
+   unsigned int attribFlags = view.presentFlags & ((1 << BONE_NUM_INF) - 1) & ~(1 << (INDICES-1));
+   view.presentFlags = 0;
+
+   for (unsigned int i = 0; i < sectionCount; i++) {
+      unsigned int sectionType, format;
+      unsigned long long offset, secSize;
+      reader.readUint(sectionType);
+      reader.readUint(format);
+      memcpy(& offset, reader.take(sizeof(offset), 1), sizeof(offset));
+      memcpy(& secSize, reader.take(sizeof(secSize), 1), sizeof(secSize));
+
+      if (offset % CIAB2_ALIGNMENT || offset > size || secSize > size - offset) {
+         view.error = "section is misaligned or runs past the end of the file";
+         return false;
+      }
+
+      // Sections from later revisions are skipped, that's what the directory is for
+      if (sectionType == 0 || sectionType > KEYFRAMES_COMPRESSED)
+         continue;
+
+      FieldReader section(data + offset, secSize);
+      if (!viewField(view, sectionType, section, format) || section.canRead(1)) {
+         view.error = "section is malformed or has the wrong size";
+         return false;
+      }
+      view.presentFlags |= 1 << (sectionType-1);
+   }
+
+   if (attribFlags & ~view.presentFlags && !view.vertexBlock) {
+      view.error = "header flags attributes that have no section";
+      return false;
+   }
+   view.presentFlags |= attribFlags;
+   return true;
+}
+
+bool CIABView::parse(const unsigned char * data, size_t size) {
+   presentFlags = 0;
+   animations.clear();
+
+   if (size >= 4 && memcmp(data, CIAB2_MAGIC, 4) == 0) {
+      if (!parseSections(*this, data, size))
+         return false;
+   } else {
+      FieldReader reader(data, size);
+      version = 1;
+      if (!reader.readUint(vertexCount) || !reader.readUint(faceCount) ||
+          !reader.readUint(boneCount) || !reader.readUint(animationCount)) {
+         error = "file is too short for the ciab header";
+         return false;
+      }
+      if (!parseFields(*this, reader))
+         return false;
+   }
+
+   if (!(positions || vertexBlock) || !indices) {
+      error = "file does not have positions and/or indices";
+      return false;
+   }
+   if ((hasField(ANIMATIONS) || hasField(KEYFRAMES_Q16) || hasField(KEYFRAMES_COMPRESSED)) &&
+       animations.size() != animationCount) {
+      error = "file has more than one animation section";
+      return false;
+   }
+
+   // Every index has to land on a vertex before anything trusts the views
+   for (unsigned int i = 0; i < NUM_FACE_EDGES * faceCount; i++) {
+      unsigned int index;
+      memcpy(& index, & indices[i], sizeof(unsigned int));
+      if (index >= vertexCount) {
+         error = "face index out of range";
+         return false;
+      }
+   }
+
+   return true;
+}
+
+void CIABView::decodeKeys(const CIABAnimationView& anim, Key * keys) const {
+   const unsigned char * ranges = anim.quantized + Q16_ANIM_HEADER_SIZE;
+   const unsigned char * keyData = ranges + boneCount * Q16_BONE_RANGE_SIZE;
+
+   for (unsigned int b = 0; b < boneCount; b++) {
+      float range[12]; // posMin, posStep, sclMin, sclStep
+      memcpy(range, ranges + b * Q16_BONE_RANGE_SIZE, Q16_BONE_RANGE_SIZE);
+
+      for (unsigned int k = 0; k < anim.keyCount; k++) {
+         Key * key = & keys[b * anim.keyCount + k];
+         unsigned short q[10];
+         memcpy(q, keyData + (size_t(b) * anim.keyCount + k) * Q16_KEY_SIZE, Q16_KEY_SIZE);
+
+         key->time = 1.0f * k / anim.fps;
+         for (int c = 0; c < 3; c++) {
+            key->position(c) = range[c] + q[c] * range[3+c];
+            key->scale(c) = range[6+c] + q[7+c] * range[9+c];
+         }
+         key->rotation = Eigen::Quaternionf((short)q[6] / 32767.0f, (short)q[3] / 32767.0f,
+                                            (short)q[4] / 32767.0f, (short)q[5] / 32767.0f);
+         key->rotation.normalize();
+      }
+   }
+}
+
+void CIABView::readBones(std::vector<Bone>& bones, unsigned int& boneRoot) const {
+   // The records were bounds checked by parse(), so read without checking again
+   FieldReader reader(boneTree, boneTreeSize);
+   reader.readUint(boneRoot);
+
+   bones = std::vector<Bone>(boneCount);
+   for (unsigned int i = 0; i < boneCount; i++) {
+      Bone * bone = & bones[i];
+      unsigned int childCount = 0;
+      memcpy(& bone->parentIndex, reader.take(sizeof(int), 1), sizeof(int));
+      reader.readUint(childCount);
+
+      bone->childIndices = std::vector<int>(childCount);
+      if (childCount)
+         memcpy(bone->childIndices.data(), reader.take(sizeof(int), childCount), childCount * sizeof(int));
+
+      memcpy(bone->invBonePose.data(), reader.take(CIAB_MATRIX_SIZE, 1), CIAB_MATRIX_SIZE);
+      memcpy(bone->parentOffset.data(), reader.take(CIAB_MATRIX_SIZE, 1), CIAB_MATRIX_SIZE);
+   }
+}
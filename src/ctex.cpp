@@ -0,0 +1,490 @@
+#include "ctex.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+
+using namespace TX;
+
+#define CTEX_HEADER_SIZE 24
+#define CTEX_LEVEL_ENTRY_SIZE 16
+#define CTEX_MAX_LEVELS 32
+#define DIFFUSE_GAMMA 2.2f
+
+static const char CTEX_MAGIC[4] = {'C', 'T', 'E', 'X'};
+
+// ========================================================== //
+// ==================== STATIC FUNCTIONS ==================== //
+// ========================================================== //
+
+static unsigned int alignUp(unsigned int value) {
+   return (value + CTEX_ALIGNMENT - 1) & ~(CTEX_ALIGNMENT - 1);
+}
+
+static void writeU16(unsigned char * out, unsigned int value) {
+   out[0] = value & 0xff;
+   out[1] = (value >> 8) & 0xff;
+}
+
+static unsigned int readU16(const unsigned char * in) {
+   return in[0] | (in[1] << 8);
+}
+
+static unsigned int readU32(const unsigned char * in) {
+   return in[0] | (in[1] << 8) | (in[2] << 16) | ((unsigned int)in[3] << 24);
+}
+
+static void putU32(std::vector<unsigned char>& out, unsigned int value) {
+   for (int i = 0; i < 4; i++)
+      out.push_back((value >> (8 * i)) & 0xff);
+}
+
+static unsigned int pack565(const float color[3]) {
+   int r = std::min(31, std::max(0, (int)(color[0] * 31.0f / 255.0f + 0.5f)));
+   int g = std::min(63, std::max(0, (int)(color[1] * 63.0f / 255.0f + 0.5f)));
+   int b = std::min(31, std::max(0, (int)(color[2] * 31.0f / 255.0f + 0.5f)));
+   return (r << 11) | (g << 5) | b;
+}
+
+static void unpack565(unsigned int c, int color[3]) {
+   int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+   color[0] = (r << 3) | (r >> 2);
+   color[1] = (g << 2) | (g >> 4);
+   color[2] = (b << 3) | (b >> 2);
+}
+
+static void bc1Palette(unsigned int c0, unsigned int c1, int palette[4][3]) {
+   unpack565(c0, palette[0]);
+   unpack565(c1, palette[1]);
+   for (int i = 0; i < 3; i++) {
+      palette[2][i] = (2 * palette[0][i] + palette[1][i]) / 3;
+      palette[3][i] = (palette[0][i] + 2 * palette[1][i]) / 3;
+   }
+}
+
+static void bc4Palette(int a0, int a1, int palette[8]) {
+   palette[0] = a0;
+   palette[1] = a1;
+   if (a0 > a1) {
+      for (int i = 2; i < 8; i++)
+         palette[i] = ((8 - i) * a0 + (i - 1) * a1) / 7;
+   } else {
+      for (int i = 2; i < 6; i++)
+         palette[i] = ((6 - i) * a0 + (i - 1) * a1) / 5;
+      palette[6] = 0;
+      palette[7] = 255;
+   }
+}
+
+// Main axis of the block's colors, by power iteration on their covariance
+static void principalAxis(const float colors[16][3], const float mean[3], float axis[3]) {
+   float cov[6] = {0, 0, 0, 0, 0, 0};
+   for (int i = 0; i < 16; i++) {
+      float r = colors[i][0] - mean[0], g = colors[i][1] - mean[1], b = colors[i][2] - mean[2];
+      cov[0] += r*r; cov[1] += r*g; cov[2] += r*b;
+      cov[3] += g*g; cov[4] += g*b; cov[5] += b*b;
+   }
+
+   axis[0] = axis[1] = axis[2] = 1;
+   for (int iter = 0; iter < 8; iter++) {
+      float x = cov[0]*axis[0] + cov[1]*axis[1] + cov[2]*axis[2];
+      float y = cov[1]*axis[0] + cov[3]*axis[1] + cov[4]*axis[2];
+      float z = cov[2]*axis[0] + cov[4]*axis[1] + cov[5]*axis[2];
+      float len = std::max(fabsf(x), std::max(fabsf(y), fabsf(z)));
+      if (len == 0)
+         return;
+      axis[0] = x / len;
+      axis[1] = y / len;
+      axis[2] = z / len;
+   }
+}
+
+// Gathers the 4x4 block at (bx, by), repeating the edge pixels past the image
+static void readBlock(const unsigned char * rgba, unsigned int width, unsigned int height,
+                      unsigned int bx, unsigned int by, unsigned char block[64]) {
+   for (unsigned int y = 0; y < 4; y++)
+      for (unsigned int x = 0; x < 4; x++) {
+         unsigned int px = std::min(4 * bx + x, width - 1);
+         unsigned int py = std::min(4 * by + y, height - 1);
+         memcpy(& block[4 * (4*y + x)], & rgba[4 * (py * width + px)], 4);
+      }
+}
+
+static void writeBlock(unsigned char * rgba, unsigned int width, unsigned int height,
+                       unsigned int bx, unsigned int by, const unsigned char block[64]) {
+   for (unsigned int y = 0; y < 4 && 4 * by + y < height; y++)
+      for (unsigned int x = 0; x < 4 && 4 * bx + x < width; x++)
+         memcpy(& rgba[4 * ((4*by + y) * width + 4*bx + x)], & block[4 * (4*y + x)], 4);
+}
+
+static void encodeBlock(Format format, const unsigned char block[64], unsigned char * out) {
+   switch (format) {
+      case BC1:
+         EncodeBC1(block, out);
+         break;
+      case BC3:
+         EncodeBC4(block, 3, out);
+         EncodeBC1(block, out + 8);
+         break;
+      case BC4:
+         EncodeBC4(block, 0, out);
+         break;
+      case BC5:
+         EncodeBC4(block, 0, out);
+         EncodeBC4(block, 1, out + 8);
+         break;
+      default:
+         break;
+   }
+}
+
+// Pixels as floats, linear for diffuse maps and unit vectors for normal maps,
+// so the mips average what is actually lit rather than the stored bytes
+static void toWorking(const unsigned char * rgba, unsigned int count, Usage usage, std::vector<float>& out) {
+   out.resize(4 * count);
+   for (unsigned int i = 0; i < 4 * count; i++) {
+      float v = rgba[i] / 255.0f;
+      if (usage == DIFFUSE && i % 4 != 3)
+         v = powf(v, DIFFUSE_GAMMA);
+      else if (usage == NORMAL && i % 4 != 3)
+         v = 2 * v - 1;
+      out[i] = v;
+   }
+}
+
+static void fromWorking(const std::vector<float>& in, Usage usage, std::vector<unsigned char>& rgba) {
+   rgba.resize(in.size());
+   for (unsigned int i = 0; i < in.size(); i += 4) {
+      float p[4] = {in[i], in[i+1], in[i+2], in[i+3]};
+
+      if (usage == NORMAL) {
+         float len = sqrtf(p[0]*p[0] + p[1]*p[1] + p[2]*p[2]);
+         for (int c = 0; c < 3; c++)
+            p[c] = 0.5f * (len > 0 ? p[c] / len : (c == 2)) + 0.5f;
+      } else if (usage == DIFFUSE) {
+         for (int c = 0; c < 3; c++)
+            p[c] = powf(std::max(0.0f, p[c]), 1.0f / DIFFUSE_GAMMA);
+      }
+
+      for (int c = 0; c < 4; c++)
+         rgba[i+c] = (unsigned char)std::min(255.0f, std::max(0.0f, p[c] * 255.0f + 0.5f));
+   }
+}
+
+// 2x2 box filter, an odd row or column is folded into its neighbor
+static void halve(const std::vector<float>& in, unsigned int width, unsigned int height,
+                  std::vector<float>& out, unsigned int& outWidth, unsigned int& outHeight) {
+   outWidth = std::max(1u, width / 2);
+   outHeight = std::max(1u, height / 2);
+   out.assign(4 * outWidth * outHeight, 0);
+
+   for (unsigned int y = 0; y < outHeight; y++)
+      for (unsigned int x = 0; x < outWidth; x++) {
+         unsigned int x0 = std::min(2*x, width - 1), x1 = std::min(2*x + 1, width - 1);
+         unsigned int y0 = std::min(2*y, height - 1), y1 = std::min(2*y + 1, height - 1);
+         for (int c = 0; c < 4; c++)
+            out[4 * (y*outWidth + x) + c] = 0.25f * (in[4 * (y0*width + x0) + c] + in[4 * (y0*width + x1) + c] +
+                                                     in[4 * (y1*width + x0) + c] + in[4 * (y1*width + x1) + c]);
+      }
+}
+
+static void compressLevel(const unsigned char * rgba, unsigned int width, unsigned int height,
+                          Format format, unsigned char * out) {
+   unsigned int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+   unsigned char block[64];
+
+   for (unsigned int by = 0; by < blocksY; by++)
+      for (unsigned int bx = 0; bx < blocksX; bx++) {
+         readBlock(rgba, width, height, bx, by, block);
+         encodeBlock(format, block, out + BlockSize(format) * (by * blocksX + bx));
+      }
+}
+
+// ========================================================== //
+// ==================== PUBLIC FUNCTIONS ==================== //
+// ========================================================== //
+
+namespace TX {
+
+   unsigned int BlockSize(Format format) {
+      return (format == BC1 || format == BC4) ? 8 : 16;
+   }
+
+   unsigned int LevelSize(Format format, unsigned int width, unsigned int height) {
+      if (format == RGB8)
+         return 3 * width * height;
+      return BlockSize(format) * ((width + 3) / 4) * ((height + 3) / 4);
+   }
+
+   void EncodeBC1(const unsigned char rgba[64], unsigned char out[8]) {
+      float colors[16][3], mean[3] = {0, 0, 0}, axis[3];
+      for (int i = 0; i < 16; i++)
+         for (int c = 0; c < 3; c++) {
+            colors[i][c] = rgba[4*i + c];
+            mean[c] += colors[i][c] / 16.0f;
+         }
+      principalAxis(colors, mean, axis);
+
+      // The extremes along the axis, pulled in a little since the ends are rarely hit exactly
+      float lowT = 1e30f, highT = -1e30f;
+      for (int i = 0; i < 16; i++) {
+         float t = (colors[i][0] - mean[0]) * axis[0] + (colors[i][1] - mean[1]) * axis[1] +
+                   (colors[i][2] - mean[2]) * axis[2];
+         lowT = std::min(lowT, t);
+         highT = std::max(highT, t);
+      }
+      float inset = (highT - lowT) / 16.0f;
+      float axisLenSq = axis[0]*axis[0] + axis[1]*axis[1] + axis[2]*axis[2];
+      float low[3], high[3];
+      for (int c = 0; c < 3; c++) {
+         float scale = axisLenSq > 0 ? axis[c] / axisLenSq : 0;
+         low[c] = mean[c] + (lowT + inset) * scale;
+         high[c] = mean[c] + (highT - inset) * scale;
+      }
+
+      // c0 > c1 selects the four color mode
+      unsigned int c0 = pack565(high), c1 = pack565(low);
+      if (c0 < c1)
+         std::swap(c0, c1);
+
+      unsigned int indices = 0;
+      if (c0 != c1) {
+         int palette[4][3];
+         bc1Palette(c0, c1, palette);
+
+         for (int i = 0; i < 16; i++) {
+            int best = 0, bestDist = 1 << 30;
+            for (int p = 0; p < 4; p++) {
+               int dr = palette[p][0] - rgba[4*i], dg = palette[p][1] - rgba[4*i+1], db = palette[p][2] - rgba[4*i+2];
+               int dist = dr*dr + dg*dg + db*db;
+               if (dist < bestDist) {
+                  bestDist = dist;
+                  best = p;
+               }
+            }
+            indices |= best << (2 * i);
+         }
+      }
+
+      writeU16(out, c0);
+      writeU16(out + 2, c1);
+      writeU16(out + 4, indices & 0xffff);
+      writeU16(out + 6, indices >> 16);
+   }
+
+   void EncodeBC4(const unsigned char rgba[64], int channel, unsigned char out[8]) {
+      int low = 255, high = 0;
+      for (int i = 0; i < 16; i++) {
+         low = std::min(low, (int)rgba[4*i + channel]);
+         high = std::max(high, (int)rgba[4*i + channel]);
+      }
+
+      // a0 > a1 selects the eight value mode, equal ends leave every index at 0
+      unsigned long long indices = 0;
+      if (high > low) {
+         int palette[8];
+         bc4Palette(high, low, palette);
+
+         for (int i = 0; i < 16; i++) {
+            int best = 0, bestDist = 1 << 30;
+            for (int p = 0; p < 8; p++) {
+               int dist = abs(palette[p] - rgba[4*i + channel]);
+               if (dist < bestDist) {
+                  bestDist = dist;
+                  best = p;
+               }
+            }
+            indices |= (unsigned long long)best << (3 * i);
+         }
+      }
+
+      out[0] = high;
+      out[1] = low;
+      for (int i = 0; i < 6; i++)
+         out[2 + i] = (indices >> (8 * i)) & 0xff;
+   }
+
+   void DecodeBC1(const unsigned char block[8], unsigned char rgba[64]) {
+      unsigned int c0 = readU16(block), c1 = readU16(block + 2);
+      unsigned int indices = readU32(block + 4);
+      int palette[4][3];
+      bc1Palette(c0, c1, palette);
+
+      // Three colors and transparent black
+      if (c0 <= c1)
+         for (int c = 0; c < 3; c++) {
+            palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+            palette[3][c] = 0;
+         }
+
+      for (int i = 0; i < 16; i++) {
+         int p = (indices >> (2 * i)) & 3;
+         for (int c = 0; c < 3; c++)
+            rgba[4*i + c] = palette[p][c];
+         rgba[4*i + 3] = (c0 <= c1 && p == 3) ? 0 : 255;
+      }
+   }
+
+   void DecodeBC4(const unsigned char block[8], int channel, unsigned char rgba[64]) {
+      int palette[8];
+      bc4Palette(block[0], block[1], palette);
+
+      unsigned long long indices = 0;
+      for (int i = 0; i < 6; i++)
+         indices |= (unsigned long long)block[2 + i] << (8 * i);
+
+      for (int i = 0; i < 16; i++)
+         rgba[4*i + channel] = palette[(indices >> (3 * i)) & 7];
+   }
+
+   void Bake(const unsigned char * rgba, unsigned int width, unsigned int height, Usage usage,
+             Format& format, std::vector<Level>& levels, std::vector<unsigned char>& data) {
+      format = usage == NORMAL ? BC5 : usage == SPECULAR ? BC4 : BC1;
+      if (usage == DIFFUSE)
+         for (unsigned int i = 0; i < width * height; i++)
+            if (rgba[4*i + 3] != 255) {
+               format = BC3;
+               break;
+            }
+
+      levels.clear();
+      data.clear();
+
+      std::vector<float> working, next;
+      std::vector<unsigned char> pixels(rgba, rgba + 4 * width * height);
+      toWorking(rgba, width * height, usage, working);
+
+      while (true) {
+         Level level;
+         level.width = width;
+         level.height = height;
+         level.offset = alignUp(data.size());
+         level.size = LevelSize(format, width, height);
+         levels.push_back(level);
+
+         data.resize(level.offset + level.size, 0);
+         compressLevel(pixels.data(), width, height, format, & data[level.offset]);
+
+         if (width == 1 && height == 1)
+            break;
+
+         halve(working, width, height, next, width, height);
+         working.swap(next);
+         fromWorking(working, usage, pixels);
+      }
+   }
+
+   void DecodeLevel(Format format, const Level& level, const unsigned char * data,
+                    std::vector<unsigned char>& rgba) {
+      unsigned int blocksX = (level.width + 3) / 4, blocksY = (level.height + 3) / 4;
+      const unsigned char * blocks = data + level.offset;
+      unsigned char block[64];
+
+      rgba.assign(4 * level.width * level.height, 0);
+      for (unsigned int by = 0; by < blocksY; by++)
+         for (unsigned int bx = 0; bx < blocksX; bx++) {
+            const unsigned char * in = blocks + BlockSize(format) * (by * blocksX + bx);
+            memset(block, 0, sizeof(block));
+
+            if (format == BC1) {
+               DecodeBC1(in, block);
+            } else if (format == BC3) {
+               DecodeBC1(in + 8, block);
+               DecodeBC4(in, 3, block);
+            } else if (format == BC4) {
+               DecodeBC4(in, 0, block);
+               for (int i = 0; i < 16; i++) {
+                  block[4*i + 1] = block[4*i + 2] = block[4*i];
+                  block[4*i + 3] = 255;
+               }
+            } else if (format == BC5) {
+               DecodeBC4(in, 0, block);
+               DecodeBC4(in + 8, 1, block);
+               for (int i = 0; i < 16; i++)
+                  block[4*i + 3] = 255;
+            }
+
+            writeBlock(rgba.data(), level.width, level.height, bx, by, block);
+         }
+   }
+
+   bool WriteFile(const char * path, Format format, const std::vector<Level>& levels,
+                  const std::vector<unsigned char>& data) {
+      unsigned int dataStart = alignUp(CTEX_HEADER_SIZE + CTEX_LEVEL_ENTRY_SIZE * levels.size());
+
+      std::vector<unsigned char> header(CTEX_MAGIC, CTEX_MAGIC + 4);
+      putU32(header, CTEX_VERSION);
+      putU32(header, format);
+      putU32(header, levels[0].width);
+      putU32(header, levels[0].height);
+      putU32(header, levels.size());
+      for (unsigned int i = 0; i < levels.size(); i++) {
+         putU32(header, levels[i].width);
+         putU32(header, levels[i].height);
+         putU32(header, dataStart + levels[i].offset);
+         putU32(header, levels[i].size);
+      }
+      header.resize(dataStart, 0);
+
+      FILE * fp = fopen(path, "wb");
+      if (!fp)
+         return false;
+
+      bool ok = fwrite(header.data(), 1, header.size(), fp) == header.size() &&
+                fwrite(data.data(), 1, data.size(), fp) == data.size();
+      return fclose(fp) == 0 && ok;
+   }
+
+   bool Parse(const unsigned char * file, size_t size, Format& format,
+              std::vector<Level>& levels, const unsigned char *& data, const char *& error) {
+      if (size < CTEX_HEADER_SIZE || memcmp(file, CTEX_MAGIC, 4) != 0) {
+         error = "not a ctex file";
+         return false;
+      }
+      if (readU32(file + 4) != CTEX_VERSION) {
+         error = "unsupported ctex version";
+         return false;
+      }
+
+      unsigned int fmt = readU32(file + 8);
+      if (fmt != BC1 && fmt != BC3 && fmt != BC4 && fmt != BC5) {
+         error = "unknown texture format";
+         return false;
+      }
+      format = (Format)fmt;
+
+      unsigned int width = readU32(file + 12), height = readU32(file + 16);
+      unsigned int levelCount = readU32(file + 20);
+      if (width == 0 || height == 0 || levelCount == 0 || levelCount > CTEX_MAX_LEVELS ||
+          CTEX_HEADER_SIZE + CTEX_LEVEL_ENTRY_SIZE * levelCount > size) {
+         error = "bad header";
+         return false;
+      }
+
+      levels.resize(levelCount);
+      for (unsigned int i = 0; i < levelCount; i++) {
+         const unsigned char * entry = file + CTEX_HEADER_SIZE + CTEX_LEVEL_ENTRY_SIZE * i;
+         Level * level = & levels[i];
+         level->width = readU32(entry);
+         level->height = readU32(entry + 4);
+         level->offset = readU32(entry + 8);
+         level->size = readU32(entry + 12);
+
+         // Every level halves the one before it, down to 1 pixel
+         if (level->width != width || level->height != height ||
+             level->size != LevelSize(format, width, height) ||
+             level->offset % CTEX_ALIGNMENT != 0 || level->offset > size || level->size > size - level->offset) {
+            error = "bad level table";
+            return false;
+         }
+         width = std::max(1u, width / 2);
+         height = std::max(1u, height / 2);
+      }
+
+      data = file;
+      return true;
+   }
+
+}
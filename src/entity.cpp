@@ -1,4 +1,5 @@
 #include "entity.h"
+#include "camera.h"
 #include "matrix_math.h"
 #include "animation.h"
 
@@ -84,6 +85,8 @@ StaticEntity::StaticEntity(Eigen::Vector3f pos, Model * model)
 }
 
 void StaticEntity::initializePhysics() {
+   lodLevel = 0;
+
    linearMomentum = Eigen::Vector3f(0,0,0);
    angularMomentum = Eigen::Vector3f(0,0,0);
 
@@ -137,26 +140,233 @@ Eigen::Matrix4f StaticEntity::generateModelM() {
    return Mmath::TransformationMatrix(position, rotation, scale);
 }
 
+unsigned int StaticEntity::chooseLOD(Camera * camera) {
+   if (model->lodCount() == 1)
+      return 0;
+
+   lodLevel = model->selectLOD(screenSize(camera), lodLevel);
+   return lodLevel;
+}
+
+float StaticEntity::screenSize(Camera * camera) {
+   Eigen::Vector4f center = generateModelM() * Eigen::Vector4f(model->boundCenter(0), model->boundCenter(1), model->boundCenter(2), 1);
+   float radius = model->boundRadius * scale.cwiseAbs().maxCoeff();
+   float distance = (center.head<3>() - camera->position).norm();
+
+   // Half the projected diameter over the NDC height of 2, inside the sphere counts as filling the screen
+   return distance > radius ? radius * camera->getProjectionM()(1,1) / distance : 1;
+}
+
+// The frustum planes come straight from the rows of the projection * view matrix
+bool StaticEntity::inView(Camera * camera) {
+   Eigen::Vector4f center = generateModelM() * Eigen::Vector4f(model->boundCenter(0), model->boundCenter(1), model->boundCenter(2), 1);
+   float radius = model->boundRadius * scale.cwiseAbs().maxCoeff();
+   Eigen::Matrix4f projViewM = camera->getProjectionM() * camera->getViewM();
+   center(3) = 1;
+
+   for (int i = 0; i < 6; i++) {
+      Eigen::Vector4f plane = projViewM.row(3) + (i % 2 ? -1.0f : 1.0f) * projViewM.row(i / 2);
+      if (plane.dot(center) < -radius * plane.head<3>().norm())
+         return false;
+   }
+   return true;
+}
+
 // --------------------------------------------------------- //
 // ==================== Animated Entity ==================== //
 // --------------------------------------------------------- //
 AnimatedEntity::AnimatedEntity(Eigen::Vector3f pos, Eigen::Quaternionf rot, Eigen::Vector3f scl, Model * model)
 : StaticEntity(pos, rot, scl, model) {
-   for (int i = 0; i < MAX_BONES; i++)
-      this->animMs[i] = Eigen::Matrix4f::Identity();
+   initializeAnimation();
 }
 AnimatedEntity::AnimatedEntity(Eigen::Vector3f pos, Eigen::Quaternionf rot, Model * model)
 : StaticEntity(pos, rot, model) {
-   for (int i = 0; i < MAX_BONES; i++)
-      this->animMs[i] = Eigen::Matrix4f::Identity();
+   initializeAnimation();
 }
 AnimatedEntity::AnimatedEntity(Eigen::Vector3f pos, Model * model)
 : StaticEntity(pos, model) {
-   for (int i = 0; i < MAX_BONES; i++)
-      this->animMs[i] = Eigen::Matrix4f::Identity();
+   initializeAnimation();
 }
 AnimatedEntity::~AnimatedEntity() {}
 
+void AnimatedEntity::initializeAnimation() {
+   this->animMs = std::vector<Mmath::Matrix3x4f>(model->boneCount, Mmath::Matrix3x4f::Identity());
+   this->keyframeMs = std::vector<Mmath::Matrix3x4f>(model->boneCount, Mmath::Matrix3x4f::Identity());
+   this->poseCache = NULL;
+   this->rootMotion = false;
+
+   this->pendingMotion = Eigen::Vector3f(0,0,0);
+   this->tickMotion = Eigen::Vector3f(0,0,0);
+   this->motionApplied = 0;
+   this->ticked = false;
+
+   transition.mode = LAYER_OVERRIDE;
+   transition.weight = 1;
+}
+
+unsigned int AnimatedEntity::addLayer(LayerMode mode) {
+   AnimLayer layer;
+   layer.mode = mode;
+   layer.weight = 1;
+   layers.push_back(layer);
+   return layers.size() - 1;
+}
+
+void AnimatedEntity::setLayerMask(unsigned int layer, int boneNum, bool isRecursive, float weight) {
+   std::vector<float> * mask = & layers[layer].boneWeights;
+   if (mask->empty())
+      *mask = std::vector<float>(model->boneCount, 0);
+   (*mask)[boneNum] = weight;
+
+   if (isRecursive)
+      for (int i = 0; i < model->bones[boneNum].childIndices.size(); i++)
+         setLayerMask(layer, model->bones[boneNum].childIndices[i], isRecursive, weight);
+}
+
+const Mmath::Matrix3x4f * AnimatedEntity::drawnAnimMs() {
+   return palette ? palette->animMs.data() : animMs.data();
+}
+
+void AnimatedEntity::endTick() {
+   const Mmath::Matrix3x4f * drawn = drawnAnimMs();
+
+   prevTickMs.swap(lastTickMs);
+   lastTickMs.assign(drawn, drawn + model->boneCount);
+   prevTickPalette = lastTickPalette;
+   lastTickPalette = palette;
+   if (prevTickMs.size() != lastTickMs.size()) {
+      prevTickMs = lastTickMs;
+      prevTickPalette = lastTickPalette;
+   }
+
+   // The rest of the tick before, then the new one moves the entity as it is drawn
+   position += (1 - motionApplied) * tickMotion;
+   tickMotion = pendingMotion;
+   pendingMotion = Eigen::Vector3f(0,0,0);
+   motionApplied = 0;
+   ticked = true;
+}
+
+// Lerping the matrices shrinks the bones a little mid turn, which at tick
+// rates of 30 and up is too small to see
+void AnimatedEntity::interpolatePose(float alpha) {
+   if (lastTickMs.empty())
+      return;
+
+   position += (alpha - motionApplied) * tickMotion;
+   motionApplied = alpha;
+
+   // Entities in step ticked into the same two palettes, so they draw the same blend of them
+   if (poseCache && prevTickPalette && lastTickPalette) {
+      BlendKey key = PoseCache::Blend(prevTickPalette, lastTickPalette, alpha);
+      if (prevTickPalette == lastTickPalette || key.step >= POSE_BLEND_STEPS) {
+         palette = lastTickPalette;
+      } else if (key.step <= 0) {
+         palette = prevTickPalette;
+      } else {
+         bool evaluate;
+         palette = poseCache->acquire(key, prevTickPalette, lastTickPalette, evaluate);
+         if (evaluate) {
+            const std::vector<Mmath::Matrix3x4f>& from = prevTickPalette->animMs;
+            const std::vector<Mmath::Matrix3x4f>& to = lastTickPalette->animMs;
+            float blend = PoseCache::BlendAlpha(key);
+
+            palette->animMs.resize(to.size());
+            for (unsigned int i = 0; i < to.size(); i++)
+               palette->animMs[i] = from[i] + blend * (to[i] - from[i]);
+         }
+      }
+      return;
+   }
+
+   for (unsigned int i = 0; i < lastTickMs.size(); i++)
+      animMs[i] = prevTickMs[i] + alpha * (lastTickMs[i] - prevTickMs[i]);
+   palette.reset();
+}
+
+void AnimatedEntity::moveByRoot(int animNum, float fromTime, float timeDelta) {
+   if (!rootMotion)
+      return;
+
+   Eigen::Vector3f moved = AN::TrackDisplacement(model->animations[animNum], model->boneRoot, fromTime, timeDelta);
+   moved(1) = 0;
+   moved = rotation * scale.cwiseProduct(moved);
+
+   if (ticked)
+      pendingMotion += moved;
+   else
+      position += moved;
+}
+
+// Only along the floor, the root still bobs up and down
+void AnimatedEntity::pinRoot(int animNum, bool chained) {
+   if (!rootMotion)
+      return;
+
+   int root = model->boneRoot;
+   Eigen::Vector3f offset = keyframeMs[root].col(3) - AN::SampleBonePose(model->animations[animNum], root, 0).position;
+   offset(1) = 0;
+
+   if (chained) {
+      keyframeMs[root].col(3) -= offset;
+   } else {
+      for (int i = 0; i < model->boneCount; i++)
+         keyframeMs[i].col(3) -= offset;
+   }
+}
+
+bool AnimatedEntity::isBlending() {
+   if (!transition.clips.empty())
+      return true;
+   for (unsigned int i = 0; i < layers.size(); i++)
+      if (!layers[i].clips.empty())
+         return true;
+   return false;
+}
+
+void AnimatedEntity::advanceLayers(float tickDelta) {
+   AN::AdvanceLayer(& transition, model->animations, tickDelta);
+   for (unsigned int i = 0; i < layers.size(); i++)
+      AN::AdvanceLayer(& layers[i], model->animations, tickDelta);
+}
+
+void AnimatedEntity::blendLayers(LocalTransform * pose, PoseArena * arena) {
+   AN::ApplyLayer(& transition, model->animations, model->boneCount, arena, pose);
+   for (unsigned int i = 0; i < layers.size(); i++)
+      AN::ApplyLayer(& layers[i], model->animations, model->boneCount, arena, pose);
+}
+
+bool AnimatedEntity::canSharePose() {
+   return !isBlending();
+}
+
+bool AnimatedEntity::reusePose(int animNum, float& time, unsigned int mask) {
+   palette.reset();
+   if (!poseCache || !canSharePose())
+      return false;
+
+   PoseKey key = PoseCache::Key(model, animNum, time, mask | (rootMotion ? POSE_IN_PLACE : 0));
+   bool evaluate;
+   palette = poseCache->acquire(key, evaluate);
+   if (evaluate) {
+      time = PoseCache::KeyTime(key);
+      return false;
+   }
+
+   keyframeMs = palette->keyframeMs;
+   return true;
+}
+
+void AnimatedEntity::sharePose(const std::vector<Mmath::Matrix3x4f> * boneMs) {
+   if (!palette)
+      return;
+
+   palette->keyframeMs = keyframeMs;
+   if (boneMs)
+      palette->boneMs = *boneMs;
+   palette->animMs = animMs;
+}
+
 // --------------------------------------------------------- //
 // ====================== Mocap Entity ===================== //
 // --------------------------------------------------------- //
@@ -179,23 +389,48 @@ void MocapEntity::stopAnimation() {
    animIsPlaying = false;
 }
 
+void MocapEntity::crossfadeTo(int animNum, float seconds) {
+   if (seconds > 0) {
+      ClipState fading = {this->animNum, animTime, 1, 0, 1 / seconds};
+      fading.cursor = cursor;
+      transition.clips.push_back(fading);
+   }
+
+   animIsPlaying = true;
+   this->animNum = animNum;
+   animTime = 0;
+}
+
 void MocapEntity::update(float tickDelta) {
    if (model->hasAnimations) {
       // Move forward the animation time
-      float duration = model->animations[animNum].duration;
-      animTime += tickDelta;
-      if (animTime > duration)
-         animTime -= duration;
+      float fromTime = animTime;
+      animTime = AN::WrapTime(animTime + tickDelta, model->animations[animNum].duration);
+      moveByRoot(animNum, fromTime, tickDelta);
 
-      // Compute each bone's animation transform (even though there's no bone heirarchy)
-      for (int boneIndex = 0; boneIndex < model->boneCount; boneIndex++) {
-         Bone * bone = & model->bones[boneIndex];
-         Animation * anim = & model->animations[this->animNum];
-         AnimBone * animBone = & anim->animBones[boneIndex];
+      advanceLayers(tickDelta);
 
-         Eigen::Matrix4f animKeysM = AN::ComputeKeyframeTransform(animBone, anim->keyCount, this->animTime, anim->duration);
-         animMs[boneIndex] = animKeysM * bone->invBonePose;
+      float sampleTime = animTime;
+      if (reusePose(animNum, sampleTime, POSE_UNCHAINED))
+         return;
+
+      // Compute each bone's animation transform (even though there's no bone heirarchy)
+      if (!isBlending()) {
+         AN::SampleAnimation(model->animations[animNum], sampleTime, keyframeMs.data(), & cursor);
+      } else {
+         PoseArena * arena = PoseArena::local();
+         arena->reset();
+
+         LocalTransform * pose = arena->take(model->boneCount);
+         AN::SamplePose(model->animations[animNum], animTime, pose, & cursor);
+         blendLayers(pose, arena);
+         AN::ComposePose(pose, model->boneCount, keyframeMs.data());
       }
+      pinRoot(animNum, false);
+
+      for (int boneIndex = 0; boneIndex < model->boneCount; boneIndex++)
+         animMs[boneIndex] = Mmath::ComposeAffine(keyframeMs[boneIndex], model->bones[boneIndex].invBonePose.topRows<3>());
+      sharePose(NULL);
    }
 }
 
@@ -216,13 +451,13 @@ SkinnedEntity::SkinnedEntity(Eigen::Vector3f pos, Model * model)
 }
 
 void SkinnedEntity::initialize() {
-   this->boneMs = std::vector<Eigen::Matrix4f>(model->boneCount);
+   this->boneMs = std::vector<Mmath::Matrix3x4f>(model->boneCount);
    this->animNums = std::vector<int>(model->boneCount);
    this->bonesPlaying = std::vector<bool>(model->boneCount);
    this->animTimes = std::vector<float>(model->boneCount);
 
    for (int i = 0; i < model->boneCount; i++) {
-      this->boneMs[i] = Eigen::Matrix4f::Identity();
+      this->boneMs[i] = Mmath::Matrix3x4f::Identity();
       this->animNums[i] = 0;
       this->bonesPlaying[i] = false;
       this->animTimes[i] = 0;
@@ -255,41 +490,111 @@ void SkinnedEntity::stopAnimation(int boneNum, bool isRecursive) {
          stopAnimation(model->bones[boneNum].childIndices[i], isRecursive);
 }
 
+void SkinnedEntity::crossfadeTo(int animNum, float seconds) {
+   int root = model->boneRoot;
+   if (seconds > 0 && bonesPlaying[root]) {
+      ClipState fading = {animNums[root], animTimes[root], 1, 0, 1 / seconds};
+      fading.cursor = cursor;
+      transition.clips.push_back(fading);
+   }
+
+   playAnimation(animNum);
+   for (int i = 0; i < model->boneCount; i++)
+      if (bonesPlaying[i])
+         animTimes[i] = 0;
+}
+
 void SkinnedEntity::update(float tickDelta) {
    if (model->hasAnimations && model->hasBoneTree) {
       // Start replaying animation if finished
+      int root = model->boneRoot;
+      float fromTime = animTimes[root];
       replayIfNeeded(tickDelta);
-      // Recursively fill in the animMs
-      computeAnimMs(model->boneRoot, Eigen::Matrix4f::Identity());
+      if (bonesPlaying[root])
+         moveByRoot(animNums[root], fromTime, tickDelta);
+
+      float rootTime = animTimes[root];
+      if (reusePose(animNums[root], rootTime, POSE_BONE_TREE)) {
+         boneMs = palette->boneMs;
+         return;
+      }
+
+      sampleKeyframes(rootTime);
+      pinRoot(animNums[root], true);
+      // Fill in the animMs, parents first
+      computeAnimMs();
+      sharePose(& boneMs);
    }
 }
 
+// Only when every bone plays the root's animation at the root's time, so the
+// clip and time alone say what the pose is
+bool SkinnedEntity::canSharePose() {
+   if (!AnimatedEntity::canSharePose())
+      return false;
+
+   int root = model->boneRoot;
+   for (int i = 0; i < model->boneCount; i++)
+      if (animNums[i] != animNums[root] || animTimes[i] != animTimes[root])
+         return false;
+   return true;
+}
+
 void SkinnedEntity::replayIfNeeded(float tickDelta) {
    for (int i = 0; i < model->boneCount; i++) {
       if (!model->hasBoneTree || bonesPlaying[i]) {
-         float duration = model->animations[animNums[i]].duration;
-
-         animTimes[i] += tickDelta;
-         if (animTimes[i] > duration)
-            animTimes[i] -= duration;
+         animTimes[i] = AN::WrapTime(animTimes[i] + tickDelta, model->animations[animNums[i]].duration);
       }
    }
+
+   advanceLayers(tickDelta);
+}
+
+void SkinnedEntity::sampleKeyframes() {
+   sampleKeyframes(animTimes[model->boneRoot]);
 }
 
-void SkinnedEntity::computeAnimMs(int boneIndex, Eigen::Matrix4f parentM) {
-   int animNum = animNums[boneIndex];
-   float tickTime = animTimes[boneIndex];
+// Every bone playing what the root plays is sampled in one batch (at rootTime,
+// which may be the root's time rounded for the pose cache), the few playing
+// something else (or stopped at another time) one at a time
+void SkinnedEntity::sampleKeyframes(float rootTime) {
+   int rootAnim = animNums[model->boneRoot];
+   float ownTime = animTimes[model->boneRoot];
+
+   if (!isBlending()) {
+      AN::SampleAnimation(model->animations[rootAnim], rootTime, keyframeMs.data(), & cursor);
 
-   Bone * bone = & model->bones[boneIndex];
-   Animation * anim = & model->animations[animNum];
-   AnimBone * animBone = & anim->animBones[boneIndex];
+      for (int i = 0; i < model->boneCount; i++)
+         if (animNums[i] != rootAnim || animTimes[i] != ownTime)
+            keyframeMs[i] = AN::SampleBone(model->animations[animNums[i]], i, animTimes[i]);
+      return;
+   }
 
-   Eigen::Matrix4f keyframeM = AN::ComputeKeyframeTransform(
-      animBone, anim->keyCount, tickTime, anim->duration);
+   // Blending happens on the parent relative poses, before they are chained together
+   PoseArena * arena = PoseArena::local();
+   arena->reset();
+
+   LocalTransform * pose = arena->take(model->boneCount);
+   AN::SamplePose(model->animations[rootAnim], rootTime, pose, & cursor);
+   for (int i = 0; i < model->boneCount; i++)
+      if (animNums[i] != rootAnim || animTimes[i] != ownTime)
+         pose[i] = AN::SampleBonePose(model->animations[animNums[i]], i, animTimes[i]);
+
+   blendLayers(pose, arena);
+   AN::ComposePose(pose, model->boneCount, keyframeMs.data());
+}
+
+void SkinnedEntity::computeAnimMs() {
+   const std::vector<BoneStep>& order = model->boneOrder;
+   for (unsigned int i = 0; i < order.size(); i++)
+      poseBone(order[i], keyframeMs[order[i].bone]);
+}
 
-   boneMs[boneIndex] = parentM * keyframeM;
-   animMs[boneIndex] = boneMs[boneIndex] * bone->invBonePose;
+// The parent's boneM is already final, since the model's boneOrder puts parents first
+void SkinnedEntity::poseBone(const BoneStep& step, const Mmath::Matrix3x4f& localM) {
+   Mmath::Matrix3x4f * boneM = & boneMs[step.bone];
+   *boneM = step.parent < 0 ? localM : Mmath::ComposeAffine(boneMs[step.parent], localM);
 
-   for (int i = 0; i < bone->childIndices.size(); i++)
-      computeAnimMs(bone->childIndices[i], boneMs[boneIndex]);
+   Mmath::Matrix3x4f invBindM = model->bones[step.bone].invBonePose.topRows<3>();
+   animMs[step.bone] = Mmath::ComposeAffine(*boneM, invBindM);
 }
@@ -3,7 +3,10 @@
 
 #include <vector>
 #include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include "animation.h"
+#include "ceres/problem.h"
 
 // ------------------------ IK Bone ------------------------ //
 IKLimb::IKLimb() {}
@@ -18,8 +21,20 @@ IKEntity::IKEntity(Eigen::Vector3f pos, Model * model)
    for (int i = 0; i < model->boneCount; i++) {
       this->ikBones[i].angles = std::vector<double>(model->bones[i].joints.size());
       this->ikBones[i].limbs = std::vector<IKLimb *>(0);
+      this->ikBones[i].problem = NULL;
+      this->ikBones[i].solved = false;
+      this->ikBones[i].converged = false;
    }
    usingIK = false;
+   ikSolved = false;
+   jobsBuilt = false;
+}
+
+IKEntity::~IKEntity() {
+   for (int i = 0; i < ikBones.size(); i++)
+      delete ikBones[i].problem;
+   for (int i = 0; i < ikLimbs.size(); i++)
+      delete ikLimbs[i];
 }
 
 void IKEntity::addLimb(std::vector<int> boneIndices, Eigen::Vector3f offset, bool isBase) {
@@ -31,18 +46,59 @@ void IKEntity::addLimb(std::vector<int> boneIndices, Eigen::Vector3f offset, boo
    limb->offset = offset;
    limb->goal = Eigen::Vector3f(0,0,0);
    limb->jointAngles = constructJointAnglePtrs(boneIndices);
-   this->ikBones[boneIndices[0]].limbs.push_back(limb);
+   limb->method = IK_CERES;
+   limb->baseM = Eigen::Matrix4f::Identity();
+   limb->solvedGoal = limb->goal;
    this->ikLimbs.push_back(limb);
+
+   // The group's problem is rebuilt with the new limb the next time it's solved
+   IKBone * ikBone = & this->ikBones[boneIndices[0]];
+   ikBone->limbs.push_back(limb);
+   delete ikBone->problem;
+   ikBone->problem = NULL;
+   ikBone->solved = false;
+   ikBone->converged = false;
+   jobsBuilt = false;
 }
 
 void IKEntity::setLimbGoal(int limbIndex, Eigen::Vector3f goal) {
    this->ikLimbs[limbIndex]->goal = goal;
 }
 
+void IKEntity::setLimbMethod(int limbIndex, IKMethod method) {
+   IKLimb * limb = this->ikLimbs[limbIndex];
+   if (method == IK_DAMPED_LEAST_SQUARES && limb->jointAngles.size() > IK_MAX_LIMB_ANGLES) {
+      fprintf(stderr, "Limb %d has %d angles, the fast solver takes at most %d\n",
+              limbIndex, (int)limb->jointAngles.size(), IK_MAX_LIMB_ANGLES);
+      exit(1);
+   }
+   limb->method = method;
+
+   IKBone * ikBone = & this->ikBones[limb->boneIndices[0]];
+   delete ikBone->problem;
+   ikBone->problem = NULL;
+   ikBone->solved = false;
+   ikBone->converged = false;
+}
+
+Eigen::Vector3f IKEntity::limbEnd(int limbIndex) {
+   IKLimb * limb = this->ikLimbs[limbIndex];
+   int parent = model->bones[limb->boneIndices[0]].parentIndex;
+   Eigen::Matrix4f parentM = parent < 0 ? Eigen::Matrix4f::Identity() : jointChainM(parent);
+   Eigen::Matrix4f modelM = Mmath::TransformationMatrix(position, rotation, scale);
+   return IK::EndEffector(model->bones, limb->boneIndices, limb->jointAngles, modelM * parentM, NULL);
+}
+
 void IKEntity::update(float tickDelta) {
    if (model->hasBoneTree && model->hasAnimations) {
       SkinnedEntity::replayIfNeeded(tickDelta);
-      computeAnimMs(model->boneRoot, Eigen::Matrix4f::Identity());
+      if (!usingIK)
+         SkinnedEntity::sampleKeyframes();
+      else if (!ikSolved)
+         for (unsigned int job = 0; job < ikJobCount(); job++)
+            solveIKJob(job);
+      ikSolved = false;
+      computeAnimMs();
    }
 }
 
@@ -54,31 +110,113 @@ void IKEntity::animateWithKeyframes() {
    usingIK = false;
 }
 
-void IKEntity::computeAnimMs(int boneIndex, Eigen::Matrix4f parentM) {
-   int animNum = this->animNums[boneIndex];
-   float tickTime = this->animTimes[boneIndex];
+void IKEntity::computeAnimMs() {
+   const std::vector<BoneStep>& order = model->boneOrder;
+
+   // The limbs' angles are already solved (see solveIKJob)
+   for (unsigned int i = 0; i < order.size(); i++) {
+      int boneIndex = order[i].bone;
+      Bone * bone = & model->bones[boneIndex];
+
+      // If this bone has a computed ik rotation, use it, otherwise use the animation rotation
+      if (!usingIK)
+         poseBone(order[i], keyframeMs[boneIndex]);
+      else if (bone->joints.size() > 0)
+         poseBone(order[i], constructJointMatrix(boneIndex).topRows<3>());
+      else
+         poseBone(order[i], bone->parentOffset.topRows<3>());
+   }
+}
 
-   Bone * bone = & model->bones[boneIndex];
-   IKBone * ikBone = & this->ikBones[boneIndex];
-   Animation * anim = & model->animations[animNum];
-   AnimBone * animBone = & anim->animBones[boneIndex];
-
-   // Compute rotation angles for all limbs who's root starts at this bone
-   if (usingIK && ikBone->limbs.size())
-      solveLimbs(parentM, ikBone->limbs);
-
-   // If this bone has a computed ik rotation, use it, otherwise use the animation rotation
-   Eigen::Matrix4f animM = (usingIK) ? (
-      (bone->joints.size() > 0) ?
-         animM = constructJointMatrix(boneIndex) :
-         animM = bone->parentOffset) :
-      AN::ComputeKeyframeTransform(animBone, anim->keyCount, tickTime, anim->duration);
-
-   boneMs[boneIndex] = parentM * animM;
-   animMs[boneIndex] = boneMs[boneIndex] * bone->invBonePose;
-
-   for (int i = 0; i < bone->childIndices.size(); i++)
-      computeAnimMs(bone->childIndices[i], boneMs[boneIndex]);
+unsigned int IKEntity::ikJobCount() {
+   if (!usingIK || !model->hasBoneTree)
+      return 0;
+   if (!jobsBuilt)
+      buildJobs();
+   return ikJobs.size();
+}
+
+void IKEntity::solveIKJob(unsigned int job) {
+   const std::vector<int>& roots = ikJobs[job];
+   for (unsigned int i = 0; i < roots.size(); i++) {
+      int parent = model->bones[roots[i]].parentIndex;
+      Eigen::Matrix4f parentM = parent < 0 ? Eigen::Matrix4f::Identity() : jointChainM(parent);
+      solveLimbs(parentM, & ikBones[roots[i]]);
+   }
+}
+
+const std::vector<int>& IKEntity::ikJobRoots(unsigned int job) {
+   return ikJobs[job];
+}
+
+// Union find over the limb groups, joining each with the earlier groups it
+// depends on
+static int findJob(std::vector<int>& jobOf, int group) {
+   while (jobOf[group] != group)
+      group = jobOf[group] = jobOf[jobOf[group]];
+   return group;
+}
+
+void IKEntity::buildJobs() {
+   const std::vector<BoneStep>& order = model->boneOrder;
+   std::vector<int> roots;
+   std::vector<std::vector<bool> > moves;   // bones each group's limbs turn
+   bool hasBase = false;
+
+   for (unsigned int i = 0; i < order.size(); i++) {
+      IKBone * ikBone = & ikBones[order[i].bone];
+      if (ikBone->limbs.empty())
+         continue;
+
+      std::vector<bool> moved = std::vector<bool>(model->boneCount, false);
+      for (int l = 0; l < ikBone->limbs.size(); l++) {
+         IKLimb * limb = ikBone->limbs[l];
+         hasBase = hasBase || limb->isBase;
+         for (int b = 0; b < limb->boneIndices.size(); b++)
+            moved[limb->boneIndices[b]] = true;
+      }
+      roots.push_back(order[i].bone);
+      moves.push_back(moved);
+   }
+
+   std::vector<int> jobOf = std::vector<int>(roots.size());
+   for (int g = 0; g < roots.size(); g++) {
+      jobOf[g] = hasBase ? 0 : g;
+
+      // An earlier group turning a bone above this one's root, or one of its
+      // bones, has to be solved first
+      for (int h = 0; h < g && !hasBase; h++) {
+         bool depends = false;
+         for (int b = model->bones[roots[g]].parentIndex; b >= 0 && !depends; b = model->bones[b].parentIndex)
+            depends = moves[h][b];
+         for (int b = 0; b < model->boneCount && !depends; b++)
+            depends = moves[h][b] && moves[g][b];
+         if (depends)
+            jobOf[findJob(jobOf, g)] = findJob(jobOf, h);
+      }
+   }
+
+   // Jobs keep their groups parents first
+   ikJobs.clear();
+   std::vector<int> jobIndex = std::vector<int>(roots.size(), -1);
+   for (int g = 0; g < roots.size(); g++) {
+      int job = findJob(jobOf, g);
+      if (jobIndex[job] < 0) {
+         jobIndex[job] = ikJobs.size();
+         ikJobs.push_back(std::vector<int>());
+      }
+      ikJobs[jobIndex[job]].push_back(roots[g]);
+   }
+   jobsBuilt = true;
+}
+
+// The bone in model space as computeAnimMs poses it under IK, from the joint
+// angles alone, so a job doesn't need the boneMs of this frame
+Eigen::Matrix4f IKEntity::jointChainM(int boneIndex) {
+   Eigen::Matrix4f m = Eigen::Matrix4f::Identity();
+   for (int b = boneIndex; b >= 0; b = model->bones[b].parentIndex)
+      m = constructJointMatrix(b) * m;
+   return m;
 }
 
 std::vector<double *> IKEntity::constructJointAnglePtrs(std::vector<int>& boneIndices) {
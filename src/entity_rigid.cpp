@@ -1,73 +1,42 @@
 #include "entity_rigid.h"
 
-RigidEntity::RJoint::RJoint()
-: angle(0), angularVelocity(Eigen::Vector3f(0,0,0)), angularAcceleration(Eigen::Vector3f(0,0,0)) {}
-RigidEntity::RBone::RBone()
-: force(Eigen::Vector3f(0,0,0)), torque(Eigen::Vector3f(0,0,0)) {}
+#include <assert.h>
+#include <math.h>
 
 RigidEntity::RigidEntity(Eigen::Vector3f pos, Eigen::Quaternionf rot, Eigen::Vector3f scl, Model * model)
-: SkinnedEntity(pos, rot, scl, model) {}
+: SkinnedEntity(pos, rot, scl, model), body(model->bones, model->boneOrder) {}
 RigidEntity::RigidEntity(Eigen::Vector3f pos, Eigen::Quaternionf rot, Model * model)
-: SkinnedEntity(pos, rot, model) {}
+: SkinnedEntity(pos, rot, model), body(model->bones, model->boneOrder) {}
 RigidEntity::RigidEntity(Eigen::Vector3f pos, Model * model)
-: SkinnedEntity(pos, model) {
-   // Initialize the rigid bones and joints
-   for (int i = 0; i < model->bones.size(); i++) {
-      RBone rbone;
-      rbone.rjoints = std::vector<RJoint>(model->bones[i].joints.size());
-      rbones.push_back(rbone);
-   }
-}
-
-typedef struct FT {
-   Eigen::Vector3f force;
-   Eigen::Vector3f torque;
-} FT;
+: SkinnedEntity(pos, model), body(model->bones, model->boneOrder) {}
 
 void RigidEntity::update(float timeDelta) {
-   updateJoint(model->boneRoot);
-}
-
-   // Use these
-   // mBone->mass;
-   // mBone->inertiaTensor;
-   // mBone->invInertiaTensor;
-   // mBone->com;
-
-void RigidEntity::updateJoint(int boneNdx) {
-   Bone * mBone = & model->bones[boneNdx];
-   RBone * rBone = & rbones[boneNdx];
+   if (!model->hasBoneTree)
+      return;
 
-   for (int i = 0; i < mBone->childIndices.size(); i++) {
-      int childIndex = mBone->childIndices[i];
-      Bone *  mChildBone = & model->bones[childIndex];
-      RBone * rChildBone = & rbones[childIndex];
-      Eigen::Matrix3f rotChildM = Mmath::AngleAxisMatrix3(rChildBone->rjoints[0].angle, mBone->joints[0].axis);
+   // Down is down in the world, whichever way the entity is turned
+   body.gravity = rotation.conjugate() * Eigen::Vector3f(0, ARTICULATED_GRAVITY, 0);
 
-      // Calculate child's linear & angular velocities and accelerations
-      // rChildBone->angularVelocity     = rotChildM * rBone->angularVelocity + childAngleDot * zhat;
-      // rChildBone->angularAcceleration = rotChildM * rBone->angularAcceleration +
-      //                                   (rotChildM * rBone->angularVelocity).cross(childAngleDot * zhat) +
-      //                                   childAngleDotDot * zhat;
-      // rChildBone->linearVelocity      =
-      // rChildBone->linearAcceleration  =
+   int steps = ceil(timeDelta / RIGID_MAX_STEP);
+   for (int i = 0; i < steps; i++)
+      body.step(timeDelta / steps);
+   body.clearForces();
 
-      // Calculate the child forces and torques required for this body's force/torques
-      updateJoint(childIndex);
-
-      // Calculate this body's force/torques
-      rBone->force  += rotChildM * rChildBone->force;
-      // rBone->torque +=
-   }
-
-   // double angVelNext = j->velocity + j->acceleration * dt;
-   // double angPosNext = j->position + j->velocity * dt + 0.5 * j->acceleration * dt * dt;
+   const std::vector<BoneStep>& order = model->boneOrder;
+   for (unsigned int i = 0; i < order.size(); i++)
+      poseBone(order[i], body.localM(order[i].bone));
 }
 
 void RigidEntity::applyForce(int boneNum, Eigen::Vector3f f) {
-   rbones[boneNum].force += f;
+   body.applyForce(boneNum, rotation.conjugate() * f);
 }
 
 void RigidEntity::applyTorque(int boneNum, Eigen::Vector3f t) {
-   rbones[boneNum].torque += t;
+   body.applyTorque(boneNum, rotation.conjugate() * t);
+}
+
+void RigidEntity::setJointTorque(int boneNum, int jointNum, float torque) {
+   int link = body.linkOf(boneNum, jointNum);
+   assert(link >= 0);
+   body.torques[link] = torque;
 }
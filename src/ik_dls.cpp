@@ -0,0 +1,112 @@
+#include "ik_dls.h"
+#include "matrix_math.h"
+
+#include <assert.h>
+#include <math.h>
+
+// Fixed size maxima, so the whole solve stays on the stack
+typedef Eigen::Matrix<float, 3, Eigen::Dynamic, 0, 3, IK_MAX_LIMB_ANGLES + 3> LimbJacobian;
+typedef Eigen::Matrix<float, Eigen::Dynamic, 1, 0, IK_MAX_LIMB_ANGLES + 3, 1> LimbStep;
+
+// ========================================================== //
+// ==================== STATIC FUNCTIONS ==================== //
+// ========================================================== //
+
+// Walks the limb from its base the way solveEndEffector does, optionally
+// keeping each joint's world position, world axis and limits on the way
+static Eigen::Vector3f walkLimb(const std::vector<Bone>& bones, const std::vector<int>& boneIndices,
+                                const std::vector<double *>& angles, const Eigen::Matrix4f& baseM,
+                                const Eigen::Vector3f * basePosition, Eigen::Vector3f * jointPositions,
+                                Eigen::Vector3f * jointAxes, const IKJoint ** joints) {
+   Eigen::Matrix4f m = baseM;
+   if (basePosition)
+      m.block<3,1>(0,3) += *basePosition;
+
+   int angleI = 0;
+   for (int boneI = 0; boneI < boneIndices.size(); boneI++) {
+      const Bone * bone = & bones[boneIndices[boneI]];
+      m = m * bone->parentOffset;
+
+      for (int jointI = 0; jointI < bone->joints.size(); jointI++, angleI++) {
+         const IKJoint * joint = & bone->joints[jointI];
+         if (jointPositions) {
+            jointPositions[angleI] = m.block<3,1>(0,3);
+            jointAxes[angleI] = (m.topLeftCorner<3,3>() * joint->axis).normalized();
+            joints[angleI] = joint;
+         }
+         m = m * Mmath::AngleAxisMatrix4<float>(*angles[angleI], joint->axis);
+      }
+   }
+
+   return m.block<3,1>(0,3);
+}
+
+// ========================================================== //
+// ======================= IK FUNCTIONS ===================== //
+// ========================================================== //
+
+namespace IK {
+   Eigen::Vector3f EndEffector(const std::vector<Bone>& bones, const std::vector<int>& boneIndices,
+                               const std::vector<double *>& angles, const Eigen::Matrix4f& baseM,
+                               const Eigen::Vector3f * basePosition) {
+      return walkLimb(bones, boneIndices, angles, baseM, basePosition, NULL, NULL, NULL);
+   }
+
+   IKResult SolveDLS(const std::vector<Bone>& bones, const std::vector<int>& boneIndices,
+                     const std::vector<double *>& angles, const Eigen::Matrix4f& baseM,
+                     const Eigen::Vector3f& goal, Eigen::Vector3f * basePosition) {
+      assert(angles.size() <= IK_MAX_LIMB_ANGLES);
+
+      int angleCount = angles.size();
+      int columns = angleCount + (basePosition ? 3 : 0);
+      Eigen::Vector3f jointPositions[IK_MAX_LIMB_ANGLES], jointAxes[IK_MAX_LIMB_ANGLES];
+      const IKJoint * joints[IK_MAX_LIMB_ANGLES];
+      LimbJacobian jacobian = LimbJacobian(3, columns);
+      LimbStep step;
+
+      // Moving the base moves the end of the limb by as much
+      if (basePosition)
+         jacobian.rightCols<3>() = Eigen::Matrix3f::Identity();
+
+      IKResult result;
+      result.iterations = 0;
+      result.settled = false;
+
+      Eigen::Vector3f end = walkLimb(bones, boneIndices, angles, baseM, basePosition, jointPositions, jointAxes, joints);
+      Eigen::Vector3f error = goal - end;
+
+      while (error.norm() >= IK_DLS_TOLERANCE && result.iterations < IK_DLS_ITERATIONS) {
+         for (int a = 0; a < angleCount; a++)
+            jacobian.col(a) = jointAxes[a].cross(end - jointPositions[a]);
+
+         Eigen::Matrix3f damped = jacobian * jacobian.transpose() +
+                                  IK_DLS_DAMPING * IK_DLS_DAMPING * Eigen::Matrix3f::Identity();
+         step = jacobian.transpose() * damped.ldlt().solve(error);
+         float turn = angleCount ? step.head(angleCount).cwiseAbs().maxCoeff() : 0;
+         if (turn > IK_DLS_MAX_TURN)
+            step *= IK_DLS_MAX_TURN / turn;
+
+         float largest = 0;
+         for (int a = 0; a < angleCount; a++) {
+            double before = *angles[a];
+            *angles[a] = Mmath::clamp<double>(joints[a]->minAngle, joints[a]->maxAngle, before + step(a));
+            largest = fmax(largest, fabs(*angles[a] - before));
+         }
+         if (basePosition) {
+            *basePosition += step.tail<3>();
+            largest = fmax(largest, step.tail<3>().norm());
+         }
+         result.iterations++;
+
+         end = walkLimb(bones, boneIndices, angles, baseM, basePosition, jointPositions, jointAxes, joints);
+         error = goal - end;
+
+         if (largest < IK_DLS_MIN_STEP)
+            break;
+      }
+
+      result.error = error.norm();
+      result.settled = result.error < IK_DLS_TOLERANCE || result.iterations < IK_DLS_ITERATIONS;
+      return result;
+   }
+}
@@ -0,0 +1,63 @@
+#include "ik_scheduler.h"
+
+#include <atomic>
+#include <future>
+
+// ========================================================== //
+// ==================== IK SCHEDULER METHODS ================ //
+// ========================================================== //
+
+IKScheduler::IKScheduler(ThreadPool * pool)
+: _pool(pool) {}
+
+IKScheduler::~IKScheduler() {}
+
+void IKScheduler::add(IKEntity * entity) {
+   _entities.push_back(entity);
+}
+
+void IKScheduler::remove(IKEntity * entity) {
+   for (unsigned int i = 0; i < _entities.size(); i++) {
+      if (_entities[i] == entity) {
+         _entities.erase(_entities.begin() + i);
+         return;
+      }
+   }
+}
+
+void IKScheduler::solve() {
+   // Gathered up front, so every job sees the goals as they are now
+   _jobs.clear();
+   for (unsigned int i = 0; i < _entities.size(); i++) {
+      unsigned int count = _entities[i]->ikJobCount();
+      for (unsigned int job = 0; job < count; job++) {
+         IKJob scheduled = {_entities[i], job};
+         _jobs.push_back(scheduled);
+      }
+   }
+
+   std::atomic<unsigned int> next(0);
+   std::vector<IKJob> * jobs = & _jobs;
+   std::function<void()> work = [jobs, &next]() {
+      for (unsigned int i = next++; i < jobs->size(); i = next++)
+         (*jobs)[i].entity->solveIKJob((*jobs)[i].job);
+   };
+
+   std::vector<std::future<void> > workers;
+   unsigned int helpers = _pool && _jobs.size() > 1 ? _pool->threadCount() : 0;
+   if (helpers > _jobs.size() - 1)
+      helpers = _jobs.size() - 1;
+   for (unsigned int i = 0; i < helpers; i++)
+      workers.push_back(_pool->submit(work));
+
+   work();
+   for (unsigned int i = 0; i < workers.size(); i++)
+      workers[i].wait();
+
+   for (unsigned int i = 0; i < _entities.size(); i++)
+      _entities[i]->ikSolved = true;
+}
+
+unsigned int IKScheduler::jobCount() {
+   return _jobs.size();
+}
@@ -49,36 +49,47 @@ Matrix<T,3,1> solveEndEffector(
    return Matrix<T,3,1>(endEffector(0), endEffector(1), endEffector(2));
 }
 
+// Gathers the angles of the limb's bones (one parameter block per bone with
+// joints) into the order solveEndEffector reads them in
+template<typename T>
+static void gatherAngles(T const* const* params, int blockCount, const IKLimb * limb, Model * model,
+                         std::vector<T>& angles) {
+   angles.clear();
+   int block = 0;
+   for (int i = 0; i < limb->boneIndices.size() && block < blockCount; i++) {
+      int jointCount = model->bones[limb->boneIndices[i]].joints.size();
+      if (jointCount == 0)
+         continue;
+      for (int j = 0; j < jointCount; j++)
+         angles.push_back(params[block][j]);
+      block++;
+   }
+}
+
+// The limb is read when the problem is evaluated, so one functor serves every
+// frame's goal and base
 class LimbCostFunctor {
 private:
    Model * model;
-   std::vector<int> boneIndices;
-   Matrix4f baseM;
-   Eigen::Vector3f goal;
-   int numAngles;
+   const IKLimb * limb;
+   int blockCount;
 
 public:
-   LimbCostFunctor(
-      Model * model,
-      std::vector<int>& boneIndices,
-      Matrix4f baseM,
-      Vector3f goal,
-      int numAngles
-   ) {
+   LimbCostFunctor(Model * model, const IKLimb * limb, int blockCount) {
       this->model = model;
-      this->boneIndices = boneIndices;
-      this->baseM = baseM;
-      this->goal = goal;
-      this->numAngles = numAngles;
+      this->limb = limb;
+      this->blockCount = blockCount;
    }
 
    template<typename T>
    bool operator()(T const* const* params, T* residuals) const {
-      T const* angles = params[0];
-      Matrix<T,4,4> baseM_T = baseM.cast<T>();
-      Matrix<T,3,1> goalT = goal.cast<T>();
+      std::vector<T> angles;
+      gatherAngles(params, blockCount, limb, model, angles);
+
+      Matrix<T,4,4> baseM_T = Matrix4f(limb->baseM).cast<T>();
+      Matrix<T,3,1> goalT = limb->goal.cast<T>();
       Matrix<T,3,1> offset = Matrix<T,3,1>(T(0), T(0), T(0));
-      Matrix<T,3,1> endPoint = solveEndEffector(model, angles, numAngles, boneIndices, baseM_T, offset);
+      Matrix<T,3,1> endPoint = solveEndEffector(model, angles.data(), angles.size(), limb->boneIndices, baseM_T, offset);
 
       residuals[0] = goalT(0) - endPoint(0);
       residuals[1] = goalT(1) - endPoint(1);
@@ -87,38 +98,31 @@ public:
    }
 };
 
+// A limb that moves the entity, its last parameter block is the entity's position
 class BaseLimbCostFunctor {
 private:
    Model * model;
-   std::vector<int> boneIndices;
-   Matrix4f scaleRotateParentM;
-   Eigen::Vector3f goal;
-   int numAngles;
+   const IKLimb * limb;
+   int blockCount;
 
 public:
-   BaseLimbCostFunctor(
-      Model * model,
-      std::vector<int>& boneIndices,
-      Matrix4f scaleRotateParentM,
-      Vector3f goal,
-      int numAngles
-   ) {
+   BaseLimbCostFunctor(Model * model, const IKLimb * limb, int blockCount) {
       this->model = model;
-      this->boneIndices = boneIndices;
-      this->scaleRotateParentM = scaleRotateParentM;
-      this->goal = goal;
-      this->numAngles = numAngles;
+      this->limb = limb;
+      this->blockCount = blockCount;
    }
 
    template<typename T>
    bool operator()(T const* const* params, T* residuals) const {
-      T const* angles = params[0];
-      Matrix<T,3,1> worldPos = Map<const Matrix<T,3,1> >(params[1], 3, 1);
+      std::vector<T> angles;
+      gatherAngles(params, blockCount, limb, model, angles);
+
+      Matrix<T,3,1> worldPos = Map<const Matrix<T,3,1> >(params[blockCount], 3, 1);
       Matrix<T,4,4> baseM = Mmath::TranslationMatrix(worldPos) *
-                            scaleRotateParentM.cast<T>();
-      Matrix<T,3,1> goalT = goal.cast<T>();
+                            Matrix4f(limb->baseM).cast<T>();
+      Matrix<T,3,1> goalT = limb->goal.cast<T>();
       Matrix<T,3,1> offset = Matrix<T,3,1>(T(0), T(0), T(0));
-      Matrix<T,3,1> endPoint = solveEndEffector(model, angles, numAngles, boneIndices, baseM, offset);
+      Matrix<T,3,1> endPoint = solveEndEffector(model, angles.data(), angles.size(), limb->boneIndices, baseM, offset);
 
       // Should change this so we get the endPoint first and then move the root so that
       // the end point is constant no matter what
@@ -129,94 +133,135 @@ public:
    }
 };
 
-void IKEntity::solveLimbs(Eigen::Matrix4f parentM, std::vector<IKLimb *> limbs) {
-   ceres::Problem problem;
+// Few iterations a frame, warm started from the last frame's angles, so a
+// moving goal is followed over a few frames instead of solved exactly in one
+static ceres::Solver::Options solverOptions() {
+   ceres::Solver::Options options;
+   options.linear_solver_type = ceres::DENSE_NORMAL_CHOLESKY;
+   options.max_num_iterations = IK_MAX_ITERATIONS;
+   options.max_solver_time_in_seconds = IK_MAX_SOLVE_SECONDS;
+   options.function_tolerance = IK_TOLERANCE;
+   options.parameter_tolerance = IK_TOLERANCE;
+   options.logging_type = ceres::SILENT;
+   options.num_threads = 1;
+   return options;
+}
 
-   // Setup the position as a double vec3
-   Vector3d positionD = position.cast<double>();
-   // Quaterniond rotationD = rotation.cast<double>();
-   double * posData = positionD.data();
-   // double * rotData = (double *)(& rotationD);
+static bool isNear(const Matrix4f& a, const Matrix4f& b) {
+   return (a - b).cwiseAbs().maxCoeff() < IK_UNCHANGED_EPSILON;
+}
 
-   std::vector<std::vector<double> > angleValuesByLimb = std::vector<std::vector<double> >(limbs.size());
+static bool isNear(const Vector3f& a, const Vector3f& b) {
+   return (a - b).cwiseAbs().maxCoeff() < IK_UNCHANGED_EPSILON;
+}
 
-   for (int limbNum = 0; limbNum < limbs.size(); limbNum++) {
-      IKLimb * limb = limbs[limbNum];
-      angleValuesByLimb[limbNum] = std::vector<double>(0);
+void IKEntity::buildProblem(IKBone * ikBone) {
+   ceres::Problem * problem = new ceres::Problem();
+   ikBone->problem = problem;
 
-      // Quick reference for angle and bone counts
-      int angleCount = limb->jointAngles.size();
-      int boneCount = limb->boneIndices.size();
+   for (int limbNum = 0; limbNum < ikBone->limbs.size(); limbNum++) {
+      IKLimb * limb = ikBone->limbs[limbNum];
+      if (limb->method != IK_CERES)
+         continue;
 
-      // Set up the angles data ptr
-      std::vector<double>* angleValues = & angleValuesByLimb[limbNum];
-      for (int i = 0; i < limb->jointAngles.size(); i++)
-         angleValues->push_back(double(*(limb->jointAngles[i])));
-      double * angleData = angleValues->data();
+      // One parameter block per bone with joints, bounded by the joints' limits
+      std::vector<double *> blocks;
+      for (int i = 0; i < limb->boneIndices.size(); i++) {
+         Bone * bone = & model->bones[limb->boneIndices[i]];
+         std::vector<double> * angles = & ikBones[limb->boneIndices[i]].angles;
+         if (bone->joints.size() == 0)
+            continue;
 
-      // Create the cost functor and problem
-      if (limb->isBase) {
-         // Create the rotScaleParent part of the base matrix
-         Matrix4f rotM = Mmath::RotationMatrix(rotation);
-         Matrix4f sclM = Mmath::ScaleMatrix(scale);
-         Matrix4f scaleRotateParentM = rotM * sclM * parentM;
+         blocks.push_back(angles->data());
+         problem->AddParameterBlock(angles->data(), angles->size());
+         for (int j = 0; j < bone->joints.size(); j++) {
+            problem->SetParameterLowerBound(angles->data(), j, bone->joints[j].minAngle);
+            problem->SetParameterUpperBound(angles->data(), j, bone->joints[j].maxAngle);
+         }
+      }
+      int blockCount = blocks.size();
 
-         // Create the Cost function
+      if (limb->isBase) {
          ceres::DynamicAutoDiffCostFunction<BaseLimbCostFunctor, 4> * costFunction =
             new ceres::DynamicAutoDiffCostFunction<BaseLimbCostFunctor, 4>(
-               new BaseLimbCostFunctor(this->model, limb->boneIndices, scaleRotateParentM, limb->goal, angleCount));
+               new BaseLimbCostFunctor(this->model, limb, blockCount));
 
-         // Set up the cost function parameter and residual blocks
-         costFunction->AddParameterBlock(angleCount); // angles
+         for (int i = 0; i < blockCount; i++)
+            costFunction->AddParameterBlock(problem->ParameterBlockSize(blocks[i]));
          costFunction->AddParameterBlock(3);          // position
-         // costFunction->AddParameterBlock(4);          // rotation
-         costFunction->SetNumResiduals(3);            // residuals
-         problem.AddResidualBlock(costFunction, NULL, angleData, posData);
-
+         costFunction->SetNumResiduals(3);
+         blocks.push_back(ikBone->basePosition);
+         problem->AddResidualBlock(costFunction, NULL, blocks);
       } else {
-         // Set up the base matrix
-         Matrix4f modelM = Mmath::TransformationMatrix(position, rotation, scale);
-         Matrix4f baseM = modelM * parentM;
-
-         // Create the Cost function
          ceres::DynamicAutoDiffCostFunction<LimbCostFunctor, 4> * costFunction =
             new ceres::DynamicAutoDiffCostFunction<LimbCostFunctor, 4>(
-               new LimbCostFunctor(this->model, limb->boneIndices, baseM, limb->goal, angleCount));
+               new LimbCostFunctor(this->model, limb, blockCount));
 
-         // Set up the cost function parameter and residual blocks
-         costFunction->AddParameterBlock(angleCount); // angles
-         costFunction->SetNumResiduals(3);            // residuals
-         problem.AddResidualBlock(costFunction, NULL, angleData);
+         for (int i = 0; i < blockCount; i++)
+            costFunction->AddParameterBlock(problem->ParameterBlockSize(blocks[i]));
+         costFunction->SetNumResiduals(3);
+         problem->AddResidualBlock(costFunction, NULL, blocks);
       }
+   }
+}
 
-      // set min and max values of each angle
-      int angleIndex = 0;
-      for (int i = 0; i < boneCount; i++) {
-         Bone * bone = & model->bones[limb->boneIndices[i]];
-         for (int j = 0; j < bone->joints.size(); j++) {
-            problem.SetParameterLowerBound(angleData, angleIndex, bone->joints[j].minAngle);
-            problem.SetParameterUpperBound(angleData, angleIndex, bone->joints[j].maxAngle);
-            angleIndex++;
-         }
-      }
+void IKEntity::solveLimbs(Eigen::Matrix4f parentM, IKBone * ikBone) {
+   // Where each limb hangs from this frame. Base limbs move the entity, so
+   // theirs leaves out its position, which is solved for.
+   Matrix4f modelM = Mmath::TransformationMatrix(position, rotation, scale);
+   Matrix4f scaleRotateParentM = Mmath::RotationMatrix(rotation) * Mmath::ScaleMatrix(scale) * parentM;
+   bool hasBase = false, hasCeres = false;
+   bool unchanged = ikBone->solved && ikBone->converged;
+
+   for (int limbNum = 0; limbNum < ikBone->limbs.size(); limbNum++) {
+      IKLimb * limb = ikBone->limbs[limbNum];
+      Matrix4f baseM = limb->isBase ? scaleRotateParentM : modelM * parentM;
+
+      unchanged = unchanged && isNear(baseM, limb->baseM) && isNear(limb->goal, limb->solvedGoal);
+      limb->baseM = baseM;
+      limb->solvedGoal = limb->goal;
+      hasBase = hasBase || limb->isBase;
+      hasCeres = hasCeres || limb->method == IK_CERES;
+   }
+   if (hasBase) {
+      Vector3f solvedPosition = Map<Vector3d>(ikBone->basePosition).cast<float>();
+      unchanged = unchanged && isNear(position, solvedPosition);
    }
 
-   // Solve for the angles
-   ceres::Solver::Options options;
-   options.linear_solver_type = ceres::DENSE_QR;
-   ceres::Solver::Summary summary;
-   ceres::Solve(options, &problem, &summary);
+   // Nothing has moved since the last solve settled, so its angles still hold
+   if (unchanged)
+      return;
 
-   // Set the calculated angles
-   for (int limbNum = 0; limbNum < limbs.size(); limbNum++) {
-      IKLimb * limb = limbs[limbNum];
-      std::vector<double>* angleValues = & angleValuesByLimb[limbNum];
+   // The angles are solved in place, starting from the last frame's
+   for (int i = 0; i < 3; i++)
+      ikBone->basePosition[i] = position(i);
+   ikBone->solved = true;
+   ikBone->converged = true;
+
+   if (hasCeres) {
+      if (!ikBone->problem)
+         buildProblem(ikBone);
+
+      static const ceres::Solver::Options options = solverOptions();
+      ceres::Solver::Summary summary;
+      ceres::Solve(options, ikBone->problem, &summary);
+      ikBone->converged = summary.termination_type == ceres::CONVERGENCE;
+   }
 
-      for (int i = 0; i < limb->jointAngles.size(); i++)
-         *(limb->jointAngles[i]) = (*angleValues)[i];
+   // The fast limbs carry on from the shared bones and base the Ceres limbs left
+   for (int limbNum = 0; limbNum < ikBone->limbs.size(); limbNum++) {
+      IKLimb * limb = ikBone->limbs[limbNum];
+      if (limb->method != IK_DAMPED_LEAST_SQUARES)
+         continue;
+
+      Vector3f basePosition = Map<Vector3d>(ikBone->basePosition).cast<float>();
+      IKResult result = IK::SolveDLS(model->bones, limb->boneIndices, limb->jointAngles, limb->baseM, limb->goal,
+                                     limb->isBase ? & basePosition : NULL);
+      Map<Vector3d>(ikBone->basePosition) = basePosition.cast<double>();
+      ikBone->converged = ikBone->converged && result.settled;
    }
 
    // Update the entity's position in case a base limb was used
-   position = positionD.cast<float>();
-   // rotation = rotationD.cast<float>();
+   if (hasBase)
+      position = Map<Vector3d>(ikBone->basePosition).cast<float>();
 }
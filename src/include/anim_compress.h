@@ -0,0 +1,95 @@
+#ifndef __ANIM_COMPRESS_H__
+#define __ANIM_COMPRESS_H__
+
+#include "matrix_math.h"
+#include <stddef.h>
+#include <vector>
+
+#define AC_HEADER_SIZE 16      // fps, frame count, bone count, size
+#define AC_TRACK_ENTRY_SIZE 8  // key count, offset
+#define AC_MAX_FRAMES 65536    // frames are indexed with 16 bits
+
+// A bone's transform relative to its parent, kept apart so poses can be blended
+typedef struct LocalTransform {
+   Eigen::Vector3f position;
+   Eigen::Quaternion<float, Eigen::DontAlign> rotation;
+   Eigen::Vector3f scale;
+} LocalTransform;
+
+// The key each track of a clip last sampled from, kept by whatever plays the
+// clip so sampling it a little later starts there instead of searching. It is
+// only a hint, so a cursor left over from another clip or time is still safe.
+typedef struct KeyCursor {
+   std::vector<unsigned int> keys;
+} KeyCursor;
+
+// Compressed keyframes (see converter/CIAB2_FORMAT.txt, keyframes_compressed).
+// Every bone has a position, rotation and scale track, and each track keeps
+// only the frames needed to stay within a tolerance of the source when
+// interpolated. Tracks that never move keep one value, or none if they sit at
+// the identity. Values are quantized to 16 bits over the track's range and
+// rotations to 48 bits (the smallest three components), and the sampler reads
+// straight from the compressed bytes.
+namespace AC {
+
+   typedef struct Tolerance {
+      float position;   // distance
+      float rotation;   // radians
+      float scale;
+   } Tolerance;
+
+   typedef struct ClipHeader {
+      unsigned int fps;
+      unsigned int frameCount;
+      unsigned int boneCount;
+      unsigned int size;        // bytes in the whole clip, header included
+   } ClipHeader;
+
+   Tolerance DefaultTolerance();
+
+   // Index of the key at or before t among count increasing key times, at
+   // most count - 2 so there is always a next key. Playing forward from hint
+   // only ever steps a key or two, anything else is a binary search.
+   template <typename T>
+   inline unsigned int FindKey(const T * times, unsigned int count, float t, unsigned int hint) {
+      if (count < 2)
+         return 0;
+
+      unsigned int last = count - 2;
+      for (unsigned int k = hint; k <= last && k < hint + 3; k++) {
+         if (t < times[k])
+            break;
+         if (k == last || t < times[k+1])
+            return k;
+      }
+
+      unsigned int low = 0, high = count - 1;
+      while (high - low > 1) {
+         unsigned int middle = (low + high) / 2;
+         if (times[middle] <= t)
+            low = middle;
+         else
+            high = middle;
+      }
+      return low;
+   }
+
+   // Compresses frameCount frames of boneCount bones sampled at fps, bone major
+   // (frames[bone * frameCount + frame]), into a clip appended to out
+   void Compress(const LocalTransform * frames, unsigned int boneCount, unsigned int frameCount,
+                 unsigned int fps, const Tolerance& tolerance, std::vector<unsigned char>& out);
+
+   // Checks the header, track table and frame lists of a clip, error says what
+   // was wrong on failure. Clips that pass can be sampled without further checks.
+   bool Parse(const unsigned char * clip, size_t size, const char *& error);
+
+   ClipHeader ReadHeader(const unsigned char * clip);
+
+   // Every bone of the clip at a time in seconds, held at the ends. The
+   // cursor (if any) is where the keys are looked for first and is moved along.
+   void SamplePose(const unsigned char * clip, float time, LocalTransform * out, KeyCursor * cursor = NULL);
+   LocalTransform SampleBone(const unsigned char * clip, unsigned int bone, float time,
+                             KeyCursor * cursor = NULL);
+}
+
+#endif // __ANIM_COMPRESS_H__
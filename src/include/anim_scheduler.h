@@ -0,0 +1,44 @@
+#ifndef __ANIM_SCHEDULER_H__
+#define __ANIM_SCHEDULER_H__
+
+#include "entity.h"
+#include "camera.h"
+
+#include <vector>
+
+#define ANIM_MAX_CATCH_UP 4   // ticks an entity runs in one frame, the rest of a stall is one long tick
+
+// Updates animated entities at a fixed tick rate instead of once a frame, and
+// draws each one in between its last two ticks so the motion stays smooth
+// whatever the display rate. Entities that are small on screen tick at half
+// the rate each time their size halves, and ones out of view at hiddenRate.
+// Entities added here should only be updated through the scheduler.
+class AnimScheduler {
+public:
+   float tickRate;             // ticks per second up close
+   float fullRateSize;         // screen size (see StaticEntity::screenSize) down to which the full rate is kept
+   unsigned int maxSlowdown;   // the farthest entities tick at tickRate / maxSlowdown
+   float hiddenRate;           // ticks per second out of view, 0 to catch up once seen again
+
+   AnimScheduler(float tickRate);
+   ~AnimScheduler();
+
+   void add(AnimatedEntity * entity);
+   void remove(AnimatedEntity * entity);
+
+   // Runs the ticks each entity has due after timeDelta more seconds and leaves
+   // its pose ready to draw
+   void update(Camera * camera, float timeDelta);
+
+   float rateFor(AnimatedEntity * entity, Camera * camera);
+
+private:
+   typedef struct Scheduled {
+      AnimatedEntity * entity;
+      float elapsed;   // seconds since its last tick
+   } Scheduled;
+
+   std::vector<Scheduled> _entities;
+};
+
+#endif // __ANIM_SCHEDULER_H__
@@ -1,11 +1,95 @@
-
 #ifndef __ANIMATION_H__
 #define __ANIMATION_H__
 
 #include "model.h"
+#include "anim_compress.h"
+
+#define POSE_ARENA_BLOCK 1024   // bone transforms per block of a PoseArena
+
+typedef enum {
+   LAYER_OVERRIDE,   // moves the pose below toward the layer's pose by its weight
+   LAYER_ADDITIVE    // adds how far the layer's clips are from their first key
+} LayerMode;
+
+typedef struct ClipState {
+   int animNum;
+   float time;
+   float weight;
+   float targetWeight;
+   float fadeRate;       // weight per second toward targetWeight, 0 once there
+   KeyCursor cursor;
+} ClipState;
+
+// Clips blended by weight into one pose, which is then laid over the pose
+// below it. The layer counts for its weight times the total of its clips'
+// weights (up to 1), so fading a layer's only clip in or out fades the layer.
+typedef struct AnimLayer {
+   LayerMode mode;
+   float weight;
+   std::vector<float> boneWeights;   // mask, empty for every bone at full weight
+   std::vector<ClipState> clips;
+} AnimLayer;
+
+// Scratch poses for one evaluation. Blocks are kept when it is reset, so once
+// the first few frames have grown it taking a pose allocates nothing.
+class PoseArena {
+public:
+   PoseArena();
+
+   LocalTransform * take(unsigned int count);
+   void reset();                        // everything taken is free again
+
+   // One per thread, for evaluating whatever that thread is updating
+   static PoseArena * local();
+
+private:
+   std::vector<std::vector<LocalTransform> > _blocks;
+   unsigned int _block, _used;
+};
 
 namespace AN {
-   Eigen::Matrix4f ComputeKeyframeTransform(AnimBone * animBone, int keyCount, float tickTime, float duration);
+   // Copies an animation's keys into its tracks, once the keys are in place.
+   // Compressed animations have no keys or tracks and are sampled with AC.
+   void BuildTracks(Animation * anim, unsigned int boneCount);
+
+   // Keyframe transform (translation * rotation * scale) of every bone at
+   // tickTime, into out[0 .. boneCount). Several bones are sampled at a time
+   // with SIMD, rotations with an approximated slerp (within about 1e-3 of the
+   // exact slerp) and the transforms are written straight as 3x4 matrices.
+   // Keys may be spaced unevenly. The cursor of whoever is playing the clip
+   // makes finding them constant time while it plays forward.
+   void SampleAnimation(const Animation& anim, float tickTime, Mmath::Matrix3x4f * out,
+                        KeyCursor * cursor = NULL);
+
+   // The same for a single bone, for bones playing something of their own
+   Mmath::Matrix3x4f SampleBone(const Animation& anim, unsigned int bone, float tickTime,
+                                KeyCursor * cursor = NULL);
+
+   // The same sampling kept as separate parts, for blending
+   void SamplePose(const Animation& anim, float tickTime, LocalTransform * out, KeyCursor * cursor = NULL);
+   LocalTransform SampleBonePose(const Animation& anim, unsigned int bone, float tickTime,
+                                 KeyCursor * cursor = NULL);
+   void ComposePose(const LocalTransform * pose, unsigned int boneCount, Mmath::Matrix3x4f * out);
+
+   // Loops a time past the end of the animation back into it, however far past
+   float WrapTime(float time, float duration);
+
+   // How far a bone's position track moves playing timeDelta seconds on from
+   // fromTime, counting a whole pass of the track for every time it loops
+   Eigen::Vector3f TrackDisplacement(const Animation& anim, unsigned int bone, float fromTime, float timeDelta);
+
+   // Fades a clip of the layer toward a weight over some seconds (at once for
+   // 0), adding it at its first key if it isn't playing. Crossfading fades the
+   // clip in and every other clip of the layer out.
+   void FadeClip(AnimLayer * layer, int animNum, float weight, float seconds);
+   void Crossfade(AnimLayer * layer, int animNum, float seconds);
+
+   // Moves the clips and fades forward, dropping clips that faded out
+   void AdvanceLayer(AnimLayer * layer, const std::vector<Animation>& animations, float timeDelta);
+
+   // Lays the layer over pose (boneCount bones), moving its clips' cursors along
+   void ApplyLayer(AnimLayer * layer, const std::vector<Animation>& animations,
+                   unsigned int boneCount, PoseArena * arena, LocalTransform * pose);
 }
 
 #endif // __ANIMATION_H__
@@ -0,0 +1,109 @@
+#ifndef __ARTICULATED_H__
+#define __ARTICULATED_H__
+
+#include "model.h"
+#include "spatial.h"
+
+#include <vector>
+
+#define ARTICULATED_GRAVITY -9.8f       // along y, in model units per second squared
+#define ARTICULATED_DAMPING 0.05f       // default joint friction, torque per radian per second
+#define ARTICULATED_ARMATURE 1e-4f      // rotor inertia added to every hinge, keeps massless links solvable
+
+// A bone tree simulated as a tree of rigid bodies with Featherstone's
+// articulated body algorithm, forward and inverse dynamics both O(n) in the
+// number of joints.
+//
+// The bones are flattened into links in boneOrder, one link per IKJoint, so a
+// bone with three joints (hinges, as in a .jnt file) becomes three links of
+// which only the last carries the bone's mass. Bones without joints are welded
+// to the link of their parent. Link 0 is the root bone, which floats freely
+// (unless fixedRoot) and whose own joints are ignored.
+//
+// Everything is in model space, velocities and forces of a link in that link's
+// own coordinates.
+class ArticulatedBody {
+public:
+   ArticulatedBody(const std::vector<Bone>& bones, const std::vector<BoneStep>& order);
+
+   // State, which can be set freely between steps. Angles start at 0 and the
+   // root where the root bone's parentOffset puts it.
+   std::vector<float> angles;                   // per link, link 0 has none
+   std::vector<float> velocities;
+   Eigen::Quaternion<float, Eigen::DontAlign> rootRotation;
+   Eigen::Vector3f rootPosition;
+   SpatialVector rootVelocity;
+
+   // Inputs, kept from step to step
+   std::vector<float> torques;                  // per link, driving its hinge
+   Eigen::Vector3f gravity;
+   float damping;
+   bool fixedRoot;                              // the root stays put, as if nailed down
+
+   // Filled in by forwardDynamics, read by inverseDynamics
+   std::vector<float> accelerations;
+   SpatialVector rootAcceleration;
+
+   unsigned int linkCount();
+   int linkOf(int bone, int joint);             // -1 for the root's joints and bones not in the tree
+
+   // Push on a bone at its center of mass, in model space, until clearForces
+   void applyForce(int bone, const Eigen::Vector3f& force);
+   void applyTorque(int bone, const Eigen::Vector3f& torque);
+   void clearForces();
+
+   // Accelerations of the links and root from the state, torques, gravity and applied forces
+   void forwardDynamics();
+
+   // The other way around: linkTorques that give the current accelerations and
+   // rootAcceleration, along with the force the root would have to be held
+   // with. A free root's force is zero for accelerations forwardDynamics found.
+   void inverseDynamics(std::vector<float>& linkTorques, SpatialVector& rootForce);
+
+   // forwardDynamics then semi-implicit Euler, with the angles kept to the joints' limits
+   void step(float timeDelta);
+
+   // A bone's transform relative to its parent (the root's relative to the model), for posing
+   Mmath::Matrix3x4f localM(int bone);
+
+   float energy();                              // kinetic plus potential
+
+private:
+   typedef struct Link {
+      int parent;                               // link, -1 for the root
+      int bone;
+      int joint;                                // of the bone, -1 for the root
+      Mmath::Matrix3x4f treeM;                  // from the parent link to just before the hinge
+      Eigen::Vector3f axis;
+      float minAngle, maxAngle;
+      SpatialMatrix inertia;                    // of the bones it carries, in its own coordinates
+      float mass;
+      Eigen::Vector3f massMoment;               // mass times center of mass
+   } Link;
+
+   // Per link values of the step being taken
+   typedef struct LinkState {
+      SpatialTransform X;                       // from the parent link
+      Eigen::Matrix3f modelE;                   // model space to the link's coordinates
+      Eigen::Vector3f origin;                   // in model space
+      SpatialVector v, c, fExt;                 // velocity, velocity product acceleration, outside forces
+      SpatialMatrix IA;                         // articulated inertia
+      SpatialVector pA, U, a;                   // bias force, IA S, acceleration
+      float D, u;
+   } LinkState;
+
+   const std::vector<Bone> * bones;
+   std::vector<Link> links;
+   std::vector<LinkState> states;
+
+   std::vector<int> boneLinks;                  // the link carrying each bone, -1 if not in the tree
+   std::vector<int> firstLinks;                 // each bone's first joint's link, -1 if it has none
+   std::vector<Mmath::Matrix3x4f> boneInLinks;  // each bone's frame in its link's coordinates
+   std::vector<Eigen::Vector3f> boneForces, boneTorques;
+
+   void addBoneMass(int bone);
+   void computeKinematics();
+   float hingeTorque(int link);
+};
+
+#endif // __ARTICULATED_H__
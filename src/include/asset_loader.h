@@ -0,0 +1,75 @@
+#ifndef __ASSET_LOADER_H__
+#define __ASSET_LOADER_H__
+
+#include "thread_pool.h"
+#include <exception>
+#include <memory>
+
+#define UPLOAD_FRAME_BUDGET 0.004   // seconds per frame the game spends sending loaded assets to the GPU
+
+class Model;
+class Texture;
+
+// The files that make up one model, NULL for the parts it doesn't have
+typedef struct ModelAsset {
+   const char * mesh;            // .ciab or .obj
+   const char * skinningPIN;
+   const char * animationPIN;
+   const char * constraints;
+   unsigned int lodLevels;       // levels of detail including the full mesh, 0 or 1 for none
+   float lodRatio;
+} ModelAsset;
+
+// Becomes ready once the asset has been sent to the GPU
+typedef std::shared_future<void> AssetHandle;
+
+// Decodes assets on a thread pool and queues whatever has to go to the GPU for
+// the GL thread. The GL thread drains the queue a little every frame with
+// update(), or with wait() and finish() when it can't go on without an asset,
+// so loading takes about as long as the slowest asset instead of all of them.
+class AssetLoader {
+public:
+   AssetLoader(unsigned int threadCount);   // 0 for one per hardware thread
+   ~AssetLoader();
+
+   // Runs decode on a worker, then upload on the GL thread
+   AssetHandle submit(const std::function<void()>& decode, const std::function<void()>& upload);
+
+   // The model is filled in on a worker, so nothing should use it until its
+   // handle is ready. A texture can be given to models before it is ready,
+   // they draw without it until then. Both are kept alive until loaded.
+   AssetHandle loadModel(const std::shared_ptr<Model>& model, const ModelAsset& asset);
+   AssetHandle loadTexture(const std::shared_ptr<Texture>& texture, const char * path, bool repeat);
+
+   // GL thread only. update() runs queued uploads for up to budget seconds (at
+   // least one if any are queued) and returns how many it ran.
+   unsigned int update(double budget);
+   void wait(const AssetHandle& handle);
+   void finish();
+
+   unsigned int pendingCount();            // submitted and not uploaded yet
+   static bool isReady(const AssetHandle& handle);
+
+private:
+   typedef struct Upload {
+      std::function<void()> run;
+      std::exception_ptr error;            // set if the decode failed, run is skipped
+      std::shared_ptr<std::promise<void> > done;
+   } Upload;
+
+   // Not copyable, the workers point back at the loader
+   AssetLoader(const AssetLoader& other);
+   AssetLoader& operator=(const AssetLoader& other);
+
+   void runNextUpload();                   // blocks until one is queued
+
+   std::deque<Upload> _uploads;
+   std::mutex _mutex;
+   std::condition_variable _uploadQueued;
+   unsigned int _pending;
+
+   // Last so the workers are joined before the queue they push to goes away
+   ThreadPool _pool;
+};
+
+#endif // __ASSET_LOADER_H__
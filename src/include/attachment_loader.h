@@ -9,6 +9,9 @@
 #include <string>
 #include <vector>
 
+// Both loaders keep a binary copy of what they parse next to the text file
+// (<path>.pinc) and read that instead for as long as the text is unchanged.
+
 void PIN_loadWeights(std::vector<float>& boneWeights,
                      int& numBones,
                      const char * path);
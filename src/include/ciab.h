@@ -0,0 +1,99 @@
+#ifndef __CIAB_H__
+#define __CIAB_H__
+
+#include "model.h"
+#include <stddef.h>
+#include <vector>
+
+// Field tags of the ciab format (see converter/CIAB_FORMAT.txt), also used as
+// the section types of ciab2 (see converter/CIAB2_FORMAT.txt)
+typedef enum {
+   POSITIONS = 1,
+   NORMALS = 2,
+   COLORS = 3,
+   TEXCOORDS = 4,
+   TANGENTS = 5,
+   BITANGENTS = 6,
+   INDICES = 7,
+   BONE_INDICES = 8,
+   BONE_WEIGHTS = 9,
+   BONE_NUM_INF = 10,
+   BONE_TREE = 11,
+   ANIMATIONS = 12,
+   VERTEX_BLOCK = 13,
+   KEYFRAMES_Q16 = 14,
+   KEYFRAMES_COMPRESSED = 15
+} modelFieldType;
+
+#define CIAB2_MAGIC "CIAB"
+#define CIAB2_VERSION 2
+#define CIAB2_ALIGNMENT 16
+
+// Byte offsets of each attribute inside a ciab2 interleaved vertex
+typedef enum {
+   VB_POSITION = 0,
+   VB_NORMAL = 12,
+   VB_COLOR = 24,
+   VB_UV = 36,
+   VB_TANGENT = 44,
+   VB_BITANGENT = 56,
+   VB_BONE_WEIGHTS = 68,
+   VB_BONE_NUM_INF = 76,
+   VB_BONE_INDICES = 80
+} vertexBlockOffset;
+
+// Bytes per interleaved vertex for 1 or 2 byte bone indices
+unsigned int CIABVertexStride(unsigned int boneIndexSize);
+
+typedef struct CIABAnimationView {
+   unsigned int fps;
+   unsigned int keyCount;
+   const Key * keys;                // bone major, boneCount * keyCount keys
+   const unsigned char * quantized; // keyframes_q16 record instead of keys (ciab2 only)
+   const unsigned char * compressed;   // AC clip instead of keys (ciab2 only)
+   size_t compressedSize;
+} CIABAnimationView;
+
+// Typed views into an in-memory ciab or ciab2 file. parse() walks the field table
+// or section directory once, checking every field fits inside the buffer, and
+// leaves each pointer aimed straight at its data. Nothing is copied, so the views
+// are only valid while the underlying buffer (usually a MappedFile) is alive.
+class CIABView {
+public:
+   CIABView();
+
+   bool parse(const unsigned char * data, size_t size);
+   bool hasField(int field) const;
+
+   // Dequantizes the bone major keys of an animation with a quantized record
+   void decodeKeys(const CIABAnimationView& anim, Key * keys) const;
+
+   unsigned int version;
+   unsigned int vertexCount, faceCount, boneCount, animationCount;
+   unsigned int presentFlags;
+   const char * error;
+
+   const Eigen::Vector3f * positions;
+   const Eigen::Vector3f * normals;
+   const Eigen::Vector3f * colors;
+   const Eigen::Vector2f * uvs;
+   const Eigen::Vector3f * tangents;
+   const Eigen::Vector3f * bitangents;
+   const unsigned int * indices;          // 3 per face
+   const unsigned int * boneIndices;      // MAX_INFLUENCES per vertex
+   const float * boneWeights;             // MAX_INFLUENCES per vertex
+   const unsigned int * boneInfCounts;
+
+   const unsigned char * vertexBlock;     // interleaved vertices (ciab2 only)
+   unsigned int vertexStride;
+   unsigned int boneIndexSize;            // bytes per bone index in the vertex block
+
+   const unsigned char * boneTree;        // start of the variable length bone records
+   size_t boneTreeSize;
+   std::vector<CIABAnimationView> animations;
+
+   // Fills the model's bone list from the bone tree field
+   void readBones(std::vector<Bone>& bones, unsigned int& boneRoot) const;
+};
+
+#endif // __CIAB_H__
@@ -0,0 +1,60 @@
+#ifndef __CTEX_H__
+#define __CTEX_H__
+
+#include <stddef.h>
+#include <vector>
+
+#define CTEX_VERSION 1
+#define CTEX_ALIGNMENT 16
+
+// Baked, block compressed textures (see converter/CTEX_FORMAT.txt). The baker
+// flips, mipmaps and compresses offline so the game only has to hand each
+// level to glCompressedTexImage2D.
+namespace TX {
+
+   typedef enum {
+      RGB8 = 0,   // plain pixels, only used for images that weren't baked
+      BC1 = 1,    // RGB, 8 bytes per 4x4 block
+      BC3 = 3,    // RGBA, 16 bytes per block (BC4 alpha then BC1 color)
+      BC4 = 4,    // one channel, 8 bytes per block
+      BC5 = 5     // two channels, 16 bytes per block (BC4 red then BC4 green)
+   } Format;
+
+   // What a texture is used for, which decides how it is compressed and filtered
+   typedef enum {
+      DIFFUSE,    // BC1, or BC3 if it has alpha, mips averaged in linear space
+      NORMAL,     // BC5 holding x and y, z is rebuilt in the shader
+      SPECULAR    // BC4 holding the red channel the shader reads
+   } Usage;
+
+   typedef struct Level {
+      unsigned int width, height;
+      unsigned int offset, size;   // bytes into the texture data
+   } Level;
+
+   unsigned int BlockSize(Format format);
+   unsigned int LevelSize(Format format, unsigned int width, unsigned int height);
+
+   // Block codecs, each on a 4x4 block of RGBA pixels in rows
+   void EncodeBC1(const unsigned char rgba[64], unsigned char out[8]);
+   void EncodeBC4(const unsigned char rgba[64], int channel, unsigned char out[8]);
+   void DecodeBC1(const unsigned char block[8], unsigned char rgba[64]);
+   void DecodeBC4(const unsigned char block[8], int channel, unsigned char rgba[64]);
+
+   // Compresses an RGBA image (rows bottom up) and all its mips down to 1x1
+   void Bake(const unsigned char * rgba, unsigned int width, unsigned int height, Usage usage,
+             Format& format, std::vector<Level>& levels, std::vector<unsigned char>& data);
+
+   // Decompresses a level back to RGBA, for drivers without the compressed formats
+   void DecodeLevel(Format format, const Level& level, const unsigned char * data,
+                    std::vector<unsigned char>& rgba);
+
+   bool WriteFile(const char * path, Format format, const std::vector<Level>& levels,
+                  const std::vector<unsigned char>& data);
+
+   // Checks the header and level table, error says what was wrong on failure
+   bool Parse(const unsigned char * file, size_t size, Format& format,
+              std::vector<Level>& levels, const unsigned char *& data, const char *& error);
+}
+
+#endif // __CTEX_H__
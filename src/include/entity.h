@@ -3,8 +3,12 @@
 
 #include "matrix_math.h"
 #include "model.h"
+#include "animation.h"
+#include "pose_cache.h"
 #include <vector>
 
+class Camera;
+
 #define LEFT_BASE       (Eigen::Vector3f(1,0,0))
 #define RIGHT_BASE      (Eigen::Vector3f(-1,0,0))
 #define UP_BASE         (Eigen::Vector3f(0,1,0))
@@ -43,6 +47,7 @@ class StaticEntity : public Entity {
 public:
    Eigen::Vector3f scale;
    Model * model;
+   unsigned int lodLevel;     // level of detail it was last drawn at
 
    /* rigid body quantities */
    Eigen::Vector3f    linearMomentum;
@@ -62,13 +67,38 @@ public:
    float getRotationalEnergy();
    Eigen::Matrix4f generateModelM();
 
+   // Picks the level of detail to draw at from the size of the model's
+   // bounding sphere on screen, and remembers it for next time
+   unsigned int chooseLOD(Camera * camera);
+
+   // Half the bounding sphere's projected diameter over the screen height,
+   // 1 from inside it
+   float screenSize(Camera * camera);
+
+   // Whether any of the bounding sphere is inside the camera's frustum
+   bool inView(Camera * camera);
+
 protected:
    void initializePhysics();
 };
 
 class AnimatedEntity : public StaticEntity {
 public:
-   Eigen::Matrix4f animMs[MAX_BONES];   // invBindPose included
+   std::vector<Mmath::Matrix3x4f> animMs;       // invBindPose included, one per bone
+   std::vector<Mmath::Matrix3x4f> keyframeMs;   // each bone's sampled keyframe, relative to its parent
+
+   // When set, the entity shares its pose with others playing the same clip in
+   // step (see PoseCache). palette is the shared pose to draw, NULL when the
+   // entity drew its own into animMs.
+   PoseCache * poseCache;
+   PaletteHandle palette;
+
+   // The bone transforms it is drawn with, for skinning it on the CPU (see SK)
+   const Mmath::Matrix3x4f * drawnAnimMs();
+
+   // Moves the entity along the floor as its root bone moves in the entity's
+   // own animation, and keeps the root over the entity's position instead
+   bool rootMotion;
 
    AnimatedEntity(Eigen::Vector3f pos, Eigen::Quaternionf rot, Eigen::Vector3f scl, Model * model);
    AnimatedEntity(Eigen::Vector3f pos, Eigen::Quaternionf rot, Model * model);
@@ -77,6 +107,61 @@ public:
    virtual void update(float timeDelta)=0;
    virtual void playAnimation(int animNum)=0;
    virtual void stopAnimation()=0;
+
+   // Plays the animation from its start, fading out of what was playing
+   virtual void crossfadeTo(int animNum, float seconds)=0;
+
+   // Laid over the entity's own animation in order (see AnimLayer), the clips
+   // are started and faded with AN::FadeClip and AN::Crossfade
+   std::vector<AnimLayer> layers;
+
+   unsigned int addLayer(LayerMode mode);
+
+   // Gives the bone (and its subtree when recursive) a weight in the layer's
+   // mask. The first bone picked limits the layer to the bones picked.
+   void setLayerMask(unsigned int layer, int boneNum, bool recursive, float weight);
+
+   // For updates at a fixed rate (see AnimScheduler). endTick() keeps the
+   // pose just updated as the latest tick, and interpolatePose() draws the
+   // pose alpha of the way to it from the tick before, moving the entity by
+   // the same part of the latest tick's root motion. When both ticks drew
+   // shared poses the pose in between is shared too, blended at the nearest
+   // 1 / POSE_BLEND_STEPS of the way.
+   void endTick();
+   void interpolatePose(float alpha);
+
+protected:
+   AnimLayer transition;   // what was playing before a crossfade, fading out
+   KeyCursor cursor;       // where the entity's own animation was last sampled
+
+   bool isBlending();
+   void advanceLayers(float timeDelta);
+   void blendLayers(LocalTransform * pose, PoseArena * arena);
+
+   // Whether the pose only depends on the clip and time, so it can be shared
+   virtual bool canSharePose();
+
+   // Looks the pose up in the pose cache, returning true when someone already
+   // evaluated it this frame and keyframeMs is copied from it. Otherwise time
+   // is moved to the cached pose's time and sharePose() publishes the result.
+   bool reusePose(int animNum, float& time, unsigned int mask);
+   void sharePose(const std::vector<Mmath::Matrix3x4f> * boneMs);
+
+   // Root motion of the entity's own animation played timeDelta seconds on
+   // from fromTime, and taking it out of keyframeMs once sampled. Unchained
+   // poses have every bone in model space, so every bone is moved back.
+   void moveByRoot(int animNum, float fromTime, float timeDelta);
+   void pinRoot(int animNum, bool chained);
+
+private:
+   std::vector<Mmath::Matrix3x4f> lastTickMs, prevTickMs;
+   PaletteHandle lastTickPalette, prevTickPalette;   // what each tick drew, NULL for its own pose
+   Eigen::Vector3f pendingMotion;   // root motion of the tick being updated
+   Eigen::Vector3f tickMotion;      // root motion of the latest tick
+   float motionApplied;             // how much of tickMotion has moved the entity
+   bool ticked;                     // updated through endTick(), root motion waits for it
+
+   void initializeAnimation();
 };
 
 class MocapEntity : public AnimatedEntity {
@@ -87,6 +172,7 @@ public:
 
    void playAnimation(int animNum);
    void stopAnimation();
+   void crossfadeTo(int animNum, float seconds);
    void update(float timeDelta);
 
 private:
@@ -98,7 +184,7 @@ private:
 class SkinnedEntity : public AnimatedEntity {
 public:
    // has all space transforms except for invBindPose
-   std::vector<Eigen::Matrix4f> boneMs;
+   std::vector<Mmath::Matrix3x4f> boneMs;
 
    SkinnedEntity(Eigen::Vector3f pos, Eigen::Quaternionf rot, Eigen::Vector3f scl, Model * model);
    SkinnedEntity(Eigen::Vector3f pos, Eigen::Quaternionf rot, Model * model);
@@ -108,6 +194,7 @@ public:
    void playAnimation(int animNum, int boneNum, bool recursive);
    void stopAnimation();
    void stopAnimation(int boneNum, bool recursive);
+   void crossfadeTo(int animNum, float seconds);
    void update(float timeDelta);
 
 protected:
@@ -115,8 +202,12 @@ protected:
    std::vector<bool> bonesPlaying;
    std::vector<float> animTimes;
 
+   bool canSharePose();
    void replayIfNeeded(float timeDelta);
-   void computeAnimMs(int boneIndex, Eigen::Matrix4f parentM);
+   void sampleKeyframes();
+   void sampleKeyframes(float rootTime);
+   void computeAnimMs();
+   void poseBone(const BoneStep& step, const Mmath::Matrix3x4f& localM);
 
 private:
    void initialize();
@@ -1,8 +1,22 @@
-
 #ifndef __ENTITY_IK_H__
 #define __ENTITY_IK_H__
 
 #include "entity.h"
+#include "ik_dls.h"
+
+#define IK_MAX_ITERATIONS 10         // per frame, the next frame carries on from where it stopped
+#define IK_MAX_SOLVE_SECONDS 0.002   // per group of limbs
+#define IK_TOLERANCE 1e-6            // relative change in cost that counts as converged
+#define IK_UNCHANGED_EPSILON 1e-6f   // goals and bases moving less than this aren't solved again
+
+typedef enum {
+   IK_CERES,                    // solved together with the other Ceres limbs of its group, with autodiff
+   IK_DAMPED_LEAST_SQUARES      // solved on its own with IK::SolveDLS, after the group's Ceres limbs
+} IKMethod;
+
+namespace ceres {
+   class Problem;
+}
 
 class IKLimb {
 public:
@@ -12,6 +26,11 @@ public:
 
    Eigen::Vector3f goal;
    std::vector<double *> jointAngles;
+   IKMethod method;
+
+   // What the limb was last solved from, read by its cost function
+   Eigen::Matrix<float, 4, 4, Eigen::DontAlign> baseM;
+   Eigen::Vector3f solvedGoal;
 
    IKLimb();
    ~IKLimb();
@@ -20,28 +39,61 @@ public:
 typedef struct {
    std::vector<double> angles;
    std::vector<IKLimb *> limbs; // list of limbs whos root start at this bone
+
+   // The limbs' problem, built the first time they're solved and kept after.
+   // Its parameters are the angles of the bones themselves (so limbs through
+   // the same bone agree on it) and basePosition for base limbs.
+   ceres::Problem * problem;
+   double basePosition[3];
+   bool solved;                 // solved at least once since the limbs last changed
+   bool converged;              // the last solve finished, rather than ran out of budget
 } IKBone;
 
 class IKEntity : public SkinnedEntity {
 public:
    IKEntity(Eigen::Vector3f pos, Model * model);
+   ~IKEntity();
    void addLimb(std::vector<int> boneIndices, Eigen::Vector3f offset, bool isBase);
    void setLimbGoal(int limbIndex, Eigen::Vector3f goal);
+   void setLimbMethod(int limbIndex, IKMethod method);
+
+   // Where the limb ends in world space, with the angles solved last
+   Eigen::Vector3f limbEnd(int limbIndex);
+
    void update(float timeDelta);
    void animateWithIK();
    void animateWithKeyframes();
 
    std::vector<IKLimb *> ikLimbs;
 
+   // The limb groups split into jobs that can be solved at the same time, on
+   // any threads, as long as nothing else touches the entity meanwhile. Groups
+   // share a job when one's bones lie above the other's root, or when any limb
+   // moves the entity (base limbs). Only solving with IK has jobs.
+   unsigned int ikJobCount();
+   void solveIKJob(unsigned int job);
+   const std::vector<int>& ikJobRoots(unsigned int job);   // root bones of the job's groups, parents first
+
+   // Set once this frame's jobs are solved (see IKScheduler), otherwise
+   // update() solves them itself
+   bool ikSolved;
+
 protected:
    std::vector<IKBone> ikBones;
    bool usingIK;
 
+   std::vector<std::vector<int> > ikJobs;   // root bones of each job's groups, parents first
+   bool jobsBuilt;
+
    std::vector<double *> constructJointAnglePtrs(std::vector<int>& boneIndices);
    Eigen::Matrix4f constructJointMatrix(int boneIndex);
-   void computeAnimMs(int boneIndex, Eigen::Matrix4f parentM);
+   void computeAnimMs();
+
+   Eigen::Matrix4f jointChainM(int boneIndex);
+   void buildJobs();
 
-   void solveLimbs(Eigen::Matrix4f baseM, std::vector<IKLimb *> limbs);
+   void buildProblem(IKBone * ikBone);
+   void solveLimbs(Eigen::Matrix4f parentM, IKBone * ikBone);
 };
 
-#endif // __ENTITY_IK_H__
\ No newline at end of file
+#endif // __ENTITY_IK_H__
@@ -2,40 +2,31 @@
 #define __ENTITY_RIGID_H__
 
 #include "entity.h"
+#include "articulated.h"
 
-#define NBODIES 1
+#define RIGID_MAX_STEP (1.0f / 240)   // longest physics step, longer updates are split into even steps
 
+// A ragdoll. The model's bone tree is simulated as an ArticulatedBody, its
+// joints the hinges loaded from a .jnt file (see Model::loadConstraints), and
+// the bones are posed from it every update. The body is built when the entity
+// is made, so the joints have to be loaded first. It lives in model space, so
+// the entity itself stays where it is put.
 class RigidEntity : public SkinnedEntity {
-private:
-   // RigidBody/Joint values that are specific to an entity
-   class RJoint {
-   public:
-      float angle;
-      Eigen::Vector3f angularVelocity;
-      Eigen::Vector3f angularAcceleration;
-      RJoint();
-   };
-
-   class RBone {
-   public:
-      Eigen::Vector3f     force;       /* total force acting on the body */
-      Eigen::Vector3f     torque;      /* total torque acting on the body */
-      std::vector<RJoint> rjoints;     /* the entity-specific joints at this bone */
-      RBone();
-   };
-
-   std::vector<RBone> rbones;
-
-   void updateJoint(int boneNdx);
-
 public:
+   ArticulatedBody body;
+
    RigidEntity(Eigen::Vector3f pos, Eigen::Quaternionf rot, Eigen::Vector3f scl, Model * model);
    RigidEntity(Eigen::Vector3f pos, Eigen::Quaternionf rot, Model * model);
    RigidEntity(Eigen::Vector3f pos, Model * model);
 
    void update(float timeDelta);
+
+   // In world space, at the bone's center of mass, for the next update
    void applyForce(int boneNum, Eigen::Vector3f force);
    void applyTorque(int boneNum, Eigen::Vector3f torque);
+
+   // Drives one of a bone's joints until changed
+   void setJointTorque(int boneNum, int jointNum, float torque);
 };
 
-#endif /* __ENTITY_RIGID_H__ */
\ No newline at end of file
+#endif /* __ENTITY_RIGID_H__ */
@@ -0,0 +1,42 @@
+#ifndef __IK_DLS_H__
+#define __IK_DLS_H__
+
+#include "model.h"
+
+#include <vector>
+
+#define IK_MAX_LIMB_ANGLES 48        // joint angles in one limb, the fast solver keeps its Jacobian on the stack
+#define IK_DLS_ITERATIONS 12         // per frame, the next frame carries on from where it stopped
+#define IK_DLS_DAMPING 0.1f          // keeps steps small near singular poses (a straight arm)
+#define IK_DLS_MAX_TURN 0.2f         // most any joint turns in one step, in radians
+#define IK_DLS_TOLERANCE 1e-4f       // distance from the goal that counts as reached
+#define IK_DLS_MIN_STEP 1e-6f        // largest angle change that counts as stuck, at a limit or out of reach
+
+typedef struct IKResult {
+   float error;                      // distance from the end of the limb to the goal after solving
+   int iterations;
+   bool settled;                     // reached the goal, or can't get any closer
+} IKResult;
+
+// Damped least squares IK on one limb, the fast alternative to solving it with
+// Ceres (see IKEntity::setLimbMethod). Every joint is a hinge, so its column of
+// the Jacobian is just its world axis crossed with the arm from the joint to
+// the end of the limb, with no autodiff. Each step solves the 3x3 system
+// (J J^T + damping^2 I) x = error, moves the angles by J^T x (scaled down to
+// IK_DLS_MAX_TURN) and clamps them to the joints' limits.
+namespace IK {
+   // The end of the limb (the origin of its last bone) in world space. baseM is
+   // what the first bone hangs from, basePosition is added to it for base limbs
+   // (NULL otherwise).
+   Eigen::Vector3f EndEffector(const std::vector<Bone>& bones, const std::vector<int>& boneIndices,
+                               const std::vector<double *>& angles, const Eigen::Matrix4f& baseM,
+                               const Eigen::Vector3f * basePosition);
+
+   // Solves the limb's angles (its jointAngles, in bone then joint order) in
+   // place, and basePosition along with them when it isn't NULL
+   IKResult SolveDLS(const std::vector<Bone>& bones, const std::vector<int>& boneIndices,
+                     const std::vector<double *>& angles, const Eigen::Matrix4f& baseM,
+                     const Eigen::Vector3f& goal, Eigen::Vector3f * basePosition);
+}
+
+#endif // __IK_DLS_H__
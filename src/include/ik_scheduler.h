@@ -0,0 +1,40 @@
+#ifndef __IK_SCHEDULER_H__
+#define __IK_SCHEDULER_H__
+
+#include "entity_ik.h"
+#include "thread_pool.h"
+
+#include <vector>
+
+// Solves the IK of many entities at once at the start of a frame, before any
+// of them is updated. Every entity's goals are read as they are then, and its
+// independent jobs (see IKEntity::ikJobCount) are spread over the pool. Workers
+// take the next job from a shared counter until none are left, so one slow
+// solve doesn't hold up the jobs queued behind it. The calling thread works
+// through jobs too.
+class IKScheduler {
+public:
+   IKScheduler(ThreadPool * pool);   // NULL solves everything on the calling thread
+   ~IKScheduler();
+
+   void add(IKEntity * entity);
+   void remove(IKEntity * entity);
+
+   // Entities are left to be updated as usual afterwards, which poses them
+   // with the solved angles
+   void solve();
+
+   unsigned int jobCount();   // jobs in the last solve
+
+private:
+   typedef struct IKJob {
+      IKEntity * entity;
+      unsigned int job;
+   } IKJob;
+
+   ThreadPool * _pool;
+   std::vector<IKEntity *> _entities;
+   std::vector<IKJob> _jobs;
+};
+
+#endif // __IK_SCHEDULER_H__
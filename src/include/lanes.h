@@ -0,0 +1,85 @@
+#ifndef __LANES_H__
+#define __LANES_H__
+
+#include <math.h>
+
+#if defined(__AVX__) || defined(__SSE2__)
+   #include <immintrin.h>
+#endif
+
+// Each lane type works on WIDTH neighboring bones (or vertices) at once. The
+// animation sampler and the skinning kernels are written once over these
+// operations and instantiated for the widest type the compiler targets, plus
+// the scalar one for single elements and leftovers.
+typedef struct ScalarLanes {
+   typedef float T;
+   enum { WIDTH = 1 };
+   static T load(const float * p) { return *p; }
+   static void store(float * p, T a) { *p = a; }
+   static T set(float v) { return v; }
+   static T add(T a, T b) { return a + b; }
+   static T sub(T a, T b) { return a - b; }
+   static T mul(T a, T b) { return a * b; }
+   static T div(T a, T b) { return a / b; }
+   static T min(T a, T b) { return a < b ? a : b; }
+   static T max(T a, T b) { return a > b ? a : b; }
+   static T sqrt(T a) { return sqrtf(a); }
+   static T gather(const float * base, const int * offsets) { return base[offsets[0]]; }
+   static T flipSign(T a, T sign) { return sign < 0 ? -a : a; }   // a, negated where sign is negative
+} ScalarLanes;
+
+#if defined(__SSE2__)
+typedef struct SSELanes {
+   typedef __m128 T;
+   enum { WIDTH = 4 };
+   static T load(const float * p) { return _mm_loadu_ps(p); }
+   static void store(float * p, T a) { _mm_storeu_ps(p, a); }
+   static T set(float v) { return _mm_set1_ps(v); }
+   static T add(T a, T b) { return _mm_add_ps(a, b); }
+   static T sub(T a, T b) { return _mm_sub_ps(a, b); }
+   static T mul(T a, T b) { return _mm_mul_ps(a, b); }
+   static T div(T a, T b) { return _mm_div_ps(a, b); }
+   static T min(T a, T b) { return _mm_min_ps(a, b); }
+   static T max(T a, T b) { return _mm_max_ps(a, b); }
+   static T sqrt(T a) { return _mm_sqrt_ps(a); }
+   static T gather(const float * base, const int * offsets) {
+      return _mm_setr_ps(base[offsets[0]], base[offsets[1]], base[offsets[2]], base[offsets[3]]);
+   }
+   static T flipSign(T a, T sign) { return _mm_xor_ps(a, _mm_and_ps(sign, _mm_set1_ps(-0.0f))); }
+} SSELanes;
+#endif
+
+#if defined(__AVX__)
+typedef struct AVXLanes {
+   typedef __m256 T;
+   enum { WIDTH = 8 };
+   static T load(const float * p) { return _mm256_loadu_ps(p); }
+   static void store(float * p, T a) { _mm256_storeu_ps(p, a); }
+   static T set(float v) { return _mm256_set1_ps(v); }
+   static T add(T a, T b) { return _mm256_add_ps(a, b); }
+   static T sub(T a, T b) { return _mm256_sub_ps(a, b); }
+   static T mul(T a, T b) { return _mm256_mul_ps(a, b); }
+   static T div(T a, T b) { return _mm256_div_ps(a, b); }
+   static T min(T a, T b) { return _mm256_min_ps(a, b); }
+   static T max(T a, T b) { return _mm256_max_ps(a, b); }
+   static T sqrt(T a) { return _mm256_sqrt_ps(a); }
+#if defined(__AVX2__)
+   static T gather(const float * base, const int * offsets) {
+      return _mm256_i32gather_ps(base, _mm256_loadu_si256((const __m256i *)offsets), 4);
+   }
+#else
+   static T gather(const float * base, const int * offsets) {
+      return _mm256_setr_ps(base[offsets[0]], base[offsets[1]], base[offsets[2]], base[offsets[3]],
+                            base[offsets[4]], base[offsets[5]], base[offsets[6]], base[offsets[7]]);
+   }
+#endif
+   static T flipSign(T a, T sign) { return _mm256_xor_ps(a, _mm256_and_ps(sign, _mm256_set1_ps(-0.0f))); }
+} AVXLanes;
+typedef AVXLanes WideLanes;
+#elif defined(__SSE2__)
+typedef SSELanes WideLanes;
+#else
+typedef ScalarLanes WideLanes;
+#endif
+
+#endif // __LANES_H__
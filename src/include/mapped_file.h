@@ -0,0 +1,29 @@
+#ifndef __MAPPED_FILE_H__
+#define __MAPPED_FILE_H__
+
+#include <stddef.h>
+
+// Read only memory mapping of a whole file. The mapping stays valid until
+// close() is called or the object is destroyed, so views into data() can be
+// held for as long as the owner keeps the MappedFile around.
+class MappedFile {
+public:
+   MappedFile();
+   ~MappedFile();
+
+   bool open(const char * path);
+   void close();
+
+   const unsigned char * data() const;
+   size_t size() const;
+
+private:
+   // Not copyable, the mapping has a single owner
+   MappedFile(const MappedFile& other);
+   MappedFile& operator=(const MappedFile& other);
+
+   void * _data;
+   size_t _size;
+};
+
+#endif // __MAPPED_FILE_H__
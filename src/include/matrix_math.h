@@ -6,6 +6,24 @@
 #define EIGEN_DEFAULT_TO_COLUMN_MAJOR
 
 namespace Mmath {
+   // An affine transform without the constant bottom row, translation in the last column
+   typedef Eigen::Matrix<float, 3, 4, Eigen::DontAlign> Matrix3x4f;
+
+   inline Eigen::Matrix4f ExpandAffine(const Matrix3x4f& m) {
+      Eigen::Matrix4f expanded;
+      expanded.topRows<3>() = m;
+      expanded.row(3) << 0, 0, 0, 1;
+      return expanded;
+   }
+
+   // a * b as 4x4 affine transforms, without the products against the constant row
+   inline Matrix3x4f ComposeAffine(const Matrix3x4f& a, const Matrix3x4f& b) {
+      Matrix3x4f m;
+      m.leftCols<3>() = a.leftCols<3>() * b.leftCols<3>();
+      m.col(3) = a.leftCols<3>() * b.col(3) + a.col(3);
+      return m;
+   }
+
    template <typename T>
    T clamp(
       const T low,
@@ -0,0 +1,109 @@
+#ifndef __MESH_H__
+#define __MESH_H__
+
+#include "matrix_math.h"
+#include "geometry.h"
+#include <vector>
+
+#define NUM_FACE_EDGES 3
+#define MAX_INFLUENCES 4
+
+class Mesh;
+
+// Lightweight handle to a single vertex stored in a Mesh.
+// Holds no data of its own, so it is cheap to create and pass by value.
+class MeshVertex {
+public:
+   unsigned int index;
+
+   MeshVertex(Mesh * mesh, unsigned int index);
+
+   Eigen::Vector3f& position();
+   Eigen::Vector3f& normal();
+   Eigen::Vector3f& tangent();
+   Eigen::Vector3f& bitangent();
+   Eigen::Vector3f& color();
+   Eigen::Vector2f& uv();
+   unsigned int * boneIndices();
+   float * boneWeights();
+
+   // Topology queries (require Mesh::buildAdjacency)
+   unsigned int faceCount();
+   unsigned int neighborCount();
+   unsigned int faceIndex(unsigned int i);
+   unsigned int neighborIndex(unsigned int i);
+   bool hasNeighbor(unsigned int vertIndex);
+
+   void calculateNormal();
+
+private:
+   Mesh * mesh;
+};
+
+// Lightweight handle to a single triangle stored in a Mesh
+class MeshFace {
+public:
+   unsigned int index;
+
+   MeshFace(Mesh * mesh, unsigned int index);
+
+   unsigned int vertexIndex(int corner);
+   MeshVertex vertex(int corner);
+   Eigen::Vector3f& normal();
+
+   void calculateNormal();
+   Eigen::Vector3f intersectRay(Geom::Rayf ray);
+   bool pointCheckInside(Eigen::Vector3f pnt);
+
+private:
+   Mesh * mesh;
+};
+
+// Structure of arrays triangle mesh. Every vertex attribute lives in its own
+// dense stream so passes over one attribute (normals, GPU upload, picking)
+// touch contiguous memory. Faces are triples of vertex indices.
+class Mesh {
+public:
+   Mesh();
+
+   // Vertex streams (all are vertexCount long, bone streams are MAX_INFLUENCES wide)
+   std::vector<Eigen::Vector3f> positions;
+   std::vector<Eigen::Vector3f> normals;
+   std::vector<Eigen::Vector3f> colors;
+   std::vector<Eigen::Vector3f> tangents;
+   std::vector<Eigen::Vector3f> bitangents;
+   std::vector<Eigen::Vector2f> uvs;
+   std::vector<unsigned int> boneInfCounts;
+   std::vector<unsigned int> boneIndices;
+   std::vector<float> boneWeights;
+
+   // Face streams
+   std::vector<unsigned int> indices;     // NUM_FACE_EDGES per face
+   std::vector<Eigen::Vector3f> faceNormals;
+
+   // Adjacency in compressed row form, vertex i owns [starts[i], starts[i+1])
+   std::vector<unsigned int> vertFaceStarts, vertFaces;
+   std::vector<unsigned int> vertNeighborStarts, vertNeighbors;
+
+   unsigned int vertexCount() const;
+   unsigned int faceCount() const;
+
+   size_t vertexStreamBytes() const;   // the streams a planar vertex upload sends
+   size_t memoryBytes() const;         // everything, adjacency included
+
+   // Sizes every stream, zero filling new elements and dropping old adjacency
+   void resize(unsigned int vertexCount, unsigned int faceCount);
+   void clear();
+
+   MeshVertex vertex(unsigned int index);
+   MeshFace face(unsigned int index);
+
+   // Builds the vertex to face and vertex to vertex tables from the index stream
+   void buildAdjacency();
+   bool hasAdjacency() const;
+
+   void calculateFaceNormals();
+   void calculateVertexNormals();
+};
+
+#endif // __MESH_H__
@@ -3,29 +3,54 @@
 
 #include "matrix_math.h"
 #include "geometry.h"
+#include "mesh.h"
+#include "ctex.h"
+#include <memory>
 #include <vector>
 
-#define NUM_FACE_EDGES 3
-#define MAX_INFLUENCES 4
-#define MAX_BONES 100
 #define MAX_BONE_JOINTS 3
 
+#define BONE_DENSITY 1000.0f        // bones are estimated as solids of water, in mass per cubic unit
+#define BONE_THICKNESS 0.2f         // radius of a bone's solid as a fraction of its length
+#define BONE_MIN_LENGTH 0.01f       // shorter bones are sized as if this long
+
+#define LOD_FULL_DETAIL_SIZE 0.5f   // screen height fraction a model covers before it drops detail
+#define LOD_HYSTERESIS 0.15f        // how far past a switch point a model has to get to switch
+
+// Unaligned so a key has exactly the 44 byte layout it has in a ciab file,
+// which lets keys be used in place from a mapped file
 typedef struct Key {
    float time;
    Eigen::Vector3f position;
-   Eigen::Quaternionf rotation;
+   Eigen::Quaternion<float, Eigen::DontAlign> rotation;
    Eigen::Vector3f scale;
 } Key;
 
 typedef struct AnimBone {
-   std::vector<Key> keys;
+   const Key * keys;    // keyCount keys, in Animation::ownedKeys or a mapped file
 } AnimBone;
 
+#define ANIM_TRACK_CHANNELS 11   // time, position xyz, rotation xyzw, scale xyz
+#define ANIM_TRACK_LANES 8       // bones are padded to a multiple of the widest SIMD sampler
+
+// The keys of every bone laid out for sampling them all at once (see
+// AN::SampleAnimation). Key major, then channel, then bone, so one channel of
+// one key is a run of boneStride floats and neighboring bones fill SIMD lanes.
+typedef struct AnimTracks {
+   unsigned int boneCount;
+   unsigned int boneStride;      // boneCount rounded up to ANIM_TRACK_LANES
+   std::vector<float> data;      // keyCount * ANIM_TRACK_CHANNELS * boneStride floats
+   std::vector<float> times;     // time of each key, the same for every bone
+} AnimTracks;
+
 typedef struct Animation {
    unsigned int fps;
    unsigned int keyCount;
    float duration;
    std::vector<AnimBone> animBones;
+   std::vector<Key> ownedKeys;   // bone major storage for keys not viewed from a file
+   AnimTracks tracks;            // built from the keys by AN::BuildTracks
+   std::vector<unsigned char> compressed;   // AC clip sampled instead of keys, empty if none
 } Animation;
 
 typedef struct IKJoint {
@@ -48,14 +73,82 @@ typedef struct Bone {
    Eigen::Vector3f    com;                /* vector pointing from 0,0,0 to the center of mass */
 } Bone;
 
+// One entry of the flattened bone tree
+typedef struct BoneStep {
+   int bone;
+   int parent;    // -1 for the root
+} BoneStep;
+
 typedef struct BoneWeight {
    unsigned int index;
    float weight;
 } BoneWeight;
 
+// Where one vertex attribute sits in its buffer
+typedef struct VertexAttrib {
+   unsigned int vbo;
+   unsigned int type;         // GL component type
+   bool normalized;           // integer components are mapped to [0,1] instead of converted
+   unsigned int offset;       // bytes from the start of a vertex
+} VertexAttrib;
+
+// Planar models keep every attribute tightly packed in its own buffer (stride 0),
+// interleaved models share one buffer and stride between all the attributes
+typedef struct VertexFormat {
+   unsigned int stride;
+   VertexAttrib position, normal, color, uv, tangent, bitangent;
+   VertexAttrib boneNumInf, boneIndices, boneWeights;
+} VertexFormat;
+
+// A simplified index buffer drawn over the model's own vertex buffers
+typedef struct LevelOfDetail {
+   unsigned int indexID;      // 0 until the indices are uploaded
+   unsigned int faceCount;
+   float screenSize;          // projected bounding sphere size (fraction of the screen height) it is used below
+   std::vector<unsigned int> indices;   // waiting for bufferLODs(), emptied once on the GPU
+} LevelOfDetail;
+
+// A texture read off the GL thread, rows bottom up for OpenGL. A baked copy
+// (<path>.ctex, see converter/CTEX_FORMAT.txt) is used when it is at least as
+// new as the image, otherwise the image is decoded to plain RGB pixels.
+class Image {
+public:
+   int width, height;
+   TX::Format format;
+   std::vector<TX::Level> levels;      // empty for plain pixels, their mips are made on upload
+   std::vector<unsigned char> data;    // the pixels, or the whole baked file
+
+   void decode(const char * path);     // exits if the file can't be used as a texture
+};
+
+// An OpenGL texture, deleted along with the last handle to it. The id stays 0
+// until an image has been uploaded, so a texture still loading draws as missing.
+class Texture {
+public:
+   Texture();
+   ~Texture();
+
+   void upload(const Image& image, bool repeat);
+
+   unsigned int id;
+   size_t gpuBytes;
+
+private:
+   // Not copyable, the GL texture has a single owner
+   Texture(const Texture& other);
+   Texture& operator=(const Texture& other);
+};
+
+typedef std::shared_ptr<Texture> TextureHandle;
+
 class Vertex;
 class Face;
+class MappedFile;
+class ProgressiveMesh;
 
+// Vertex and Face form an editable pointer graph for geometry that changes
+// topology while it is being built (see TerrainGenerator). Loaded models keep
+// their geometry in a packed Mesh instead.
 class Vertex {
 public:
    unsigned int index;
@@ -63,11 +156,7 @@ public:
    Eigen::Vector3f normal;
    Eigen::Vector3f tangent;
    Eigen::Vector3f bitangent;
-   Eigen::Vector3f color;
    Eigen::Vector2f uv;
-   float boneInfCount;
-   float boneIndices[MAX_INFLUENCES];
-   float boneWeights[MAX_INFLUENCES];
 
    std::vector<Vertex *> neighbors; // neighboring vertices
    std::vector<Face *> faces; // faces that use this vertex as a corner
@@ -99,12 +188,15 @@ public:
 //    std::vector<FaceUpdate> faceUpdates;
 // } TesselateStep;
 
+// Owns its GL buffers, so a model has to be created and destroyed on the GL thread
 class Model {
 public:
    Model();
    ~Model();
 
    void loadVBV(const char * path);
+   void openVBV(const char * path);                // Starts streaming a VBV model in
+   bool streamVBV(unsigned int vertexCount);       // Reads up to vertexCount more vertices, true once done
    void loadCIAB(const char * path);
    void loadTexture(const char * path, bool repeat);
    void loadNormalMap(const char * path, bool repeat);
@@ -114,9 +206,62 @@ public:
    void loadAnimationPIN(const char * path);
    void loadConstraints(const char * path);
 
+   // Adds every animation of source, played on this model's bone tree through
+   // a bone map file (see RT)
+   void retargetAnimations(const Model * source, const char * mapPath);
+
+   // Each load above is a decode followed by an upload. The decode steps only
+   // fill in CPU side data so they can run off the GL thread, upload() then
+   // sends the vertices, indices and levels of detail they produced to the GPU.
+   void decodeCIAB(const char * path);
+   void decodeOBJ(const char * path);
+   void decodeSkinningPIN(const char * path);
+   void decodeAnimationPIN(const char * path);
+   void simplifyLODs(unsigned int levelCount, float faceRatio);
+   void upload();
+
+   void setTexture(const Image& image, bool repeat);
+   void setNormalMap(const Image& image, bool repeat);
+   void setSpecularMap(const Image& image, bool repeat);
+
+   // GL names of the model's textures, 0 while missing or still loading
+   unsigned int textureID();
+   unsigned int normalMapID();
+   unsigned int specularMapID();
+
+   size_t cpuBytes();         // mesh, skeleton, keys and the mapped file
+   size_t gpuBytes();         // vertex and index buffers, textures not included
+
    void CalculateNormals();   // Calculate vertex and face normals from vertex positions
    void bufferVertices();     // Send the vertex data to the GPU memory
+   void usePlanarFormat();    // Point the shaders at the per attribute buffers
+
+   // Level of detail of progressive (VBV) models, other models are always drawn whole
+   void setVertexBudget(unsigned int vertexCount);
+   unsigned int drawFaceCount();
    void bufferIndices();      // Send the index array to the GPU
+   bool bufferVertexBlock();  // Send a ciab2 vertex block from the mapping, false if there is none
+   void bufferLODs();         // Send the index arrays of simplified levels not uploaded yet
+
+   // Simplified levels of detail, level 0 is the full mesh. Each level has about
+   // faceRatio times the faces of the one before it. Animated models are
+   // simplified so that vertices on different bones stay apart.
+   void generateLODs(unsigned int levelCount, float faceRatio);
+   void calculateBounds();
+
+   // Fills in boneOrder from the bones' children, once the bone tree is read
+   void flattenBoneTree();
+
+   // Fills in each bone's mass, center of mass and inertia from the bone tree,
+   // as a solid rod out to the middle of its children or a ball at a leaf
+   void estimateBoneMasses();
+   unsigned int lodCount();
+   unsigned int lodIndexID(unsigned int level);
+   unsigned int lodFaceCount(unsigned int level);
+
+   // Level to draw at for a projected size, only moving away from the current
+   // level once the size is clearly past the switch point
+   unsigned int selectLOD(float screenSize, unsigned int currentLevel);
 
    void printVertices();
    void printFaces();
@@ -130,20 +275,44 @@ public:
    Eigen::Vector3f    com;                /* vector pointing from 0,0,0 to the center of mass */
 
    // Mesh properties
-   std::vector<Vertex *> vertices;
-   std::vector<Face *> faces;
+   Mesh mesh;
    std::vector<Bone> bones;
    std::vector<Animation> animations;
 
    unsigned int boneRoot;
 
+   // The bones under boneRoot in depth first order, so every bone comes after
+   // its parent and a pose can be built in one pass without recursing
+   std::vector<BoneStep> boneOrder;
+
+   // Backing file for geometry and keys viewed in place (NULL if none)
+   MappedFile * mappedFile;
+
+   // Vertex split state of a VBV model (NULL if not progressive)
+   ProgressiveMesh * progressive;
+
+   std::vector<LevelOfDetail> lods;    // levels 1 and up
+   Eigen::Vector3f boundCenter;        // bounding sphere in model space
+   float boundRadius;
+
    unsigned int vertexCount, faceCount, boneCount, animationCount;
 
    unsigned int posID, normID, colorID, uvID, tanID, bitanID,
-                indexID, texID, nmapID, smapID, bNumInfID, bIndexID, bWeightID;
+                indexID, bNumInfID, bIndexID, bWeightID, vertexBlockID;
+
+   // Can be shared with other models, NULL if the model has none
+   TextureHandle texture, normalMap, specularMap;
 
-   bool hasNormals, hasColors, hasTexCoords, hasTexture, hasNormalMap, hasSpecularMap,
+   // How the shaders find each attribute, set by bufferVertices() or the loader
+   VertexFormat vertexFormat;
+
+   bool hasNormals, hasColors, hasTexCoords,
         hasTansAndBitans, hasBoneWeights, hasBoneTree, hasAnimations, isAnimated;
+
+private:
+   // Not copyable, the GL buffers have a single owner
+   Model(const Model& other);
+   Model& operator=(const Model& other);
 };
 
 #endif // __MODEL_H__
@@ -0,0 +1,106 @@
+#ifndef __POSE_CACHE_H__
+#define __POSE_CACHE_H__
+
+#include "matrix_math.h"
+#include "model.h"
+
+#include <stddef.h>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+#define POSE_CACHE_RATE 120   // poses per second, entities sharing poses sample at these times
+#define POSE_BLEND_STEPS 32   // fractions of a tick that poses drawn between two ticks are blended at
+
+// How the bones of a cached pose were put together, or'd together in a key
+typedef enum {
+   POSE_UNCHAINED = 0,   // each bone on its own (MocapEntity)
+   POSE_BONE_TREE = 1,   // chained from the root down (SkinnedEntity)
+   POSE_IN_PLACE = 2     // root motion taken out (see AnimatedEntity::rootMotion)
+} PoseMask;
+
+typedef struct PoseKey {
+   const Model * model;
+   int animNum;
+   int step;            // time in 1 / POSE_CACHE_RATE seconds
+   unsigned int mask;   // PoseMask bits
+
+   bool operator==(const PoseKey& other) const;
+} PoseKey;
+
+struct PoseKeyHash {
+   size_t operator()(const PoseKey& key) const;
+};
+
+// One evaluated pose, drawn by every entity showing it
+typedef struct PosePalette {
+   std::vector<Mmath::Matrix3x4f> keyframeMs;
+   std::vector<Mmath::Matrix3x4f> boneMs;    // empty for unchained poses
+   std::vector<Mmath::Matrix3x4f> animMs;    // invBindPose included
+   unsigned int frame;                       // cache frame it was last evaluated in
+   unsigned int version;                     // new each time it is evaluated, never 0
+} PosePalette;
+
+typedef std::shared_ptr<PosePalette> PaletteHandle;
+
+// A pose drawn between two cached ones (see AnimatedEntity::interpolatePose)
+typedef struct BlendKey {
+   const PosePalette * from;
+   const PosePalette * to;
+   int step;            // how far from one to the other in 1 / POSE_BLEND_STEPS
+
+   bool operator==(const BlendKey& other) const;
+} BlendKey;
+
+struct BlendKeyHash {
+   size_t operator()(const BlendKey& key) const;
+};
+
+// Poses by model, clip, time (rounded to POSE_CACHE_RATE) and mask, so a crowd
+// playing the same clip in step evaluates it once a frame and the renderer
+// uploads one palette for all of them. The first entity to ask for a pose in a
+// frame evaluates it and the rest copy it. Not thread safe, a cache belongs to
+// whichever thread updates its entities.
+class PoseCache {
+public:
+   unsigned int evaluated, shared;   // poses handed out this frame
+
+   PoseCache();
+   ~PoseCache();
+
+   static PoseKey Key(const Model * model, int animNum, float time, unsigned int mask);
+   static float KeyTime(const PoseKey& key);   // what the pose is sampled at
+
+   // Starts a frame, poses nobody asked for last frame are dropped. Entities
+   // still holding one keep it until they let go.
+   void beginFrame();
+
+   // The pose's palette, evaluate is set when nobody has filled it in this
+   // frame and the caller has to
+   PaletteHandle acquire(const PoseKey& key, bool& evaluate);
+
+   // The same for a blend of two palettes, which are kept alive as long as
+   // the blend is. Only animMs is filled in for a blend.
+   static BlendKey Blend(const PaletteHandle& from, const PaletteHandle& to, float alpha);
+   static float BlendAlpha(const BlendKey& key);   // what the palettes are blended by
+   PaletteHandle acquire(const BlendKey& key, const PaletteHandle& from, const PaletteHandle& to, bool& evaluate);
+
+   unsigned int size();
+
+private:
+   // Not copyable, both copies would hand out the same palettes
+   PoseCache(const PoseCache& other);
+   PoseCache& operator=(const PoseCache& other);
+
+   typedef struct Blended {
+      PaletteHandle from, to, palette;
+   } Blended;
+
+   bool claim(PosePalette * palette);   // whether the palette has to be evaluated this frame
+
+   std::unordered_map<PoseKey, PaletteHandle, PoseKeyHash> _palettes;
+   std::unordered_map<BlendKey, Blended, BlendKeyHash> _blends;
+   unsigned int _frame;
+};
+
+#endif // __POSE_CACHE_H__
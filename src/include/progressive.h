@@ -0,0 +1,72 @@
+#ifndef __PROGRESSIVE_H__
+#define __PROGRESSIVE_H__
+
+#include "matrix_math.h"
+#include <stdio.h>
+#include <vector>
+
+namespace PM {
+
+   // A face corner that moves from the base vertex to the split vertex
+   typedef struct FaceUpdate {
+      unsigned int face;
+      unsigned char corner;
+   } FaceUpdate;
+
+   // Brings one vertex back, undoing the edge collapse that merged it into its base
+   typedef struct VertexSplit {
+      unsigned int baseVertex;                  // equal to the vertex itself if it has no base
+      std::vector<unsigned int> newFaces;       // corners of the faces that appear, 3 per face
+      std::vector<FaceUpdate> updatedFaces;
+   } VertexSplit;
+
+   // Orders a mesh's vertices coarse to fine by collapsing its shortest edges
+   // (with MR::Collapse) until no edges are left. order[i] is the original index
+   // of vertex i, splits[i] brings vertex i back, and faces is the full
+   // resolution index list in the order the faces appear.
+   void BuildProgressiveMesh(const std::vector<Eigen::Vector3f>& positions,
+                             const std::vector<unsigned int>& indices,
+                             std::vector<unsigned int>& order,
+                             std::vector<VertexSplit>& splits,
+                             std::vector<unsigned int>& faces);
+
+}
+
+// Refinement state of a progressive mesh. Vertices are ordered coarse to fine
+// and faces in the order they appear, so at any level of detail the active mesh
+// is the first activeVertices vertices and the first activeFaces faces, and
+// moving between levels only touches the faces named by the splits in between.
+class ProgressiveMesh {
+public:
+   ProgressiveMesh(unsigned int vertexCount, unsigned int faceCount);
+   ~ProgressiveMesh();
+
+   unsigned int vertexCount, faceCount;
+   std::vector<PM::VertexSplit> splits;      // one per vertex read so far
+   std::vector<unsigned int> indices;        // NUM_FACE_EDGES per face, valid for active faces
+
+   unsigned int activeVertices, activeFaces;
+   unsigned int targetVertices;              // level of detail asked for, maybe not read yet
+   unsigned int dirtyBegin, dirtyEnd;        // index entries changed since clearDirty()
+
+   FILE * source;                            // file still being streamed in, NULL once read
+
+   // Checks a split read from a file refers only to vertices and faces before it
+   bool addSplit(const PM::VertexSplit& split);
+
+   // Refines or coarsens toward the given number of vertices, as far as has
+   // been read. The target is kept, so refresh() continues toward it once
+   // more splits have been streamed in.
+   void setVertexCount(unsigned int count);
+   void refresh();
+   void clearDirty();
+
+private:
+   void split();
+   void collapse();
+   void markDirty(unsigned int index);
+
+   unsigned int readyFaces;                  // faces brought in by the splits read so far
+};
+
+#endif // __PROGRESSIVE_H__
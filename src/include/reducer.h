@@ -1,14 +1,30 @@
-
 #ifndef __REDUCER_H__
 #define __REDUCER_H__
 
-struct Model;
-struct Vertex;
+#include <vector>
+#include <float.h>
+
+class Vertex;
+class Face;
+class Mesh;
 
 namespace MR {
 
-   void Collapse(Model * model, Vertex * from, Vertex * to);
+   void Collapse(std::vector<Vertex *>& vertices, std::vector<Face *>& faces, Vertex * from, Vertex * to);
+
+   // Quadric error simplification. Collapses the edge of least error until at
+   // most targetFaces faces are left or the next collapse would cost more than
+   // maxError (a sum of squared distances to the original face planes).
+   // Collapses merge a vertex into a neighbor without moving it, so the faces
+   // written to indices refer to the mesh's own vertices and can share its
+   // vertex buffers. preserveSkin makes collapses between vertices skinned to
+   // different bones more costly. Returns the error of the last collapse made.
+   float SimplifyIndices(const Mesh& mesh, unsigned int targetFaces, float maxError,
+                         std::vector<unsigned int>& indices, bool preserveSkin = false);
+
+   // Simplifies a mesh in place, then drops the vertices no face uses anymore
+   float Simplify(Mesh& mesh, unsigned int targetFaces, float maxError = FLT_MAX);
 
 }
 
-#endif // __REDUCER_H__
\ No newline at end of file
+#endif // __REDUCER_H__
@@ -0,0 +1,49 @@
+#ifndef __RESOURCES_H__
+#define __RESOURCES_H__
+
+#include "asset_loader.h"
+#include "model.h"
+
+#include <stdio.h>
+#include <map>
+#include <string>
+
+typedef std::shared_ptr<Model> ModelHandle;
+
+// Loads each model and texture once, keyed by its canonical path and load
+// options, and hands out shared handles to it. Asking for the same file again
+// (through any relative path) returns the same GL objects without reading or
+// uploading anything. Everything is freed with its last handle, the registry
+// only lets go of its own once releaseUnused() finds nobody else holding it.
+class ResourceRegistry {
+public:
+   ResourceRegistry(AssetLoader * loader);
+   ~ResourceRegistry();
+
+   // ready (if given) becomes ready once the resource is on the GPU
+   ModelHandle model(const ModelAsset& asset, AssetHandle * ready = NULL);
+   TextureHandle texture(const char * path, bool repeat, AssetHandle * ready = NULL);
+
+   // GL thread only, returns how many resources were freed
+   unsigned int releaseUnused();
+
+   unsigned int size();
+   void report(FILE * out);   // handles, CPU and GPU memory of each resource
+
+private:
+   typedef struct Resource {
+      std::string name;
+      ModelHandle model;        // one of model and texture is set
+      TextureHandle texture;
+      AssetHandle ready;
+   } Resource;
+
+   // Not copyable, the handles would be shared between two registries
+   ResourceRegistry(const ResourceRegistry& other);
+   ResourceRegistry& operator=(const ResourceRegistry& other);
+
+   AssetLoader * _loader;
+   std::map<std::string, Resource> _resources;
+};
+
+#endif // __RESOURCES_H__
@@ -0,0 +1,54 @@
+#ifndef __RETARGET_H__
+#define __RETARGET_H__
+
+#include "model.h"
+#include "animation.h"
+
+#include <vector>
+
+// A target bone and what drives it, precomputed so retargeting a pose is a
+// quaternion product or two per bone
+typedef struct RetargetBone {
+   int bone;                      // target bone
+   int parent;                    // its target parent, -1 for the root
+   int source;                    // source bone driving it, -1 to keep its bind pose
+   Eigen::Quaternion<float, Eigen::DontAlign> offset;      // source bind rotation to target bind rotation
+   Eigen::Quaternion<float, Eigen::DontAlign> bindLocal;   // rotation of its parentOffset
+   Eigen::Vector3f bindPosition;  // translation of its parentOffset, in model space for the root
+} RetargetBone;
+
+typedef struct RetargetMap {
+   std::vector<RetargetBone> bones;     // in the target's boneOrder, parents first
+   std::vector<BoneStep> sourceOrder;   // the source's boneOrder, empty when its keyframes are in model space
+   unsigned int sourceBoneCount, targetBoneCount;
+   Eigen::Vector3f sourceRootBind;      // bind position of the bone driving the target root
+   float rootScale;                     // target hip height over the source's
+} RetargetMap;
+
+// Plays one skeleton's animations on another. Each mapped target bone turns
+// from its own bind pose as its source bone turns from the source's bind pose
+// (both taken from invBonePose), so the two rigs only have to face the same
+// way when bound, not share bone axes or lengths. Bones keep their own lengths
+// (parentOffset), and the root moves as the source's does, scaled to the
+// target's height.
+namespace RT {
+   // Reads a bone map file, one "targetBone sourceBone" pair of indices per
+   // line and anything else skipped, into the source bone of every target
+   // bone (-1 for bones it doesn't list). Exits on indices out of range.
+   std::vector<int> LoadBoneMap(const char * path, unsigned int sourceBoneCount, unsigned int targetBoneCount);
+
+   // sourceOrder is empty for sources whose keyframes are already in model
+   // space (PIN mocap), targetOrder is the target's boneOrder
+   RetargetMap BuildMap(const std::vector<Bone>& sourceBones, const std::vector<BoneStep>& sourceOrder,
+                        const std::vector<Bone>& targetBones, const std::vector<BoneStep>& targetOrder,
+                        const std::vector<int>& sourceOf);
+
+   // The target pose (relative to parents, targetBoneCount bones) for a sampled
+   // source pose. A chained source's keyframes are chained into model space in place.
+   void RetargetPose(const RetargetMap& map, Mmath::Matrix3x4f * sourceMs, PoseArena * arena, LocalTransform * out);
+
+   // Retargets every frame of a source animation into a compressed target animation
+   void RetargetAnimation(const RetargetMap& map, const Animation& source, Animation * out);
+}
+
+#endif // __RETARGET_H__
@@ -8,6 +8,8 @@
 #include "entity.h"
 #include "terrain.h"
 
+#define ANIM_RESERVED_VECTORS 16   // vertex uniform vec4s the animated shader keeps for everything but bones
+
 class Entity;
 class StaticEntity;
 class AnimatedEntity;
@@ -25,10 +27,7 @@ public:
    void renderPaths(Camera * camera, TerrainGenerator * tg);
 
 protected:
-   void sendVertexAttribArray(unsigned int handle, unsigned int vbo, int size);
-   void sendLargeVertexAttribArray(unsigned int handle0, unsigned int handle1,
-                                   unsigned int handle2, unsigned int handle3,
-                                   unsigned int vbo);
+   void sendVertexAttribArray(unsigned int handle, int size, const VertexAttrib& attrib, unsigned int stride);
    void sendTexture(unsigned int handle, unsigned int id, GLenum texture);
 
    unsigned int program;
@@ -71,11 +70,14 @@ protected:
    unsigned int h_uHasNormals, h_uHasColors, h_uHasTexture, h_uHasNormalMap, h_uHasSpecularMap;
    unsigned int h_uModelM, h_uProjViewM, h_uCameraPosition, h_uLights, h_uTexture;
    unsigned int h_uNormalMap, h_uSpecularMap;
-   unsigned int h_uAnimMs;
+   unsigned int h_uBoneMs;
    unsigned int h_aPosition, h_aColor, h_aNormal, h_aTangent, h_aBitangent, h_aUV;
    unsigned int h_aBoneIndices0, h_aBoneIndices1, h_aBoneIndices2, h_aBoneIndices3;
    unsigned int h_aBoneWeights0, h_aBoneWeights1, h_aBoneWeights2, h_aBoneWeights3;
    unsigned int h_aNumInfluences;
+
+   unsigned int uploadedPalette;   // version of the shared pose in uBoneMs, 0 if none
+   unsigned int boneCapacity;      // most bones uBoneMs holds on this GPU
 };
 
 
@@ -6,6 +6,10 @@
 	the opengl shader program handle */
 namespace SB {
    unsigned int BuildProgramFromPaths(const char * vertPath, const char * fragPath);
+
+   /* As above, with vertDefines (#define lines) put ahead of the vertex
+      shader's source, for array sizes only known once there's a context */
+   unsigned int BuildProgramFromPaths(const char * vertPath, const char * fragPath, const char * vertDefines);
    unsigned int BuildProgramFromStrings(const char * vertString, const char * fragString);
 }
 
@@ -0,0 +1,42 @@
+#ifndef __SKINNING_H__
+#define __SKINNING_H__
+
+#include "matrix_math.h"
+#include "mesh.h"
+#include "thread_pool.h"
+
+#include <vector>
+
+#define SKIN_CHUNK_VERTICES 4096   // vertices per job when skinning on a thread pool
+
+typedef enum {
+   SKIN_LINEAR,            // blends the bone matrices, as the animated shader does
+   SKIN_DUAL_QUATERNION    // blends rigid bones without the candy wrapper at twisting joints
+} SkinMethod;
+
+// Bone transforms laid out for the kernels, one set per pose
+typedef struct SkinPalette {
+   SkinMethod method;
+   std::vector<float> bones;   // 3x4 row major matrices, or dual quaternions (real xyzw, dual xyzw)
+   unsigned int stride;        // floats per bone
+} SkinPalette;
+
+// Skinning on the CPU, for collision, picking and simulation that need the
+// animated surface without a GPU. Several vertices are skinned at a time with
+// SIMD (see lanes.h), and whole meshes are split into chunks over a pool.
+namespace SK {
+   // animMs are the entity's (invBindPose included). Dual quaternions only
+   // hold rotation and translation, so the bones have to be unscaled for them.
+   void BuildPalette(const Mmath::Matrix3x4f * animMs, unsigned int boneCount, SkinMethod method, SkinPalette * palette);
+
+   // Model space positions and normals (either may be NULL) of vertices
+   // [first, first + count) of the mesh, written from positions[first] on
+   void SkinVertices(const Mesh& mesh, const SkinPalette& palette, unsigned int first, unsigned int count,
+                     Eigen::Vector3f * positions, Eigen::Vector3f * normals);
+
+   // The whole mesh, on the pool if one is given, resizing the outputs
+   void SkinMesh(const Mesh& mesh, const SkinPalette& palette, ThreadPool * pool,
+                 std::vector<Eigen::Vector3f>& positions, std::vector<Eigen::Vector3f>& normals);
+}
+
+#endif // __SKINNING_H__
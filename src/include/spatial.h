@@ -0,0 +1,113 @@
+#ifndef __SPATIAL_H__
+#define __SPATIAL_H__
+
+#include "matrix_math.h"
+
+// Spatial (6D) vectors as in Featherstone's Rigid Body Dynamics Algorithms.
+// Motion vectors are [angular; linear] velocities and accelerations, force
+// vectors [moment; force], both about the origin of the frame they're in.
+// Unaligned so they can be kept in std::vectors.
+typedef Eigen::Matrix<float, 6, 1, Eigen::DontAlign> SpatialVector;
+typedef Eigen::Matrix<float, 6, 6, Eigen::DontAlign> SpatialMatrix;
+
+// A Plucker transform from frame A to frame B, kept as the rotation E taking A
+// coordinates to B coordinates and B's origin r in A coordinates, which is
+// much cheaper to apply than the 6x6 matrix it stands for
+typedef struct SpatialTransform {
+   Eigen::Matrix3f E;
+   Eigen::Vector3f r;
+} SpatialTransform;
+
+namespace SV {
+   inline Eigen::Matrix3f Skew(const Eigen::Vector3f& v) {
+      Eigen::Matrix3f m;
+      m <<     0, -v(2),  v(1),
+            v(2),     0, -v(0),
+           -v(1),  v(0),     0;
+      return m;
+   }
+
+   // From a bone style local matrix, which takes the child's coordinates to the parent's
+   inline SpatialTransform FromLocal(const Mmath::Matrix3x4f& local) {
+      SpatialTransform X;
+      X.E = local.leftCols<3>().transpose();
+      X.r = local.col(3);
+      return X;
+   }
+
+   // a after b, both taking their own frame to the next
+   inline SpatialTransform Compose(const SpatialTransform& a, const SpatialTransform& b) {
+      SpatialTransform X;
+      X.E = a.E * b.E;
+      X.r = b.r + b.E.transpose() * a.r;
+      return X;
+   }
+
+   // X m, a motion vector in A moved to B
+   inline SpatialVector ApplyMotion(const SpatialTransform& X, const SpatialVector& m) {
+      SpatialVector out;
+      Eigen::Vector3f w = m.head<3>();
+      out.head<3>() = X.E * w;
+      out.tail<3>() = X.E * (Eigen::Vector3f(m.tail<3>()) - X.r.cross(w));
+      return out;
+   }
+
+   // X^T f, a force vector in B moved back to A
+   inline SpatialVector ApplyForceTranspose(const SpatialTransform& X, const SpatialVector& f) {
+      SpatialVector out;
+      Eigen::Vector3f force = X.E.transpose() * Eigen::Vector3f(f.tail<3>());
+      out.head<3>() = X.E.transpose() * Eigen::Vector3f(f.head<3>()) + X.r.cross(force);
+      out.tail<3>() = force;
+      return out;
+   }
+
+   // v x m, how a motion vector changes in a frame moving with velocity v
+   inline SpatialVector CrossMotion(const SpatialVector& v, const SpatialVector& m) {
+      Eigen::Vector3f w = v.head<3>(), vo = v.tail<3>();
+      SpatialVector out;
+      out.head<3>() = w.cross(Eigen::Vector3f(m.head<3>()));
+      out.tail<3>() = w.cross(Eigen::Vector3f(m.tail<3>())) + vo.cross(Eigen::Vector3f(m.head<3>()));
+      return out;
+   }
+
+   // v x* f, the same for force vectors
+   inline SpatialVector CrossForce(const SpatialVector& v, const SpatialVector& f) {
+      Eigen::Vector3f w = v.head<3>(), vo = v.tail<3>();
+      SpatialVector out;
+      out.head<3>() = w.cross(Eigen::Vector3f(f.head<3>())) + vo.cross(Eigen::Vector3f(f.tail<3>()));
+      out.tail<3>() = w.cross(Eigen::Vector3f(f.tail<3>()));
+      return out;
+   }
+
+   // Rigid body inertia about the frame's origin, from the mass, the center
+   // of mass and the rotational inertia about the center of mass
+   inline SpatialMatrix Inertia(float mass, const Eigen::Vector3f& com, const Eigen::Matrix3f& inertiaAtCom) {
+      Eigen::Matrix3f c = Skew(com);
+      SpatialMatrix I;
+      I.topLeftCorner<3,3>() = inertiaAtCom + mass * c * c.transpose();
+      I.topRightCorner<3,3>() = mass * c;
+      I.bottomLeftCorner<3,3>() = mass * c.transpose();
+      I.bottomRightCorner<3,3>() = mass * Eigen::Matrix3f::Identity();
+      return I;
+   }
+
+   // X^T I X, an inertia in B moved back to A. Done on the 3x3 blocks of the
+   // symmetric inertia, turned into A's axes and then shifted to A's origin,
+   // which skips most of the products of the full 6x6 one.
+   inline SpatialMatrix TransformInertia(const SpatialTransform& X, const SpatialMatrix& I) {
+      Eigen::Matrix3f A = X.E.transpose() * I.topLeftCorner<3,3>() * X.E;
+      Eigen::Matrix3f B = X.E.transpose() * I.topRightCorner<3,3>() * X.E;
+      Eigen::Matrix3f M = X.E.transpose() * I.bottomRightCorner<3,3>() * X.E;
+      Eigen::Matrix3f R = Skew(X.r);
+      Eigen::Matrix3f RM = R * M;
+
+      SpatialMatrix out;
+      out.topLeftCorner<3,3>() = A - B * R + R * B.transpose() - RM * R;
+      out.topRightCorner<3,3>() = B + RM;
+      out.bottomLeftCorner<3,3>() = (B + RM).transpose();
+      out.bottomRightCorner<3,3>() = M;
+      return out;
+   }
+}
+
+#endif // __SPATIAL_H__
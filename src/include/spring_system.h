@@ -0,0 +1,119 @@
+#ifndef __SPRING_SYSTEM_H__
+#define __SPRING_SYSTEM_H__
+
+#include <Eigen/Dense>
+#include <Eigen/Sparse>
+
+#include <map>
+#include <utility>
+#include <vector>
+
+#define SPRING_GRAVITY -9.8                   // along y
+#define SPRING_CG_ITERATIONS 100              // per step, the next step carries on from where it stopped
+#define SPRING_CG_TOLERANCE 1e-8              // residual relative to the right hand side that counts as solved
+
+typedef Eigen::SparseMatrix<double> SpringMatrix;
+
+// Ropes and straps factorize with next to no fill in, so the direct solver is
+// much faster on them. Cloth fills in, and conjugate gradient is faster there.
+typedef enum SpringMethod {
+   SPRING_CONJUGATE_GRADIENT,                 // Jacobi preconditioned, started from the last velocities
+   SPRING_DIRECT                              // sparse LDLT, analyzed once per topology
+} SpringMethod;
+
+typedef struct SpringParticle {
+   Eigen::Vector3d position;
+   Eigen::Vector3d velocity;
+   double mass;
+   bool fixed;                                // pinned in place, not solved for
+} SpringParticle;
+
+typedef struct Spring {
+   int p0, p1;                                // particles
+   double stiffness;
+   double restLength;
+} Spring;
+
+// A spring pulling a particle towards a point, with no rest length
+typedef struct SpringContact {
+   int particle;
+   Eigen::Vector3d point;
+   double stiffness;
+} SpringContact;
+
+// Ropes, straps and cloth as particles joined by springs, stepped with
+// implicit Euler so stiff springs stay stable at frame sized steps. Each step
+// solves (M - h^2 K) v' = M v + h f, with K the springs' force Jacobian, as a
+// sparse system with a 3x3 block per free particle and per spring.
+//
+// The sparsity pattern and where every block sits in it are worked out once
+// per topology. A step only writes the new values in place (and the direct
+// solver only refactorizes numerically). Collisions are springs that last one
+// step, and only ever touch their particles' own diagonal blocks, so they
+// never change the pattern. Between two particles, each is solved as if the
+// other held still for the step, and their pull on each other is explicit.
+class SpringSystem {
+public:
+   SpringSystem();
+
+   // Change particles' fixed flags freely, the pattern is rebuilt when they change
+   std::vector<SpringParticle> particles;
+   std::vector<Spring> springs;
+   Eigen::Vector3d gravity;
+   SpringMethod method;
+
+   int addParticle(const Eigen::Vector3d& position, double mass, bool fixed);
+   int addSpring(int p0, int p1, double stiffness);                       // at rest as the particles are now
+   int addSpring(int p0, int p1, double stiffness, double restLength);
+
+   // Only for the next step
+   void addCollisionSpring(int p0, int p1, double stiffness, double restLength);
+   void addContact(int particle, const Eigen::Vector3d& point, double stiffness);
+
+   void step(double timeDelta);
+
+   unsigned int patternBuildCount();          // times the sparsity pattern was built
+   unsigned int lastIterations();             // conjugate gradient iterations of the last step
+
+private:
+   // Offsets into the matrix's values of a 3x3 block's three columns, each column's three rows contiguous
+   typedef struct BlockSlot {
+      int columns[3];
+   } BlockSlot;
+
+   // Blocks a spring adds to, -1 where a particle is fixed or, between the
+   // two, for collisions. The block between the two is stored once, under the
+   // diagonal, and K is symmetric so it doesn't matter which of the two it is.
+   typedef struct SpringSlots {
+      int diagonal0, diagonal1, between;
+   } SpringSlots;
+
+   std::vector<Spring> collisions;
+   std::vector<SpringContact> contacts;
+
+   // The pattern: a block on the diagonal per free particle and one under it
+   // per pair of free particles joined by a spring
+   std::vector<int> unknowns;                 // first row of each particle's velocity, -1 if fixed
+   std::vector<BlockSlot> blocks;
+   std::vector<int> diagonalBlocks;           // per particle
+   std::map<std::pair<int,int>, int> pairBlocks;   // by the pair's particles, higher row first
+   std::vector<SpringSlots> springSlots;      // per spring
+   bool patternDirty;
+   unsigned int builds;
+
+   SpringMatrix A;
+   Eigen::VectorXd b, solved;
+   Eigen::ConjugateGradient<SpringMatrix, Eigen::Lower> cg;
+   Eigen::SimplicialLDLT<SpringMatrix, Eigen::Lower> ldlt;
+   bool analyzed;                             // ldlt has the current pattern's symbolic factorization
+   unsigned int iterations;
+
+   bool topologyChanged();
+   std::pair<int,int> pairKey(int p0, int p1);
+   void buildPattern();
+   SpringSlots slotsOf(int p0, int p1);
+   void addBlock(int block, const Eigen::Matrix3d& m);
+   void addSpringTerms(const Spring& spring, const SpringSlots& slots, double timeDelta);
+};
+
+#endif // __SPRING_SYSTEM_H__
@@ -43,6 +43,10 @@ public:
    std::vector<Path *> paths;
    Model * model;
 
+   // The growing surface is edited as a pointer graph and packed into model->mesh
+   std::vector<Vertex *> vertices;
+   std::vector<Face *> faces;
+
 private:
    bool shouldUpdate;
    float edgeLength;
@@ -57,6 +61,7 @@ private:
    void RemoveRetreatingGeometry();
    void RemoveConvergingPaths();
    void CalculateVertexNormals();
+   void PackMesh();
    void collapsePath(Path * p);
 
    void HandleSameHead(Path * leftP, Path * rightP);
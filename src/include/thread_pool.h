@@ -0,0 +1,39 @@
+#ifndef __THREAD_POOL_H__
+#define __THREAD_POOL_H__
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads taking jobs off one queue in the order they
+// were submitted. Jobs must not touch OpenGL, only the thread that owns the
+// context can do that.
+class ThreadPool {
+public:
+   ThreadPool(unsigned int threadCount);   // 0 for one per hardware thread
+   ~ThreadPool();                          // runs whatever is still queued, then joins
+
+   // The future becomes ready once the job has run
+   std::future<void> submit(const std::function<void()>& job);
+
+   unsigned int threadCount() const;
+
+private:
+   // Not copyable, the workers point back at the pool
+   ThreadPool(const ThreadPool& other);
+   ThreadPool& operator=(const ThreadPool& other);
+
+   void work();
+
+   std::vector<std::thread> _threads;
+   std::deque<std::packaged_task<void()> > _jobs;
+   std::mutex _mutex;
+   std::condition_variable _wake;
+   bool _stopping;
+};
+
+#endif // __THREAD_POOL_H__
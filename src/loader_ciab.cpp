@@ -1,327 +1,171 @@
-
-#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <unistd.h>
 
 #include "safe_gl.h"
 #include "model.h"
+#include "animation.h"
+#include "ciab.h"
+#include "mapped_file.h"
 
-typedef enum {
-   POSITIONS = 1,
-   NORMALS = 2,
-   COLORS = 3,
-   TEXCOORDS = 4,
-   TANGENTS = 5,
-   BITANGENTS = 6,
-   INDICES = 7,
-   BONE_INDICES = 8,
-   BONE_WEIGHTS = 9,
-   BONE_NUM_INF = 10,
-   BONE_TREE = 11,
-   ANIMATIONS = 12
-} modelFieldType;
-
-static void readHeader(FILE *fp, Model * model) {
-   fread(& model->vertexCount, sizeof(unsigned int), 1, fp);
-   fread(& model->faceCount, sizeof(unsigned int), 1, fp);
-   fread(& model->boneCount, sizeof(unsigned int), 1, fp);
-   fread(& model->animationCount, sizeof(unsigned int), 1, fp);
-
-   if (model->boneCount > MAX_BONES) {
-      printf("There are %d bones and the max is %d\n", model->boneCount, MAX_BONES);
-      exit(1);
-   }
-
-   model->vertices = std::vector<Vertex *>(model->vertexCount);
-   for (int i = 0; i < model->vertices.size(); i++) {
-      model->vertices[i] = new Vertex();
-      model->vertices[i]->index = i;
-   }
+static void readHeader(const CIABView& view, Model * model) {
+   model->vertexCount = view.vertexCount;
+   model->faceCount = view.faceCount;
+   model->boneCount = view.boneCount;
+   model->animationCount = view.animationCount;
 
-   model->faces = std::vector<Face *>(model->faceCount);
-   for (int i = 0; i < model->faces.size(); i++)
-      model->faces[i] = new Face();
+   model->mesh.resize(model->vertexCount, model->faceCount);
 
    // printf("verts: %d, faces: %d, bones: %d, anims: %d\n", model->vertexCount, model->faceCount, model->boneCount, model->animationCount);
 }
 
-static void readPositions(FILE *fp, Model * model) {
-   int count = 3 * model->vertexCount;
-   int size = sizeof(float);
-
-   float * data = (float *)malloc(count * size);
-   fread(data, size, count, fp);
-
-   for (int i = 0; i < model->vertexCount; i++)
-      model->vertices[i]->position = Eigen::Vector3f(data[3*i], data[3*i+1], data[3*i+2]);
-
-   free(data);
-}
-
-static void readNormals(FILE *fp, Model * model) {
-   int count = 3 * model->vertexCount;
-   int size = sizeof(float);
-
-   float * data = (float *)malloc(count * size);
-   fread(data, size, count, fp);
-
-   for (int i = 0; i < model->vertexCount; i++)
-      model->vertices[i]->normal = Eigen::Vector3f(data[3*i], data[3*i+1], data[3*i+2]);
-
-   free(data);
-}
-
-static void readColors(FILE *fp, Model * model) {
-   int count = 3 * model->vertexCount;
-   int size = sizeof(float);
-
-   float * data = (float *)malloc(count * size);
-   fread(data, size, count, fp);
-
-   for (int i = 0; i < model->vertexCount; i++)
-      model->vertices[i]->color = Eigen::Vector3f(data[3*i], data[3*i+1], data[3*i+2]);
-
-   free(data);
-}
-
-static void readTexCoords(FILE *fp, Model * model) {
-   int count = 2 * model->vertexCount;
-   int size = sizeof(float);
-
-   float * data = (float *)malloc(count * size);
-   fread(data, size, count, fp);
-
-   for (int i = 0; i < model->vertexCount; i++)
-      model->vertices[i]->uv = Eigen::Vector2f(data[2*i], data[2*i+1]);
-
-   free(data);
-}
-
-static void readTangents(FILE *fp, Model * model) {
-   int count = 3 * model->vertexCount;
-   int size = sizeof(float);
-
-   float * data = (float *)malloc(count * size);
-   fread(data, size, count, fp);
-
-   for (int i = 0; i < model->vertexCount; i++)
-      model->vertices[i]->tangent = Eigen::Vector3f(data[3*i], data[3*i+1], data[3*i+2]);
-
-   free(data);
-}
-
-static void readBitangents(FILE *fp, Model * model) {
-   int count = 3 * model->vertexCount;
-   int size = sizeof(float);
-
-   float * data = (float *)malloc(count * size);
-   fread(data, size, count, fp);
-
-   for (int i = 0; i < model->vertexCount; i++)
-      model->vertices[i]->bitangent = Eigen::Vector3f(data[3*i], data[3*i+1], data[3*i+2]);
-
-   free(data);
-}
-
-static void readIndices(FILE *fp, Model * model) {
-   int count = NUM_FACE_EDGES * model->faceCount;
-   int size = sizeof(unsigned int);
-
-   unsigned int * data = (unsigned int *)malloc(count * size);
-   fread(data, size, count, fp);
-
-   for (int i = 0; i < model->faceCount; i++)
-      for (int j = 0; j < NUM_FACE_EDGES; j++)
-         model->faces[i]->vertices[j] = model->vertices[data[NUM_FACE_EDGES*i+j]];
-
-   free(data);
+// Copies a whole stream out of the mapping in one block, if the file has it
+template <typename T, typename V>
+static void copyStream(std::vector<T>& stream, const V * view) {
+   if (view)
+      memcpy((void *)stream.data(), view, stream.size() * sizeof(T));
 }
 
-static void readBoneIndices(FILE *fp, Model * model) {
-   int count = MAX_INFLUENCES * model->vertexCount;
-
-   unsigned int * uintData = (unsigned int *)malloc(count * sizeof(unsigned int));
-   fread(uintData, sizeof(unsigned int), count, fp);
-
-   // convert the data from unsigned ints to floats
-   float * floatData = (float *)malloc(count * sizeof(float));
-   for (int i = 0; i < count; i++)
-      floatData[i] = uintData[i];
-
-   for (int i = 0; i < model->vertexCount; i++)
-      for (int j = 0; j < MAX_INFLUENCES; j++)
-         model->vertices[i]->boneIndices[j] = floatData[MAX_INFLUENCES * i + j];
-
-   // free the data blocks
-   free(uintData);
-   free(floatData);
+template <typename T>
+static T readVertexField(const unsigned char * vert, int offset) {
+   T val;
+   memcpy((void *)& val, vert + offset, sizeof(T));
+   return val;
 }
 
-static void readBoneWeights(FILE *fp, Model * model) {
-   int count = MAX_INFLUENCES * model->vertexCount;
-   int size = sizeof(float);
-
-   float * data = (float *)malloc(count * size);
-   fread(data, size, count, fp);
+// Splits the interleaved ciab2 vertices back into the mesh streams
+static void unpackVertexBlock(const CIABView& view, Mesh * mesh) {
+   for (unsigned int i = 0; i < view.vertexCount; i++) {
+      const unsigned char * vert = view.vertexBlock + i * view.vertexStride;
 
-   for (int i = 0; i < model->vertexCount; i++)
-      for (int j = 0; j < MAX_INFLUENCES; j++)
-         model->vertices[i]->boneWeights[j] = data[MAX_INFLUENCES * i + j];
+      mesh->positions[i]  = readVertexField<Eigen::Vector3f>(vert, VB_POSITION);
+      mesh->normals[i]    = readVertexField<Eigen::Vector3f>(vert, VB_NORMAL);
+      mesh->colors[i]     = readVertexField<Eigen::Vector3f>(vert, VB_COLOR);
+      mesh->uvs[i]        = readVertexField<Eigen::Vector2f>(vert, VB_UV);
+      mesh->tangents[i]   = readVertexField<Eigen::Vector3f>(vert, VB_TANGENT);
+      mesh->bitangents[i] = readVertexField<Eigen::Vector3f>(vert, VB_BITANGENT);
+      mesh->boneInfCounts[i] = vert[VB_BONE_NUM_INF];
 
-   free(data);
+      for (int j = 0; j < MAX_INFLUENCES; j++) {
+         unsigned short weight = readVertexField<unsigned short>(vert, VB_BONE_WEIGHTS + j * sizeof(short));
+         mesh->boneWeights[MAX_INFLUENCES*i+j] = weight / 65535.0f;
+         mesh->boneIndices[MAX_INFLUENCES*i+j] = view.boneIndexSize == 1 ?
+            vert[VB_BONE_INDICES + j] :
+            readVertexField<unsigned short>(vert, VB_BONE_INDICES + j * sizeof(short));
+      }
+   }
 }
 
-static void readBoneInfluences(FILE *fp, Model * model) {
-   int count = model->vertexCount;
+static void readStreams(const CIABView& view, Model * model) {
+   Mesh * mesh = & model->mesh;
+   copyStream(mesh->indices,       view.indices);
 
-   unsigned int * uintData = (unsigned int *)malloc(count * sizeof(unsigned int));
-   fread(uintData, sizeof(unsigned int), count, fp);
-
-   // convert the data from unsigned ints to floats
-   float * floatData = (float *)malloc(count * sizeof(float));
-   for (int i = 0; i < count; i++)
-      floatData[i] = uintData[i];
-
-   for (int i = 0; i < model->vertexCount; i++)
-      model->vertices[i]->boneInfCount = floatData[i];
+   if (view.vertexBlock) {
+      unpackVertexBlock(view, mesh);
+      return;
+   }
 
-   // free the data blocks
-   free(uintData);
-   free(floatData);
+   copyStream(mesh->positions,     view.positions);
+   copyStream(mesh->normals,       view.normals);
+   copyStream(mesh->colors,        view.colors);
+   copyStream(mesh->uvs,           view.uvs);
+   copyStream(mesh->tangents,      view.tangents);
+   copyStream(mesh->bitangents,    view.bitangents);
+   copyStream(mesh->boneIndices,   view.boneIndices);
+   copyStream(mesh->boneWeights,   view.boneWeights);
+   copyStream(mesh->boneInfCounts, view.boneInfCounts);
 }
 
-static void readBoneTree(FILE *fp, Model * model) {
-   fread(& model->boneRoot, sizeof(int), 1, fp);
-
-   model->bones = std::vector<Bone>(model->boneCount);
-
-   for (int i = 0; i < model->boneCount; i++) {
-      Bone * bone = & model->bones[i];
-      fread(& bone->parentIndex, sizeof(int), 1, fp);
-      int childCount;
-      fread(& childCount, sizeof(unsigned int), 1, fp);
-
-      bone->childIndices = std::vector<int>(childCount);
-      for (int j = 0; j < childCount; j++)
-         fread(& bone->childIndices[j], sizeof(int), 1, fp);
-
-      fread(& bone->invBonePose, sizeof(Eigen::Matrix4f), 1, fp);
-      fread(& bone->parentOffset, sizeof(Eigen::Matrix4f), 1, fp);
-
-      // Rigid body properties
-      // fread(& bone->mass, sizeof(float), 1, fp);
-      // fread(& bone->inertiaTensor, sizeof(Eigen::Matrix3f), 1, fp);
-      // freed(& bone->com, sizeof(Eigen::Vector3f), 1, fp);
-      // Replace this with actual stuff
-      bone->mass = 1;
-      bone->inertiaTensor = Eigen::Matrix3f::Identity();
-      bone->com = Eigen::Vector3f(0,0,0);
-      bone->invInertiaTensor = bone->inertiaTensor.inverse();
-   }
+static void readBoneTree(const CIABView& view, Model * model) {
+   view.readBones(model->bones, model->boneRoot);
+   model->flattenBoneTree();
+   model->estimateBoneMasses();
 }
 
-static void readAnimations(FILE *fp, Model * model) {
+// Keys stay in the mapping, each animated bone just points at its run of keys.
+// Quantized keys are expanded into the animation's own storage instead, and
+// compressed clips are copied out whole.
+static void readAnimations(const CIABView& view, Model * model) {
    model->animations = std::vector<Animation>(model->animationCount);
 
    for (int i = 0; i < model->animationCount; i++) {
       Animation * anim = & model->animations[i];
+      const CIABAnimationView * animView = & view.animations[i];
 
-      fread(& anim->fps, sizeof(unsigned int), 1, fp);
-      fread(& anim->keyCount, sizeof(unsigned int), 1, fp);
+      anim->fps = animView->fps;
+      anim->keyCount = animView->keyCount;
       anim->duration = 1.0 * (anim->keyCount-1) / anim->fps;
 
-      anim->animBones = std::vector<AnimBone>(model->boneCount);
-      for (int j = 0; j < model->boneCount; j++) {
-         AnimBone * animBone = & anim->animBones[j];
-
-         animBone->keys = std::vector<Key>(anim->keyCount);
-         for (int k = 0; k < anim->keyCount; k++) {
-            Key * key = & animBone->keys[k];
-
-            fread(& key->time, sizeof(float), 1, fp);
-            fread(& key->position, sizeof(float), 3, fp);
-            fread(& key->rotation, sizeof(float), 4, fp);
-            fread(& key->scale, sizeof(float), 3, fp);
-         }
+      // Compressed clips are copied as they are and sampled from the copy, there are no keys to lay out
+      if (animView->compressed) {
+         anim->compressed.assign(animView->compressed, animView->compressed + animView->compressedSize);
+         continue;
       }
-   }
-}
 
-static bool isFieldPresent(unsigned short flags, int field) {
-   return flags & (1 << (field-1));
-}
+      const Key * keys = animView->keys;
+      if (animView->quantized) {
+         anim->ownedKeys = std::vector<Key>(model->boneCount * anim->keyCount);
+         view.decodeKeys(*animView, anim->ownedKeys.data());
+         keys = anim->ownedKeys.data();
+      }
 
-static void checkPresentFields(Model * model, unsigned short flags) {
-   if (!isFieldPresent(flags, POSITIONS) || !isFieldPresent(flags, INDICES)) {
-      fprintf(stderr, "Model file does not have positions and/or indices\n");
-      exit(1);
+      anim->animBones = std::vector<AnimBone>(model->boneCount);
+      for (int j = 0; j < model->boneCount; j++)
+         anim->animBones[j].keys = & keys[j * anim->keyCount];
+      AN::BuildTracks(anim, model->boneCount);
    }
-
-   model->hasNormals = isFieldPresent(flags, NORMALS);
-   model->hasColors = isFieldPresent(flags, COLORS);
-   model->hasTexCoords = isFieldPresent(flags, TEXCOORDS);
-   model->hasTansAndBitans = isFieldPresent(flags, TANGENTS) &&
-                             isFieldPresent(flags, BITANGENTS);
-   model->hasBoneWeights = isFieldPresent(flags, BONE_INDICES) &&
-                           isFieldPresent(flags, BONE_WEIGHTS);
-   model->hasBoneTree = isFieldPresent(flags, BONE_TREE);
-   model->hasAnimations = isFieldPresent(flags, ANIMATIONS);
 }
 
-static void loadMeshData(FILE *fp, Model * model) {
-   readHeader(fp, model);
-
-   char fieldType;
-   unsigned short receivedFlags = 0;
-
-   while (fread(&fieldType, sizeof(char), 1, fp) > 0) {
-      receivedFlags |= 1 << (fieldType-1);
-
-      switch(fieldType) {
-         case POSITIONS:
-            readPositions(fp, model);
-            break;
-         case NORMALS:
-            readNormals(fp, model);
-            break;
-         case COLORS:
-            readColors(fp, model);
-            break;
-         case TEXCOORDS:
-            readTexCoords(fp, model);
-            break;
-         case TANGENTS:
-            readTangents(fp, model);
-            break;
-         case BITANGENTS:
-            readBitangents(fp, model);
-            break;
-         case INDICES:
-            readIndices(fp, model);
-            break;
-         case BONE_INDICES:
-            readBoneIndices(fp, model);
-            break;
-         case BONE_WEIGHTS:
-            readBoneWeights(fp, model);
-            break;
-         case BONE_NUM_INF:
-            readBoneInfluences(fp, model);
-            break;
-         case BONE_TREE:
-            readBoneTree(fp, model);
-            break;
-         case ANIMATIONS:
-            readAnimations(fp, model);
-            break;
-         default:
-            printf("Invalid model field '%d' encountered while loading model\n", fieldType);
-            exit(1);
-            break;
-      }
-   }
+static VertexAttrib blockAttrib(Model * model, unsigned int type, bool normalized, int offset) {
+   VertexAttrib attrib;
+   attrib.vbo = model->vertexBlockID;
+   attrib.type = type;
+   attrib.normalized = normalized;
+   attrib.offset = offset;
+   return attrib;
+}
+
+// The interleaved block is already laid out for the GPU, so it goes up in one piece
+static void uploadVertexBlock(const CIABView& view, Model * model) {
+   VertexFormat * format = & model->vertexFormat;
+   GLenum indexType = view.boneIndexSize == 1 ? GL_UNSIGNED_BYTE : GL_UNSIGNED_SHORT;
+
+   glBindBuffer(GL_ARRAY_BUFFER, model->vertexBlockID);
+   glBufferData(GL_ARRAY_BUFFER, view.vertexCount * view.vertexStride, view.vertexBlock, GL_STATIC_DRAW);
+
+   format->stride = view.vertexStride;
+   format->position    = blockAttrib(model, GL_FLOAT,          false, VB_POSITION);
+   format->normal      = blockAttrib(model, GL_FLOAT,          false, VB_NORMAL);
+   format->color       = blockAttrib(model, GL_FLOAT,          false, VB_COLOR);
+   format->uv          = blockAttrib(model, GL_FLOAT,          false, VB_UV);
+   format->tangent     = blockAttrib(model, GL_FLOAT,          false, VB_TANGENT);
+   format->bitangent   = blockAttrib(model, GL_FLOAT,          false, VB_BITANGENT);
+   format->boneNumInf  = blockAttrib(model, GL_UNSIGNED_BYTE,  false, VB_BONE_NUM_INF);
+   format->boneIndices = blockAttrib(model, indexType,         false, VB_BONE_INDICES);
+   format->boneWeights = blockAttrib(model, GL_UNSIGNED_SHORT, true,  VB_BONE_WEIGHTS);
+}
+
+static void checkPresentFields(Model * model, const CIABView& view) {
+   model->hasNormals = view.hasField(NORMALS);
+   model->hasColors = view.hasField(COLORS);
+   model->hasTexCoords = view.hasField(TEXCOORDS);
+   model->hasTansAndBitans = view.hasField(TANGENTS) &&
+                             view.hasField(BITANGENTS);
+   model->hasBoneWeights = view.hasField(BONE_INDICES) &&
+                           view.hasField(BONE_WEIGHTS);
+   model->hasBoneTree = view.hasField(BONE_TREE);
+   model->hasAnimations = view.hasField(ANIMATIONS) || view.hasField(KEYFRAMES_Q16) ||
+                          view.hasField(KEYFRAMES_COMPRESSED);
+}
+
+static void loadMeshData(const CIABView& view, Model * model) {
+   readHeader(view, model);
+   readStreams(view, model);
+
+   if (view.hasField(BONE_TREE))
+      readBoneTree(view, model);
+   if (model->hasAnimations)
+      readAnimations(view, model);
 
    // Rigid body stuff
    float h = 1.79f;
@@ -334,37 +178,60 @@ static void loadMeshData(FILE *fp, Model * model) {
    model->invInertiaTensor = model->inertiaTensor.inverse();
    model->com = Eigen::Vector3f(0,0,0);
 
-   // Send data to the graphics card
-   model->bufferVertices();
-   model->bufferIndices();
-
-   checkPresentFields(model, receivedFlags);
+   checkPresentFields(model, view);
    model->isAnimated = model->hasBoneWeights && model->hasAnimations;
-
-   checkOpenGLError();
 }
 
-static FILE * safe_fopen(const char * path) {
+static MappedFile * safe_mmap(const char * path) {
    if (!path) {
       fprintf(stderr, "Error reading model file. Filename string empty\n");
       exit(1);
    }
 
-   FILE * fp = fopen(path,"rb");
+   MappedFile * file = new MappedFile();
 
-   if (!fp) {
+   if (!file->open(path)) {
       printf("Error loading %s:\n ", path);
       perror("");
       exit(1);
    }
 
-   return fp;
+   return file;
+}
+
+void Model::decodeCIAB(const char * path) {
+   MappedFile * file = safe_mmap(path);
+
+   CIABView view;
+   if (!view.parse(file->data(), file->size())) {
+      fprintf(stderr, "Error loading %s: %s\n", path, view.error);
+      exit(1);
+   }
+
+   loadMeshData(view, this);
+
+   // The animation keys point into the mapping, so the model keeps it alive
+   delete this->mappedFile;
+   this->mappedFile = file;
+}
+
+// Planar ciab streams were copied into the mesh, only the interleaved block
+// goes up straight from the mapping
+bool Model::bufferVertexBlock() {
+   if (!mappedFile)
+      return false;
+
+   CIABView view;
+   if (!view.parse(mappedFile->data(), mappedFile->size()) || !view.vertexBlock)
+      return false;
+
+   uploadVertexBlock(view, this);
+   return true;
 }
 
 void Model::loadCIAB(const char * path) {
-   FILE * fp = safe_fopen(path);
-   loadMeshData(fp, this);
-   fclose(fp);
+   decodeCIAB(path);
+   upload();
 
    // printBoneTree();
    // printAnimations();
@@ -1,6 +1,7 @@
 
 #include "safe_gl.h"
 #include "model.h"
+#include "animation.h"
 #include "attachment_loader.h"
 
 #include <algorithm>
@@ -46,58 +47,37 @@ static void normalizeBoneWeights(std::vector<VertexWeight> & verts) {
    }
 }
 
-static void parseVertexWeights(std::vector<VertexWeight> & verts, float * bIndices, float * bWeights, float * bNumInfluences) {
-   // Sort vertex components into buffers to send to the GPU
+static void parseVertexWeights(std::vector<VertexWeight> & verts, Mesh * mesh) {
+   // Sort vertex components into the mesh's bone streams
    for (int i = 0; i < verts.size(); i++) {
       bool foundNum = false;
 
       for (int j = 0; j < MAX_INFLUENCES; j++) {
-         bIndices[MAX_INFLUENCES * i + j] = float(verts[i].boneWeights[j].index);
-         bWeights[MAX_INFLUENCES * i + j] = verts[i].boneWeights[j].weight;
+         mesh->boneIndices[MAX_INFLUENCES * i + j] = verts[i].boneWeights[j].index;
+         mesh->boneWeights[MAX_INFLUENCES * i + j] = verts[i].boneWeights[j].weight;
 
          if (verts[i].boneWeights[j].weight == 0.0f && !foundNum) {
-            bNumInfluences[i] = j;
+            mesh->boneInfCounts[i] = j;
             foundNum = true;
          }
       }
 
       if (!foundNum)
-         bNumInfluences[i] = MAX_INFLUENCES;
+         mesh->boneInfCounts[i] = MAX_INFLUENCES;
    }
 }
 
 static void bindBoneWeights(Model * model, std::vector<float> & inWeights, int numBones) {
    int numVertices = inWeights.size() / numBones;
    std::vector<VertexWeight> verts = std::vector<VertexWeight>(numVertices);
-   int numWeights = numVertices * MAX_INFLUENCES;
-   float * bNumInfluences = (float *)malloc(numVertices * sizeof(float));
-   float * bIndices = (float *)malloc(numWeights * sizeof(float));
-   float * bWeights = (float *)malloc(numWeights * sizeof(float));
 
    fillVertexArray(inWeights, verts);
    sortBoneWeights(verts);
    normalizeBoneWeights(verts);
-   parseVertexWeights(verts, bIndices, bWeights, bNumInfluences);
-
-   for (int i = 0; i < numVertices; i++)
-      model->vertices[i]->boneInfCount = bNumInfluences[i];
-
-   for (int i = 0; i < numVertices; i++)
-      for (int j = 0; j < MAX_INFLUENCES; j++)
-         model->vertices[i]->boneIndices[j] = bIndices[MAX_INFLUENCES*i+j];
-
-   for (int i = 0; i < numVertices; i++)
-      for (int j = 0; j < MAX_INFLUENCES; j++)
-         model->vertices[i]->boneWeights[j] = bWeights[MAX_INFLUENCES*i+j];
+   parseVertexWeights(verts, & model->mesh);
 
    model->boneCount = numBones;
    model->hasBoneWeights = true;
-
-   model->bufferVertices();
-
-   free(bIndices);
-   free(bWeights);
-   free(bNumInfluences);
 }
 
 static void setBindPoseMatrices(Model * model, std::vector<float> & inBindPoses, int numBones) {
@@ -126,28 +106,28 @@ static void setAnimFrames(Model * model, std::vector<float> & inFrames, int numB
    anim->keyCount = keyCount;
    anim->duration = 1.0 * (keyCount-1) / fps;
 
-   anim->animBones = std::vector<AnimBone>(numBones);
+   // PIN frames come at a fixed rate with unit scale, so most of each clip is
+   // constant tracks or keys that interpolation gets right on its own
+   std::vector<LocalTransform> frames = std::vector<LocalTransform>(numBones * keyCount);
    for (int boneNdx = 0; boneNdx < numBones; boneNdx++) {
-      AnimBone * animBone = & anim->animBones[boneNdx];
-
-      animBone->keys = std::vector<Key>(anim->keyCount);
       for (int keyNdx = 0; keyNdx < keyCount; keyNdx++) {
-         Key * key = & animBone->keys[keyNdx];
+         LocalTransform * frame = & frames[boneNdx * keyCount + keyNdx];
 
          int inNdx = (7 * numBones * keyNdx) + (7 * boneNdx);
 
-         key->time = 1.0 * keyNdx / fps;
-         key->position = Eigen::Vector3f(inFrames[inNdx+4], inFrames[inNdx+5], inFrames[inNdx+6]);
-         key->rotation = Eigen::Quaternionf(inFrames[inNdx+3], inFrames[inNdx], inFrames[inNdx+1], inFrames[inNdx+2]);
-         key->scale = Eigen::Vector3f(1, 1, 1);
+         frame->position = Eigen::Vector3f(inFrames[inNdx+4], inFrames[inNdx+5], inFrames[inNdx+6]);
+         frame->rotation = Eigen::Quaternionf(inFrames[inNdx+3], inFrames[inNdx], inFrames[inNdx+1], inFrames[inNdx+2]);
+         frame->scale = Eigen::Vector3f(1, 1, 1);
       }
    }
 
+   AC::Compress(frames.data(), numBones, keyCount, fps, AC::DefaultTolerance(), anim->compressed);
+
    model->animationCount = 1;
    model->hasAnimations = true;
 }
 
-void Model::loadSkinningPIN(const char * path) {
+void Model::decodeSkinningPIN(const char * path) {
    std::vector<float> boneWeights;
    int numBones;
 
@@ -157,7 +137,7 @@ void Model::loadSkinningPIN(const char * path) {
    isAnimated = hasBoneWeights && hasAnimations;
 }
 
-void Model::loadAnimationPIN(const char * path) {
+void Model::decodeAnimationPIN(const char * path) {
    std::vector<float> frames;
    std::vector<float> bindPoses;
    int numBones;
@@ -168,3 +148,12 @@ void Model::loadAnimationPIN(const char * path) {
 
    isAnimated = hasBoneWeights && hasAnimations;
 }
+
+void Model::loadSkinningPIN(const char * path) {
+   decodeSkinningPIN(path);
+   bufferVertices();
+}
+
+void Model::loadAnimationPIN(const char * path) {
+   decodeAnimationPIN(path);
+}
@@ -8,7 +8,7 @@
 #include "matrix_math.h"
 #include "model.h"
 
-void Model::loadOBJ(const char * path)
+void Model::decodeOBJ(const char * path)
 {
    std::vector<tinyobj::shape_t> shapes;
    std::vector<tinyobj::material_t> objMaterials;
@@ -29,36 +29,28 @@ void Model::loadOBJ(const char * path)
    this->boneCount = 0;
    this->animationCount = 0;
 
-   this->vertices = std::vector<Vertex *>(this->vertexCount);
-   for (int i = 0; i < this->vertices.size(); i++) {
-      this->vertices[i] = new Vertex();
-      this->vertices[i]->index = i;
-   }
-
-   this->faces = std::vector<Face *>(this->faceCount);
-   for (int i = 0; i < this->faces.size(); i++)
-      this->faces[i] = new Face();
+   this->mesh.resize(this->vertexCount, this->faceCount);
 
    for (int i = 0; i < this->vertexCount; i++)
-      this->vertices[i]->position = Eigen::Vector3f(posBuf[3*i], posBuf[3*i+1], posBuf[3*i+2]);
+      this->mesh.positions[i] = Eigen::Vector3f(posBuf[3*i], posBuf[3*i+1], posBuf[3*i+2]);
 
    if (!norBuf.empty())
       for (int i = 0; i < this->vertexCount; i++)
-         this->vertices[i]->normal = Eigen::Vector3f(norBuf[3*i], norBuf[3*i+1], norBuf[3*i+2]);
+         this->mesh.normals[i] = Eigen::Vector3f(norBuf[3*i], norBuf[3*i+1], norBuf[3*i+2]);
 
    if (!texBuf.empty())
       for (int i = 0; i < this->vertexCount; i++)
-         this->vertices[i]->uv = Eigen::Vector2f(texBuf[2*i], texBuf[2*i+1]);
+         this->mesh.uvs[i] = Eigen::Vector2f(texBuf[2*i], texBuf[2*i+1]);
 
-   for (int i = 0; i < this->faceCount; i++)
-      for (int j = 0; j < NUM_FACE_EDGES; j++)
-         this->faces[i]->vertices[j] = this->vertices[indBuf[NUM_FACE_EDGES*i+j]];
+   this->mesh.indices.assign(indBuf.begin(), indBuf.begin() + NUM_FACE_EDGES * this->faceCount);
+}
 
-   // Send vertex and face data to the GPU
-   bufferVertices();
-   bufferIndices();
+void Model::loadOBJ(const char * path)
+{
+   decodeOBJ(path);
 
-   checkOpenGLError();
+   // Send vertex and face data to the GPU
+   upload();
 
    std::cerr << "Loaded OBJ model: " << path << "\n";
 }
@@ -1,15 +1,86 @@
 
 #include <stdio.h>
+#include <string.h>
 #include <stdlib.h>
 #include <iostream>
+#include <string>
+#include <sys/stat.h>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 #include "safe_gl.h"
 #include "model.h"
 
-static unsigned int loadImage(const char * filename, bool repeat) {
-   unsigned int id;
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_RED_RGTC1
+#define GL_COMPRESSED_RED_RGTC1 0x8DBB
+#endif
+#ifndef GL_COMPRESSED_RG_RGTC2
+#define GL_COMPRESSED_RG_RGTC2 0x8DBD
+#endif
+#ifndef GL_TEXTURE_MAX_LEVEL
+#define GL_TEXTURE_MAX_LEVEL 0x813D
+#endif
+
+static bool modifiedTime(const char * path, time_t& time) {
+   struct stat info;
+   if (stat(path, & info) != 0)
+      return false;
+   time = info.st_mtime;
+   return true;
+}
+
+// The baked copy is only trusted while the image it came from hasn't changed
+static bool isBakeCurrent(const std::string& bakedPath, const char * sourcePath) {
+   time_t bakedTime, sourceTime;
+   if (!modifiedTime(bakedPath.c_str(), bakedTime))
+      return false;
+   if (!modifiedTime(sourcePath, sourceTime))
+      return true;
+   if (sourceTime > bakedTime) {
+      std::cerr << bakedPath << " is older than " << sourcePath << ", rebake it. Using the image for now\n";
+      return false;
+   }
+   return true;
+}
+
+static void readBaked(const std::string& path, Image * image) {
+   FILE * fp = fopen(path.c_str(), "rb");
+   if (!fp) {
+      std::cerr << path << " not found\n";
+      exit(1);
+   }
+
+   fseek(fp, 0, SEEK_END);
+   long size = ftell(fp);
+   fseek(fp, 0, SEEK_SET);
+
+   image->data.resize(size > 0 ? size : 0);
+   bool ok = size > 0 && fread(image->data.data(), 1, size, fp) == (size_t)size;
+   fclose(fp);
+
+   const unsigned char * levelData;
+   const char * error = "file is empty";
+   if (!ok || !TX::Parse(image->data.data(), image->data.size(), image->format, image->levels, levelData, error)) {
+      std::cerr << "Error loading " << path << ": " << error << "\n";
+      exit(1);
+   }
+
+   image->width = image->levels[0].width;
+   image->height = image->levels[0].height;
+}
+
+void Image::decode(const char * filename) {
+   std::string baked = std::string(filename) + ".ctex";
+   if (isBakeCurrent(baked, filename)) {
+      readBaked(baked, this);
+      return;
+   }
 
    // Load texture
    int w, h, ncomps;
@@ -30,21 +101,90 @@ static unsigned int loadImage(const char * filename, bool repeat) {
 
    // Flip the image for opengl
    int rowSize = ncomps * w;
-   unsigned char * data = (unsigned char *)malloc(sizeof(unsigned char) * rowSize * h);
+   this->width = w;
+   this->height = h;
+   this->format = TX::RGB8;
+   this->levels.clear();
+   this->data.resize(rowSize * h);
    for (int i = 0; i < h; i++)
-      memcpy(& data[rowSize * i], & stbi_data[rowSize * (h-1-i)], rowSize);
+      memcpy(& this->data[rowSize * i], & stbi_data[rowSize * (h-1-i)], rowSize);
 
-   // Free the stbi buffer because now we're using "data"
+   // Free the stbi buffer because now we're using the flipped copy
    stbi_image_free(stbi_data);
-   // Generate a texture buffer object
-   glGenTextures(1, & id);
+}
+
+static bool hasExtension(const char * name) {
+   const char * extensions = (const char *)glGetString(GL_EXTENSIONS);
+   return extensions && strstr(extensions, name);
+}
+
+static unsigned int compressedFormat(TX::Format format) {
+   switch (format) {
+      case TX::BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+      case TX::BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+      case TX::BC4: return GL_COMPRESSED_RED_RGTC1;
+      default:      return GL_COMPRESSED_RG_RGTC2;
+   }
+}
+
+static bool supportsFormat(TX::Format format) {
+   static const bool s3tc = hasExtension("GL_EXT_texture_compression_s3tc");
+   static const bool rgtc = hasExtension("GL_ARB_texture_compression_rgtc") ||
+                            hasExtension("GL_EXT_texture_compression_rgtc");
+   return (format == TX::BC1 || format == TX::BC3) ? s3tc : rgtc;
+}
+
+// Baked levels go up as they are, drivers without the format get them decompressed
+static void uploadLevels(const Image& image) {
+   bool native = supportsFormat(image.format);
+   if (!native)
+      std::cerr << "Compressed texture format " << image.format << " isn't supported, decompressing\n";
+
+   for (unsigned int i = 0; i < image.levels.size(); i++) {
+      const TX::Level& level = image.levels[i];
+
+      if (native) {
+         glCompressedTexImage2D(GL_TEXTURE_2D, i, compressedFormat(image.format), level.width, level.height, 0,
+                                level.size, & image.data[level.offset]);
+      } else {
+         std::vector<unsigned char> rgba;
+         TX::DecodeLevel(image.format, level, image.data.data(), rgba);
+         glTexImage2D(GL_TEXTURE_2D, i, GL_RGBA, level.width, level.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+      }
+   }
+   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, image.levels.size() - 1);
+}
+
+// ======================================================== //
+// =================== TEXTURE METHODS ==================== //
+// ======================================================== //
+
+Texture::Texture()
+: id(0), gpuBytes(0) {}
+
+Texture::~Texture() {
+   if (id)
+      glDeleteTextures(1, & id);
+}
+
+void Texture::upload(const Image& image, bool repeat) {
+   if (!id)
+      glGenTextures(1, & id);
+
    // Bind the current texture to be the newly generated texture object
    glBindTexture(GL_TEXTURE_2D, id);
-   // Load the actual texture data
-   // Base level is 0, number of channels is 3, and border is 0.
-   glTexImage2D(GL_TEXTURE_2D, 0, ncomps, w, h, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-   // Generate image pyramid
-   glGenerateMipmap(GL_TEXTURE_2D);
+
+   if (image.levels.empty()) {
+      // Load the actual texture data
+      // Base level is 0, number of channels is 3, and border is 0.
+      glTexImage2D(GL_TEXTURE_2D, 0, 3, image.width, image.height, 0, GL_RGB, GL_UNSIGNED_BYTE, image.data.data());
+      // Generate image pyramid
+      glGenerateMipmap(GL_TEXTURE_2D);
+   } else {
+      // The pyramid was made when the texture was baked
+      uploadLevels(image);
+   }
+
    // Set texture wrap modes for the S and T directions
    int glRepeatConst = repeat ? GL_REPEAT : GL_CLAMP_TO_EDGE;
    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, glRepeatConst);
@@ -55,28 +195,54 @@ static unsigned int loadImage(const char * filename, bool repeat) {
 
    // Unbind
    glBindTexture(GL_TEXTURE_2D, 0);
-   // Free the image data, since the data is now on the GPU
-   free(data);
 
-   return id;
+   // Drivers keep RGB at 4 bytes a pixel, and a full mip chain is a third bigger than its base
+   gpuBytes = 0;
+   for (unsigned int i = 0; i < image.levels.size(); i++)
+      gpuBytes += image.levels[i].size;
+   if (image.levels.empty())
+      gpuBytes = 4 * image.width * image.height * 4 / 3;
+}
+
+// ======================================================== //
+// ================ MODEL TEXTURE METHODS ================= //
+// ======================================================== //
+
+static TextureHandle uploadImage(const Image& image, bool repeat) {
+   TextureHandle texture = std::make_shared<Texture>();
+   texture->upload(image, repeat);
+   return texture;
+}
+
+void Model::setTexture(const Image& image, bool repeat) {
+   this->texture = uploadImage(image, repeat);
+}
+
+void Model::setNormalMap(const Image& image, bool repeat) {
+   this->normalMap = uploadImage(image, repeat);
+}
+
+void Model::setSpecularMap(const Image& image, bool repeat) {
+   this->specularMap = uploadImage(image, repeat);
 }
 
 void Model::loadTexture(const char * filename, bool repeat) {
-   this->texID = loadImage(filename, repeat);
-   this->hasTexture = true;
+   Image image;
+   image.decode(filename);
+   setTexture(image, repeat);
    std::cerr << "Loaded texture: " << filename << "\n";
 }
 
 void Model::loadNormalMap(const char * filename, bool repeat) {
-   this->nmapID = loadImage(filename, repeat);
-   this->hasNormalMap = true;
+   Image image;
+   image.decode(filename);
+   setNormalMap(image, repeat);
    std::cerr << "Loaded normal map: " << filename << "\n";
 }
 
 void Model::loadSpecularMap(const char * filename, bool repeat) {
-   this->smapID = loadImage(filename, repeat);
-   this->hasSpecularMap = true;
+   Image image;
+   image.decode(filename);
+   setSpecularMap(image, repeat);
    std::cerr << "Loaded specular map: " << filename << "\n";
 }
-
-
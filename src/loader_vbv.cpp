@@ -0,0 +1,272 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "safe_gl.h"
+#include "model.h"
+#include "animation.h"
+#include "progressive.h"
+
+// Field bits of the has_flags header entry, same numbering as the ciab field tags
+typedef enum {
+   HAS_NORMALS = 1 << 1,
+   HAS_COLORS = 1 << 2,
+   HAS_TEXCOORDS = 1 << 3,
+   HAS_TANGENTS = 1 << 4,
+   HAS_BITANGENTS = 1 << 5,
+   HAS_BONE_INDICES = 1 << 7,
+   HAS_BONE_WEIGHTS = 1 << 8,
+   HAS_BONE_TREE = 1 << 10,
+   HAS_ANIMATIONS = 1 << 11
+} vbvFlag;
+
+static FILE * safe_fopen(const char * path) {
+   if (!path) {
+      fprintf(stderr, "Error reading model file. Filename string empty\n");
+      exit(1);
+   }
+
+   FILE * fp = fopen(path, "rb");
+
+   if (!fp) {
+      printf("Error loading %s:\n ", path);
+      perror("");
+      exit(1);
+   }
+
+   return fp;
+}
+
+static void failVBV(const char * message) {
+   fprintf(stderr, "Error loading VBV model: %s\n", message);
+   exit(1);
+}
+
+// Sizes a GPU buffer for the whole stream, the vertices are filled in as they stream
+template <typename T>
+static void allocateStream(unsigned int vbo, const std::vector<T>& stream) {
+   glBindBuffer(GL_ARRAY_BUFFER, vbo);
+   glBufferData(GL_ARRAY_BUFFER, stream.size() * sizeof(T), NULL, GL_DYNAMIC_DRAW);
+}
+
+template <typename T>
+static void uploadRange(unsigned int vbo, const std::vector<T>& stream, unsigned int perVertex,
+                        unsigned int first, unsigned int count) {
+   glBindBuffer(GL_ARRAY_BUFFER, vbo);
+   glBufferSubData(GL_ARRAY_BUFFER, first * perVertex * sizeof(T), count * perVertex * sizeof(T),
+                   & stream[first * perVertex]);
+}
+
+static bool readVertexRecord(FILE * fp, Model * model, unsigned int i, PM::VertexSplit& split) {
+   Mesh * mesh = & model->mesh;
+   unsigned short boneIndices[MAX_INFLUENCES], numInf;
+   unsigned int numUpdates;
+   unsigned char numNewFaces;
+   bool ok = true;
+
+   ok = ok && fread(mesh->positions[i].data(), sizeof(float), 3, fp) == 3;
+   ok = ok && fread(mesh->normals[i].data(), sizeof(float), 3, fp) == 3;
+   ok = ok && fread(mesh->colors[i].data(), sizeof(float), 3, fp) == 3;
+   ok = ok && fread(mesh->uvs[i].data(), sizeof(float), 2, fp) == 2;
+   ok = ok && fread(mesh->tangents[i].data(), sizeof(float), 3, fp) == 3;
+   ok = ok && fread(mesh->bitangents[i].data(), sizeof(float), 3, fp) == 3;
+   ok = ok && fread(boneIndices, sizeof(unsigned short), MAX_INFLUENCES, fp) == MAX_INFLUENCES;
+   ok = ok && fread(& mesh->boneWeights[MAX_INFLUENCES*i], sizeof(float), MAX_INFLUENCES, fp) == MAX_INFLUENCES;
+   ok = ok && fread(& numInf, sizeof(unsigned short), 1, fp) == 1;
+   if (!ok)
+      return false;
+
+   for (int j = 0; j < MAX_INFLUENCES; j++)
+      mesh->boneIndices[MAX_INFLUENCES*i+j] = boneIndices[j];
+   mesh->boneInfCounts[i] = numInf;
+
+   ok = ok && fread(& split.baseVertex, sizeof(unsigned int), 1, fp) == 1;
+   ok = ok && fread(& numNewFaces, sizeof(unsigned char), 1, fp) == 1;
+   if (!ok)
+      return false;
+
+   split.newFaces = std::vector<unsigned int>(NUM_FACE_EDGES * numNewFaces);
+   if (numNewFaces)
+      ok = fread(split.newFaces.data(), sizeof(unsigned int), split.newFaces.size(), fp) == split.newFaces.size();
+
+   ok = ok && fread(& numUpdates, sizeof(unsigned int), 1, fp) == 1;
+   if (!ok || numUpdates > NUM_FACE_EDGES * model->faceCount)
+      return false;
+
+   split.updatedFaces = std::vector<PM::FaceUpdate>(numUpdates);
+   for (unsigned int j = 0; j < numUpdates && ok; j++) {
+      ok = ok && fread(& split.updatedFaces[j].face, sizeof(unsigned int), 1, fp) == 1;
+      ok = ok && fread(& split.updatedFaces[j].corner, sizeof(unsigned char), 1, fp) == 1;
+   }
+
+   return ok;
+}
+
+static void readFaces(FILE * fp, Model * model) {
+   Mesh * mesh = & model->mesh;
+
+   if (fread(mesh->indices.data(), sizeof(unsigned int), mesh->indices.size(), fp) != mesh->indices.size())
+      failVBV("file ends before the face list");
+   for (unsigned int i = 0; i < mesh->indices.size(); i++)
+      if (mesh->indices[i] >= model->vertexCount)
+         failVBV("face index out of range");
+}
+
+static void readBoneTree(FILE * fp, Model * model) {
+   short boneRoot;
+   fread(& boneRoot, sizeof(short), 1, fp);
+   if (boneRoot < 0 || boneRoot >= (int)model->boneCount)
+      failVBV("bone root index out of range");
+   model->boneRoot = boneRoot;
+
+   model->bones = std::vector<Bone>(model->boneCount);
+   for (int i = 0; i < model->boneCount; i++) {
+      Bone * bone = & model->bones[i];
+      short parent, numChildren;
+
+      fread(& parent, sizeof(short), 1, fp);
+      fread(& numChildren, sizeof(short), 1, fp);
+      bone->parentIndex = parent;
+
+      bone->childIndices = std::vector<int>(numChildren > 0 ? numChildren : 0);
+      for (int j = 0; j < numChildren; j++) {
+         short child;
+         fread(& child, sizeof(short), 1, fp);
+         if (child < 0 || child >= model->boneCount)
+            failVBV("bone child index out of range");
+         bone->childIndices[j] = child;
+      }
+
+      if (parent < -1 || parent >= (int)model->boneCount)
+         failVBV("bone parent index out of range");
+
+      fread(bone->invBonePose.data(), sizeof(float), 16, fp);
+      if (fread(bone->parentOffset.data(), sizeof(float), 16, fp) != 16)
+         failVBV("file ends inside the bone tree");
+   }
+
+   model->flattenBoneTree();
+   model->estimateBoneMasses();
+}
+
+static void readAnimations(FILE * fp, Model * model) {
+   model->animations = std::vector<Animation>(model->animationCount);
+
+   for (int i = 0; i < model->animationCount; i++) {
+      Animation * anim = & model->animations[i];
+
+      fread(& anim->fps, sizeof(unsigned int), 1, fp);
+      fread(& anim->keyCount, sizeof(unsigned int), 1, fp);
+      anim->duration = 1.0 * (anim->keyCount-1) / anim->fps;
+
+      anim->ownedKeys = std::vector<Key>(model->boneCount * anim->keyCount);
+      if (fread(anim->ownedKeys.data(), sizeof(Key), anim->ownedKeys.size(), fp) != anim->ownedKeys.size())
+         failVBV("file ends inside an animation");
+
+      anim->animBones = std::vector<AnimBone>(model->boneCount);
+      for (int j = 0; j < model->boneCount; j++)
+         anim->animBones[j].keys = & anim->ownedKeys[j * anim->keyCount];
+      AN::BuildTracks(anim, model->boneCount);
+   }
+}
+
+// Everything after the last vertex record, read once the vertices are in
+static void finishVBV(FILE * fp, Model * model) {
+   readFaces(fp, model);
+   if (model->hasBoneTree)
+      readBoneTree(fp, model);
+   if (model->hasAnimations)
+      readAnimations(fp, model);
+
+   model->isAnimated = model->hasBoneWeights && model->hasAnimations;
+}
+
+void Model::openVBV(const char * path) {
+   FILE * fp = safe_fopen(path);
+   unsigned int flags;
+
+   fread(& vertexCount, sizeof(unsigned int), 1, fp);
+   fread(& faceCount, sizeof(unsigned int), 1, fp);
+   fread(& boneCount, sizeof(unsigned int), 1, fp);
+   fread(& animationCount, sizeof(unsigned int), 1, fp);
+   if (fread(& flags, sizeof(unsigned int), 1, fp) != 1)
+      failVBV("file is too short for the header");
+
+   hasNormals = flags & HAS_NORMALS;
+   hasColors = flags & HAS_COLORS;
+   hasTexCoords = flags & HAS_TEXCOORDS;
+   hasTansAndBitans = (flags & HAS_TANGENTS) && (flags & HAS_BITANGENTS);
+   hasBoneWeights = (flags & HAS_BONE_INDICES) && (flags & HAS_BONE_WEIGHTS);
+   hasBoneTree = flags & HAS_BONE_TREE;
+   hasAnimations = flags & HAS_ANIMATIONS;
+   isAnimated = false;
+
+   mesh.resize(vertexCount, faceCount);
+   delete progressive;
+   progressive = new ProgressiveMesh(vertexCount, faceCount);
+   progressive->source = fp;
+
+   // Size the GPU buffers up front so vertices can be drawn as soon as they arrive
+   usePlanarFormat();
+   allocateStream(posID,     mesh.positions);
+   allocateStream(normID,    mesh.normals);
+   allocateStream(colorID,   mesh.colors);
+   allocateStream(uvID,      mesh.uvs);
+   allocateStream(tanID,     mesh.tangents);
+   allocateStream(bitanID,   mesh.bitangents);
+   allocateStream(bNumInfID, mesh.boneInfCounts);
+   allocateStream(bIndexID,  mesh.boneIndices);
+   allocateStream(bWeightID, mesh.boneWeights);
+
+   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexID);
+   glBufferData(GL_ELEMENT_ARRAY_BUFFER, progressive->indices.size() * sizeof(unsigned int),
+                progressive->indices.data(), GL_DYNAMIC_DRAW);
+
+   checkOpenGLError();
+}
+
+bool Model::streamVBV(unsigned int count) {
+   if (!progressive || !progressive->source)
+      return true;
+
+   FILE * fp = progressive->source;
+   unsigned int first = progressive->splits.size();
+   unsigned int last = first + count < vertexCount ? first + count : vertexCount;
+
+   for (unsigned int i = first; i < last; i++) {
+      PM::VertexSplit split;
+      if (!readVertexRecord(fp, this, i, split) || !progressive->addSplit(split))
+         failVBV("malformed vertex record");
+   }
+
+   if (last > first) {
+      uploadRange(posID,     mesh.positions,     1, first, last - first);
+      uploadRange(normID,    mesh.normals,       1, first, last - first);
+      uploadRange(colorID,   mesh.colors,        1, first, last - first);
+      uploadRange(uvID,      mesh.uvs,           1, first, last - first);
+      uploadRange(tanID,     mesh.tangents,      1, first, last - first);
+      uploadRange(bitanID,   mesh.bitangents,    1, first, last - first);
+      uploadRange(bNumInfID, mesh.boneInfCounts, 1, first, last - first);
+      uploadRange(bIndexID,  mesh.boneIndices,   MAX_INFLUENCES, first, last - first);
+      uploadRange(bWeightID, mesh.boneWeights,   MAX_INFLUENCES, first, last - first);
+   }
+
+   // Continue toward the level of detail that was asked for
+   setVertexBudget(progressive->targetVertices);
+
+   if (last < vertexCount)
+      return false;
+
+   finishVBV(fp, this);
+   fclose(fp);
+   progressive->source = NULL;
+
+   checkOpenGLError();
+   return true;
+}
+
+void Model::loadVBV(const char * path) {
+   openVBV(path);
+   while (!streamVBV(vertexCount));
+
+   fprintf(stderr, "Loaded VBV model: %s\n", path);
+}
@@ -0,0 +1,57 @@
+#include "mapped_file.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+MappedFile::MappedFile()
+: _data(NULL), _size(0) {}
+
+MappedFile::~MappedFile() {
+   close();
+}
+
+bool MappedFile::open(const char * path) {
+   close();
+
+   int fd = ::open(path, O_RDONLY);
+   if (fd < 0)
+      return false;
+
+   struct stat st;
+   if (fstat(fd, & st) < 0 || st.st_size == 0) {
+      ::close(fd);
+      return false;
+   }
+
+   void * addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+   // The mapping holds its own reference to the file
+   ::close(fd);
+
+   if (addr == MAP_FAILED)
+      return false;
+
+   // Loaders walk the file front to back, let the kernel read ahead
+   madvise(addr, st.st_size, MADV_SEQUENTIAL);
+   madvise(addr, st.st_size, MADV_WILLNEED);
+
+   _data = addr;
+   _size = st.st_size;
+   return true;
+}
+
+void MappedFile::close() {
+   if (_data)
+      munmap(_data, _size);
+   _data = NULL;
+   _size = 0;
+}
+
+const unsigned char * MappedFile::data() const {
+   return (const unsigned char *)_data;
+}
+
+size_t MappedFile::size() const {
+   return _size;
+}
@@ -0,0 +1,246 @@
+#include "mesh.h"
+
+#include <algorithm>
+#include <assert.h>
+
+// ======================================================== //
+// ================= MESH VERTEX METHODS ================== //
+// ======================================================== //
+
+MeshVertex::MeshVertex(Mesh * mesh, unsigned int index)
+: index(index), mesh(mesh) {}
+
+Eigen::Vector3f& MeshVertex::position() {
+   return mesh->positions[index];
+}
+Eigen::Vector3f& MeshVertex::normal() {
+   return mesh->normals[index];
+}
+Eigen::Vector3f& MeshVertex::tangent() {
+   return mesh->tangents[index];
+}
+Eigen::Vector3f& MeshVertex::bitangent() {
+   return mesh->bitangents[index];
+}
+Eigen::Vector3f& MeshVertex::color() {
+   return mesh->colors[index];
+}
+Eigen::Vector2f& MeshVertex::uv() {
+   return mesh->uvs[index];
+}
+unsigned int * MeshVertex::boneIndices() {
+   return & mesh->boneIndices[MAX_INFLUENCES * index];
+}
+float * MeshVertex::boneWeights() {
+   return & mesh->boneWeights[MAX_INFLUENCES * index];
+}
+
+unsigned int MeshVertex::faceCount() {
+   assert(mesh->hasAdjacency());
+   return mesh->vertFaceStarts[index+1] - mesh->vertFaceStarts[index];
+}
+
+unsigned int MeshVertex::neighborCount() {
+   assert(mesh->hasAdjacency());
+   return mesh->vertNeighborStarts[index+1] - mesh->vertNeighborStarts[index];
+}
+
+unsigned int MeshVertex::faceIndex(unsigned int i) {
+   return mesh->vertFaces[mesh->vertFaceStarts[index] + i];
+}
+
+unsigned int MeshVertex::neighborIndex(unsigned int i) {
+   return mesh->vertNeighbors[mesh->vertNeighborStarts[index] + i];
+}
+
+bool MeshVertex::hasNeighbor(unsigned int vertIndex) {
+   unsigned int numNeighs = neighborCount();
+   for (unsigned int i = 0; i < numNeighs; i++)
+      if (neighborIndex(i) == vertIndex)
+         return true;
+   return false;
+}
+
+void MeshVertex::calculateNormal() {
+   Eigen::Vector3f n = Eigen::Vector3f(0,0,0);
+   unsigned int numFaces = faceCount();
+   for (unsigned int i = 0; i < numFaces; i++)
+      n += mesh->faceNormals[faceIndex(i)];
+   mesh->normals[index] = n.normalized();
+}
+
+// ======================================================== //
+// ================== MESH FACE METHODS =================== //
+// ======================================================== //
+
+MeshFace::MeshFace(Mesh * mesh, unsigned int index)
+: index(index), mesh(mesh) {}
+
+unsigned int MeshFace::vertexIndex(int corner) {
+   return mesh->indices[NUM_FACE_EDGES * index + corner];
+}
+
+MeshVertex MeshFace::vertex(int corner) {
+   return MeshVertex(mesh, vertexIndex(corner));
+}
+
+Eigen::Vector3f& MeshFace::normal() {
+   return mesh->faceNormals[index];
+}
+
+void MeshFace::calculateNormal() {
+   Eigen::Vector3f& p1 = mesh->positions[vertexIndex(0)];
+   Eigen::Vector3f& p2 = mesh->positions[vertexIndex(1)];
+   Eigen::Vector3f& p3 = mesh->positions[vertexIndex(2)];
+   normal() = ((p3 - p2).cross(p1 - p2)).normalized();
+}
+
+Eigen::Vector3f MeshFace::intersectRay(Geom::Rayf ray) {
+   calculateNormal();
+   Geom::Planef plane = Geom::Planef(mesh->positions[vertexIndex(0)], normal());
+   return Geom::Intersectf(ray, plane);
+}
+
+bool MeshFace::pointCheckInside(Eigen::Vector3f pnt) {
+   Eigen::Vector3f& p1 = mesh->positions[vertexIndex(0)];
+   Eigen::Vector3f& p2 = mesh->positions[vertexIndex(1)];
+   Eigen::Vector3f& p3 = mesh->positions[vertexIndex(2)];
+   Eigen::Vector3f& n = normal();
+
+   bool inside12 = (p2 - p1).cross(pnt - p1).dot(n) >= 0;
+   bool inside23 = (p3 - p2).cross(pnt - p2).dot(n) >= 0;
+   bool inside31 = (p1 - p3).cross(pnt - p3).dot(n) >= 0;
+
+   return inside12 && inside23 && inside31;
+}
+
+// ======================================================== //
+// ===================== MESH METHODS ===================== //
+// ======================================================== //
+
+Mesh::Mesh() {}
+
+unsigned int Mesh::vertexCount() const {
+   return positions.size();
+}
+
+unsigned int Mesh::faceCount() const {
+   return indices.size() / NUM_FACE_EDGES;
+}
+
+void Mesh::resize(unsigned int vertexCount, unsigned int faceCount) {
+   Eigen::Vector3f zero3 = Eigen::Vector3f(0,0,0);
+   Eigen::Vector2f zero2 = Eigen::Vector2f(0,0);
+
+   positions.resize(vertexCount, zero3);
+   normals.resize(vertexCount, zero3);
+   colors.resize(vertexCount, zero3);
+   tangents.resize(vertexCount, zero3);
+   bitangents.resize(vertexCount, zero3);
+   uvs.resize(vertexCount, zero2);
+   boneInfCounts.resize(vertexCount, 0);
+   boneIndices.resize(MAX_INFLUENCES * vertexCount, 0);
+   boneWeights.resize(MAX_INFLUENCES * vertexCount, 0.0f);
+
+   indices.resize(NUM_FACE_EDGES * faceCount, 0);
+   faceNormals.resize(faceCount, zero3);
+
+   vertFaceStarts.clear();
+   vertFaces.clear();
+   vertNeighborStarts.clear();
+   vertNeighbors.clear();
+}
+
+template <typename T>
+static size_t streamBytes(const std::vector<T>& stream) {
+   return stream.size() * sizeof(T);
+}
+
+size_t Mesh::vertexStreamBytes() const {
+   return streamBytes(positions) + streamBytes(normals) + streamBytes(colors) +
+          streamBytes(tangents) + streamBytes(bitangents) + streamBytes(uvs) +
+          streamBytes(boneInfCounts) + streamBytes(boneIndices) + streamBytes(boneWeights);
+}
+
+size_t Mesh::memoryBytes() const {
+   return vertexStreamBytes() + streamBytes(indices) + streamBytes(faceNormals) +
+          streamBytes(vertFaceStarts) + streamBytes(vertFaces) +
+          streamBytes(vertNeighborStarts) + streamBytes(vertNeighbors);
+}
+
+void Mesh::clear() {
+   resize(0, 0);
+}
+
+MeshVertex Mesh::vertex(unsigned int index) {
+   return MeshVertex(this, index);
+}
+
+MeshFace Mesh::face(unsigned int index) {
+   return MeshFace(this, index);
+}
+
+bool Mesh::hasAdjacency() const {
+   return vertFaceStarts.size() == positions.size() + 1;
+}
+
+void Mesh::buildAdjacency() {
+   unsigned int numVerts = vertexCount();
+   unsigned int numFaces = faceCount();
+   unsigned int numCorners = NUM_FACE_EDGES * numFaces;
+
+   // Count the faces touching each vertex, then prefix sum into row starts
+   vertFaceStarts.assign(numVerts + 1, 0);
+   for (unsigned int i = 0; i < numCorners; i++)
+      vertFaceStarts[indices[i] + 1]++;
+   for (unsigned int i = 0; i < numVerts; i++)
+      vertFaceStarts[i+1] += vertFaceStarts[i];
+
+   // Scatter each face into the rows of its corners
+   std::vector<unsigned int> fill(vertFaceStarts.begin(), vertFaceStarts.end() - 1);
+   vertFaces.resize(numCorners);
+   for (unsigned int i = 0; i < numCorners; i++)
+      vertFaces[fill[indices[i]]++] = i / NUM_FACE_EDGES;
+
+   // Neighbors are the other corners of every face touching the vertex
+   vertNeighborStarts.assign(numVerts + 1, 0);
+   vertNeighbors.clear();
+   vertNeighbors.reserve(2 * numCorners);
+   for (unsigned int v = 0; v < numVerts; v++) {
+      unsigned int rowStart = vertNeighbors.size();
+
+      for (unsigned int i = vertFaceStarts[v]; i < vertFaceStarts[v+1]; i++) {
+         const unsigned int * corners = & indices[NUM_FACE_EDGES * vertFaces[i]];
+         for (int j = 0; j < NUM_FACE_EDGES; j++)
+            if (corners[j] != v)
+               vertNeighbors.push_back(corners[j]);
+      }
+
+      // Drop the duplicates from edges shared by two faces
+      std::sort(vertNeighbors.begin() + rowStart, vertNeighbors.end());
+      vertNeighbors.erase(std::unique(vertNeighbors.begin() + rowStart, vertNeighbors.end()), vertNeighbors.end());
+      vertNeighborStarts[v+1] = vertNeighbors.size();
+   }
+}
+
+void Mesh::calculateFaceNormals() {
+   unsigned int numFaces = faceCount();
+   faceNormals.resize(numFaces);
+   for (unsigned int i = 0; i < numFaces; i++)
+      face(i).calculateNormal();
+}
+
+void Mesh::calculateVertexNormals() {
+   unsigned int numVerts = vertexCount();
+   unsigned int numFaces = faceCount();
+   Eigen::Vector3f zero = Eigen::Vector3f(0,0,0);
+
+   // Accumulate each face normal into its corners, no adjacency table needed
+   normals.assign(numVerts, zero);
+   for (unsigned int i = 0; i < numFaces; i++)
+      for (int j = 0; j < NUM_FACE_EDGES; j++)
+         normals[indices[NUM_FACE_EDGES*i+j]] += faceNormals[i];
+
+   for (unsigned int i = 0; i < numVerts; i++)
+      normals[i].normalize();
+}
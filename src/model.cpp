@@ -1,8 +1,13 @@
 #include "model.h"
+#include "mapped_file.h"
+#include "progressive.h"
+#include "reducer.h"
 #include "stdio.h"
 #include "safe_gl.h"
 
 #include <cstring>
+#include <math.h>
+#include <algorithm>
 
 // ======================================================== //
 // ==================== VERTEX METHODS ==================== //
@@ -61,9 +66,6 @@ Model::Model() {
    hasNormals = false;
    hasColors = false;
    hasTexCoords = false;
-   hasTexture = false;
-   hasNormalMap = false;
-   hasSpecularMap = false;
    hasTansAndBitans = false;
    hasBoneWeights = false;
    hasBoneTree = false;
@@ -74,6 +76,13 @@ Model::Model() {
    faceCount = 0;
    boneCount = 0;
    animationCount = 0;
+   boneRoot = 0;
+
+   mappedFile = NULL;
+   progressive = NULL;
+
+   boundCenter = Eigen::Vector3f(0,0,0);
+   boundRadius = 0;
 
    glGenBuffers(1, & posID);
    glGenBuffers(1, & normID);
@@ -85,71 +94,325 @@ Model::Model() {
    glGenBuffers(1, & bIndexID);
    glGenBuffers(1, & bWeightID);
    glGenBuffers(1, & indexID);
+   glGenBuffers(1, & vertexBlockID);
+
+   usePlanarFormat();
 }
 
 Model::~Model() {
+   unsigned int buffers[] = {posID, normID, colorID, uvID, tanID, bitanID,
+                             bNumInfID, bIndexID, bWeightID, indexID, vertexBlockID};
+   glDeleteBuffers(sizeof(buffers) / sizeof(buffers[0]), buffers);
+
+   for (unsigned int i = 0; i < lods.size(); i++)
+      if (lods[i].indexID)
+         glDeleteBuffers(1, & lods[i].indexID);
+
+   delete mappedFile;
+   delete progressive;
 }
 
-void Model::CalculateNormals() {
-   // Calculate face normals
-   for (int i = 0; i < faces.size(); i++)
-      faces[i]->calculateNormal();
+static unsigned int readyTexture(const TextureHandle& texture) {
+   return texture ? texture->id : 0;
+}
+
+unsigned int Model::textureID() {
+   return readyTexture(texture);
+}
+
+unsigned int Model::normalMapID() {
+   return readyTexture(normalMap);
+}
 
-   // Calculate vertex normals
-   for (int i = 0; i < vertices.size(); i++)
-      vertices[i]->calculateNormal();
+unsigned int Model::specularMapID() {
+   return readyTexture(specularMap);
 }
 
-static void bufferVertexField(char ** ptrData, size_t offset, unsigned int vbo, int size, int count) {
-   int numBytes = size * count;
-   char * toGPU = (char *)malloc(numBytes);
+size_t Model::cpuBytes() {
+   size_t bytes = mesh.memoryBytes() + bones.size() * sizeof(Bone);
 
-   for (int i = 0; i < count; i++)
-      std::memcpy(& toGPU[size*i], & (ptrData[i][offset]), size);
+   for (unsigned int i = 0; i < animations.size(); i++)
+      bytes += animations[i].ownedKeys.size() * sizeof(Key) +
+               animations[i].animBones.size() * sizeof(AnimBone) +
+               animations[i].tracks.data.size() * sizeof(float) +
+               animations[i].compressed.size();
+   for (unsigned int i = 0; i < lods.size(); i++)
+      bytes += lods[i].indices.size() * sizeof(unsigned int);
 
+   if (mappedFile)
+      bytes += mappedFile->size();
+   if (progressive)
+      bytes += progressive->indices.size() * sizeof(unsigned int);
+
+   return bytes;
+}
+
+size_t Model::gpuBytes() {
+   size_t bytes = vertexFormat.stride ? (size_t)vertexCount * vertexFormat.stride : mesh.vertexStreamBytes();
+   bytes += NUM_FACE_EDGES * faceCount * sizeof(unsigned int);
+
+   for (unsigned int i = 0; i < lods.size(); i++)
+      if (lods[i].indexID)
+         bytes += NUM_FACE_EDGES * lods[i].faceCount * sizeof(unsigned int);
+
+   return bytes;
+}
+
+void Model::CalculateNormals() {
+   mesh.calculateFaceNormals();
+   mesh.calculateVertexNormals();
+}
+
+template <typename T>
+static void bufferVertexStream(const std::vector<T>& stream, unsigned int vbo) {
    glBindBuffer(GL_ARRAY_BUFFER, vbo);
-   glBufferData(GL_ARRAY_BUFFER, numBytes, toGPU, GL_DYNAMIC_DRAW);
-   free(toGPU);
+   glBufferData(GL_ARRAY_BUFFER, stream.size() * sizeof(T), stream.data(), GL_DYNAMIC_DRAW);
+}
+
+static VertexAttrib planarAttrib(unsigned int vbo, unsigned int type) {
+   VertexAttrib attrib;
+   attrib.vbo = vbo;
+   attrib.type = type;
+   attrib.normalized = false;
+   attrib.offset = 0;
+   return attrib;
+}
+
+void Model::usePlanarFormat() {
+   vertexFormat.stride = 0;
+   vertexFormat.position    = planarAttrib(posID,     GL_FLOAT);
+   vertexFormat.normal      = planarAttrib(normID,    GL_FLOAT);
+   vertexFormat.color       = planarAttrib(colorID,   GL_FLOAT);
+   vertexFormat.uv          = planarAttrib(uvID,      GL_FLOAT);
+   vertexFormat.tangent     = planarAttrib(tanID,     GL_FLOAT);
+   vertexFormat.bitangent   = planarAttrib(bitanID,   GL_FLOAT);
+   vertexFormat.boneNumInf  = planarAttrib(bNumInfID, GL_UNSIGNED_INT);
+   vertexFormat.boneIndices = planarAttrib(bIndexID,  GL_UNSIGNED_INT);
+   vertexFormat.boneWeights = planarAttrib(bWeightID, GL_FLOAT);
 }
 
 void Model::bufferVertices() {
-   char ** vertPtr = (char **)(vertices.data());
-   bufferVertexField(vertPtr, offsetof(Vertex, position),     posID,     3*sizeof(float), vertices.size());
-   bufferVertexField(vertPtr, offsetof(Vertex, normal),       normID,    3*sizeof(float), vertices.size());
-   bufferVertexField(vertPtr, offsetof(Vertex, color),        colorID,   3*sizeof(float), vertices.size());
-   bufferVertexField(vertPtr, offsetof(Vertex, uv),           uvID,      2*sizeof(float), vertices.size());
-   bufferVertexField(vertPtr, offsetof(Vertex, tangent),      tanID,     3*sizeof(float), vertices.size());
-   bufferVertexField(vertPtr, offsetof(Vertex, bitangent),    bitanID,   3*sizeof(float), vertices.size());
-   bufferVertexField(vertPtr, offsetof(Vertex, boneInfCount), bNumInfID, 1*sizeof(float), vertices.size());
-   bufferVertexField(vertPtr, offsetof(Vertex, boneIndices),  bIndexID,  4*sizeof(float), vertices.size());
-   bufferVertexField(vertPtr, offsetof(Vertex, boneWeights),  bWeightID, 4*sizeof(float), vertices.size());
+   usePlanarFormat();
+   bufferVertexStream(mesh.positions,     posID);
+   bufferVertexStream(mesh.normals,       normID);
+   bufferVertexStream(mesh.colors,        colorID);
+   bufferVertexStream(mesh.uvs,           uvID);
+   bufferVertexStream(mesh.tangents,      tanID);
+   bufferVertexStream(mesh.bitangents,    bitanID);
+   bufferVertexStream(mesh.boneInfCounts, bNumInfID);
+   bufferVertexStream(mesh.boneIndices,   bIndexID);
+   bufferVertexStream(mesh.boneWeights,   bWeightID);
 }
 
 void Model::bufferIndices() {
-   int numBytes = sizeof(unsigned int) * NUM_FACE_EDGES * faces.size();
-   unsigned int * indices = (unsigned int *)malloc(numBytes);
-   for (int i = 0; i < faces.size(); i++)
-      for (int j = 0; j < NUM_FACE_EDGES; j++)
-         indices[NUM_FACE_EDGES*i+j] = faces[i]->vertices[j]->index;
-
    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexID);
-   glBufferData(GL_ELEMENT_ARRAY_BUFFER, numBytes, indices, GL_STATIC_DRAW);
-   free(indices);
+   glBufferData(GL_ELEMENT_ARRAY_BUFFER, mesh.indices.size() * sizeof(unsigned int),
+                mesh.indices.data(), GL_STATIC_DRAW);
+}
+
+void Model::setVertexBudget(unsigned int vertexCount) {
+   if (!progressive)
+      return;
+
+   progressive->setVertexCount(vertexCount);
+
+   // Only the corners touched by the splits in between go back to the GPU
+   if (progressive->dirtyEnd > progressive->dirtyBegin) {
+      unsigned int begin = progressive->dirtyBegin;
+      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexID);
+      glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, begin * sizeof(unsigned int),
+                      (progressive->dirtyEnd - begin) * sizeof(unsigned int),
+                      & progressive->indices[begin]);
+      progressive->clearDirty();
+   }
+}
+
+unsigned int Model::drawFaceCount() {
+   return progressive ? progressive->activeFaces : faceCount;
+}
+
+void Model::flattenBoneTree() {
+   boneOrder.clear();
+   if (boneRoot >= bones.size())
+      return;
+
+   // Children are pushed last to first so they come out in the order they are listed
+   std::vector<bool> visited = std::vector<bool>(bones.size(), false);
+   std::vector<BoneStep> stack;
+   BoneStep root = {(int)boneRoot, -1};
+   stack.push_back(root);
+
+   while (!stack.empty()) {
+      BoneStep step = stack.back();
+      stack.pop_back();
+
+      // A malformed tree could list a bone twice, it is only posed the first time
+      if (visited[step.bone])
+         continue;
+      visited[step.bone] = true;
+      boneOrder.push_back(step);
+
+      const std::vector<int>& children = bones[step.bone].childIndices;
+      for (int i = children.size() - 1; i >= 0; i--) {
+         BoneStep child = {children[i], step.bone};
+         if (child.bone >= 0 && child.bone < (int)bones.size())
+            stack.push_back(child);
+      }
+   }
+}
+
+void Model::estimateBoneMasses() {
+   for (unsigned int i = 0; i < bones.size(); i++) {
+      Bone * bone = & bones[i];
+
+      Eigen::Vector3f end = Eigen::Vector3f(0,0,0);
+      int childCount = 0;
+      for (unsigned int j = 0; j < bone->childIndices.size(); j++) {
+         int child = bone->childIndices[j];
+         if (child >= 0 && child < (int)bones.size()) {
+            end += bones[child].parentOffset.block<3,1>(0,3);
+            childCount++;
+         }
+      }
+      if (childCount > 0)
+         end /= childCount;
+
+      if (end.norm() >= BONE_MIN_LENGTH) {
+         float length = end.norm();
+         float radius = BONE_THICKNESS * length;
+         Eigen::Vector3f along = end / length;
+         Eigen::Matrix3f alongM = along * along.transpose();
+
+         bone->mass = BONE_DENSITY * M_PI * radius * radius * length;
+         bone->com = 0.5f * end;
+         bone->inertiaTensor = bone->mass * (3 * radius * radius + length * length) / 12 * (Eigen::Matrix3f::Identity() - alongM) +
+                               bone->mass * radius * radius / 2 * alongM;
+      }
+      else {
+         // Leaves and bones sitting on their children, sized by how far they are from their parent
+         float length = fmax(bone->parentOffset.block<3,1>(0,3).norm(), BONE_MIN_LENGTH);
+         float radius = BONE_THICKNESS * length;
+
+         bone->mass = BONE_DENSITY * 4 * M_PI / 3 * radius * radius * radius;
+         bone->com = Eigen::Vector3f(0,0,0);
+         bone->inertiaTensor = 0.4f * bone->mass * radius * radius * Eigen::Matrix3f::Identity();
+      }
+      bone->invInertiaTensor = bone->inertiaTensor.inverse();
+   }
+}
+
+void Model::calculateBounds() {
+   if (mesh.positions.empty())
+      return;
+
+   Eigen::Vector3f low = mesh.positions[0], high = mesh.positions[0];
+   for (unsigned int i = 1; i < mesh.positions.size(); i++) {
+      low = low.cwiseMin(mesh.positions[i]);
+      high = high.cwiseMax(mesh.positions[i]);
+   }
+
+   boundCenter = 0.5f * (low + high);
+   boundRadius = 0;
+   for (unsigned int i = 0; i < mesh.positions.size(); i++)
+      boundRadius = std::max(boundRadius, (mesh.positions[i] - boundCenter).norm());
+}
+
+void Model::simplifyLODs(unsigned int levelCount, float faceRatio) {
+   // Progressive models refine themselves instead
+   if (progressive || faceCount == 0)
+      return;
+
+   calculateBounds();
+   lods.clear();
+
+   unsigned int lastFaces = faceCount;
+   for (unsigned int i = 1; i < levelCount; i++) {
+      LevelOfDetail lod;
+      MR::SimplifyIndices(mesh, lastFaces * faceRatio, FLT_MAX, lod.indices, hasBoneWeights);
+
+      // Stop once the mesh won't get meaningfully simpler
+      unsigned int faces = lod.indices.size() / NUM_FACE_EDGES;
+      if (faces == 0 || faces > 0.9f * lastFaces)
+         break;
+
+      // Triangles cover about the same number of pixels on every level
+      lod.indexID = 0;
+      lod.faceCount = faces;
+      lod.screenSize = LOD_FULL_DETAIL_SIZE * sqrtf((float)faces / faceCount);
+
+      lods.push_back(lod);
+      lastFaces = faces;
+   }
+}
+
+void Model::bufferLODs() {
+   for (unsigned int i = 0; i < lods.size(); i++) {
+      LevelOfDetail * lod = & lods[i];
+      if (lod->indexID)
+         continue;
+
+      glGenBuffers(1, & lod->indexID);
+      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, lod->indexID);
+      glBufferData(GL_ELEMENT_ARRAY_BUFFER, lod->indices.size() * sizeof(unsigned int),
+                   lod->indices.data(), GL_STATIC_DRAW);
+      std::vector<unsigned int>().swap(lod->indices);
+   }
+}
+
+void Model::generateLODs(unsigned int levelCount, float faceRatio) {
+   simplifyLODs(levelCount, faceRatio);
+   bufferLODs();
+
+   checkOpenGLError();
+}
+
+void Model::upload() {
+   if (!bufferVertexBlock())
+      bufferVertices();
+   bufferIndices();
+   bufferLODs();
+
+   checkOpenGLError();
+}
+
+unsigned int Model::lodCount() {
+   return lods.size() + 1;
+}
+
+unsigned int Model::lodIndexID(unsigned int level) {
+   return level == 0 ? indexID : lods[level-1].indexID;
+}
+
+unsigned int Model::lodFaceCount(unsigned int level) {
+   return level == 0 ? drawFaceCount() : lods[level-1].faceCount;
+}
+
+unsigned int Model::selectLOD(float screenSize, unsigned int currentLevel) {
+   unsigned int level = std::min(currentLevel, (unsigned int)lods.size());
+
+   while (level < lods.size() && screenSize < lods[level].screenSize * (1 - LOD_HYSTERESIS))
+      level++;
+   while (level > 0 && screenSize > lods[level-1].screenSize * (1 + LOD_HYSTERESIS))
+      level--;
+
+   return level;
 }
 
 void Model::printVertices() {
    for (int i = 0; i < vertexCount; i++) {
-      Vertex * v = vertices[i];
+      Eigen::Vector3f& p = mesh.positions[i];
+      Eigen::Vector3f& n = mesh.normals[i];
       printf("Vertex %d:\n", i);
-      printf("  position = %f %f %f\n", v->position(0), v->position(1), v->position(2));
-      printf("  normal = %f %f %f\n", v->normal(0), v->normal(1), v->normal(2));
+      printf("  position = %f %f %f\n", p(0), p(1), p(2));
+      printf("  normal = %f %f %f\n", n(0), n(1), n(2));
    }
 }
 
 void Model::printFaces() {
    for (int i = 0; i < faceCount; i++) {
+      unsigned int * corners = & mesh.indices[NUM_FACE_EDGES*i];
       printf("Face %d:\n", i);
-      printf("  vertIndices: %d %d %d\n", faces[i]->vertices[0]->index, faces[i]->vertices[1]->index, faces[i]->vertices[2]->index);
+      printf("  vertIndices: %d %d %d\n", corners[0], corners[1], corners[2]);
    }
 }
 
@@ -184,12 +447,17 @@ void Model::printAnimations() {
       printf("fps %d\n", anim->fps);
       printf("keyCount %d\n", anim->keyCount);
 
+      if (!anim->compressed.empty()) {
+         printf("  compressed to %d bytes\n", (int)anim->compressed.size());
+         continue;
+      }
+
       for (int j = 0; j < boneCount; j++) {
          AnimBone * animBone = & anim->animBones[j];
          printf("  AnimBone %d:\n", j);
 
          for (int k = 0; k < anim->keyCount; k++) {
-            Key * key = & animBone->keys[k];
+            const Key * key = & animBone->keys[k];
             printf("    key %d at time %f:\n", k, key->time);
             printf("      trans: %.2f %.2f %.2f\n", key->position.x(), key->position.y(), key->position.z());
             printf("      rotate: %.2f %.2f %.2f %.2f\n", key->rotation.w(), key->rotation.x(), key->rotation.y(), key->rotation.z());
@@ -0,0 +1,122 @@
+#include "pose_cache.h"
+
+#include <math.h>
+#include <atomic>
+
+// Versions are unique across caches, so the renderer can tell palettes apart
+// by version alone. Atomic since each thread can have its own cache.
+static std::atomic<unsigned int> nextVersion(1);
+
+// ========================================================== //
+// ==================== POSE KEY FUNCTIONS ================== //
+// ========================================================== //
+
+bool PoseKey::operator==(const PoseKey& other) const {
+   return model == other.model && animNum == other.animNum && step == other.step && mask == other.mask;
+}
+
+size_t PoseKeyHash::operator()(const PoseKey& key) const {
+   size_t hash = std::hash<const Model *>()(key.model);
+   hash = hash * 31 + key.animNum;
+   hash = hash * 31 + key.step;
+   return hash * 31 + key.mask;
+}
+
+bool BlendKey::operator==(const BlendKey& other) const {
+   return from == other.from && to == other.to && step == other.step;
+}
+
+size_t BlendKeyHash::operator()(const BlendKey& key) const {
+   size_t hash = std::hash<const PosePalette *>()(key.from);
+   hash = hash * 31 + std::hash<const PosePalette *>()(key.to);
+   return hash * 31 + key.step;
+}
+
+// ========================================================== //
+// ================== POSE CACHE METHODS ==================== //
+// ========================================================== //
+
+PoseCache::PoseCache()
+: evaluated(0), shared(0), _frame(1) {}
+
+PoseCache::~PoseCache() {}
+
+PoseKey PoseCache::Key(const Model * model, int animNum, float time, unsigned int mask) {
+   PoseKey key = {model, animNum, (int)floorf(time * POSE_CACHE_RATE + 0.5f), mask};
+   return key;
+}
+
+float PoseCache::KeyTime(const PoseKey& key) {
+   return 1.0f * key.step / POSE_CACHE_RATE;
+}
+
+BlendKey PoseCache::Blend(const PaletteHandle& from, const PaletteHandle& to, float alpha) {
+   BlendKey key = {from.get(), to.get(), (int)floorf(alpha * POSE_BLEND_STEPS + 0.5f)};
+   return key;
+}
+
+float PoseCache::BlendAlpha(const BlendKey& key) {
+   return 1.0f * key.step / POSE_BLEND_STEPS;
+}
+
+void PoseCache::beginFrame() {
+   std::unordered_map<PoseKey, PaletteHandle, PoseKeyHash>::iterator it = _palettes.begin();
+   while (it != _palettes.end()) {
+      if (it->second->frame != _frame)
+         it = _palettes.erase(it);
+      else
+         ++it;
+   }
+
+   std::unordered_map<BlendKey, Blended, BlendKeyHash>::iterator blend = _blends.begin();
+   while (blend != _blends.end()) {
+      if (blend->second.palette->frame != _frame)
+         blend = _blends.erase(blend);
+      else
+         ++blend;
+   }
+
+   _frame++;
+   evaluated = 0;
+   shared = 0;
+}
+
+PaletteHandle PoseCache::acquire(const PoseKey& key, bool& evaluate) {
+   PaletteHandle& palette = _palettes[key];
+   if (!palette) {
+      palette = std::make_shared<PosePalette>();
+      palette->frame = 0;
+   }
+
+   evaluate = claim(palette.get());
+   return palette;
+}
+
+PaletteHandle PoseCache::acquire(const BlendKey& key, const PaletteHandle& from, const PaletteHandle& to, bool& evaluate) {
+   Blended& blend = _blends[key];
+   if (!blend.palette) {
+      blend.from = from;
+      blend.to = to;
+      blend.palette = std::make_shared<PosePalette>();
+      blend.palette->frame = 0;
+   }
+
+   evaluate = claim(blend.palette.get());
+   return blend.palette;
+}
+
+bool PoseCache::claim(PosePalette * palette) {
+   if (palette->frame == _frame) {
+      shared++;
+      return false;
+   }
+
+   palette->frame = _frame;
+   palette->version = nextVersion++;
+   evaluated++;
+   return true;
+}
+
+unsigned int PoseCache::size() {
+   return _palettes.size() + _blends.size();
+}
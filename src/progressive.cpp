@@ -0,0 +1,314 @@
+#include "progressive.h"
+#include "model.h"
+#include "reducer.h"
+
+#include <algorithm>
+#include <queue>
+#include <unordered_map>
+
+using namespace PM;
+
+typedef struct EdgeCandidate {
+   float cost;
+   unsigned int from, to;
+
+   bool operator>(const EdgeCandidate& other) const {
+      return cost > other.cost;
+   }
+} EdgeCandidate;
+
+typedef std::priority_queue<EdgeCandidate, std::vector<EdgeCandidate>, std::greater<EdgeCandidate> > EdgeHeap;
+
+// Everything needed to undo one collapse, in terms of stable vertex and face ids
+typedef struct CollapseRecord {
+   unsigned int from, to;
+   std::vector<unsigned int> removedFaces;
+   std::vector<unsigned int> removedCorners;   // vertex ids, NUM_FACE_EDGES per removed face
+   std::vector<FaceUpdate> movedCorners;       // face ids whose corner moved from -> to
+} CollapseRecord;
+
+// ========================================================== //
+// ==================== STATIC FUNCTIONS ==================== //
+// ========================================================== //
+
+static bool isNeighbor(Vertex * a, Vertex * b) {
+   return find(a->neighbors.begin(), a->neighbors.end(), b) != a->neighbors.end();
+}
+
+static bool hasFace(Vertex * v, Face * f) {
+   return find(v->faces.begin(), v->faces.end(), f) != v->faces.end();
+}
+
+static void pushEdge(EdgeHeap& heap, std::vector<Vertex *>& verts, unsigned int from, unsigned int to) {
+   EdgeCandidate c;
+   c.cost = (verts[from]->position - verts[to]->position).norm();
+   c.from = from;
+   c.to = to;
+   heap.push(c);
+}
+
+// ========================================================== //
+// ==================== PUBLIC FUNCTIONS ==================== //
+// ========================================================== //
+
+namespace PM {
+
+   void BuildProgressiveMesh(const std::vector<Eigen::Vector3f>& positions,
+                             const std::vector<unsigned int>& indices,
+                             std::vector<unsigned int>& order,
+                             std::vector<VertexSplit>& splits,
+                             std::vector<unsigned int>& faces) {
+      unsigned int numVerts = positions.size();
+
+      // Build the pointer graph MR::Collapse works on, ids stay fixed as it edits
+      std::vector<Vertex *> vertices, vertById;
+      std::vector<Face *> graphFaces;
+      std::unordered_map<Vertex *, unsigned int> vertId;
+      std::unordered_map<Face *, unsigned int> faceId;
+
+      for (unsigned int i = 0; i < numVerts; i++) {
+         Vertex * v = new Vertex();
+         v->index = i;
+         v->position = positions[i];
+         vertices.push_back(v);
+         vertById.push_back(v);
+         vertId[v] = i;
+      }
+
+      for (unsigned int i = 0; i + NUM_FACE_EDGES <= indices.size(); i += NUM_FACE_EDGES) {
+         Vertex * a = vertById[indices[i]];
+         Vertex * b = vertById[indices[i+1]];
+         Vertex * c = vertById[indices[i+2]];
+
+         // Degenerate faces can't be collapsed away cleanly, and aren't visible anyway
+         if (a == b || b == c || c == a)
+            continue;
+
+         Face * f = new Face();
+         f->vertices[0] = a;
+         f->vertices[1] = b;
+         f->vertices[2] = c;
+         faceId[f] = graphFaces.size();
+         graphFaces.push_back(f);
+
+         for (int j = 0; j < NUM_FACE_EDGES; j++) {
+            Vertex * v = f->vertices[j];
+            Vertex * n = f->vertices[(j+1) % NUM_FACE_EDGES];
+            v->faces.push_back(f);
+            if (!isNeighbor(v, n)) {
+               v->neighbors.push_back(n);
+               n->neighbors.push_back(v);
+            }
+         }
+      }
+      unsigned int numFaces = graphFaces.size();
+
+      // Collapse the shortest edge until none are left, skipping stale candidates
+      EdgeHeap heap;
+      for (unsigned int i = 0; i < numVerts; i++)
+         for (unsigned int j = 0; j < vertById[i]->neighbors.size(); j++)
+            pushEdge(heap, vertById, i, vertId[vertById[i]->neighbors[j]]);
+
+      std::vector<bool> alive = std::vector<bool>(numVerts, true);
+      std::vector<CollapseRecord> collapses;
+
+      while (!heap.empty()) {
+         EdgeCandidate c = heap.top();
+         heap.pop();
+
+         if (!alive[c.from] || !alive[c.to] || !isNeighbor(vertById[c.from], vertById[c.to]))
+            continue;
+
+         Vertex * fromV = vertById[c.from];
+         Vertex * toV = vertById[c.to];
+         CollapseRecord record;
+         record.from = c.from;
+         record.to = c.to;
+
+         for (unsigned int i = 0; i < fromV->faces.size(); i++) {
+            Face * f = fromV->faces[i];
+            if (hasFace(toV, f)) {
+               record.removedFaces.push_back(faceId[f]);
+               for (int j = 0; j < NUM_FACE_EDGES; j++)
+                  record.removedCorners.push_back(vertId[f->vertices[j]]);
+            } else {
+               for (int j = 0; j < NUM_FACE_EDGES; j++)
+                  if (f->vertices[j] == fromV) {
+                     FaceUpdate update = {faceId[f], (unsigned char)j};
+                     record.movedCorners.push_back(update);
+                     break;
+                  }
+            }
+         }
+
+         for (unsigned int i = 0; i < fromV->neighbors.size(); i++) {
+            Vertex * n = fromV->neighbors[i];
+            if (n != toV && !isNeighbor(n, toV)) {
+               pushEdge(heap, vertById, vertId[n], c.to);
+               pushEdge(heap, vertById, c.to, vertId[n]);
+            }
+         }
+
+         MR::Collapse(vertices, graphFaces, fromV, toV);
+         alive[c.from] = false;
+         collapses.push_back(record);
+      }
+
+      // Whatever is left (one vertex per connected piece) is the coarsest mesh
+      std::vector<unsigned int> newIndex = std::vector<unsigned int>(numVerts);
+      std::vector<unsigned int> newFace = std::vector<unsigned int>(numFaces);
+      std::vector<unsigned int> roots;
+      unsigned int nextVert = 0, nextFace = 0;
+
+      for (unsigned int i = 0; i < numVerts; i++)
+         if (alive[i]) {
+            roots.push_back(i);
+            newIndex[i] = nextVert++;
+         }
+      for (int i = collapses.size() - 1; i >= 0; i--)
+         newIndex[collapses[i].from] = nextVert++;
+
+      order = std::vector<unsigned int>(numVerts);
+      splits = std::vector<VertexSplit>(numVerts);
+      for (unsigned int i = 0; i < numVerts; i++) {
+         order[newIndex[i]] = i;
+         splits[newIndex[i]].baseVertex = newIndex[i];
+      }
+
+      // Faces that were never collapsed away come in with the last root
+      for (unsigned int i = 0; i < graphFaces.size(); i++) {
+         Face * f = graphFaces[i];
+         VertexSplit * s = & splits[roots.size() - 1];
+         newFace[faceId[f]] = nextFace++;
+         for (int j = 0; j < NUM_FACE_EDGES; j++)
+            s->newFaces.push_back(newIndex[vertId[f->vertices[j]]]);
+      }
+
+      for (int i = collapses.size() - 1; i >= 0; i--) {
+         CollapseRecord * record = & collapses[i];
+         VertexSplit * s = & splits[newIndex[record->from]];
+         s->baseVertex = newIndex[record->to];
+
+         for (unsigned int j = 0; j < record->removedFaces.size(); j++)
+            newFace[record->removedFaces[j]] = nextFace++;
+         for (unsigned int j = 0; j < record->removedCorners.size(); j++)
+            s->newFaces.push_back(newIndex[record->removedCorners[j]]);
+         for (unsigned int j = 0; j < record->movedCorners.size(); j++) {
+            FaceUpdate update = record->movedCorners[j];
+            update.face = newFace[update.face];
+            s->updatedFaces.push_back(update);
+         }
+      }
+
+      // Play every split forward to get the full resolution faces in order
+      ProgressiveMesh pm = ProgressiveMesh(numVerts, numFaces);
+      for (unsigned int i = 0; i < numVerts; i++)
+         pm.addSplit(splits[i]);
+      pm.setVertexCount(numVerts);
+      faces = pm.indices;
+
+      for (unsigned int i = 0; i < vertices.size(); i++)
+         delete vertices[i];
+      for (unsigned int i = 0; i < graphFaces.size(); i++)
+         delete graphFaces[i];
+   }
+
+}
+
+// ======================================================== //
+// =============== PROGRESSIVE MESH METHODS =============== //
+// ======================================================== //
+
+ProgressiveMesh::ProgressiveMesh(unsigned int vertexCount, unsigned int faceCount)
+: vertexCount(vertexCount), faceCount(faceCount),
+  activeVertices(0), activeFaces(0), targetVertices(vertexCount), dirtyBegin(0), dirtyEnd(0),
+  source(NULL), readyFaces(0) {
+   indices = std::vector<unsigned int>(NUM_FACE_EDGES * faceCount, 0);
+}
+
+ProgressiveMesh::~ProgressiveMesh() {
+   if (source)
+      fclose(source);
+}
+
+bool ProgressiveMesh::addSplit(const VertexSplit& s) {
+   unsigned int v = splits.size();
+   unsigned int numNewFaces = s.newFaces.size() / NUM_FACE_EDGES;
+
+   if (v >= vertexCount || s.baseVertex > v || s.newFaces.size() % NUM_FACE_EDGES ||
+       numNewFaces > faceCount - readyFaces)
+      return false;
+   if (s.baseVertex == v && !s.updatedFaces.empty())
+      return false;
+
+   for (unsigned int i = 0; i < s.newFaces.size(); i++)
+      if (s.newFaces[i] > v)
+         return false;
+   for (unsigned int i = 0; i < s.updatedFaces.size(); i++)
+      if (s.updatedFaces[i].face >= readyFaces || s.updatedFaces[i].corner >= NUM_FACE_EDGES)
+         return false;
+
+   splits.push_back(s);
+   readyFaces += numNewFaces;
+   return true;
+}
+
+void ProgressiveMesh::markDirty(unsigned int index) {
+   if (dirtyBegin == dirtyEnd) {
+      dirtyBegin = index;
+      dirtyEnd = index + 1;
+   } else {
+      dirtyBegin = std::min(dirtyBegin, index);
+      dirtyEnd = std::max(dirtyEnd, index + 1);
+   }
+}
+
+void ProgressiveMesh::clearDirty() {
+   dirtyBegin = dirtyEnd = 0;
+}
+
+void ProgressiveMesh::split() {
+   unsigned int v = activeVertices;
+   VertexSplit * s = & splits[v];
+
+   for (unsigned int i = 0; i < s->newFaces.size(); i++) {
+      unsigned int index = NUM_FACE_EDGES * activeFaces + i;
+      indices[index] = s->newFaces[i];
+      markDirty(index);
+   }
+   activeFaces += s->newFaces.size() / NUM_FACE_EDGES;
+
+   for (unsigned int i = 0; i < s->updatedFaces.size(); i++) {
+      unsigned int index = NUM_FACE_EDGES * s->updatedFaces[i].face + s->updatedFaces[i].corner;
+      indices[index] = v;
+      markDirty(index);
+   }
+   activeVertices++;
+}
+
+void ProgressiveMesh::collapse() {
+   unsigned int v = activeVertices - 1;
+   VertexSplit * s = & splits[v];
+
+   for (int i = s->updatedFaces.size() - 1; i >= 0; i--) {
+      unsigned int index = NUM_FACE_EDGES * s->updatedFaces[i].face + s->updatedFaces[i].corner;
+      indices[index] = s->baseVertex;
+      markDirty(index);
+   }
+   activeFaces -= s->newFaces.size() / NUM_FACE_EDGES;
+   activeVertices--;
+}
+
+void ProgressiveMesh::setVertexCount(unsigned int count) {
+   targetVertices = count;
+   count = std::min(count, (unsigned int)splits.size());
+
+   while (activeVertices < count)
+      split();
+   while (activeVertices > count)
+      collapse();
+}
+
+void ProgressiveMesh::refresh() {
+   setVertexCount(targetVertices);
+}
@@ -2,6 +2,13 @@
 #include "model.h"
 #include <assert.h>
 #include <stdio.h>
+#include <math.h>
+#include <algorithm>
+
+#define NOT_IN_HEAP 0xFFFFFFFF
+#define REMOVED_VERTEX 0xFFFFFFFF
+#define BORDER_WEIGHT 10.0
+#define SKIN_WEIGHT 4.0
 
 // ========================================================== //
 // ==================== STATIC FUNCTIONS ==================== //
@@ -48,26 +55,443 @@ static bool areNeighbors(Vertex * a, Vertex * b) {
    return false;
 }
 
+// ========================================================== //
+// =================== QUADRIC SIMPLIFIER =================== //
+// ========================================================== //
+
+// Symmetric 4x4 matrix of a sum of squared plane distances, upper triangle only
+typedef struct Quadric {
+   double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+} Quadric;
+
+static Quadric planeQuadric(const Eigen::Vector3f& n, float d, double weight) {
+   Quadric q;
+   q.a2 = weight * n(0) * n(0); q.ab = weight * n(0) * n(1); q.ac = weight * n(0) * n(2); q.ad = weight * n(0) * d;
+   q.b2 = weight * n(1) * n(1); q.bc = weight * n(1) * n(2); q.bd = weight * n(1) * d;
+   q.c2 = weight * n(2) * n(2); q.cd = weight * n(2) * d;
+   q.d2 = weight * d * d;
+   return q;
+}
+
+static void addQuadric(Quadric& q, const Quadric& r) {
+   q.a2 += r.a2; q.ab += r.ab; q.ac += r.ac; q.ad += r.ad;
+   q.b2 += r.b2; q.bc += r.bc; q.bd += r.bd;
+   q.c2 += r.c2; q.cd += r.cd;
+   q.d2 += r.d2;
+}
+
+static double quadricError(const Quadric& q, const Quadric& r, const Eigen::Vector3f& p) {
+   double x = p(0), y = p(1), z = p(2);
+   double error =
+      (q.a2 + r.a2) * x * x + 2 * (q.ab + r.ab) * x * y + 2 * (q.ac + r.ac) * x * z + 2 * (q.ad + r.ad) * x +
+      (q.b2 + r.b2) * y * y + 2 * (q.bc + r.bc) * y * z + 2 * (q.bd + r.bd) * y +
+      (q.c2 + r.c2) * z * z + 2 * (q.cd + r.cd) * z +
+      (q.d2 + r.d2);
+   return error > 0 ? error : 0;
+}
+
+// Min-heap of vertices keyed by the cost of their cheapest collapse. Each vertex
+// knows its place in the heap, so a key can be changed or removed in log time.
+class VertexHeap {
+public:
+   VertexHeap(const std::vector<double>& keys)
+   : keys(keys), position(keys.size(), NOT_IN_HEAP) {}
+
+   bool empty() const { return heap.empty(); }
+   unsigned int top() const { return heap[0]; }
+
+   // Inserts the vertex, or moves it after its key changed
+   void update(unsigned int v) {
+      if (position[v] == NOT_IN_HEAP) {
+         position[v] = heap.size();
+         heap.push_back(v);
+      }
+      siftDown(siftUp(position[v]));
+   }
+
+   void remove(unsigned int v) {
+      unsigned int i = position[v];
+      if (i == NOT_IN_HEAP)
+         return;
+
+      position[v] = NOT_IN_HEAP;
+      unsigned int last = heap.back();
+      heap.pop_back();
+      if (i < heap.size()) {
+         heap[i] = last;
+         position[last] = i;
+         siftDown(siftUp(i));
+      }
+   }
+
+private:
+   const std::vector<double>& keys;
+   std::vector<unsigned int> heap, position;
+
+   void place(unsigned int i, unsigned int v) {
+      heap[i] = v;
+      position[v] = i;
+   }
+
+   unsigned int siftUp(unsigned int i) {
+      unsigned int v = heap[i];
+      while (i > 0 && keys[heap[(i-1)/2]] > keys[v]) {
+         place(i, heap[(i-1)/2]);
+         i = (i-1)/2;
+      }
+      place(i, v);
+      return i;
+   }
+
+   void siftDown(unsigned int i) {
+      unsigned int v = heap[i];
+      unsigned int n = heap.size();
+      while (2*i+1 < n) {
+         unsigned int c = 2*i+1;
+         if (c+1 < n && keys[heap[c+1]] < keys[heap[c]])
+            c++;
+         if (keys[heap[c]] >= keys[v])
+            break;
+         place(i, heap[c]);
+         i = c;
+      }
+      place(i, v);
+   }
+};
+
+// Half-edge collapses over a copy of the index list. Removed vertices and faces
+// are only flagged dead, and the per-vertex face lists drop dead faces as they
+// are walked, so a collapse only touches the faces around it.
+class Simplifier {
+public:
+   Simplifier(const Mesh& mesh, bool preserveSkin);
+
+   double run(unsigned int targetFaces, double maxError);
+   void output(std::vector<unsigned int>& out) const;
+
+private:
+   const Mesh& mesh;
+   const std::vector<Eigen::Vector3f>& positions;
+   bool preserveSkin;
+   std::vector<unsigned int> indices;
+   std::vector<std::vector<unsigned int> > vertFaces;
+   std::vector<Quadric> quadrics;
+   std::vector<bool> vertAlive, faceAlive, border;
+   std::vector<bool> stale;               // cost is only a lower bound, find it again when popped
+   std::vector<unsigned int> target;      // cheapest valid vertex to collapse into
+   std::vector<double> cost;
+   VertexHeap heap;
+   unsigned int liveFaceCount;
+
+   // Scratch lists kept around so collapses don't allocate
+   std::vector<unsigned int> nearV, nearT, nearCollapse;
+   std::vector<std::pair<double, unsigned int> > candidates;
+
+   std::vector<unsigned int>& liveFaces(unsigned int v);
+   double skinDistance(unsigned int v, unsigned int t);
+   double collapseCost(unsigned int v, unsigned int t);
+   void neighbors(unsigned int v, std::vector<unsigned int>& out);
+   unsigned int sharedFaces(unsigned int v, unsigned int t);
+   bool canCollapse(unsigned int v, unsigned int t);
+   void evaluate(unsigned int v);
+   void collapse(unsigned int v, unsigned int t);
+};
+
+Simplifier::Simplifier(const Mesh& mesh, bool preserveSkin)
+: mesh(mesh), positions(mesh.positions), preserveSkin(preserveSkin), indices(mesh.indices),
+  vertFaces(mesh.vertexCount()), quadrics(mesh.vertexCount()),
+  vertAlive(mesh.vertexCount(), true), faceAlive(mesh.faceCount(), true), border(mesh.vertexCount(), false),
+  stale(mesh.vertexCount(), false), target(mesh.vertexCount(), 0), cost(mesh.vertexCount(), 0), heap(cost),
+  liveFaceCount(mesh.faceCount()) {
+   unsigned int numVerts = mesh.vertexCount();
+   unsigned int numFaces = mesh.faceCount();
+   Quadric zero = {0,0,0,0,0,0,0,0,0,0};
+   quadrics.assign(numVerts, zero);
+
+   // Every face adds its plane to its corners
+   for (unsigned int f = 0; f < numFaces; f++) {
+      const unsigned int * c = & indices[NUM_FACE_EDGES * f];
+      Eigen::Vector3f n = (positions[c[1]] - positions[c[0]]).cross(positions[c[2]] - positions[c[0]]);
+
+      if (c[0] == c[1] || c[1] == c[2] || c[2] == c[0] || n.norm() == 0) {
+         faceAlive[f] = false;
+         liveFaceCount--;
+         continue;
+      }
+
+      n.normalize();
+      Quadric q = planeQuadric(n, -n.dot(positions[c[0]]), 1.0);
+      for (int j = 0; j < NUM_FACE_EDGES; j++) {
+         addQuadric(quadrics[c[j]], q);
+         vertFaces[c[j]].push_back(f);
+      }
+   }
+
+   // Edges with only one face are borders. They get a plane perpendicular to
+   // the face through the edge, so collapses can't pull the border inward.
+   for (unsigned int f = 0; f < numFaces; f++) {
+      if (!faceAlive[f])
+         continue;
+
+      const unsigned int * c = & indices[NUM_FACE_EDGES * f];
+      Eigen::Vector3f n = (positions[c[1]] - positions[c[0]]).cross(positions[c[2]] - positions[c[0]]).normalized();
+
+      for (int j = 0; j < NUM_FACE_EDGES; j++) {
+         unsigned int a = c[j], b = c[(j+1) % NUM_FACE_EDGES];
+         if (sharedFaces(a, b) != 1)
+            continue;
+
+         Eigen::Vector3f edge = positions[b] - positions[a];
+         Eigen::Vector3f side = edge.cross(n).normalized();
+         Quadric q = planeQuadric(side, -side.dot(positions[a]), BORDER_WEIGHT * edge.squaredNorm());
+         addQuadric(quadrics[a], q);
+         addQuadric(quadrics[b], q);
+         border[a] = border[b] = true;
+      }
+   }
+
+   for (unsigned int v = 0; v < numVerts; v++)
+      evaluate(v);
+}
+
+std::vector<unsigned int>& Simplifier::liveFaces(unsigned int v) {
+   std::vector<unsigned int>& faces = vertFaces[v];
+   unsigned int kept = 0;
+   for (unsigned int i = 0; i < faces.size(); i++)
+      if (faceAlive[faces[i]])
+         faces[kept++] = faces[i];
+   faces.resize(kept);
+   return faces;
+}
+
+// How much of the two vertices' skinning weight goes to different bones, 0 to 2
+double Simplifier::skinDistance(unsigned int v, unsigned int t) {
+   const unsigned int * vBones = & mesh.boneIndices[MAX_INFLUENCES * v];
+   const unsigned int * tBones = & mesh.boneIndices[MAX_INFLUENCES * t];
+   const float * vWeights = & mesh.boneWeights[MAX_INFLUENCES * v];
+   const float * tWeights = & mesh.boneWeights[MAX_INFLUENCES * t];
+   double distance = 0;
+
+   for (int i = 0; i < MAX_INFLUENCES; i++) {
+      float other = 0;
+      for (int j = 0; j < MAX_INFLUENCES; j++)
+         if (tBones[j] == vBones[i])
+            other = tWeights[j];
+      distance += fabs(vWeights[i] - other);
+   }
+   for (int j = 0; j < MAX_INFLUENCES; j++) {
+      bool shared = false;
+      for (int i = 0; i < MAX_INFLUENCES; i++)
+         shared |= vBones[i] == tBones[j];
+      if (!shared)
+         distance += tWeights[j];
+   }
+
+   return distance;
+}
+
+// Error of merging v into t. With preserveSkin, vertices that follow different
+// bones also pay for the distance between them, so joints keep their shape
+// when they bend.
+double Simplifier::collapseCost(unsigned int v, unsigned int t) {
+   double cost = quadricError(quadrics[v], quadrics[t], positions[t]);
+   if (preserveSkin)
+      cost += SKIN_WEIGHT * skinDistance(v, t) * (positions[v] - positions[t]).squaredNorm();
+   return cost;
+}
+
+void Simplifier::neighbors(unsigned int v, std::vector<unsigned int>& out) {
+   std::vector<unsigned int>& faces = liveFaces(v);
+   out.clear();
+   for (unsigned int i = 0; i < faces.size(); i++)
+      for (int j = 0; j < NUM_FACE_EDGES; j++) {
+         unsigned int n = indices[NUM_FACE_EDGES * faces[i] + j];
+         if (n != v && find(out.begin(), out.end(), n) == out.end())
+            out.push_back(n);
+      }
+}
+
+unsigned int Simplifier::sharedFaces(unsigned int v, unsigned int t) {
+   std::vector<unsigned int>& faces = liveFaces(v);
+   unsigned int count = 0;
+   for (unsigned int i = 0; i < faces.size(); i++) {
+      const unsigned int * c = & indices[NUM_FACE_EDGES * faces[i]];
+      if (c[0] == t || c[1] == t || c[2] == t)
+         count++;
+   }
+   return count;
+}
+
+bool Simplifier::canCollapse(unsigned int v, unsigned int t) {
+   if (!vertAlive[v] || !vertAlive[t] || v == t)
+      return false;
+
+   unsigned int shared = sharedFaces(v, t);
+   if (shared == 0)
+      return false;
+
+   // Border vertices may only slide along the border
+   if (border[v] && (!border[t] || shared != 1))
+      return false;
+
+   // Any neighbor the two share besides the faces between them would end up
+   // on an edge with more than two faces
+   neighbors(v, nearV);
+   neighbors(t, nearT);
+   unsigned int common = 0;
+   for (unsigned int i = 0; i < nearV.size(); i++)
+      if (find(nearT.begin(), nearT.end(), nearV[i]) != nearT.end())
+         common++;
+   if (common != shared)
+      return false;
+
+   // None of the faces that move may flip over or collapse to a sliver
+   std::vector<unsigned int>& faces = liveFaces(v);
+   for (unsigned int i = 0; i < faces.size(); i++) {
+      const unsigned int * c = & indices[NUM_FACE_EDGES * faces[i]];
+      if (c[0] == t || c[1] == t || c[2] == t)
+         continue;
+
+      Eigen::Vector3f p[NUM_FACE_EDGES];
+      for (int j = 0; j < NUM_FACE_EDGES; j++)
+         p[j] = positions[c[j]];
+      Eigen::Vector3f before = (p[1] - p[0]).cross(p[2] - p[0]);
+      for (int j = 0; j < NUM_FACE_EDGES; j++)
+         if (c[j] == v)
+            p[j] = positions[t];
+      Eigen::Vector3f after = (p[1] - p[0]).cross(p[2] - p[0]);
+
+      if (after.dot(before) <= 1e-3f * before.norm() * after.norm())
+         return false;
+   }
+
+   return true;
+}
+
+// Finds the cheapest valid collapse of v and files it in the heap. Candidates
+// are checked cheapest first, so usually only one validity check is needed.
+void Simplifier::evaluate(unsigned int v) {
+   neighbors(v, nearCollapse);
+   stale[v] = false;
+
+   candidates.clear();
+   for (unsigned int i = 0; i < nearCollapse.size(); i++) {
+      unsigned int n = nearCollapse[i];
+      candidates.push_back(std::make_pair(collapseCost(v, n), n));
+   }
+   std::sort(candidates.begin(), candidates.end());
+
+   for (unsigned int i = 0; i < candidates.size(); i++)
+      if (canCollapse(v, candidates[i].second)) {
+         cost[v] = candidates[i].first;
+         target[v] = candidates[i].second;
+         heap.update(v);
+         return;
+      }
+
+   heap.remove(v);
+}
+
+void Simplifier::collapse(unsigned int v, unsigned int t) {
+   std::vector<unsigned int>& faces = liveFaces(v);
+
+   for (unsigned int i = 0; i < faces.size(); i++) {
+      unsigned int * c = & indices[NUM_FACE_EDGES * faces[i]];
+      if (c[0] == t || c[1] == t || c[2] == t) {
+         faceAlive[faces[i]] = false;
+         liveFaceCount--;
+      } else {
+         for (int j = 0; j < NUM_FACE_EDGES; j++)
+            if (c[j] == v)
+               c[j] = t;
+         vertFaces[t].push_back(faces[i]);
+      }
+   }
+
+   addQuadric(quadrics[t], quadrics[v]);
+   vertAlive[v] = false;
+   vertFaces[v].clear();
+   heap.remove(v);
+
+   // Only t's quadric changed, so only collapses into or out of t cost more
+   // now. Quadrics only grow, so the old costs of neighbors that were headed
+   // for v or t are lower bounds and can wait until they reach the top.
+   evaluate(t);
+   neighbors(t, nearCollapse);
+   for (unsigned int i = 0; i < nearCollapse.size(); i++) {
+      unsigned int n = nearCollapse[i];
+      if (target[n] == v || target[n] == t) {
+         stale[n] = true;
+      } else {
+         double c = collapseCost(n, t);
+         if (c < cost[n]) {
+            cost[n] = c;
+            target[n] = t;
+            heap.update(n);
+         }
+      }
+   }
+}
+
+double Simplifier::run(unsigned int targetFaces, double maxError) {
+   double error = 0;
+
+   while (liveFaceCount > targetFaces && !heap.empty()) {
+      unsigned int v = heap.top();
+      unsigned int t = target[v];
+      if (cost[v] > maxError)
+         break;
+
+      // The neighborhood may have changed since the cost was found, recheck
+      // the collapse only now that it is the cheapest
+      if (stale[v] || !canCollapse(v, t)) {
+         evaluate(v);
+         continue;
+      }
+
+      error = cost[v];
+      collapse(v, t);
+   }
+
+   return error;
+}
+
+void Simplifier::output(std::vector<unsigned int>& out) const {
+   out.clear();
+   out.reserve(NUM_FACE_EDGES * liveFaceCount);
+   for (unsigned int f = 0; f < faceAlive.size(); f++)
+      if (faceAlive[f])
+         out.insert(out.end(), & indices[NUM_FACE_EDGES * f], & indices[NUM_FACE_EDGES * (f+1)]);
+}
+
+template <typename T>
+static void compactStream(std::vector<T>& stream, unsigned int perVertex,
+                          const std::vector<unsigned int>& newIndex, unsigned int newCount) {
+   std::vector<T> compact = std::vector<T>(perVertex * newCount);
+   for (unsigned int i = 0; i < newIndex.size(); i++)
+      if (newIndex[i] != REMOVED_VERTEX)
+         for (unsigned int j = 0; j < perVertex; j++)
+            compact[perVertex * newIndex[i] + j] = stream[perVertex * i + j];
+   stream.swap(compact);
+}
+
 // ========================================================== //
 // ==================== PUBLIC FUNCTIONS ==================== //
 // ========================================================== //
 
 namespace MR {
 
-   void Collapse(Model * model, Vertex * fromV, Vertex * toV) {
+   void Collapse(std::vector<Vertex *>& vertices, std::vector<Face *>& faces, Vertex * fromV, Vertex * toV) {
       // assert(areNeighbors(fromV, toV));
 
       // Remove shared faces
       for (int i = 0; i < fromV->faces.size(); i++) {
-         for (int j = 0; j < toV->faces.size(); j++) {
-            if (fromV->faces[i] == toV->faces[j]) {
-               Face * f = fromV->faces[i];
-               removeFaceFromVertexReferences(f);
-               model->faces.erase(find(model->faces.begin(), model->faces.end(), f));
-               delete(f);
-               i--;
-               j--;
-            }
+         Face * f = fromV->faces[i];
+         if (find(toV->faces.begin(), toV->faces.end(), f) != toV->faces.end()) {
+            removeFaceFromVertexReferences(f);
+            faces.erase(find(faces.begin(), faces.end(), f));
+            delete(f);
+            i--;
          }
       }
 
@@ -102,13 +526,13 @@ namespace MR {
 
       // Remove fromV from model's vertex list
       int ndx = -1;
-      while (model->vertices[++ndx] != fromV);
-      model->vertices.erase(model->vertices.begin() + ndx);
+      while (vertices[++ndx] != fromV);
+      vertices.erase(vertices.begin() + ndx);
 
       // Update all id's after the one removed.
-      int numVerts = model->vertices.size();
+      int numVerts = vertices.size();
       while (ndx < numVerts) {
-         model->vertices[ndx]->index = model->vertices[ndx]->index - 1;
+         vertices[ndx]->index = vertices[ndx]->index - 1;
          ndx++;
       }
 
@@ -116,4 +540,46 @@ namespace MR {
       delete fromV;
    }
 
-}
\ No newline at end of file
+   float SimplifyIndices(const Mesh& mesh, unsigned int targetFaces, float maxError,
+                         std::vector<unsigned int>& indices, bool preserveSkin) {
+      Simplifier simplifier(mesh, preserveSkin);
+      float error = simplifier.run(targetFaces, maxError);
+      simplifier.output(indices);
+      return error;
+   }
+
+   float Simplify(Mesh& mesh, unsigned int targetFaces, float maxError) {
+      std::vector<unsigned int> indices;
+      float error = SimplifyIndices(mesh, targetFaces, maxError, indices);
+
+      // Number the vertices that are still used in their old order
+      std::vector<unsigned int> newIndex = std::vector<unsigned int>(mesh.vertexCount(), REMOVED_VERTEX);
+      for (unsigned int i = 0; i < indices.size(); i++)
+         newIndex[indices[i]] = 0;
+      unsigned int count = 0;
+      for (unsigned int i = 0; i < newIndex.size(); i++)
+         if (newIndex[i] != REMOVED_VERTEX)
+            newIndex[i] = count++;
+
+      compactStream(mesh.positions,     1, newIndex, count);
+      compactStream(mesh.normals,       1, newIndex, count);
+      compactStream(mesh.colors,        1, newIndex, count);
+      compactStream(mesh.tangents,      1, newIndex, count);
+      compactStream(mesh.bitangents,    1, newIndex, count);
+      compactStream(mesh.uvs,           1, newIndex, count);
+      compactStream(mesh.boneInfCounts, 1, newIndex, count);
+      compactStream(mesh.boneIndices,   MAX_INFLUENCES, newIndex, count);
+      compactStream(mesh.boneWeights,   MAX_INFLUENCES, newIndex, count);
+
+      for (unsigned int i = 0; i < indices.size(); i++)
+         indices[i] = newIndex[indices[i]];
+      mesh.indices.swap(indices);
+
+      // Drops the stale adjacency along with the old face normals
+      mesh.resize(count, mesh.indices.size() / NUM_FACE_EDGES);
+      mesh.calculateFaceNormals();
+
+      return error;
+   }
+
+}
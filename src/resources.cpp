@@ -0,0 +1,126 @@
+#include "resources.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <sstream>
+
+// ========================================================== //
+// ==================== STATIC FUNCTIONS ==================== //
+// ========================================================== //
+
+// The same file reached through different relative paths gets one key. Files
+// that don't exist keep their path, the loader reports them when it gets there.
+static std::string canonicalPath(const char * path) {
+   if (!path)
+      return "";
+
+   char resolved[PATH_MAX];
+   if (realpath(path, resolved))
+      return resolved;
+   return path;
+}
+
+// ========================================================== //
+// ================ RESOURCE REGISTRY METHODS =============== //
+// ========================================================== //
+
+ResourceRegistry::ResourceRegistry(AssetLoader * loader)
+: _loader(loader) {}
+
+ResourceRegistry::~ResourceRegistry() {}
+
+ModelHandle ResourceRegistry::model(const ModelAsset& asset, AssetHandle * ready) {
+   std::ostringstream key;
+   key << "model " << canonicalPath(asset.mesh)
+       << " skin=" << canonicalPath(asset.skinningPIN)
+       << " anim=" << canonicalPath(asset.animationPIN)
+       << " joints=" << canonicalPath(asset.constraints)
+       << " lods=" << asset.lodLevels << "x" << asset.lodRatio;
+
+   std::map<std::string, Resource>::iterator found = _resources.find(key.str());
+   if (found == _resources.end()) {
+      Resource resource;
+      resource.name = asset.mesh;
+      resource.model = std::make_shared<Model>();
+      resource.ready = _loader->loadModel(resource.model, asset);
+      found = _resources.insert(std::make_pair(key.str(), resource)).first;
+   }
+
+   if (ready)
+      *ready = found->second.ready;
+   return found->second.model;
+}
+
+TextureHandle ResourceRegistry::texture(const char * path, bool repeat, AssetHandle * ready) {
+   std::string key = "texture " + canonicalPath(path) + (repeat ? " repeat" : " clamp");
+
+   std::map<std::string, Resource>::iterator found = _resources.find(key);
+   if (found == _resources.end()) {
+      Resource resource;
+      resource.name = path;
+      resource.texture = std::make_shared<Texture>();
+      resource.ready = _loader->loadTexture(resource.texture, path, repeat);
+      found = _resources.insert(std::make_pair(key, resource)).first;
+   }
+
+   if (ready)
+      *ready = found->second.ready;
+   return found->second.texture;
+}
+
+unsigned int ResourceRegistry::releaseUnused() {
+   unsigned int released = 0;
+
+   // A resource still loading is held by the loader, so it is never dropped here
+   std::map<std::string, Resource>::iterator it = _resources.begin();
+   while (it != _resources.end()) {
+      long useCount = it->second.model ? it->second.model.use_count() : it->second.texture.use_count();
+      if (useCount <= 1 && AssetLoader::isReady(it->second.ready)) {
+         _resources.erase(it++);
+         released++;
+      } else {
+         ++it;
+      }
+   }
+
+   return released;
+}
+
+unsigned int ResourceRegistry::size() {
+   return _resources.size();
+}
+
+void ResourceRegistry::report(FILE * out) {
+   size_t totalCPU = 0, totalGPU = 0;
+
+   fprintf(out, "%6s %10s %10s  %s\n", "users", "cpu KB", "gpu KB", "resource");
+
+   std::map<std::string, Resource>::iterator it;
+   for (it = _resources.begin(); it != _resources.end(); ++it) {
+      Resource * resource = & it->second;
+      size_t cpu = 0, gpu = 0;
+      long users;
+
+      // Only count what is there, a resource still loading is being written to
+      bool ready = AssetLoader::isReady(resource->ready);
+      if (resource->model) {
+         users = resource->model.use_count() - 1;
+         if (ready) {
+            cpu = resource->model->cpuBytes();
+            gpu = resource->model->gpuBytes();
+         }
+      } else {
+         users = resource->texture.use_count() - 1;
+         if (ready)
+            gpu = resource->texture->gpuBytes;
+      }
+
+      totalCPU += cpu;
+      totalGPU += gpu;
+      fprintf(out, "%6ld %10zu %10zu  %s%s\n", users, cpu / 1024, gpu / 1024,
+              resource->name.c_str(), ready ? "" : " (loading)");
+   }
+
+   fprintf(out, "%6s %10zu %10zu  %u resources\n", "", totalCPU / 1024, totalGPU / 1024,
+           (unsigned int)_resources.size());
+}
@@ -0,0 +1,198 @@
+#include "retarget.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+// ========================================================== //
+// ==================== STATIC FUNCTIONS ==================== //
+// ========================================================== //
+
+static LocalTransform identityTransform() {
+   LocalTransform t;
+   t.position = Eigen::Vector3f(0, 0, 0);
+   t.rotation = Eigen::Quaternionf::Identity();
+   t.scale = Eigen::Vector3f(1, 1, 1);
+   return t;
+}
+
+// Bind and keyframe matrices may carry scale, which is left out of the rotation
+static Eigen::Quaternionf rotationOf(const Eigen::Matrix3f& m) {
+   Eigen::Matrix3f rotation = m;
+   for (int i = 0; i < 3; i++)
+      rotation.col(i).normalize();
+   return Eigen::Quaternionf(rotation).normalized();
+}
+
+static Eigen::Matrix4f bindPose(const Bone& bone) {
+   return bone.invBonePose.inverse();
+}
+
+// ========================================================== //
+// ==================== RETARGET FUNCTIONS ================== //
+// ========================================================== //
+
+namespace RT {
+   std::vector<int> LoadBoneMap(const char * path, unsigned int sourceBoneCount, unsigned int targetBoneCount) {
+      std::vector<int> sourceOf = std::vector<int>(targetBoneCount, -1);
+
+      std::ifstream infile(path);
+      if (!infile) {
+         fprintf(stderr, "Bone map file \"%s\" not found.\n", path);
+         exit(1);
+      }
+
+      std::string line;
+      int lineNum = 0;
+
+      while (std::getline(infile, line)) {
+         lineNum++;
+         std::istringstream iss(line);
+
+         int target, source;
+         if (iss >> target >> source) {
+            if (target < 0 || target >= (int)targetBoneCount || source < 0 || source >= (int)sourceBoneCount) {
+               fprintf(stderr, "Bone map \"%s\" line %d: bone out of range\n", path, lineNum);
+               exit(1);
+            }
+            sourceOf[target] = source;
+         } else {
+            // skip comments and empty lines
+         }
+      }
+
+      return sourceOf;
+   }
+
+   RetargetMap BuildMap(const std::vector<Bone>& sourceBones, const std::vector<BoneStep>& sourceOrder,
+                        const std::vector<Bone>& targetBones, const std::vector<BoneStep>& targetOrder,
+                        const std::vector<int>& sourceOf) {
+      RetargetMap map;
+      map.sourceOrder = sourceOrder;
+      map.sourceBoneCount = sourceBones.size();
+      map.targetBoneCount = targetBones.size();
+      map.sourceRootBind = Eigen::Vector3f(0, 0, 0);
+      map.rootScale = 1;
+
+      for (unsigned int i = 0; i < targetOrder.size(); i++) {
+         const BoneStep& step = targetOrder[i];
+         Eigen::Matrix4f targetBind = bindPose(targetBones[step.bone]);
+         Eigen::Matrix4f local = step.parent < 0 ? targetBind : targetBones[step.bone].parentOffset;
+
+         RetargetBone bone;
+         bone.bone = step.bone;
+         bone.parent = step.parent;
+         bone.source = step.bone < (int)sourceOf.size() ? sourceOf[step.bone] : -1;
+         bone.bindLocal = rotationOf(local.topLeftCorner<3,3>());
+         bone.bindPosition = local.block<3,1>(0,3);
+         bone.offset = Eigen::Quaternionf::Identity();
+
+         if (bone.source >= 0) {
+            Eigen::Matrix4f sourceBind = bindPose(sourceBones[bone.source]);
+            bone.offset = rotationOf(sourceBind.topLeftCorner<3,3>()).conjugate() *
+                          rotationOf(targetBind.topLeftCorner<3,3>());
+
+            // The root is moved by the bone driving it, scaled from its hip height to the target's
+            if (step.parent < 0) {
+               map.sourceRootBind = sourceBind.block<3,1>(0,3);
+               if (fabs(map.sourceRootBind(1)) > 1e-6f && fabs(bone.bindPosition(1)) > 1e-6f)
+                  map.rootScale = bone.bindPosition(1) / map.sourceRootBind(1);
+            }
+         }
+
+         map.bones.push_back(bone);
+      }
+
+      return map;
+   }
+
+   void RetargetPose(const RetargetMap& map, Mmath::Matrix3x4f * sourceMs, PoseArena * arena, LocalTransform * out) {
+      for (unsigned int i = 0; i < map.sourceOrder.size(); i++) {
+         const BoneStep& step = map.sourceOrder[i];
+         if (step.parent >= 0)
+            sourceMs[step.bone] = Mmath::ComposeAffine(sourceMs[step.parent], sourceMs[step.bone]);
+      }
+
+      // Model space rotation of each target bone, so children can be made relative to it
+      LocalTransform * world = arena->take(map.targetBoneCount);
+
+      for (unsigned int i = 0; i < map.bones.size(); i++) {
+         const RetargetBone& bone = map.bones[i];
+         Eigen::Quaternionf parentWorld = bone.parent < 0 ? Eigen::Quaternionf::Identity() :
+                                          Eigen::Quaternionf(world[bone.parent].rotation);
+
+         Eigen::Quaternionf rotation;
+         if (bone.source >= 0)
+            rotation = rotationOf(sourceMs[bone.source].leftCols<3>()) * Eigen::Quaternionf(bone.offset);
+         else
+            rotation = parentWorld * Eigen::Quaternionf(bone.bindLocal);
+         world[bone.bone].rotation = rotation;
+
+         LocalTransform * t = & out[bone.bone];
+         t->rotation = (parentWorld.conjugate() * rotation).normalized();
+         t->position = bone.bindPosition;
+         t->scale = Eigen::Vector3f(1, 1, 1);
+
+         if (bone.parent < 0 && bone.source >= 0)
+            t->position += map.rootScale * (sourceMs[bone.source].col(3) - map.sourceRootBind);
+      }
+   }
+
+   void RetargetAnimation(const RetargetMap& map, const Animation& source, Animation * out) {
+      unsigned int frameCount = (unsigned int)(source.duration * source.fps + 0.5f) + 1;
+      if (frameCount > AC_MAX_FRAMES) {
+         fprintf(stderr, "Can't retarget an animation of %d frames, the most is %d\n", frameCount, AC_MAX_FRAMES);
+         exit(1);
+      }
+
+      std::vector<Mmath::Matrix3x4f> sourceMs = std::vector<Mmath::Matrix3x4f>(map.sourceBoneCount);
+      std::vector<LocalTransform> pose = std::vector<LocalTransform>(map.targetBoneCount, identityTransform());
+      std::vector<LocalTransform> frames = std::vector<LocalTransform>(map.targetBoneCount * frameCount);
+      PoseArena * arena = PoseArena::local();
+      KeyCursor cursor;
+
+      for (unsigned int f = 0; f < frameCount; f++) {
+         arena->reset();
+         AN::SampleAnimation(source, 1.0f * f / source.fps, sourceMs.data(), & cursor);
+         RetargetPose(map, sourceMs.data(), arena, pose.data());
+
+         for (unsigned int j = 0; j < map.targetBoneCount; j++)
+            frames[j * frameCount + f] = pose[j];
+      }
+
+      out->fps = source.fps;
+      out->keyCount = frameCount;
+      out->duration = 1.0 * (frameCount-1) / source.fps;
+      out->compressed.clear();
+      AC::Compress(frames.data(), map.targetBoneCount, frameCount, source.fps, AC::DefaultTolerance(), out->compressed);
+   }
+}
+
+// ========================================================== //
+// ====================== MODEL METHODS ===================== //
+// ========================================================== //
+
+void Model::retargetAnimations(const Model * source, const char * mapPath) {
+   if (!hasBoneTree) {
+      fprintf(stderr, "Can't retarget onto a model without a bone tree\n");
+      exit(1);
+   }
+
+   std::vector<int> sourceOf = RT::LoadBoneMap(mapPath, source->boneCount, boneCount);
+   std::vector<BoneStep> sourceOrder = source->hasBoneTree ? source->boneOrder : std::vector<BoneStep>();
+   RetargetMap map = RT::BuildMap(source->bones, sourceOrder, bones, boneOrder, sourceOf);
+
+   for (unsigned int i = 0; i < source->animations.size(); i++) {
+      animations.push_back(Animation());
+      RT::RetargetAnimation(map, source->animations[i], & animations.back());
+   }
+
+   animationCount = animations.size();
+   hasAnimations = animationCount > 0;
+   isAnimated = hasBoneWeights && hasAnimations;
+
+   fprintf(stderr, "Retargeted %d animations with %s\n", (int)source->animations.size(), mapPath);
+}
@@ -1,26 +1,13 @@
 
 #include "shader.h"
 
-void EntityShader::sendVertexAttribArray(unsigned int handle, unsigned int vbo, int size) {
+// Integer types are converted to float by the GL unless the attribute is
+// normalized, so bone indices and influence counts can be sent in the same
+// integer form they are stored in
+void EntityShader::sendVertexAttribArray(unsigned int handle, int size, const VertexAttrib& attrib, unsigned int stride) {
    glEnableVertexAttribArray(handle);
-   glBindBuffer(GL_ARRAY_BUFFER, vbo);
-   glVertexAttribPointer(handle, size, GL_FLOAT, GL_FALSE, 0, 0);
-}
-
-void EntityShader::sendLargeVertexAttribArray(unsigned int handle0, unsigned int handle1,
-                                              unsigned int handle2, unsigned int handle3,
-                                              unsigned int vbo) {
-   unsigned stride = MAX_INFLUENCES * sizeof(float);
-
-   glEnableVertexAttribArray(handle0);
-   glEnableVertexAttribArray(handle1);
-   glEnableVertexAttribArray(handle2);
-   glEnableVertexAttribArray(handle3);
-   glBindBuffer(GL_ARRAY_BUFFER, vbo);
-   glVertexAttribPointer(handle0, 4, GL_FLOAT, GL_FALSE, stride, (const void *)( 0*sizeof(float)));
-   glVertexAttribPointer(handle1, 4, GL_FLOAT, GL_FALSE, stride, (const void *)( 4*sizeof(float)));
-   glVertexAttribPointer(handle2, 4, GL_FLOAT, GL_FALSE, stride, (const void *)( 8*sizeof(float)));
-   glVertexAttribPointer(handle3, 4, GL_FLOAT, GL_FALSE, stride, (const void *)(12*sizeof(float)));
+   glBindBuffer(GL_ARRAY_BUFFER, attrib.vbo);
+   glVertexAttribPointer(handle, size, attrib.type, attrib.normalized, stride, (const void *)(size_t)attrib.offset);
 }
 
 void EntityShader::sendTexture(unsigned int handle, unsigned int id, GLenum unit) {
@@ -39,34 +26,33 @@ void EntityShader::renderVertices(Camera * camera, StaticEntity * entity) {
    Eigen::Matrix4f MV = camera->getViewM() * entity->generateModelM();
    glLoadMatrixf(MV.data());
 
-   for (int i = 0; i < model->vertices.size(); i++)
-      renderPoint(camera, model->vertices[i]->position);
+   Mesh * mesh = & model->mesh;
+   int numVerts = mesh->vertexCount();
+
+   for (int i = 0; i < numVerts; i++)
+      renderPoint(camera, mesh->positions[i]);
 
    glBegin(GL_LINES);
-   for (int i = 0; i < model->vertices.size(); i++) {
-      // printf("i = %d\n", i); // seg fault at 0 at line 47
+   for (int i = 0; i < numVerts; i++) {
       // draw normal
       glColor3f(1,0,0);
-      Eigen::Vector3f p = model->vertices[i]->position;
+      Eigen::Vector3f p = mesh->positions[i];
       glVertex3fv(p.data());
-      Eigen::Vector3f normal = model->vertices[i]->normal;
-      p += normal * 0.1f;
+      p += mesh->normals[i] * 0.1f;
       glVertex3fv(p.data());
 
       // draw tangent
       glColor3f(0,1,0);
-      p = model->vertices[i]->position;
+      p = mesh->positions[i];
       glVertex3fv(p.data());
-      Eigen::Vector3f tangent = model->vertices[i]->tangent;
-      p += tangent * 0.1f;
+      p += mesh->tangents[i] * 0.1f;
       glVertex3fv(p.data());
 
       // draw bitangent
       glColor3f(0,0,1);
-      p = model->vertices[i]->position;
+      p = mesh->positions[i];
       glVertex3fv(p.data());
-      Eigen::Vector3f bitangent = model->vertices[i]->bitangent;
-      p += bitangent * 0.1f;
+      p += mesh->bitangents[i] * 0.1f;
       glVertex3fv(p.data());
    }
    glEnd();
@@ -76,7 +62,8 @@ void EntityShader::renderBones(Camera * camera, SkinnedEntity * entity) {
    Model * model = entity->model;
 
    for (int i = 0; i < model->boneCount; i++) {
-      Eigen::Vector4f p = entity->generateModelM() * entity->boneMs[i] * Eigen::Vector4f(0,0,0,1);
+      Eigen::Matrix4f boneM = Mmath::ExpandAffine(entity->boneMs[i]);
+      Eigen::Vector4f p = entity->generateModelM() * boneM * Eigen::Vector4f(0,0,0,1);
       renderPoint(camera, Eigen::Vector3f(p(0), p(1), p(2)));
 
       glLineWidth(3);
@@ -84,19 +71,19 @@ void EntityShader::renderBones(Camera * camera, SkinnedEntity * entity) {
 
       glColor3f(0.8,0,0);
       glVertex3f(p(0), p(1), p(2));
-      Eigen::Vector4f dir = entity->generateModelM() * entity->boneMs[i] * Eigen::Vector4f(1,0,0,0);
+      Eigen::Vector4f dir = entity->generateModelM() * boneM * Eigen::Vector4f(1,0,0,0);
       Eigen::Vector4f end = p + dir * 0.5f;
       glVertex3f(end(0), end(1), end(2));
 
       glColor3f(0,0.8,0);
       glVertex3f(p(0), p(1), p(2));
-      dir = entity->generateModelM() * entity->boneMs[i] * Eigen::Vector4f(0,1,0,0);
+      dir = entity->generateModelM() * boneM * Eigen::Vector4f(0,1,0,0);
       end = p + dir * 0.5f;
       glVertex3f(end(0), end(1), end(2));
 
       glColor3f(0,0,0.8);
       glVertex3f(p(0), p(1), p(2));
-      dir = entity->generateModelM() * entity->boneMs[i] * Eigen::Vector4f(0,0,1,0);
+      dir = entity->generateModelM() * boneM * Eigen::Vector4f(0,0,1,0);
       end = p + dir * 0.5f;
       glVertex3f(end(0), end(1), end(2));
 
@@ -10,13 +10,21 @@
 
 #include <math.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "shader.h"
 #include "shader_builder.h"
 #include "safe_gl.h"
 
 AnimatedShader::AnimatedShader() {
-   program = SB::BuildProgramFromPaths("shaders/forward_animated.vert.glsl", "shaders/forward.frag.glsl");
+   // As many 3x4 bone matrices (3 vec4s each) as the vertex uniforms left over hold
+   GLint components = 0;
+   glGetIntegerv(GL_MAX_VERTEX_UNIFORM_COMPONENTS, & components);
+   boneCapacity = (components / 4 - ANIM_RESERVED_VECTORS) / 3;
+
+   char defines[64];
+   snprintf(defines, sizeof(defines), "#define BONE_CAPACITY %u\n", boneCapacity);
+   program = SB::BuildProgramFromPaths("shaders/forward_animated.vert.glsl", "shaders/forward.frag.glsl", defines);
 
    h_uHasNormals     = glGetUniformLocation(program, "uHasNormals");
    h_uHasColors      = glGetUniformLocation(program, "uHasColors");
@@ -32,7 +40,7 @@ AnimatedShader::AnimatedShader() {
    h_uNormalMap      = glGetUniformLocation(program, "uNormalMap");
    h_uSpecularMap    = glGetUniformLocation(program, "uSpecularMap");
 
-   h_uAnimMs         = glGetUniformLocation(program, "uAnimMs");
+   h_uBoneMs         = glGetUniformLocation(program, "uBoneMs");
 
    h_aPosition       = glGetAttribLocation(program, "aPosition");
    h_aNormal         = glGetAttribLocation(program, "aNormal");
@@ -50,6 +58,8 @@ AnimatedShader::AnimatedShader() {
    h_aBoneWeights2   = glGetAttribLocation(program, "aBoneWeights2");
    h_aBoneWeights3   = glGetAttribLocation(program, "aBoneWeights3");
    h_aNumInfluences  = glGetAttribLocation(program, "aNumInfluences");
+
+   uploadedPalette = 0;
 }
 
 AnimatedShader::~AnimatedShader() {}
@@ -72,46 +82,62 @@ void AnimatedShader::render(Camera * camera, LightData * lightData, AnimatedEnti
    // Send model present flags
    glUniform1i(h_uHasNormals, model->hasNormals);
    glUniform1i(h_uHasColors, model->hasColors);
-   glUniform1i(h_uHasTexture, model->hasTexCoords && model->hasTexture);
-   glUniform1i(h_uHasNormalMap, model->hasTexCoords && model->hasNormalMap);
-   glUniform1i(h_uHasSpecularMap, model->hasTexCoords && model->hasSpecularMap);
+   glUniform1i(h_uHasTexture, model->hasTexCoords && model->textureID());
+   glUniform1i(h_uHasNormalMap, model->hasTexCoords && model->normalMapID());
+   glUniform1i(h_uHasSpecularMap, model->hasTexCoords && model->specularMapID());
 
    // Send model attributes
-   sendVertexAttribArray(h_aPosition, model->posID, 3);
+   VertexFormat * format = & model->vertexFormat;
+   sendVertexAttribArray(h_aPosition, 3, format->position, format->stride);
 
    if (model->hasNormals)
-      sendVertexAttribArray(h_aNormal, model->normID, 3);
+      sendVertexAttribArray(h_aNormal, 3, format->normal, format->stride);
    if (model->hasColors)
-      sendVertexAttribArray(h_aColor, model->colorID, 3);
+      sendVertexAttribArray(h_aColor, 3, format->color, format->stride);
    if (model->hasTexCoords) {
-      sendVertexAttribArray(h_aUV, model->uvID, 2);
+      sendVertexAttribArray(h_aUV, 2, format->uv, format->stride);
 
       if (model->hasTansAndBitans) {
-         sendVertexAttribArray(h_aTangent, model->tanID, 3);
-         sendVertexAttribArray(h_aBitangent, model->bitanID, 3);
+         sendVertexAttribArray(h_aTangent, 3, format->tangent, format->stride);
+         sendVertexAttribArray(h_aBitangent, 3, format->bitangent, format->stride);
       }
 
-      if (model->hasTexture)
-         sendTexture(h_uTexture, model->texID, GL_TEXTURE0);
-      if (model->hasNormalMap)
-         sendTexture(h_uNormalMap, model->nmapID, GL_TEXTURE1);
-      if (model->hasSpecularMap)
-         sendTexture(h_uSpecularMap, model->smapID, GL_TEXTURE2);
+      if (model->textureID())
+         sendTexture(h_uTexture, model->textureID(), GL_TEXTURE0);
+      if (model->normalMapID())
+         sendTexture(h_uNormalMap, model->normalMapID(), GL_TEXTURE1);
+      if (model->specularMapID())
+         sendTexture(h_uSpecularMap, model->specularMapID(), GL_TEXTURE2);
    }
 
    // Send animation data
-   sendVertexAttribArray(h_aNumInfluences, model->bNumInfID, 1);
-   sendLargeVertexAttribArray(h_aBoneIndices0, h_aBoneIndices1,
-                              h_aBoneIndices2, h_aBoneIndices3,
-                              model->bIndexID);
-   sendLargeVertexAttribArray(h_aBoneWeights0, h_aBoneWeights1,
-                              h_aBoneWeights2, h_aBoneWeights3,
-                              model->bWeightID);
-   glUniformMatrix4fv(h_uAnimMs, MAX_BONES, GL_FALSE, (GLfloat *)(entity->animMs));
+   if (model->boneCount > boneCapacity) {
+      fprintf(stderr, "There are %d bones and this GPU can skin at most %u\n", model->boneCount, boneCapacity);
+      exit(1);
+   }
+
+   // Every vertex has at most MAX_INFLUENCES (4) influences, so only the first
+   // index and weight vectors are read by the shader
+   sendVertexAttribArray(h_aNumInfluences, 1, format->boneNumInf, format->stride);
+   sendVertexAttribArray(h_aBoneIndices0, MAX_INFLUENCES, format->boneIndices, format->stride);
+   sendVertexAttribArray(h_aBoneWeights0, MAX_INFLUENCES, format->boneWeights, format->stride);
+
+   // Entities sharing a pose (see PoseCache) draw the same palette, which stays
+   // in the program's uniforms until something else is uploaded over it.
+   // Only the model's bones are sent, 12 floats each.
+   const PosePalette * palette = entity->palette.get();
+   if (!palette) {
+      glUniform4fv(h_uBoneMs, 3 * model->boneCount, entity->animMs.data()->data());
+      uploadedPalette = 0;
+   } else if (palette->version != uploadedPalette) {
+      glUniform4fv(h_uBoneMs, 3 * model->boneCount, palette->animMs.data()->data());
+      uploadedPalette = palette->version;
+   }
 
    // Draw the damn thing!
-   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, model->indexID);
-   glDrawElements(GL_TRIANGLES, 3 * model->faceCount, GL_UNSIGNED_INT, 0);
+   unsigned int lod = entity->chooseLOD(camera);
+   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, model->lodIndexID(lod));
+   glDrawElements(GL_TRIANGLES, 3 * model->lodFaceCount(lod), GL_UNSIGNED_INT, 0);
 
    // cleanup
    glUseProgram(0);
@@ -14,6 +14,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <string>
 
 #include "shader_builder.h"
 #include "safe_gl.h"
@@ -190,6 +191,17 @@ namespace SB {
       return buildProgram(vs, fs);
    }
 
+   GLuint BuildProgramFromPaths(const char * vertPath, const char * fragPath, const char * vertDefines) {
+      char * vertSrc = textFileRead(vertPath);
+      std::string src = std::string(vertDefines) + vertSrc;
+      free(vertSrc);
+
+      GLuint vs = buildShaderFromString(src.c_str(), GL_VERTEX_SHADER);
+      GLuint fs = buildShaderFromPath(fragPath, GL_FRAGMENT_SHADER);
+
+      return buildProgram(vs, fs);
+   }
+
    GLuint BuildProgramFromStrings(const char * vertString, const char * fragString) {
       GLuint vs = buildShaderFromString(vertString, GL_VERTEX_SHADER);
       GLuint fs = buildShaderFromString(fragString, GL_FRAGMENT_SHADER);
@@ -56,36 +56,38 @@ void StaticShader::render(Camera * camera, LightData * lightData, StaticEntity *
    // Send model present flags
    glUniform1i(h_uHasNormals, model->hasNormals);
    glUniform1i(h_uHasColors, model->hasColors);
-   glUniform1i(h_uHasTexture, model->hasTexCoords && model->hasTexture);
-   glUniform1i(h_uHasNormalMap, model->hasTexCoords && model->hasNormalMap);
-   glUniform1i(h_uHasSpecularMap, model->hasTexCoords && model->hasSpecularMap);
+   glUniform1i(h_uHasTexture, model->hasTexCoords && model->textureID());
+   glUniform1i(h_uHasNormalMap, model->hasTexCoords && model->normalMapID());
+   glUniform1i(h_uHasSpecularMap, model->hasTexCoords && model->specularMapID());
 
    // Send model attributes
-   sendVertexAttribArray(h_aPosition, model->posID, 3);
+   VertexFormat * format = & model->vertexFormat;
+   sendVertexAttribArray(h_aPosition, 3, format->position, format->stride);
 
    if (model->hasNormals)
-      sendVertexAttribArray(h_aNormal, model->normID, 3);
+      sendVertexAttribArray(h_aNormal, 3, format->normal, format->stride);
    if (model->hasColors)
-      sendVertexAttribArray(h_aColor, model->colorID, 3);
+      sendVertexAttribArray(h_aColor, 3, format->color, format->stride);
    if (model->hasTexCoords) {
-      sendVertexAttribArray(h_aUV, model->uvID, 2);
+      sendVertexAttribArray(h_aUV, 2, format->uv, format->stride);
 
       if (model->hasTansAndBitans) {
-         sendVertexAttribArray(h_aTangent, model->tanID, 3);
-         sendVertexAttribArray(h_aBitangent, model->bitanID, 3);
+         sendVertexAttribArray(h_aTangent, 3, format->tangent, format->stride);
+         sendVertexAttribArray(h_aBitangent, 3, format->bitangent, format->stride);
       }
 
-      if (model->hasTexture)
-         sendTexture(h_uTexture, model->texID, GL_TEXTURE0);
-      if (model->hasNormalMap)
-         sendTexture(h_uNormalMap, model->nmapID, GL_TEXTURE1);
-      if (model->hasSpecularMap)
-         sendTexture(h_uSpecularMap, model->smapID, GL_TEXTURE2);
+      if (model->textureID())
+         sendTexture(h_uTexture, model->textureID(), GL_TEXTURE0);
+      if (model->normalMapID())
+         sendTexture(h_uNormalMap, model->normalMapID(), GL_TEXTURE1);
+      if (model->specularMapID())
+         sendTexture(h_uSpecularMap, model->specularMapID(), GL_TEXTURE2);
    }
 
    // Draw the damn thing!
-   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, model->indexID);
-   glDrawElements(GL_TRIANGLES, 3 * model->faceCount, GL_UNSIGNED_INT, 0);
+   unsigned int lod = entity->chooseLOD(camera);
+   glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, model->lodIndexID(lod));
+   glDrawElements(GL_TRIANGLES, 3 * model->lodFaceCount(lod), GL_UNSIGNED_INT, 0);
 
    // cleanup
    glUseProgram(0);
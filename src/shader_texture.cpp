@@ -33,15 +33,16 @@ void TextureShader::render(Camera * camera, LightData * lightdata, StaticEntity
    glUniformMatrix4fv(h_uProjViewModelM, 1, GL_FALSE, projViewModelM.data());
 
    // Send vertex attributes
-   sendVertexAttribArray(h_aPosition, model->posID, 3);
-   sendVertexAttribArray(h_aUV, model->uvID, 2);
+   VertexFormat * format = & model->vertexFormat;
+   sendVertexAttribArray(h_aPosition, 3, format->position, format->stride);
+   sendVertexAttribArray(h_aUV, 2, format->uv, format->stride);
 
    // Send textures
-   sendTexture(h_uTexture, model->texID, GL_TEXTURE0);
+   sendTexture(h_uTexture, model->textureID(), GL_TEXTURE0);
 
    // Draw the damn thing!
    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, model->indexID);
-   glDrawElements(GL_TRIANGLES, 3 * model->faceCount, GL_UNSIGNED_INT, 0);
+   glDrawElements(GL_TRIANGLES, 3 * model->drawFaceCount(), GL_UNSIGNED_INT, 0);
 
    // cleanup
    glUseProgram(0);
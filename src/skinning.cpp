@@ -0,0 +1,237 @@
+#include "skinning.h"
+#include "lanes.h"
+
+#include <future>
+
+#define LINEAR_STRIDE 12      // 3x4 matrix
+#define DUAL_QUAT_STRIDE 8    // real and dual quaternion
+#define NORMAL_EPSILON 1e-12f
+
+// Some vertices of the mesh, one per lane. Lanes past the end of the range
+// repeat its last vertex and are never stored.
+template <typename L>
+struct VertexGroup {
+   typename L::T position[3], normal[3];
+   typename L::T weights[MAX_INFLUENCES];
+   int offsets[MAX_INFLUENCES][L::WIDTH];   // into the palette, weight 0 for unused influences
+};
+
+// ========================================================== //
+// ==================== STATIC FUNCTIONS ==================== //
+// ========================================================== //
+
+template <typename L>
+static void loadGroup(const Mesh& mesh, const SkinPalette& palette, unsigned int first, unsigned int count,
+                      VertexGroup<L> * group) {
+   float position[3][L::WIDTH], normal[3][L::WIDTH], weights[MAX_INFLUENCES][L::WIDTH];
+   unsigned int boneCount = palette.bones.size() / palette.stride;
+   bool hasNormals = mesh.normals.size() == mesh.positions.size();
+
+   for (unsigned int lane = 0; lane < (unsigned int)L::WIDTH; lane++) {
+      unsigned int v = first + (lane < count ? lane : count - 1);
+      for (int c = 0; c < 3; c++) {
+         position[c][lane] = mesh.positions[v](c);
+         normal[c][lane] = hasNormals ? mesh.normals[v](c) : 0;
+      }
+
+      unsigned int influences = mesh.boneInfCounts[v];
+      for (int i = 0; i < MAX_INFLUENCES; i++) {
+         unsigned int bone = mesh.boneIndices[MAX_INFLUENCES * v + i];
+         bool used = i < influences && bone < boneCount;
+         group->offsets[i][lane] = used ? bone * palette.stride : 0;
+         weights[i][lane] = used ? mesh.boneWeights[MAX_INFLUENCES * v + i] : 0;
+      }
+   }
+
+   for (int c = 0; c < 3; c++) {
+      group->position[c] = L::load(position[c]);
+      group->normal[c] = L::load(normal[c]);
+   }
+   for (int i = 0; i < MAX_INFLUENCES; i++)
+      group->weights[i] = L::load(weights[i]);
+}
+
+template <typename L>
+static void storeGroup(const typename L::T values[3], unsigned int first, unsigned int count, Eigen::Vector3f * out) {
+   if (!out)
+      return;
+
+   float lanes[3][L::WIDTH];
+   for (int c = 0; c < 3; c++)
+      L::store(lanes[c], values[c]);
+   for (unsigned int lane = 0; lane < count && lane < (unsigned int)L::WIDTH; lane++)
+      out[first + lane] = Eigen::Vector3f(lanes[0][lane], lanes[1][lane], lanes[2][lane]);
+}
+
+template <typename L>
+static void cross(const typename L::T a[3], const typename L::T b[3], typename L::T out[3]) {
+   out[0] = L::sub(L::mul(a[1], b[2]), L::mul(a[2], b[1]));
+   out[1] = L::sub(L::mul(a[2], b[0]), L::mul(a[0], b[2]));
+   out[2] = L::sub(L::mul(a[0], b[1]), L::mul(a[1], b[0]));
+}
+
+// The weighted sum of the bone matrices, applied to the position and normal
+template <typename L>
+static void skinLinear(const float * bones, const VertexGroup<L>& group,
+                       typename L::T position[3], typename L::T normal[3]) {
+   typedef typename L::T T;
+
+   T m[LINEAR_STRIDE];
+   for (int k = 0; k < LINEAR_STRIDE; k++)
+      m[k] = L::set(0);
+   for (int i = 0; i < MAX_INFLUENCES; i++)
+      for (int k = 0; k < LINEAR_STRIDE; k++)
+         m[k] = L::add(m[k], L::mul(group.weights[i], L::gather(bones + k, group.offsets[i])));
+
+   for (int r = 0; r < 3; r++) {
+      T rotated = L::add(L::add(L::mul(m[4*r], group.position[0]), L::mul(m[4*r+1], group.position[1])),
+                         L::mul(m[4*r+2], group.position[2]));
+      position[r] = L::add(rotated, m[4*r+3]);
+      normal[r] = L::add(L::add(L::mul(m[4*r], group.normal[0]), L::mul(m[4*r+1], group.normal[1])),
+                         L::mul(m[4*r+2], group.normal[2]));
+   }
+
+   T length = L::sqrt(L::add(L::add(L::mul(normal[0], normal[0]), L::mul(normal[1], normal[1])),
+                             L::mul(normal[2], normal[2])));
+   T invLength = L::div(L::set(1), L::max(length, L::set(NORMAL_EPSILON)));
+   for (int c = 0; c < 3; c++)
+      normal[c] = L::mul(normal[c], invLength);
+}
+
+// The weighted sum of the bones' dual quaternions, each flipped into the
+// first influence's hemisphere, normalized and applied as a rigid transform
+template <typename L>
+static void skinDualQuaternion(const float * bones, const VertexGroup<L>& group,
+                               typename L::T position[3], typename L::T normal[3]) {
+   typedef typename L::T T;
+
+   T real[4], dual[4], first[4];
+   for (int k = 0; k < 4; k++) {
+      real[k] = L::set(0);
+      dual[k] = L::set(0);
+      first[k] = L::gather(bones + k, group.offsets[0]);
+   }
+
+   for (int i = 0; i < MAX_INFLUENCES; i++) {
+      T r[4], d[4];
+      for (int k = 0; k < 4; k++) {
+         r[k] = L::gather(bones + k, group.offsets[i]);
+         d[k] = L::gather(bones + 4 + k, group.offsets[i]);
+      }
+
+      T dot = L::add(L::add(L::mul(first[0], r[0]), L::mul(first[1], r[1])),
+                     L::add(L::mul(first[2], r[2]), L::mul(first[3], r[3])));
+      T weight = L::flipSign(group.weights[i], dot);
+      for (int k = 0; k < 4; k++) {
+         real[k] = L::add(real[k], L::mul(weight, r[k]));
+         dual[k] = L::add(dual[k], L::mul(weight, d[k]));
+      }
+   }
+
+   T length = L::sqrt(L::add(L::add(L::mul(real[0], real[0]), L::mul(real[1], real[1])),
+                             L::add(L::mul(real[2], real[2]), L::mul(real[3], real[3]))));
+   T invLength = L::div(L::set(1), L::max(length, L::set(NORMAL_EPSILON)));
+   for (int k = 0; k < 4; k++) {
+      real[k] = L::mul(real[k], invLength);
+      dual[k] = L::mul(dual[k], invLength);
+   }
+
+   // Rotation: p + 2 v x (v x p + w p), translation: 2 (w d - dw v + v x d)
+   T two = L::set(2), t[3], turned[3], translation[3];
+
+   cross<L>(real, group.position, t);
+   for (int c = 0; c < 3; c++)
+      t[c] = L::add(t[c], L::mul(real[3], group.position[c]));
+   cross<L>(real, t, turned);
+
+   cross<L>(real, dual, translation);
+   for (int c = 0; c < 3; c++) {
+      translation[c] = L::add(translation[c], L::sub(L::mul(real[3], dual[c]), L::mul(dual[3], real[c])));
+      position[c] = L::add(L::add(group.position[c], L::mul(two, turned[c])), L::mul(two, translation[c]));
+   }
+
+   cross<L>(real, group.normal, t);
+   for (int c = 0; c < 3; c++)
+      t[c] = L::add(t[c], L::mul(real[3], group.normal[c]));
+   cross<L>(real, t, turned);
+   for (int c = 0; c < 3; c++)
+      normal[c] = L::add(group.normal[c], L::mul(two, turned[c]));
+}
+
+// ========================================================== //
+// ==================== SKINNING FUNCTIONS ================== //
+// ========================================================== //
+
+namespace SK {
+   void BuildPalette(const Mmath::Matrix3x4f * animMs, unsigned int boneCount, SkinMethod method, SkinPalette * palette) {
+      palette->method = method;
+      palette->stride = method == SKIN_LINEAR ? LINEAR_STRIDE : DUAL_QUAT_STRIDE;
+      palette->bones.resize(boneCount * palette->stride);
+
+      for (unsigned int j = 0; j < boneCount; j++) {
+         float * bone = & palette->bones[j * palette->stride];
+
+         if (method == SKIN_LINEAR) {
+            for (int r = 0; r < 3; r++)
+               for (int c = 0; c < 4; c++)
+                  bone[4*r + c] = animMs[j](r, c);
+            continue;
+         }
+
+         Eigen::Quaternionf real = Eigen::Quaternionf(Eigen::Matrix3f(animMs[j].topLeftCorner<3,3>())).normalized();
+         Eigen::Vector3f t = animMs[j].block<3,1>(0,3);
+         Eigen::Quaternionf dual = Eigen::Quaternionf(0, t(0), t(1), t(2)) * real;
+         dual.coeffs() *= 0.5f;
+
+         for (int k = 0; k < 4; k++) {
+            bone[k] = real.coeffs()(k);
+            bone[4 + k] = dual.coeffs()(k);
+         }
+      }
+   }
+
+   void SkinVertices(const Mesh& mesh, const SkinPalette& palette, unsigned int first, unsigned int count,
+                     Eigen::Vector3f * positions, Eigen::Vector3f * normals) {
+      if (palette.bones.empty())
+         return;
+
+      for (unsigned int start = first; start < first + count; start += WideLanes::WIDTH) {
+         unsigned int left = first + count - start;
+         VertexGroup<WideLanes> group;
+         WideLanes::T position[3], normal[3];
+
+         loadGroup<WideLanes>(mesh, palette, start, left, & group);
+         if (palette.method == SKIN_LINEAR)
+            skinLinear<WideLanes>(palette.bones.data(), group, position, normal);
+         else
+            skinDualQuaternion<WideLanes>(palette.bones.data(), group, position, normal);
+
+         storeGroup<WideLanes>(position, start, left, positions);
+         storeGroup<WideLanes>(normal, start, left, normals);
+      }
+   }
+
+   void SkinMesh(const Mesh& mesh, const SkinPalette& palette, ThreadPool * pool,
+                 std::vector<Eigen::Vector3f>& positions, std::vector<Eigen::Vector3f>& normals) {
+      unsigned int vertexCount = mesh.vertexCount();
+      positions.resize(vertexCount);
+      normals.resize(vertexCount);
+
+      if (!pool || vertexCount <= SKIN_CHUNK_VERTICES) {
+         SkinVertices(mesh, palette, 0, vertexCount, positions.data(), normals.data());
+         return;
+      }
+
+      std::vector<std::future<void> > chunks;
+      for (unsigned int first = 0; first < vertexCount; first += SKIN_CHUNK_VERTICES) {
+         unsigned int count = vertexCount - first < SKIN_CHUNK_VERTICES ? vertexCount - first : SKIN_CHUNK_VERTICES;
+         Eigen::Vector3f * outPositions = positions.data();
+         Eigen::Vector3f * outNormals = normals.data();
+         chunks.push_back(pool->submit([&mesh, &palette, first, count, outPositions, outNormals]() {
+            SkinVertices(mesh, palette, first, count, outPositions, outNormals);
+         }));
+      }
+      for (unsigned int i = 0; i < chunks.size(); i++)
+         chunks[i].wait();
+   }
+}
@@ -0,0 +1,256 @@
+#include "spring_system.h"
+
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+SpringSystem::SpringSystem()
+: gravity(0, SPRING_GRAVITY, 0), method(SPRING_CONJUGATE_GRADIENT),
+  patternDirty(true), builds(0), analyzed(false), iterations(0) {
+   cg.setMaxIterations(SPRING_CG_ITERATIONS);
+   cg.setTolerance(SPRING_CG_TOLERANCE);
+}
+
+int SpringSystem::addParticle(const Eigen::Vector3d& position, double mass, bool fixed) {
+   SpringParticle particle;
+   particle.position = position;
+   particle.velocity = Eigen::Vector3d(0,0,0);
+   particle.mass = mass;
+   particle.fixed = fixed;
+   particles.push_back(particle);
+
+   patternDirty = true;
+   return particles.size() - 1;
+}
+
+int SpringSystem::addSpring(int p0, int p1, double stiffness) {
+   return addSpring(p0, p1, stiffness, (particles[p1].position - particles[p0].position).norm());
+}
+
+int SpringSystem::addSpring(int p0, int p1, double stiffness, double restLength) {
+   Spring spring = {p0, p1, stiffness, restLength};
+   springs.push_back(spring);
+
+   patternDirty = true;
+   return springs.size() - 1;
+}
+
+void SpringSystem::addCollisionSpring(int p0, int p1, double stiffness, double restLength) {
+   Spring spring = {p0, p1, stiffness, restLength};
+   collisions.push_back(spring);
+}
+
+void SpringSystem::addContact(int particle, const Eigen::Vector3d& point, double stiffness) {
+   SpringContact contact;
+   contact.particle = particle;
+   contact.point = point;
+   contact.stiffness = stiffness;
+   contacts.push_back(contact);
+}
+
+unsigned int SpringSystem::patternBuildCount() {
+   return builds;
+}
+
+unsigned int SpringSystem::lastIterations() {
+   return iterations;
+}
+
+// Particles and springs are public, so they may have changed without add*()
+bool SpringSystem::topologyChanged() {
+   if (unknowns.size() != particles.size() || springSlots.size() != springs.size())
+      return true;
+   for (unsigned int i = 0; i < particles.size(); i++)
+      if (particles[i].fixed != (unknowns[i] < 0))
+         return true;
+   return false;
+}
+
+std::pair<int,int> SpringSystem::pairKey(int p0, int p1) {
+   return unknowns[p0] > unknowns[p1] ? std::make_pair(p0, p1) : std::make_pair(p1, p0);
+}
+
+void SpringSystem::buildPattern() {
+   int size = 0;
+   unknowns = std::vector<int>(particles.size(), -1);
+   for (unsigned int i = 0; i < particles.size(); i++) {
+      if (!particles[i].fixed) {
+         unknowns[i] = size;
+         size += 3;
+      }
+   }
+
+   // Every block is listed with its top left corner, diagonal ones first
+   std::vector<std::pair<int,int> > corners;
+   diagonalBlocks = std::vector<int>(particles.size(), -1);
+   for (unsigned int i = 0; i < particles.size(); i++) {
+      if (unknowns[i] >= 0) {
+         diagonalBlocks[i] = corners.size();
+         corners.push_back(std::make_pair(unknowns[i], unknowns[i]));
+      }
+   }
+
+   pairBlocks.clear();
+   for (unsigned int i = 0; i < springs.size(); i++) {
+      int p0 = springs[i].p0, p1 = springs[i].p1;
+      if (p0 == p1 || unknowns[p0] < 0 || unknowns[p1] < 0)
+         continue;
+
+      std::pair<int,int> key = pairKey(p0, p1);
+      if (pairBlocks.count(key))
+         continue;
+      pairBlocks[key] = corners.size();
+      corners.push_back(std::make_pair(unknowns[key.first], unknowns[key.second]));
+   }
+
+   std::vector<Eigen::Triplet<double> > triplets;
+   triplets.reserve(9 * corners.size());
+   for (unsigned int i = 0; i < corners.size(); i++)
+      for (int col = 0; col < 3; col++)
+         for (int row = 0; row < 3; row++)
+            triplets.push_back(Eigen::Triplet<double>(corners[i].first + row, corners[i].second + col, 0));
+
+   A = SpringMatrix(size, size);
+   A.setFromTriplets(triplets.begin(), triplets.end());
+   A.makeCompressed();
+
+   // A block's rows are whole and sorted in each of its columns, so finding the top one finds all three
+   blocks = std::vector<BlockSlot>(corners.size());
+   for (unsigned int i = 0; i < corners.size(); i++) {
+      for (int col = 0; col < 3; col++) {
+         int outer = corners[i].second + col;
+         const int * begin = A.innerIndexPtr() + A.outerIndexPtr()[outer];
+         const int * end = A.innerIndexPtr() + A.outerIndexPtr()[outer + 1];
+         blocks[i].columns[col] = std::lower_bound(begin, end, corners[i].first) - A.innerIndexPtr();
+      }
+   }
+
+   springSlots = std::vector<SpringSlots>(springs.size());
+   for (unsigned int i = 0; i < springs.size(); i++)
+      springSlots[i] = slotsOf(springs[i].p0, springs[i].p1);
+
+   b = Eigen::VectorXd::Zero(size);
+   solved = Eigen::VectorXd::Zero(size);
+   analyzed = false;
+   patternDirty = false;
+   builds++;
+}
+
+SpringSystem::SpringSlots SpringSystem::slotsOf(int p0, int p1) {
+   SpringSlots slots;
+   slots.diagonal0 = diagonalBlocks[p0];
+   slots.diagonal1 = diagonalBlocks[p1];
+   slots.between = -1;
+
+   if (p0 != p1 && slots.diagonal0 >= 0 && slots.diagonal1 >= 0) {
+      std::map<std::pair<int,int>, int>::iterator found = pairBlocks.find(pairKey(p0, p1));
+      if (found != pairBlocks.end())
+         slots.between = found->second;
+   }
+   return slots;
+}
+
+void SpringSystem::addBlock(int block, const Eigen::Matrix3d& m) {
+   double * values = A.valuePtr();
+   for (int col = 0; col < 3; col++) {
+      double * column = values + blocks[block].columns[col];
+      column[0] += m(0, col);
+      column[1] += m(1, col);
+      column[2] += m(2, col);
+   }
+}
+
+void SpringSystem::addSpringTerms(const Spring& spring, const SpringSlots& slots, double timeDelta) {
+   Eigen::Vector3d dx = particles[spring.p1].position - particles[spring.p0].position;
+   double length = dx.norm();
+   if (length < 1e-12)
+      return;
+
+   Eigen::Vector3d along = dx / length;
+   Eigen::Vector3d force = spring.stiffness * (length - spring.restLength) * along;
+
+   // A compressed spring's Jacobian is indefinite across the spring, leaving
+   // that part out keeps the system positive definite for both solvers
+   double stretch = fmax((length - spring.restLength) / length, 0.0);
+   Eigen::Matrix3d Ks = -spring.stiffness * (stretch * Eigen::Matrix3d::Identity() +
+                                             (1 - stretch) * along * along.transpose());
+   Eigen::Matrix3d stiff = -(timeDelta * timeDelta) * Ks;
+
+   if (slots.diagonal0 >= 0) {
+      addBlock(slots.diagonal0, stiff);
+      b.segment<3>(unknowns[spring.p0]) += timeDelta * force;
+   }
+   if (slots.diagonal1 >= 0) {
+      addBlock(slots.diagonal1, stiff);
+      b.segment<3>(unknowns[spring.p1]) -= timeDelta * force;
+   }
+   if (slots.between >= 0)
+      addBlock(slots.between, -stiff);
+}
+
+void SpringSystem::step(double timeDelta) {
+   if (topologyChanged() || patternDirty)
+      buildPattern();
+
+   // M on the diagonal, then M v + h f and -h^2 K summed in
+   memset(A.valuePtr(), 0, A.nonZeros() * sizeof(double));
+   for (unsigned int i = 0; i < particles.size(); i++) {
+      const SpringParticle * particle = & particles[i];
+      if (unknowns[i] < 0)
+         continue;
+
+      addBlock(diagonalBlocks[i], particle->mass * Eigen::Matrix3d::Identity());
+      b.segment<3>(unknowns[i]) = particle->mass * (particle->velocity + timeDelta * gravity);
+      solved.segment<3>(unknowns[i]) = particle->velocity;
+   }
+
+   for (unsigned int i = 0; i < springs.size(); i++)
+      addSpringTerms(springs[i], springSlots[i], timeDelta);
+
+   // Collisions only last a step, so they stay out of the pattern. Each
+   // particle takes the spring implicitly as if the other held still for the
+   // step, which keeps even very stiff collisions stable.
+   for (unsigned int i = 0; i < collisions.size(); i++) {
+      SpringSlots slots = {diagonalBlocks[collisions[i].p0], diagonalBlocks[collisions[i].p1], -1};
+      addSpringTerms(collisions[i], slots, timeDelta);
+   }
+
+   for (unsigned int i = 0; i < contacts.size(); i++) {
+      const SpringContact * contact = & contacts[i];
+      if (unknowns[contact->particle] < 0)
+         continue;
+
+      Eigen::Vector3d force = contact->stiffness * (contact->point - particles[contact->particle].position);
+      addBlock(diagonalBlocks[contact->particle], timeDelta * timeDelta * contact->stiffness * Eigen::Matrix3d::Identity());
+      b.segment<3>(unknowns[contact->particle]) += timeDelta * force;
+   }
+
+   iterations = 0;
+   if (A.rows() > 0) {
+      if (method == SPRING_CONJUGATE_GRADIENT) {
+         cg.compute(A);
+         solved = cg.solveWithGuess(b, solved);
+         iterations = cg.iterations();
+      }
+      else {
+         if (!analyzed)
+            ldlt.analyzePattern(A);
+         analyzed = true;
+         ldlt.factorize(A);
+         solved = ldlt.solve(b);
+      }
+   }
+
+   // Fixed particles stay wherever they were put
+   for (unsigned int i = 0; i < particles.size(); i++) {
+      SpringParticle * particle = & particles[i];
+      if (unknowns[i] < 0)
+         continue;
+
+      particle->velocity = solved.segment<3>(unknowns[i]);
+      particle->position += timeDelta * particle->velocity;
+   }
+
+   collisions.clear();
+   contacts.clear();
+}
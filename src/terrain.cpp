@@ -112,14 +112,14 @@ Model * TerrainGenerator::GenerateModel() {
 
    // Initialize the model
    model = new Model();
-   model->vertices = std::vector<Vertex *>(0);
-   model->faces = std::vector<Face *>(0);
+   vertices = std::vector<Vertex *>(0);
+   faces = std::vector<Face *>(0);
    model->hasNormals = true;
    model->hasTexCoords = true;
    model->hasTansAndBitans = true;
 
    // Add the vertex to the model
-   model->vertices.push_back(vStart);
+   vertices.push_back(vStart);
 
    // Initialize the starting paths
    paths = std::vector<Path *>(0);
@@ -137,11 +137,7 @@ Model * TerrainGenerator::GenerateModel() {
    CreateNeededPaths();
    AddVerticesAndFaces();
    CalculateVertexNormals();
-
-   model->vertexCount = model->vertices.size();
-   model->faceCount = model->faces.size();
-   model->bufferVertices();
-   model->bufferIndices();
+   PackMesh();
 
    return model;
 }
@@ -157,11 +153,7 @@ void TerrainGenerator::UpdateMesh(Vector3f center, float radius) {
       // RemoveRetreatingGeometry();
       RemoveConvergingPaths();
       CalculateVertexNormals();
-
-      model->vertexCount = model->vertices.size();
-      model->faceCount = model->faces.size();
-      model->bufferVertices();
-      model->bufferIndices();
+      PackMesh();
    }
 }
 
@@ -331,8 +323,8 @@ void TerrainGenerator::AddVerticesAndFaces() {
       // Add the vertex
       if (selfP->buildAction == Path::BuildAction::ADVANCE &&
           selfP->headV != rightP->headV) {
-         selfP->headV->index = model->vertices.size();
-         model->vertices.push_back(selfP->headV);
+         selfP->headV->index = vertices.size();
+         vertices.push_back(selfP->headV);
       }
 
       // Add the faces and neighbors
@@ -361,7 +353,7 @@ void TerrainGenerator::HandleSameHead(Path * midP, Path * rightP) {
       f->vertices[1] = midP->tailV;
       f->vertices[2] = rightP->tailV;
       f->calculateNormal();
-      model->faces.push_back(f);
+      faces.push_back(f);
       addFaceToVertexReferences(f);
 
       // Add neighbors to all effected vertices
@@ -378,7 +370,7 @@ void TerrainGenerator::HandleSameTail(Path * midP, Path * rightP) {
       f->vertices[1] = midP->tailV;
       f->vertices[2] = rightP->headV;
       f->calculateNormal();
-      model->faces.push_back(f);
+      faces.push_back(f);
       addFaceToVertexReferences(f);
 
       // Add neighbors to all effected vertices
@@ -400,7 +392,7 @@ void TerrainGenerator::HandleBothDiff(Path * midP, Path * rightP) {
       f->vertices[1] = midP->tailV;
       f->vertices[2] = rightP->headV;
       f->calculateNormal();
-      model->faces.push_back(f);
+      faces.push_back(f);
       addFaceToVertexReferences(f);
 
       // Add in the neighbors
@@ -416,7 +408,7 @@ void TerrainGenerator::HandleBothDiff(Path * midP, Path * rightP) {
       f->vertices[1] = rightP->tailV;
       f->vertices[2] = rightP->headV;
       f->calculateNormal();
-      model->faces.push_back(f);
+      faces.push_back(f);
       addFaceToVertexReferences(f);
 
       // Add in the neighbors
@@ -438,7 +430,7 @@ void TerrainGenerator::HandleBothDiff(Path * midP, Path * rightP) {
          f->vertices[1] = midP->tailV;
          f->vertices[2] = rightP->headV;
          f->calculateNormal();
-         model->faces.push_back(f);
+         faces.push_back(f);
          addFaceToVertexReferences(f);
 
          f = new Face();
@@ -446,7 +438,7 @@ void TerrainGenerator::HandleBothDiff(Path * midP, Path * rightP) {
          f->vertices[1] = midP->tailV;
          f->vertices[2] = rightP->tailV;
          f->calculateNormal();
-         model->faces.push_back(f);
+         faces.push_back(f);
          addFaceToVertexReferences(f);
 
          // Add in the neighbors
@@ -461,7 +453,7 @@ void TerrainGenerator::HandleBothDiff(Path * midP, Path * rightP) {
          f->vertices[1] = midP->tailV;
          f->vertices[2] = rightP->tailV;
          f->calculateNormal();
-         model->faces.push_back(f);
+         faces.push_back(f);
          addFaceToVertexReferences(f);
 
          f = new Face();
@@ -469,7 +461,7 @@ void TerrainGenerator::HandleBothDiff(Path * midP, Path * rightP) {
          f->vertices[1] = midP->headV;
          f->vertices[2] = rightP->tailV;
          f->calculateNormal();
-         model->faces.push_back(f);
+         faces.push_back(f);
          addFaceToVertexReferences(f);
 
          // Add in the neighbors
@@ -481,7 +473,7 @@ void TerrainGenerator::HandleBothDiff(Path * midP, Path * rightP) {
 }
 
 // void TerrainGenerator::collapsePath(Path * p) {
-//    MR::Collapse(model, p->headV, p->tailV);
+//    MR::Collapse(vertices, faces, p->headV, p->tailV);
 //    p->headV = p->tailV;
 //    p->tailV = neighborFromDirection(p->tailV, - p->heading);
 // }
@@ -491,7 +483,7 @@ void TerrainGenerator::RemoveRetreatingGeometry() {
    for (int i = 0; i < numPaths; i++) {
       Path * p = paths[i];
       if (paths[i]->buildAction == Path::BuildAction::RETREAT) {
-         MR::Collapse(model, p->headV, p->tailV);
+         MR::Collapse(vertices, faces, p->headV, p->tailV);
          p->headV = p->tailV;
          p->tailV = neighborFromDirection(p->tailV, - p->heading);
       }
@@ -506,11 +498,11 @@ void TerrainGenerator::RemoveConvergingPaths() {
 
       // In case one path goes in front of another
       if (midP->tailV == rightP->headV) {
-         MR::Collapse(model, midP->headV, midP->tailV);
+         MR::Collapse(vertices, faces, midP->headV, midP->tailV);
          midP->headV = midP->tailV;
          midP->tailV = neighborFromDirection(midP->tailV, - midP->heading);
       } else if (midP->headV == rightP->tailV) {
-         MR::Collapse(model, rightP->headV, rightP->tailV);
+         MR::Collapse(vertices, faces, rightP->headV, rightP->tailV);
          rightP->headV = rightP->tailV;
          rightP->tailV = neighborFromDirection(rightP->tailV, - rightP->heading);
       }
@@ -540,3 +532,30 @@ void TerrainGenerator::CalculateVertexNormals() {
       }
    }
 }
+
+// Copy the edited graph into the model's packed streams and upload them
+void TerrainGenerator::PackMesh() {
+   int numVerts = vertices.size();
+   int numFaces = faces.size();
+   Mesh * mesh = & model->mesh;
+
+   mesh->resize(numVerts, numFaces);
+   for (int i = 0; i < numVerts; i++) {
+      Vertex * v = vertices[i];
+      mesh->positions[i] = v->position;
+      mesh->normals[i] = v->normal;
+      mesh->tangents[i] = v->tangent;
+      mesh->bitangents[i] = v->bitangent;
+      mesh->uvs[i] = v->uv;
+   }
+   for (int i = 0; i < numFaces; i++) {
+      for (int j = 0; j < NUM_FACE_EDGES; j++)
+         mesh->indices[NUM_FACE_EDGES*i+j] = faces[i]->vertices[j]->index;
+      mesh->faceNormals[i] = faces[i]->normal;
+   }
+
+   model->vertexCount = numVerts;
+   model->faceCount = numFaces;
+   model->bufferVertices();
+   model->bufferIndices();
+}
@@ -0,0 +1,61 @@
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(unsigned int threadCount)
+: _stopping(false) {
+   if (threadCount == 0)
+      threadCount = std::thread::hardware_concurrency();
+   if (threadCount == 0)
+      threadCount = 1;
+
+   for (unsigned int i = 0; i < threadCount; i++)
+      _threads.push_back(std::thread(& ThreadPool::work, this));
+}
+
+ThreadPool::~ThreadPool() {
+   {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _stopping = true;
+   }
+   _wake.notify_all();
+
+   for (unsigned int i = 0; i < _threads.size(); i++)
+      _threads[i].join();
+}
+
+std::future<void> ThreadPool::submit(const std::function<void()>& job) {
+   std::packaged_task<void()> task(job);
+   std::future<void> done = task.get_future();
+
+   {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _jobs.push_back(std::move(task));
+   }
+   _wake.notify_one();
+
+   return done;
+}
+
+unsigned int ThreadPool::threadCount() const {
+   return _threads.size();
+}
+
+void ThreadPool::work() {
+   while (true) {
+      std::packaged_task<void()> task;
+
+      {
+         std::unique_lock<std::mutex> lock(_mutex);
+         while (_jobs.empty() && !_stopping)
+            _wake.wait(lock);
+
+         // Only leave once the queue has drained
+         if (_jobs.empty())
+            return;
+
+         task = std::move(_jobs.front());
+         _jobs.pop_front();
+      }
+
+      task();
+   }
+}
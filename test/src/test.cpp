@@ -4,6 +4,21 @@ int main() {
    testGeometry();
    testModel();
    testGrid();
+   testProgressive();
+   testReducer();
+   testAssetLoader();
+   testCTEX();
+   testResources();
+   testAnimation();
+   testAnimCompress();
+   testPoseCache();
+   testAnimScheduler();
+   testRetarget();
+   testSkinning();
+   testIK();
+   testIKScheduler();
+   testArticulated();
+   testSprings();
 
    return 0;
 }
\ No newline at end of file
@@ -57,5 +57,20 @@ inline void _nanCheck_(
 void testGeometry();
 void testModel();
 void testGrid();
+void testProgressive();
+void testReducer();
+void testAssetLoader();
+void testCTEX();
+void testResources();
+void testAnimation();
+void testAnimCompress();
+void testPoseCache();
+void testAnimScheduler();
+void testRetarget();
+void testSkinning();
+void testIK();
+void testIKScheduler();
+void testArticulated();
+void testSprings();
 
 #endif // __TEST_H__
\ No newline at end of file
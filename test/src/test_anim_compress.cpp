@@ -0,0 +1,203 @@
+#include "test.h"
+#include "anim_compress.h"
+#include "animation.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+#define CLIP_FPS 60
+#define PLAIN_KEY_SIZE (11 * sizeof(float))
+
+static float rotationError(const Eigen::Quaternionf& a, const Eigen::Quaternionf& b) {
+   float chord = fmin((a.coeffs() - b.coeffs()).norm(), (a.coeffs() + b.coeffs()).norm());
+   return 4 * asinf(fmin(1.0f, chord * 0.5f));
+}
+
+static LocalTransform identityTransform() {
+   LocalTransform t;
+   t.position = Eigen::Vector3f(0, 0, 0);
+   t.rotation = Eigen::Quaternionf::Identity();
+   t.scale = Eigen::Vector3f(1, 1, 1);
+   return t;
+}
+
+// Something like mocap: a moving root, limbs swinging at their own rates from
+// fixed offsets, a few bones that never turn, and unit scale throughout
+static std::vector<LocalTransform> mocapFrames(unsigned int boneCount, unsigned int frameCount) {
+   std::vector<LocalTransform> frames = std::vector<LocalTransform>(boneCount * frameCount);
+
+   for (unsigned int j = 0; j < boneCount; j++) {
+      Eigen::Vector3f axis = Eigen::Vector3f(sinf(j + 1.0f), cosf(2.0f * j), 0.5f).normalized();
+      float period = 90 + 7 * j;
+
+      for (unsigned int f = 0; f < frameCount; f++) {
+         LocalTransform * t = & frames[j * frameCount + f];
+         *t = identityTransform();
+
+         float phase = 2 * M_PI * f / period;
+         if (j == 0)
+            t->position = Eigen::Vector3f(0.01f * f, 0.9f + 0.05f * sinf(phase), 0);
+         else
+            t->position = Eigen::Vector3f(0, 0.3f, 0.02f * j);
+         if (j % 6 != 5)
+            t->rotation = Eigen::Quaternionf(Eigen::AngleAxisf(0.8f * sinf(phase), axis));
+      }
+   }
+   return frames;
+}
+
+void testAnimCompress() {
+   AC::Tolerance tolerance = AC::DefaultTolerance();
+
+   {
+      // Every frame comes back within tolerance, from a fraction of the plain keys
+      unsigned int boneCount = 18, frameCount = 3000;
+      std::vector<LocalTransform> frames = mocapFrames(boneCount, frameCount);
+      std::vector<unsigned char> clip;
+      const char * error = NULL;
+
+      AC::Compress(frames.data(), boneCount, frameCount, CLIP_FPS, tolerance, clip);
+      boolCheck(AC::Parse(clip.data(), clip.size(), error), true);
+
+      AC::ClipHeader header = AC::ReadHeader(clip.data());
+      equalityIntCheck(header.fps, CLIP_FPS);
+      equalityIntCheck(header.frameCount, frameCount);
+      equalityIntCheck(header.boneCount, boneCount);
+      equalityIntCheck(header.size, clip.size());
+
+      float worstPosition = 0, worstRotation = 0, worstScale = 0;
+      std::vector<LocalTransform> pose = std::vector<LocalTransform>(boneCount);
+      for (unsigned int f = 0; f < frameCount; f++) {
+         AC::SamplePose(clip.data(), 1.0f * f / CLIP_FPS, pose.data());
+         for (unsigned int j = 0; j < boneCount; j++) {
+            const LocalTransform * source = & frames[j * frameCount + f];
+            worstPosition = fmax(worstPosition, (pose[j].position - source->position).norm());
+            worstRotation = fmax(worstRotation, rotationError(pose[j].rotation, source->rotation));
+            worstScale = fmax(worstScale, (pose[j].scale - source->scale).norm());
+         }
+      }
+      boolCheck(worstPosition <= tolerance.position + 1e-5f, true);
+      boolCheck(worstRotation <= tolerance.rotation + 1e-4f, true);
+      equalityFloatCheck(worstScale, 0, 1e-6);
+
+      size_t plainSize = boneCount * frameCount * PLAIN_KEY_SIZE;
+      boolCheck(plainSize >= 5 * clip.size(), true);
+
+      // Playing forward with a cursor samples the same as searching every time
+      KeyCursor cursor;
+      float worstCursor = 0;
+      for (unsigned int f = 0; f < 4 * frameCount; f += 3) {
+         float time = 0.25f * f / CLIP_FPS;
+         AC::SamplePose(clip.data(), time, pose.data(), & cursor);
+         for (unsigned int j = 0; j < boneCount; j++) {
+            LocalTransform searched = AC::SampleBone(clip.data(), j, time);
+            worstCursor = fmax(worstCursor, (searched.position - pose[j].position).norm());
+            worstCursor = fmax(worstCursor, rotationError(searched.rotation, pose[j].rotation));
+         }
+      }
+      equalityFloatCheck(worstCursor, 0, 1e-6);
+      equalityIntCheck(cursor.keys.size(), 3 * boneCount);
+
+      // Past either end holds the first or last frame
+      LocalTransform last = AC::SampleBone(clip.data(), 1, 1000);
+      boolCheck(rotationError(last.rotation, frames[2 * frameCount - 1].rotation) <= tolerance.rotation + 1e-4f, true);
+      LocalTransform first = AC::SampleBone(clip.data(), 1, -1);
+      boolCheck(rotationError(first.rotation, frames[frameCount].rotation) <= tolerance.rotation + 1e-4f, true);
+   }
+
+   {
+      // Tracks at their identity value take no room, constant tracks one value
+      unsigned int frameCount = 100;
+      std::vector<LocalTransform> frames = std::vector<LocalTransform>(2 * frameCount, identityTransform());
+      std::vector<unsigned char> clip;
+
+      AC::Compress(frames.data(), 2, frameCount, CLIP_FPS, tolerance, clip);
+      equalityIntCheck(clip.size(), AC_HEADER_SIZE + 2 * 3 * AC_TRACK_ENTRY_SIZE);
+
+      for (unsigned int f = 0; f < frameCount; f++)
+         frames[frameCount + f].position = Eigen::Vector3f(1, 2, 3);
+      clip.clear();
+      AC::Compress(frames.data(), 2, frameCount, CLIP_FPS, tolerance, clip);
+      equalityIntCheck(clip.size(), AC_HEADER_SIZE + 2 * 3 * AC_TRACK_ENTRY_SIZE + 3 * sizeof(float));
+
+      LocalTransform t = AC::SampleBone(clip.data(), 1, 0.5f);
+      equalityFloatCheck(t.position.y(), 2, 1e-6);
+      equalityFloatCheck(t.scale.x(), 1, 1e-6);
+      equalityFloatCheck(t.rotation.w(), 1, 1e-6);
+
+      // Bones past the clip's are left at identity
+      t = AC::SampleBone(clip.data(), 7, 0.5f);
+      equalityFloatCheck(t.position.norm(), 0, 1e-6);
+   }
+
+   {
+      // With no tolerance every frame is kept, so this is just the 48 bit
+      // rotations, including ones whose largest component is negative
+      unsigned int frameCount = 64;
+      std::vector<LocalTransform> frames = std::vector<LocalTransform>(frameCount, identityTransform());
+      AC::Tolerance exact = {0, 0, 0};
+      std::vector<unsigned char> clip;
+
+      srand(7);
+      for (unsigned int f = 0; f < frameCount; f++) {
+         Eigen::Vector4f c = Eigen::Vector4f::Random().normalized();
+         frames[f].rotation = Eigen::Quaternionf(c(3), c(0), c(1), c(2));
+      }
+      AC::Compress(frames.data(), 1, frameCount, CLIP_FPS, exact, clip);
+
+      float worst = 0;
+      for (unsigned int f = 0; f < frameCount; f++) {
+         LocalTransform t = AC::SampleBone(clip.data(), 0, 1.0f * f / CLIP_FPS);
+         equalityFloatCheck(Eigen::Quaternionf(t.rotation).norm(), 1, 1e-5);
+         worst = fmax(worst, rotationError(t.rotation, frames[f].rotation));
+      }
+      boolCheck(worst < 2e-4f, true);
+   }
+
+   {
+      // Broken clips are caught before anything samples them
+      unsigned int boneCount = 3, frameCount = 200;
+      std::vector<LocalTransform> frames = mocapFrames(boneCount, frameCount);
+      std::vector<unsigned char> clip;
+      const char * error = NULL;
+      AC::Compress(frames.data(), boneCount, frameCount, CLIP_FPS, tolerance, clip);
+
+      boolCheck(AC::Parse(clip.data(), clip.size() - 4, error), false);
+      boolCheck(AC::Parse(clip.data(), 8, error), false);
+
+      // Repeat a frame of bone 0's rotation track, which would leave an empty span
+      std::vector<unsigned char> broken = clip;
+      unsigned int entry[2];
+      memcpy(entry, & broken[AC_HEADER_SIZE + AC_TRACK_ENTRY_SIZE], sizeof(entry));
+      boolCheck(entry[0] > 2, true);
+      memcpy(& broken[entry[1]], & broken[entry[1] + sizeof(unsigned short)], sizeof(unsigned short));
+      boolCheck(AC::Parse(broken.data(), broken.size(), error), false);
+      boolCheck(error != NULL, true);
+   }
+
+   {
+      // Animations holding a clip sample through AN like plain ones
+      unsigned int boneCount = 4, frameCount = 120;
+      std::vector<LocalTransform> frames = mocapFrames(boneCount, frameCount);
+      Animation anim;
+      anim.fps = CLIP_FPS;
+      anim.keyCount = frameCount;
+      anim.duration = 1.0f * (frameCount-1) / CLIP_FPS;
+      AC::Compress(frames.data(), boneCount, frameCount, CLIP_FPS, tolerance, anim.compressed);
+
+      std::vector<Mmath::Matrix3x4f> matrices = std::vector<Mmath::Matrix3x4f>(boneCount);
+      std::vector<LocalTransform> pose = std::vector<LocalTransform>(boneCount);
+      AN::SampleAnimation(anim, 0.7f, matrices.data());
+      AN::SamplePose(anim, 0.7f, pose.data());
+
+      for (unsigned int j = 0; j < boneCount; j++) {
+         Mmath::Matrix3x4f expected;
+         AN::ComposePose(& pose[j], 1, & expected);
+         equalityFloatCheck((matrices[j] - expected).norm(), 0, 1e-6);
+         equalityFloatCheck((AN::SampleBone(anim, j, 0.7f) - expected).norm(), 0, 1e-6);
+         equalityFloatCheck((AN::SampleBonePose(anim, j, 0.7f).position - pose[j].position).norm(), 0, 1e-6);
+      }
+   }
+}
@@ -0,0 +1,90 @@
+#include "test.h"
+#include "anim_scheduler.h"
+#include "camera.h"
+
+#include <math.h>
+
+// A two bone arm waving about z for a second
+static void buildWavingArm(Model * model) {
+   const unsigned int boneCount = 2, keyCount = 5, fps = 4;
+
+   model->bones = std::vector<Bone>(boneCount);
+   for (unsigned int i = 0; i < boneCount; i++) {
+      Bone * bone = & model->bones[i];
+      bone->parentIndex = i - 1;
+      bone->invBonePose = Eigen::Matrix4f::Identity();
+      bone->parentOffset = Mmath::TranslationMatrix(Eigen::Vector3f(i, 0, 0));
+      if (i + 1 < boneCount)
+         bone->childIndices.push_back(i + 1);
+   }
+   model->boneCount = boneCount;
+   model->boneRoot = 0;
+   model->flattenBoneTree();
+   model->hasBoneTree = true;
+
+   Animation anim;
+   anim.fps = fps;
+   anim.keyCount = keyCount;
+   anim.duration = 1.0 * (keyCount-1) / fps;
+   anim.ownedKeys = std::vector<Key>(boneCount * keyCount);
+   anim.animBones = std::vector<AnimBone>(boneCount);
+   for (unsigned int j = 0; j < boneCount; j++) {
+      anim.animBones[j].keys = & anim.ownedKeys[j * keyCount];
+      for (unsigned int k = 0; k < keyCount; k++) {
+         Key * key = & anim.ownedKeys[j * keyCount + k];
+         key->time = 1.0 * k / fps;
+         key->position = Eigen::Vector3f(j, 0, 0);
+         key->rotation = Eigen::AngleAxisf(0.3f * k, Eigen::Vector3f(0, 0, 1));
+         key->scale = Eigen::Vector3f(1, 1, 1);
+      }
+   }
+   AN::BuildTracks(& anim, boneCount);
+
+   model->animations.push_back(anim);
+   model->animationCount = 1;
+   model->hasAnimations = true;
+   model->boundRadius = 2;
+}
+
+void testAnimScheduler() {
+   Model model;
+   buildWavingArm(& model);
+   Camera camera = Camera(Eigen::Vector3f(0, 0, -10));
+
+   // Every entity ticks at the same rate wherever it is on screen
+   AnimScheduler scheduler = AnimScheduler(30);
+   scheduler.maxSlowdown = 1;
+   scheduler.hiddenRate = 30;
+
+   PoseCache cache;
+   SkinnedEntity first = SkinnedEntity(Eigen::Vector3f(0, 0, 0), & model);
+   SkinnedEntity second = SkinnedEntity(Eigen::Vector3f(3, 0, 0), & model);
+   SkinnedEntity alone = SkinnedEntity(Eigen::Vector3f(-3, 0, 0), & model);
+   first.poseCache = & cache;
+   second.poseCache = & cache;
+
+   cache.beginFrame();
+   scheduler.add(& first);
+   scheduler.add(& second);
+   scheduler.add(& alone);
+
+   // Entities in step draw one palette between their ticks, evaluated once a
+   // frame, and it is the pose an entity drawing its own would have drawn
+   bool sharing = true, onceAFrame = true;
+   float worst = 0;
+   for (int frame = 0; frame < 40; frame++) {
+      cache.beginFrame();
+      scheduler.update(& camera, 1.0f / 70);
+
+      sharing = sharing && first.palette && first.palette == second.palette;
+      onceAFrame = onceAFrame && cache.evaluated <= 2;
+      for (int i = 0; i < model.boneCount; i++)
+         worst = fmax(worst, (first.drawnAnimMs()[i] - alone.drawnAnimMs()[i]).cwiseAbs().maxCoeff());
+   }
+   boolCheck(sharing, true);
+   boolCheck(onceAFrame, true);
+   boolCheck(alone.palette == NULL, true);
+
+   // Blends are made at the nearest step of the way, so they are off by at most half a step of a tick's turn
+   equalityFloatCheck(worst, 0, 0.5f * (0.3f * 4 / 30) / POSE_BLEND_STEPS + 1e-5);
+}
@@ -0,0 +1,287 @@
+#include "test.h"
+#include "animation.h"
+
+#include <stdlib.h>
+
+static Eigen::Quaternionf randomRotation() {
+   Eigen::Vector4f v = Eigen::Vector4f::Random();
+   return Eigen::Quaternionf(v(3), v(0), v(1), v(2)).normalized();
+}
+
+// The transform the sampler approximates, lerped position and scale and an exact slerp
+static Eigen::Matrix4f referenceTransform(const Key& early, const Key& late, float tickTime) {
+   float ratio = (tickTime - early.time) / (late.time - early.time);
+   ratio = Mmath::clamp(0.0f, 1.0f, ratio);
+   Eigen::Vector3f position = early.position + ratio * (late.position - early.position);
+   Eigen::Vector3f scale = early.scale + ratio * (late.scale - early.scale);
+   Eigen::Quaternionf rotation = Eigen::Quaternionf(early.rotation).slerp(ratio, Eigen::Quaternionf(late.rotation));
+   return Mmath::TransformationMatrix(position, rotation, scale);
+}
+
+static float maxDifference(const Eigen::Matrix4f& a, const Eigen::Matrix4f& b) {
+   return (a - b).cwiseAbs().maxCoeff();
+}
+
+void testAnimation() {
+   srand(7);
+
+   // 11 bones fills a full group of lanes and part of a second one
+   const unsigned int boneCount = 11, keyCount = 5, fps = 4;
+   Animation anim;
+   anim.fps = fps;
+   anim.keyCount = keyCount;
+   anim.duration = 1.0 * (keyCount-1) / fps;
+   anim.ownedKeys = std::vector<Key>(boneCount * keyCount);
+   anim.animBones = std::vector<AnimBone>(boneCount);
+
+   for (unsigned int j = 0; j < boneCount; j++) {
+      anim.animBones[j].keys = & anim.ownedKeys[j * keyCount];
+      Eigen::Quaternionf rotation = randomRotation();
+
+      for (unsigned int k = 0; k < keyCount; k++) {
+         Key * key = & anim.ownedKeys[j * keyCount + k];
+         key->time = 1.0 * k / fps;
+         key->position = Eigen::Vector3f::Random() * 10;
+         key->scale = Eigen::Vector3f(1, 1, 1) + Eigen::Vector3f::Random().cwiseAbs();
+
+         // Turns of up to about 50 degrees between keys, every other key
+         // flipped to the opposite hemisphere as exporters often write them
+         Eigen::Vector3f axis = Eigen::Vector3f::Random().normalized();
+         rotation = rotation * Mmath::AngleAxisQuat<float>(0.9f * rand() / RAND_MAX, axis);
+         key->rotation = Eigen::Quaternionf(rotation.coeffs() * (k % 2 ? -1.0f : 1.0f));
+      }
+   }
+
+   AN::BuildTracks(& anim, boneCount);
+   equalityIntCheck(anim.tracks.boneStride, 16);
+   equalityIntCheck(anim.tracks.data.size(), keyCount * ANIM_TRACK_CHANNELS * 16);
+
+   {
+      // Every bone matches lerp and slerp, on keys, between them and past the ends
+      float times[] = {0, 0.1f, 0.25f, 0.4f, 0.6249f, 0.9f, 1.0f, 1.3f};
+      std::vector<Mmath::Matrix3x4f> sampled = std::vector<Mmath::Matrix3x4f>(boneCount);
+      float worst = 0;
+
+      for (int t = 0; t < sizeof(times) / sizeof(float); t++) {
+         AN::SampleAnimation(anim, times[t], sampled.data());
+
+         int early = times[t] * (keyCount-1) / anim.duration;
+         early = early < keyCount-1 ? early : keyCount-2;
+
+         for (unsigned int j = 0; j < boneCount; j++) {
+            const Key * keys = anim.animBones[j].keys;
+            Eigen::Matrix4f expected = referenceTransform(keys[early], keys[early+1], times[t]);
+            worst = fmax(worst, maxDifference(Mmath::ExpandAffine(sampled[j]), expected));
+
+            // The single bone sampler agrees with the batched one
+            Mmath::Matrix3x4f single = AN::SampleBone(anim, j, times[t]);
+            equalityFloatCheck((single - sampled[j]).cwiseAbs().maxCoeff(), 0, 1e-5);
+         }
+      }
+
+      // Scales are below 2 and translations below 10, so this is the rotation error
+      equalityFloatCheck(worst, 0, 1e-3);
+   }
+
+   {
+      // Chaining 3x4 transforms gives what the 4x4 products did
+      std::vector<Mmath::Matrix3x4f> sampled = std::vector<Mmath::Matrix3x4f>(boneCount);
+      AN::SampleAnimation(anim, 0.3f, sampled.data());
+
+      Mmath::Matrix3x4f chained = sampled[0];
+      Eigen::Matrix4f expected = Mmath::ExpandAffine(sampled[0]);
+      for (unsigned int j = 1; j < boneCount; j++) {
+         chained = Mmath::ComposeAffine(chained, sampled[j]);
+         expected = expected * Mmath::ExpandAffine(sampled[j]);
+      }
+      equalityFloatCheck(maxDifference(Mmath::ExpandAffine(chained), expected), 0, 1e-3 * expected.cwiseAbs().maxCoeff());
+   }
+
+   {
+      // Sampling the parts and putting them together matches sampling the transforms
+      std::vector<Mmath::Matrix3x4f> sampled = std::vector<Mmath::Matrix3x4f>(boneCount);
+      std::vector<Mmath::Matrix3x4f> composed = std::vector<Mmath::Matrix3x4f>(boneCount);
+      std::vector<LocalTransform> pose = std::vector<LocalTransform>(boneCount);
+
+      AN::SampleAnimation(anim, 0.55f, sampled.data());
+      AN::SamplePose(anim, 0.55f, pose.data());
+      AN::ComposePose(pose.data(), boneCount, composed.data());
+      for (unsigned int j = 0; j < boneCount; j++) {
+         equalityFloatCheck((composed[j] - sampled[j]).cwiseAbs().maxCoeff(), 0, 1e-4);
+         equalityFloatCheck(pose[j].rotation.norm(), 1, 1e-5);
+      }
+
+      LocalTransform single = AN::SampleBonePose(anim, 3, 0.55f);
+      equalityFloatCheck((single.position - pose[3].position).norm(), 0, 1e-5);
+      equalityFloatCheck(fabs(single.rotation.coeffs().dot(pose[3].rotation.coeffs())), 1, 1e-5);
+   }
+
+   {
+      // Fades move at a constant rate and clips that faded out are dropped
+      std::vector<Animation> animations = std::vector<Animation>(2, anim);
+      AnimLayer layer;
+      layer.mode = LAYER_OVERRIDE;
+      layer.weight = 1;
+
+      AN::FadeClip(& layer, 0, 1, 0);
+      AN::Crossfade(& layer, 1, 0.5f);
+      equalityIntCheck(layer.clips.size(), 2);
+
+      AN::AdvanceLayer(& layer, animations, 0.25f);
+      equalityFloatCheck(layer.clips[0].weight, 0.5, 1e-5);
+      equalityFloatCheck(layer.clips[1].weight, 0.5, 1e-5);
+      equalityFloatCheck(layer.clips[1].time, 0.25, 1e-6);
+
+      AN::AdvanceLayer(& layer, animations, 0.3f);
+      equalityIntCheck(layer.clips.size(), 1);
+      equalityIntCheck(layer.clips[0].animNum, 1);
+      equalityFloatCheck(layer.clips[0].weight, 1, 1e-6);
+
+      // Clips loop around their animation's duration
+      AN::AdvanceLayer(& layer, animations, 0.6f);
+      equalityFloatCheck(layer.clips[0].time, 1.15 - anim.duration, 1e-5);
+   }
+
+   {
+      // Layers blend the pose below toward their own by weight, only on their bones
+      std::vector<Animation> animations = std::vector<Animation>(1, anim);
+      PoseArena arena;
+      std::vector<LocalTransform> base = std::vector<LocalTransform>(boneCount);
+      std::vector<LocalTransform> target = std::vector<LocalTransform>(boneCount);
+      AN::SamplePose(anim, 0, base.data());
+      AN::SamplePose(anim, 0.5f, target.data());
+
+      AnimLayer layer;
+      layer.mode = LAYER_OVERRIDE;
+      layer.weight = 1;
+      layer.boneWeights = std::vector<float>(boneCount, 0);
+      layer.boneWeights[2] = 1;
+      AN::FadeClip(& layer, 0, 0.5f, 0);
+      layer.clips[0].time = 0.5f;
+
+      std::vector<LocalTransform> pose = base;
+      AN::ApplyLayer(& layer, animations, boneCount, & arena, pose.data());
+      Eigen::Vector3f halfway = 0.5f * (base[2].position + target[2].position);
+      equalityFloatCheck((pose[2].position - halfway).norm(), 0, 1e-4);
+      equalityFloatCheck((pose[1].position - base[1].position).norm(), 0, 1e-6);
+
+      // Two clips at full weight share the layer evenly
+      AN::FadeClip(& layer, 0, 1, 0);
+      layer.clips[0].time = 0;
+      animations.push_back(anim);
+      AN::FadeClip(& layer, 1, 1, 0);
+      layer.clips[1].time = 0.5f;
+
+      pose = base;
+      AN::ApplyLayer(& layer, animations, boneCount, & arena, pose.data());
+      equalityFloatCheck((pose[2].position - halfway).norm(), 0, 1e-4);
+
+      // An additive layer at its clip's first key adds nothing
+      AnimLayer additive;
+      additive.mode = LAYER_ADDITIVE;
+      additive.weight = 1;
+      AN::FadeClip(& additive, 0, 1, 0);
+
+      pose = target;
+      AN::ApplyLayer(& additive, animations, boneCount, & arena, pose.data());
+      for (unsigned int j = 0; j < boneCount; j++) {
+         equalityFloatCheck((pose[j].position - target[j].position).norm(), 0, 1e-4);
+         equalityFloatCheck(fabs(pose[j].rotation.coeffs().dot(target[j].rotation.coeffs())), 1, 1e-5);
+      }
+
+      // Reset hands the same memory out again
+      arena.reset();
+      LocalTransform * first = arena.take(boneCount);
+      arena.reset();
+      boolCheck(arena.take(boneCount) == first, true);
+   }
+
+   {
+      // A single key is held for the whole animation
+      Animation still;
+      still.fps = fps;
+      still.keyCount = 1;
+      still.duration = 0;
+      still.animBones = std::vector<AnimBone>(1);
+      still.animBones[0].keys = & anim.ownedKeys[0];
+      AN::BuildTracks(& still, 1);
+
+      Mmath::Matrix3x4f sampled;
+      AN::SampleAnimation(still, 0.5f, & sampled);
+      Eigen::Matrix4f expected = Mmath::TransformationMatrix(anim.ownedKeys[0].position,
+         Eigen::Quaternionf(anim.ownedKeys[0].rotation), anim.ownedKeys[0].scale);
+      equalityFloatCheck(maxDifference(Mmath::ExpandAffine(sampled), expected), 0, 1e-4);
+   }
+
+   {
+      // Unevenly spaced keys, as key reduced clips and some exporters write
+      // them, sampled forward with a cursor and then seeking back without
+      float keyTimes[] = {0, 0.05f, 0.5f, 0.6f, 1.5f};
+      Animation uneven;
+      uneven.fps = fps;
+      uneven.keyCount = keyCount;
+      uneven.duration = keyTimes[keyCount-1];
+      uneven.ownedKeys = anim.ownedKeys;
+      uneven.animBones = std::vector<AnimBone>(boneCount);
+      for (unsigned int j = 0; j < boneCount; j++) {
+         uneven.animBones[j].keys = & uneven.ownedKeys[j * keyCount];
+         for (unsigned int k = 0; k < keyCount; k++)
+            uneven.ownedKeys[j * keyCount + k].time = keyTimes[k];
+      }
+      AN::BuildTracks(& uneven, boneCount);
+
+      float times[] = {0, 0.02f, 0.05f, 0.3f, 0.55f, 0.61f, 1.4f, 2.0f, 0.04f, 0.7f};
+      std::vector<Mmath::Matrix3x4f> sampled = std::vector<Mmath::Matrix3x4f>(boneCount);
+      KeyCursor cursor;
+      float worst = 0;
+
+      for (int t = 0; t < sizeof(times) / sizeof(float); t++) {
+         AN::SampleAnimation(uneven, times[t], sampled.data(), & cursor);
+
+         int early = 0;
+         while (early < keyCount-2 && keyTimes[early+1] <= times[t])
+            early++;
+         equalityIntCheck(cursor.keys[0], early);
+
+         for (unsigned int j = 0; j < boneCount; j++) {
+            const Key * keys = uneven.animBones[j].keys;
+            Eigen::Matrix4f expected = referenceTransform(keys[early], keys[early+1], times[t]);
+            worst = fmax(worst, maxDifference(Mmath::ExpandAffine(sampled[j]), expected));
+
+            Mmath::Matrix3x4f searched = AN::SampleBone(uneven, j, times[t]);
+            equalityFloatCheck((searched - sampled[j]).cwiseAbs().maxCoeff(), 0, 1e-5);
+         }
+      }
+      equalityFloatCheck(worst, 0, 1e-3);
+
+      // A cursor from somewhere else entirely is only a bad hint
+      float sortedTimes[] = {0, 1, 2, 3, 4, 5, 6, 7};
+      equalityIntCheck(AC::FindKey(sortedTimes, 8, 5.5f, 4), 5);
+      equalityIntCheck(AC::FindKey(sortedTimes, 8, 5.5f, 100), 5);
+      equalityIntCheck(AC::FindKey(sortedTimes, 8, 0.5f, 6), 0);
+      equalityIntCheck(AC::FindKey(sortedTimes, 8, 9.0f, 0), 6);
+      equalityIntCheck(AC::FindKey(sortedTimes, 8, -1.0f, 3), 0);
+      equalityIntCheck(AC::FindKey(sortedTimes, 1, 3.0f, 3), 0);
+   }
+
+   {
+      // Times wrap however far past the end they are moved
+      equalityFloatCheck(AN::WrapTime(0.5f, 1), 0.5, 1e-6);
+      equalityFloatCheck(AN::WrapTime(1, 1), 1, 1e-6);
+      equalityFloatCheck(AN::WrapTime(7.25f, 1), 0.25, 1e-5);
+      equalityFloatCheck(AN::WrapTime(3, 0), 3, 1e-6);
+
+      // Root motion over one long step adds up to the same as many short ones
+      Eigen::Vector3f stepped = Eigen::Vector3f(0, 0, 0);
+      float time = 0.6f;
+      for (int i = 0; i < 23; i++) {
+         stepped += AN::TrackDisplacement(anim, 0, time, 0.1f);
+         time = AN::WrapTime(time + 0.1f, anim.duration);
+      }
+      Eigen::Vector3f jumped = AN::TrackDisplacement(anim, 0, 0.6f, 2.3f);
+      equalityFloatCheck((stepped - jumped).norm(), 0, 1e-4);
+
+      Eigen::Vector3f pass = anim.animBones[0].keys[keyCount-1].position - anim.animBones[0].keys[0].position;
+      equalityFloatCheck((AN::TrackDisplacement(anim, 0, 0, 3) - 3 * pass).norm(), 0, 1e-4);
+   }
+}
@@ -0,0 +1,138 @@
+#include "test.h"
+#include "articulated.h"
+
+#include <math.h>
+#include <vector>
+
+static Bone massBone(int parent, Eigen::Vector3f offset, float mass, Eigen::Vector3f com) {
+   Bone bone;
+   bone.parentIndex = parent;
+   bone.parentOffset = Mmath::TranslationMatrix(offset);
+   bone.invBonePose = Eigen::Matrix4f::Identity();
+   bone.mass = mass;
+   bone.com = com;
+   bone.inertiaTensor = 0.01f * mass * Eigen::Matrix3f::Identity();
+   bone.invInertiaTensor = bone.inertiaTensor.inverse();
+   return bone;
+}
+
+static void addHinge(Bone * bone, Eigen::Vector3f axis, float minAngle, float maxAngle) {
+   IKJoint joint;
+   joint.axis = axis;
+   joint.minAngle = minAngle;
+   joint.maxAngle = maxAngle;
+   bone->joints.push_back(joint);
+}
+
+static std::vector<BoneStep> chainOrder(int boneCount) {
+   std::vector<BoneStep> order;
+   for (int i = 0; i < boneCount; i++) {
+      BoneStep step = {i, i - 1};
+      order.push_back(step);
+   }
+   return order;
+}
+
+void testArticulated() {
+   {
+      // A pendulum, two kilograms a meter out from a hinge about z
+      std::vector<Bone> bones;
+      bones.push_back(massBone(-1, Eigen::Vector3f(0, 0, 0), 1, Eigen::Vector3f(0, 0, 0)));
+      bones.push_back(massBone(0, Eigen::Vector3f(0, 0, 0), 2, Eigen::Vector3f(1, 0, 0)));
+      addHinge(& bones[1], Eigen::Vector3f(0, 0, 1), -M_PI, M_PI);
+
+      ArticulatedBody body = ArticulatedBody(bones, chainOrder(2));
+      body.fixedRoot = true;
+      equalityIntCheck(body.linkCount(), 2);
+      equalityIntCheck(body.linkOf(1, 0), 1);
+      equalityIntCheck(body.linkOf(0, 0), -1);
+
+      // Held out level, gravity's torque over the inertia about the hinge
+      body.forwardDynamics();
+      float inertia = 0.02f + 2 * 1 * 1 + ARTICULATED_ARMATURE;
+      equalityFloatCheck(body.accelerations[1], -2 * 9.8f / inertia, 1e-3);
+
+      // Inverse dynamics says no torque was needed for that
+      std::vector<float> torques;
+      SpatialVector rootForce;
+      body.inverseDynamics(torques, rootForce);
+      equalityFloatCheck(torques[1], 0, 1e-3);
+
+      // A swing without friction keeps its energy
+      body.damping = 0;
+      body.angles[1] = -0.5f;
+      float energy = body.energy();
+      for (int i = 0; i < 2000; i++)
+         body.step(0.001f);
+      equalityFloatCheck(body.energy(), energy, 0.01f * fabs(energy));
+
+      // Limits hold the swing in
+      bones[1].joints[0].minAngle = -0.5f;
+      bones[1].joints[0].maxAngle = 0.5f;
+      ArticulatedBody limited = ArticulatedBody(bones, chainOrder(2));
+      limited.fixedRoot = true;
+      bool inside = true;
+      for (int i = 0; i < 1000; i++) {
+         limited.step(0.001f);
+         inside = inside && limited.angles[1] >= -0.5f && limited.angles[1] <= 0.5f;
+      }
+      boolCheck(inside, true);
+      equalityFloatCheck(limited.angles[1], -0.5f, 1e-6);
+   }
+
+   {
+      // A free chain whose middle bone turns about two axes and whose last bone is welded on
+      std::vector<Bone> bones;
+      bones.push_back(massBone(-1, Eigen::Vector3f(0, 1, 0), 3, Eigen::Vector3f(0, 0.1f, 0)));
+      bones.push_back(massBone(0, Eigen::Vector3f(0.5f, 0, 0), 1, Eigen::Vector3f(0.4f, 0, 0)));
+      bones.push_back(massBone(1, Eigen::Vector3f(0.8f, 0, 0.1f), 0.5f, Eigen::Vector3f(0.3f, 0, 0)));
+      bones.push_back(massBone(2, Eigen::Vector3f(0.6f, 0, 0), 0.2f, Eigen::Vector3f(0.1f, 0, 0)));
+      addHinge(& bones[1], Eigen::Vector3f(0, 0, 1), -M_PI, M_PI);
+      addHinge(& bones[2], Eigen::Vector3f(0, 1, 0), -M_PI, M_PI);
+      addHinge(& bones[2], Eigen::Vector3f(1, 0, 1), -M_PI, M_PI);
+
+      ArticulatedBody body = ArticulatedBody(bones, chainOrder(4));
+      equalityIntCheck(body.linkCount(), 4);
+      equalityIntCheck(body.linkOf(2, 1), 3);
+      equalityIntCheck(body.linkOf(3, 0), -1);
+
+      // At rest it all falls together, nothing bends
+      body.forwardDynamics();
+      equalityFloatCheck((Eigen::Vector3f(body.rootAcceleration.tail<3>()) - body.gravity).norm(), 0, 1e-4);
+      equalityFloatCheck(body.rootAcceleration.head<3>().norm(), 0, 1e-4);
+      for (int i = 1; i < 4; i++)
+         equalityFloatCheck(body.accelerations[i], 0, 1e-4);
+
+      // Moving, pushed and driven, inverse dynamics gives back the torques that
+      // made forward dynamics' accelerations, with nothing holding the root
+      body.rootRotation = Eigen::Quaternionf(Eigen::AngleAxisf(0.3f, Eigen::Vector3f(1, 1, 0).normalized()));
+      body.rootVelocity << 0.2f, -0.4f, 0.1f, 1, 0.5f, -0.3f;
+      const float angles[] = {0, 0.4f, -0.7f, 1.1f};
+      const float velocities[] = {0, 1.5f, -0.5f, 2};
+      const float driven[] = {0, 0.8f, -0.3f, 0.1f};
+      for (int i = 1; i < 4; i++) {
+         body.angles[i] = angles[i];
+         body.velocities[i] = velocities[i];
+         body.torques[i] = driven[i];
+      }
+      body.applyForce(3, Eigen::Vector3f(2, 0, 1));
+      body.applyTorque(1, Eigen::Vector3f(0, 0.5f, 0));
+
+      body.forwardDynamics();
+      std::vector<float> torques;
+      SpatialVector rootForce;
+      body.inverseDynamics(torques, rootForce);
+      for (int i = 1; i < 4; i++)
+         equalityFloatCheck(torques[i], driven[i], 1e-3);
+      equalityFloatCheck(rootForce.norm(), 0, 1e-3);
+
+      // Held in place, the root needs the force that stops it falling
+      body.fixedRoot = true;
+      body.rootVelocity = SpatialVector::Zero();
+      body.forwardDynamics();
+      body.inverseDynamics(torques, rootForce);
+      for (int i = 1; i < 4; i++)
+         equalityFloatCheck(torques[i], driven[i], 1e-3);
+      boolCheck(rootForce.norm() > 1, true);
+   }
+}
@@ -0,0 +1,117 @@
+#include "test.h"
+#include "thread_pool.h"
+#include "asset_loader.h"
+
+#include <atomic>
+#include <stdexcept>
+
+// Stands in for a Model or Texture, whose destructor has to run on the GL thread
+typedef struct GLOwner {
+   std::thread::id * freedOn;
+   ~GLOwner() { *freedOn = std::this_thread::get_id(); }
+} GLOwner;
+
+void testAssetLoader() {
+   {
+      // Every job runs exactly once, and its future is ready after it has
+      ThreadPool pool(4);
+      equalityIntCheck(pool.threadCount(), 4);
+
+      std::atomic<int> sum(0);
+      std::vector<std::future<void> > done;
+      for (int i = 1; i <= 100; i++)
+         done.push_back(pool.submit([&sum, i]() { sum += i; }));
+
+      for (int i = 0; i < done.size(); i++)
+         done[i].wait();
+      equalityIntCheck(sum, 5050);
+   }
+
+   {
+      // Destroying the pool still runs the jobs left in the queue
+      std::atomic<int> count(0);
+      {
+         ThreadPool pool(1);
+         for (int i = 0; i < 20; i++)
+            pool.submit([&count]() { count++; });
+      }
+      equalityIntCheck(count, 20);
+   }
+
+   {
+      // Decodes run on the workers, uploads only on the thread calling into the loader
+      AssetLoader loader(3);
+      std::thread::id self = std::this_thread::get_id();
+      std::atomic<int> decodedOffThread(0);
+      std::vector<int> uploaded;
+      std::vector<AssetHandle> handles;
+
+      for (int i = 0; i < 8; i++)
+         handles.push_back(loader.submit(
+            [&decodedOffThread, self]() {
+               if (std::this_thread::get_id() != self)
+                  decodedOffThread++;
+            },
+            [&uploaded, self, i]() {
+               if (std::this_thread::get_id() == self)
+                  uploaded.push_back(i);
+            }));
+
+      loader.wait(handles[7]);
+      boolCheck(AssetLoader::isReady(handles[7]), true);
+
+      loader.finish();
+      equalityIntCheck(loader.pendingCount(), 0);
+      equalityIntCheck(decodedOffThread, 8);
+      equalityIntCheck(uploaded.size(), 8);
+      for (int i = 0; i < handles.size(); i++)
+         boolCheck(AssetLoader::isReady(handles[i]), true);
+   }
+
+   {
+      // When the closures hold the last reference, it's let go of on the loader's thread
+      AssetLoader loader(2);
+      std::thread::id freedOn;
+      {
+         std::shared_ptr<GLOwner> owner = std::make_shared<GLOwner>();
+         owner->freedOn = & freedOn;
+         loader.submit([owner]() {}, [owner]() {});
+      }
+      loader.finish();
+      boolCheck(freedOn == std::this_thread::get_id(), true);
+   }
+
+   {
+      // A zero budget still makes progress one upload per frame
+      AssetLoader loader(2);
+      std::vector<AssetHandle> handles;
+      for (int i = 0; i < 3; i++)
+         handles.push_back(loader.submit([]() {}, []() {}));
+
+      unsigned int uploads = 0;
+      while (loader.pendingCount() > 0) {
+         unsigned int ran = loader.update(0);
+         boolCheck(ran <= 1, true);
+         uploads += ran;
+      }
+      equalityIntCheck(uploads, 3);
+   }
+
+   {
+      // A decode that throws skips its upload and hands the error to the handle
+      AssetLoader loader(1);
+      bool uploadRan = false;
+      AssetHandle handle = loader.submit([]() { throw std::runtime_error("bad file"); },
+                                         [&uploadRan]() { uploadRan = true; });
+      loader.wait(handle);
+
+      bool threw = false;
+      try {
+         handle.get();
+      } catch (const std::runtime_error&) {
+         threw = true;
+      }
+      boolCheck(threw, true);
+      boolCheck(uploadRan, false);
+   }
+}
@@ -0,0 +1,134 @@
+#include "test.h"
+#include "ctex.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+static void fillBlock(unsigned char block[64], unsigned char r, unsigned char g, unsigned char b) {
+   for (int i = 0; i < 16; i++) {
+      block[4*i] = r;
+      block[4*i+1] = g;
+      block[4*i+2] = b;
+      block[4*i+3] = 255;
+   }
+}
+
+void testCTEX() {
+   {
+      // A flat color that 565 can hold exactly comes back exactly
+      unsigned char block[64], out[64], bc[8];
+      fillBlock(block, 255, 0, 0);
+      TX::EncodeBC1(block, bc);
+      TX::DecodeBC1(bc, out);
+      for (int i = 0; i < 16; i++) {
+         equalityIntCheck(out[4*i], 255);
+         equalityIntCheck(out[4*i+1], 0);
+         equalityIntCheck(out[4*i+2], 0);
+         equalityIntCheck(out[4*i+3], 255);
+      }
+   }
+
+   {
+      // A grey ramp over 4 palette entries is off by at most half their spacing
+      unsigned char block[64], out[64], bc[8];
+      fillBlock(block, 0, 0, 0);
+      for (int i = 0; i < 16; i++)
+         block[4*i] = block[4*i+1] = block[4*i+2] = 16 * i;
+
+      TX::EncodeBC1(block, bc);
+      TX::DecodeBC1(bc, out);
+
+      int worst = 0;
+      for (int i = 0; i < 64; i++)
+         if (i % 4 != 3)
+            worst = std::max(worst, abs(out[i] - block[i]));
+      boolCheck(worst <= 240 / 3 / 2, true);
+   }
+
+   {
+      // Eight evenly spaced values are exactly the BC4 palette
+      unsigned char block[64] = {0}, out[64] = {0}, bc[8];
+      for (int i = 0; i < 16; i++)
+         block[4*i + 1] = 7 * 20 - 20 * (i % 8);
+
+      TX::EncodeBC4(block, 1, bc);
+      TX::DecodeBC4(bc, 1, out);
+      for (int i = 0; i < 16; i++)
+         equalityIntCheck(out[4*i + 1], block[4*i + 1]);
+   }
+
+   {
+      // Every mip is baked down to 1x1, non power of two sizes included
+      const unsigned int width = 12, height = 5;
+      std::vector<unsigned char> rgba(4 * width * height);
+      for (unsigned int i = 0; i < width * height; i++) {
+         rgba[4*i] = 128;
+         rgba[4*i+1] = 128;
+         rgba[4*i+2] = 255;
+         rgba[4*i+3] = 255;
+      }
+
+      TX::Format format;
+      std::vector<TX::Level> levels;
+      std::vector<unsigned char> data;
+      TX::Bake(rgba.data(), width, height, TX::NORMAL, format, levels, data);
+
+      equalityIntCheck(format, TX::BC5);
+      equalityIntCheck(levels.size(), 4);
+      equalityIntCheck(levels[1].width, 6);
+      equalityIntCheck(levels[1].height, 2);
+      equalityIntCheck(levels[3].width, 1);
+      equalityIntCheck(levels[3].height, 1);
+      equalityIntCheck(levels[0].size, 16 * 3 * 2);
+      for (unsigned int i = 0; i < levels.size(); i++)
+         equalityIntCheck(levels[i].offset % CTEX_ALIGNMENT, 0);
+
+      // A flat normal map stays flat on the smallest level
+      std::vector<unsigned char> decoded;
+      TX::DecodeLevel(format, levels[3], data.data(), decoded);
+      equalityIntCheck(decoded[0], 128);
+      equalityIntCheck(decoded[1], 128);
+
+      // Alpha turns a diffuse map into BC3
+      rgba[3] = 0;
+      TX::Bake(rgba.data(), width, height, TX::DIFFUSE, format, levels, data);
+      equalityIntCheck(format, TX::BC3);
+   }
+
+   {
+      // Written files parse back to the same levels, broken ones are refused
+      const char * path = "/tmp/mountaineer_test_texture.ctex";
+      std::vector<unsigned char> rgba(4 * 8 * 8, 200);
+
+      TX::Format format;
+      std::vector<TX::Level> levels;
+      std::vector<unsigned char> data;
+      TX::Bake(rgba.data(), 8, 8, TX::SPECULAR, format, levels, data);
+      boolCheck(TX::WriteFile(path, format, levels, data), true);
+
+      FILE * fp = fopen(path, "rb");
+      std::vector<unsigned char> file(4096);
+      file.resize(fread(file.data(), 1, file.size(), fp));
+      fclose(fp);
+      remove(path);
+
+      TX::Format readFormat;
+      std::vector<TX::Level> readLevels;
+      const unsigned char * readData;
+      const char * error;
+      boolCheck(TX::Parse(file.data(), file.size(), readFormat, readLevels, readData, error), true);
+      equalityIntCheck(readFormat, TX::BC4);
+      equalityIntCheck(readLevels.size(), levels.size());
+      for (unsigned int i = 0; i < levels.size(); i++) {
+         equalityIntCheck(readLevels[i].size, levels[i].size);
+         boolCheck(memcmp(readData + readLevels[i].offset, & data[levels[i].offset], levels[i].size) == 0, true);
+      }
+
+      boolCheck(TX::Parse(file.data(), file.size() - 1, readFormat, readLevels, readData, error), false);
+      file[0] = 'X';
+      boolCheck(TX::Parse(file.data(), file.size(), readFormat, readLevels, readData, error), false);
+   }
+}
@@ -0,0 +1,87 @@
+#include "test.h"
+#include "ik_dls.h"
+
+#include <math.h>
+#include <vector>
+
+static Bone hingeBone(Eigen::Vector3f offset, bool hasJoint, float minAngle, float maxAngle) {
+   Bone bone;
+   bone.parentOffset = Mmath::TranslationMatrix(offset);
+   if (hasJoint) {
+      IKJoint joint;
+      joint.axis = Eigen::Vector3f(0, 0, 1);
+      joint.minAngle = minAngle;
+      joint.maxAngle = maxAngle;
+      bone.joints.push_back(joint);
+   }
+   return bone;
+}
+
+void testIK() {
+   // A two hinge arm in the xy plane, each segment a unit long
+   std::vector<Bone> bones;
+   bones.push_back(hingeBone(Eigen::Vector3f(0, 0, 0), true, -M_PI, M_PI));
+   bones.push_back(hingeBone(Eigen::Vector3f(1, 0, 0), true, -M_PI, M_PI));
+   bones.push_back(hingeBone(Eigen::Vector3f(1, 0, 0), false, 0, 0));
+
+   std::vector<int> boneIndices;
+   for (int i = 0; i < 3; i++)
+      boneIndices.push_back(i);
+
+   double values[2] = {0, 0};
+   std::vector<double *> angles;
+   angles.push_back(& values[0]);
+   angles.push_back(& values[1]);
+   Eigen::Matrix4f baseM = Eigen::Matrix4f::Identity();
+
+   {
+      // Straight out it ends two along x
+      Eigen::Vector3f end = IK::EndEffector(bones, boneIndices, angles, baseM, NULL);
+      equalityFloatCheck((end - Eigen::Vector3f(2, 0, 0)).norm(), 0, 1e-6);
+   }
+
+   {
+      // A reachable goal is reached within a few frames, and stays reached
+      Eigen::Vector3f goal = Eigen::Vector3f(1, 1, 0);
+      IKResult result;
+      for (int frame = 0; frame < 4; frame++)
+         result = IK::SolveDLS(bones, boneIndices, angles, baseM, goal, NULL);
+      boolCheck(result.settled, true);
+      equalityFloatCheck(result.error, 0, IK_DLS_TOLERANCE);
+
+      Eigen::Vector3f end = IK::EndEffector(bones, boneIndices, angles, baseM, NULL);
+      equalityFloatCheck((end - goal).norm(), 0, IK_DLS_TOLERANCE);
+
+      result = IK::SolveDLS(bones, boneIndices, angles, baseM, goal, NULL);
+      equalityIntCheck(result.iterations, 0);
+   }
+
+   {
+      // Angles are kept to the joints' limits, the arm gets as close as they allow
+      bones[1].joints[0].minAngle = 0;
+      bones[1].joints[0].maxAngle = 0.5f;
+      values[0] = values[1] = 0;
+
+      IKResult result;
+      for (int frame = 0; frame < 8; frame++)
+         result = IK::SolveDLS(bones, boneIndices, angles, baseM, Eigen::Vector3f(0, 0.5f, 0), NULL);
+      boolCheck(values[1] >= 0 && values[1] <= 0.5f + 1e-6, true);
+      boolCheck(result.error > 0.1f, true);
+   }
+
+   {
+      // A base limb moves its base to reach past the arm's length
+      values[0] = values[1] = 0;
+      Eigen::Vector3f basePosition = Eigen::Vector3f(0, 0, 0);
+      Eigen::Vector3f goal = Eigen::Vector3f(5, 0, 0);
+
+      IKResult result;
+      for (int frame = 0; frame < 8; frame++)
+         result = IK::SolveDLS(bones, boneIndices, angles, baseM, goal, & basePosition);
+      equalityFloatCheck(result.error, 0, IK_DLS_TOLERANCE);
+      boolCheck(basePosition(0) > 2.5f, true);
+
+      Eigen::Vector3f end = IK::EndEffector(bones, boneIndices, angles, baseM, & basePosition);
+      equalityFloatCheck((end - goal).norm(), 0, IK_DLS_TOLERANCE);
+   }
+}
@@ -0,0 +1,139 @@
+#include "test.h"
+#include "ik_scheduler.h"
+
+#include <math.h>
+#include <vector>
+
+// A spine with an arm out to each side, the arms' first two bones hinged about z
+static void buildTwoArms(Model * model) {
+   const int parents[] = {-1, 0, 1, 2, 3, 1, 5, 6};
+   const float offsets[] = {0, 0, 1, 1, 1, -1, -1, -1};
+   const bool hinged[] = {false, false, true, true, false, true, true, false};
+   const int boneCount = 8;
+
+   model->bones = std::vector<Bone>(boneCount);
+   for (int i = 0; i < boneCount; i++) {
+      Bone * bone = & model->bones[i];
+      bone->parentIndex = parents[i];
+      bone->invBonePose = Eigen::Matrix4f::Identity();
+      bone->parentOffset = Mmath::TranslationMatrix(i == 1 ? Eigen::Vector3f(0, 1, 0) : Eigen::Vector3f(offsets[i], 0, 0));
+      if (parents[i] >= 0)
+         model->bones[parents[i]].childIndices.push_back(i);
+
+      if (hinged[i]) {
+         IKJoint joint;
+         joint.axis = Eigen::Vector3f(0, 0, 1);
+         joint.minAngle = -M_PI;
+         joint.maxAngle = M_PI;
+         bone->joints.push_back(joint);
+      }
+   }
+   model->boneCount = boneCount;
+   model->boneRoot = 0;
+   model->flattenBoneTree();
+   model->hasBoneTree = true;
+}
+
+static std::vector<int> bones(int first, int count) {
+   std::vector<int> indices;
+   for (int i = 0; i < count; i++)
+      indices.push_back(first + i);
+   return indices;
+}
+
+static void addArms(IKEntity * entity) {
+   entity->addLimb(bones(2, 3), Eigen::Vector3f(0, 0, 0), false);
+   entity->addLimb(bones(5, 3), Eigen::Vector3f(0, 0, 0), false);
+   entity->setLimbMethod(0, IK_DAMPED_LEAST_SQUARES);
+   entity->setLimbMethod(1, IK_DAMPED_LEAST_SQUARES);
+   entity->animateWithIK();
+}
+
+void testIKScheduler() {
+   Model model;
+   buildTwoArms(& model);
+
+   {
+      // The arms don't touch each other's bones, so they're solved apart
+      IKEntity entity = IKEntity(Eigen::Vector3f(0, 0, 0), & model);
+      equalityIntCheck(entity.ikJobCount(), 0);
+      addArms(& entity);
+      equalityIntCheck(entity.ikJobCount(), 2);
+      equalityIntCheck(entity.ikJobRoots(0).size(), 1);
+      equalityIntCheck(entity.ikJobRoots(0)[0], 2);
+      equalityIntCheck(entity.ikJobRoots(1).size(), 1);
+      equalityIntCheck(entity.ikJobRoots(1)[0], 5);
+
+      // A group hanging off a bone the left arm turns waits for it
+      entity.addLimb(bones(3, 2), Eigen::Vector3f(0, 0, 0), false);
+      equalityIntCheck(entity.ikJobCount(), 2);
+      equalityIntCheck(entity.ikJobRoots(0).size(), 2);
+      equalityIntCheck(entity.ikJobRoots(0)[0], 2);
+      equalityIntCheck(entity.ikJobRoots(0)[1], 3);
+      equalityIntCheck(entity.ikJobRoots(1)[0], 5);
+
+      // A base limb moves the entity under every group, so they're all one job
+      entity.addLimb(bones(1, 4), Eigen::Vector3f(0, 0, 0), true);
+      equalityIntCheck(entity.ikJobCount(), 1);
+      const int together[] = {1, 2, 3, 5};
+      equalityIntCheck(entity.ikJobRoots(0).size(), 4);
+      for (int i = 0; i < 4; i++)
+         equalityIntCheck(entity.ikJobRoots(0)[i], together[i]);
+
+      entity.animateWithKeyframes();
+      equalityIntCheck(entity.ikJobCount(), 0);
+   }
+
+   {
+      // A crowd solved on a pool ends up where it does solved on one thread
+      const int crowdSize = 6;
+      ThreadPool pool(3);
+      IKScheduler pooled = IKScheduler(& pool);
+      IKScheduler serial = IKScheduler(NULL);
+      std::vector<IKEntity *> crowd, copies;
+
+      for (int i = 0; i < crowdSize; i++) {
+         Eigen::Vector3f position = Eigen::Vector3f(5 * i, 0, 0);
+         crowd.push_back(new IKEntity(position, & model));
+         copies.push_back(new IKEntity(position, & model));
+         addArms(crowd[i]);
+         addArms(copies[i]);
+
+         float reach = 1.2f + 0.1f * i;
+         Eigen::Vector3f left = position + Eigen::Vector3f(1 + reach, 1 + 0.8f, 0);
+         Eigen::Vector3f right = position + Eigen::Vector3f(-1 - reach, 1 - 0.8f, 0);
+         crowd[i]->setLimbGoal(0, left);
+         crowd[i]->setLimbGoal(1, right);
+         copies[i]->setLimbGoal(0, left);
+         copies[i]->setLimbGoal(1, right);
+
+         pooled.add(crowd[i]);
+         serial.add(copies[i]);
+      }
+
+      for (int frame = 0; frame < 20; frame++) {
+         pooled.solve();
+         serial.solve();
+      }
+      equalityIntCheck(pooled.jobCount(), 2 * crowdSize);
+
+      float worst = 0, apart = 0;
+      bool solved = true;
+      for (int i = 0; i < crowdSize; i++) {
+         for (int limb = 0; limb < 2; limb++) {
+            Eigen::Vector3f end = crowd[i]->limbEnd(limb);
+            worst = fmax(worst, (end - crowd[i]->ikLimbs[limb]->goal).norm());
+            apart = fmax(apart, (end - copies[i]->limbEnd(limb)).norm());
+         }
+         solved = solved && crowd[i]->ikSolved;
+      }
+      equalityFloatCheck(worst, 0, 1e-3);
+      equalityFloatCheck(apart, 0, 1e-6);
+      boolCheck(solved, true);
+
+      for (int i = 0; i < crowdSize; i++) {
+         delete crowd[i];
+         delete copies[i];
+      }
+   }
+}
@@ -1,5 +1,10 @@
 #include "test.h"
 #include "model.h"
+#include "ciab.h"
+#include "attachment_loader.h"
+
+#include <string.h>
+#include <stdio.h>
 
 using namespace Eigen;
 using namespace Geom;
@@ -76,4 +81,186 @@ void testModel() {
          boolCheck(isInside, false);
       }
    }
-}
\ No newline at end of file
+
+   {
+      // Test Mesh (two triangles sharing the edge 1-2)
+      Mesh mesh;
+      mesh.resize(4, 2);
+      mesh.positions[0] = Vector3f(  0, .5,0);
+      mesh.positions[1] = Vector3f(-.5,-.5,0);
+      mesh.positions[2] = Vector3f( .5,-.5,0);
+      mesh.positions[3] = Vector3f(  0,-1.5,0);
+      unsigned int indices[] = {0,1,2, 2,1,3};
+      mesh.indices.assign(indices, indices + 6);
+
+      // Test calculateFaceNormals and calculateVertexNormals
+      mesh.calculateFaceNormals();
+      mesh.calculateVertexNormals();
+      equalityFloatCheck(mesh.faceNormals[1](2), 1, 1e-5);
+      equalityFloatCheck(mesh.normals[3](2), 1, 1e-5);
+
+      // Test buildAdjacency
+      mesh.buildAdjacency();
+      boolCheck(mesh.hasAdjacency(), true);
+      equalityIntCheck(mesh.vertex(0).faceCount(), 1);
+      equalityIntCheck(mesh.vertex(1).faceCount(), 2);
+      equalityIntCheck(mesh.vertex(1).neighborCount(), 3);
+      equalityIntCheck(mesh.vertex(3).neighborCount(), 2);
+      boolCheck(mesh.vertex(0).hasNeighbor(3), false);
+      boolCheck(mesh.vertex(2).hasNeighbor(3), true);
+
+      // Test MeshFace intersectRay and pointCheckInside
+      MeshFace f = mesh.face(0);
+      Rayf ray(Vector3f(0,0,5), Vector3f(0,0,-1));
+      Vector3f pnt = f.intersectRay(ray);
+      equalityFloatCheck(pnt(2), 0, 1e-5);
+      boolCheck(f.pointCheckInside(pnt), true);
+      boolCheck(mesh.face(1).pointCheckInside(pnt), false);
+   }
+
+   {
+      // Test CIABView (one triangle with positions and indices)
+      unsigned int header[] = {3, 1, 0, 0};
+      float positions[] = {0,.5,0, -.5,-.5,0, .5,-.5,0};
+      unsigned int indices[] = {0,1,2};
+      unsigned char buf[sizeof(header) + 1 + sizeof(positions) + 1 + sizeof(indices)];
+      unsigned char * p = buf;
+      memcpy(p, header, sizeof(header)); p += sizeof(header);
+      *p++ = POSITIONS;
+      memcpy(p, positions, sizeof(positions)); p += sizeof(positions);
+      *p++ = INDICES;
+      memcpy(p, indices, sizeof(indices));
+
+      CIABView view;
+      boolCheck(view.parse(buf, sizeof(buf)), true);
+      boolCheck(view.hasField(POSITIONS), true);
+      boolCheck(view.hasField(NORMALS), false);
+      equalityIntCheck(view.vertexCount, 3);
+      equalityFloatCheck(view.positions[1](0), -.5, 1e-5);
+
+      // Truncated fields and out of range indices are rejected
+      CIABView truncated;
+      boolCheck(truncated.parse(buf, sizeof(buf) - 1), false);
+
+      buf[sizeof(buf) - sizeof(unsigned int)] = 3;
+      CIABView badIndex;
+      boolCheck(badIndex.parse(buf, sizeof(buf)), false);
+   }
+
+   {
+      // Test CIABView on a ciab2 file (one triangle in a vertex block, one
+      // bone with a two key quantized animation)
+      unsigned int stride = CIABVertexStride(1);
+      equalityIntCheck(stride, 84);
+
+      unsigned char buf[512];
+      memset(buf, 0, sizeof(buf));
+      unsigned int header[] = {CIAB2_VERSION, 3, 1, 1, 1, (1 << (POSITIONS-1)) | (1 << (BONE_WEIGHTS-1)), 3};
+      memcpy(buf, CIAB2_MAGIC, 4);
+      memcpy(buf + 4, header, sizeof(header));
+
+      // Directory: vertex block at 128, indices at 384, keyframes at 400
+      unsigned int types[] = {VERTEX_BLOCK, INDICES, KEYFRAMES_Q16};
+      unsigned int formats[] = {1, 0, 0};
+      unsigned long long offsets[] = {128, 384, 400};
+      unsigned long long sizes[] = {3 * stride, 12, 112};
+      for (int i = 0; i < 3; i++) {
+         unsigned char * entry = buf + 32 + 24 * i;
+         memcpy(entry, & types[i], 4);
+         memcpy(entry + 4, & formats[i], 4);
+         memcpy(entry + 8, & offsets[i], 8);
+         memcpy(entry + 16, & sizes[i], 8);
+      }
+
+      float pos[] = {.5,-.5,0};
+      unsigned short weight = 65535;
+      memcpy(buf + 128 + stride + VB_POSITION, pos, sizeof(pos));
+      memcpy(buf + 128 + stride + VB_BONE_WEIGHTS, & weight, sizeof(weight));
+
+      unsigned int indices[] = {0,1,2};
+      memcpy(buf + 384, indices, sizeof(indices));
+
+      // fps 2, two keys; position range 1 to 3 along x, unit scale
+      unsigned int animHeader[] = {2, 2, 0, 0};
+      float ranges[] = {1,0,0, 2/65535.0f,0,0, 1,1,1, 0,0,0};
+      unsigned short keys[] = {0,0,0, 0,0,0,32767, 0,0,0,
+                               65535,0,0, 0,32767,0,0, 0,0,0};
+      memcpy(buf + 400, animHeader, sizeof(animHeader));
+      memcpy(buf + 416, ranges, sizeof(ranges));
+      memcpy(buf + 464, keys, sizeof(keys));
+
+      CIABView view;
+      boolCheck(view.parse(buf, sizeof(buf)), true);
+      equalityIntCheck(view.version, 2);
+      equalityIntCheck(view.vertexStride, 84);
+      boolCheck(view.hasField(BONE_WEIGHTS), true);
+      boolCheck(view.hasField(NORMALS), false);
+      boolCheck(view.hasField(KEYFRAMES_Q16), true);
+      equalityIntCheck(view.animations.size(), 1);
+
+      // Test decodeKeys
+      Key decoded[2];
+      view.decodeKeys(view.animations[0], decoded);
+      equalityFloatCheck(decoded[0].position(0), 1, 1e-4);
+      equalityFloatCheck(decoded[1].position(0), 3, 1e-4);
+      equalityFloatCheck(decoded[1].time, .5, 1e-5);
+      equalityFloatCheck(decoded[0].rotation.w(), 1, 1e-4);
+      equalityFloatCheck(decoded[1].rotation.y(), 1, 1e-4);
+      equalityFloatCheck(decoded[1].scale(2), 1, 1e-5);
+
+      // Misaligned sections are rejected
+      offsets[1] = 388;
+      memcpy(buf + 32 + 24 + 8, & offsets[1], 8);
+      CIABView misaligned;
+      boolCheck(misaligned.parse(buf, sizeof(buf)), false);
+   }
+
+   {
+      // Test PIN parsing and its binary cache
+      const char * path = "/tmp/mountaineer_test_skel.txt";
+      std::string cachePath = std::string(path) + ".pinc";
+      remove(cachePath.c_str());
+
+      FILE * fp = fopen(path, "w");
+      fprintf(fp, "# frameCount boneCount\n2 1\n0 0 0 1 -1.5 2e-3 .25\n");
+      fprintf(fp, "\n# comment\n  0.5 -0.5 0.5 0.5 3 4 5\n0.1 0.2 0.3 0.4 1E2 -7 0\n");
+      fclose(fp);
+
+      for (int pass = 0; pass < 2; pass++) {
+         std::vector<float> frames, bindPose;
+         int numBones = 0;
+         PIN_loadSkeleton(frames, bindPose, numBones, path);
+
+         equalityIntCheck(numBones, 1);
+         equalityIntCheck(bindPose.size(), 7);
+         equalityIntCheck(frames.size(), 14);
+         equalityFloatCheck(bindPose[4], -1.5, 1e-6);
+         equalityFloatCheck(bindPose[5], 0.002, 1e-9);
+         equalityFloatCheck(bindPose[6], 0.25, 1e-6);
+         equalityFloatCheck(frames[1], -0.5, 1e-6);
+         equalityFloatCheck(frames[11], 100, 1e-6);
+         boolCheck(frames[7] == 0.1f && frames[9] == 0.3f, true);
+
+         // The first pass leaves a cache behind for the second to read
+         FILE * cache = fopen(cachePath.c_str(), "rb");
+         boolCheck(cache != NULL, true);
+         if (cache)
+            fclose(cache);
+      }
+
+      // A changed source is parsed again instead of read from the stale cache
+      fp = fopen(path, "w");
+      fprintf(fp, "1 2\n1 2 3\n4 5\n");
+      fclose(fp);
+
+      std::vector<float> frames, bindPose;
+      int numBones = 0;
+      PIN_loadSkeleton(frames, bindPose, numBones, path);
+      equalityIntCheck(numBones, 2);
+      equalityIntCheck(bindPose.size(), 3);
+      equalityIntCheck(frames.size(), 2);
+
+      remove(path);
+      remove(cachePath.c_str());
+   }
+}
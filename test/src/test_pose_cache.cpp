@@ -0,0 +1,63 @@
+#include "test.h"
+#include "pose_cache.h"
+
+void testPoseCache() {
+   // Only the model's address goes into a key, so these stand in for two models
+   int models[2];
+   const Model * modelA = (const Model *)(& models[0]);
+   const Model * modelB = (const Model *)(& models[1]);
+
+   {
+      // Times within half a step of each other share a key, sampled on the step
+      PoseKey key = PoseCache::Key(modelA, 0, 0.5f, POSE_BONE_TREE);
+      boolCheck(key == PoseCache::Key(modelA, 0, 0.5f + 0.4f / POSE_CACHE_RATE, POSE_BONE_TREE), true);
+      boolCheck(key == PoseCache::Key(modelA, 0, 0.5f - 0.4f / POSE_CACHE_RATE, POSE_BONE_TREE), true);
+      boolCheck(key == PoseCache::Key(modelA, 0, 0.5f + 1.0f / POSE_CACHE_RATE, POSE_BONE_TREE), false);
+      equalityFloatCheck(PoseCache::KeyTime(key), 0.5f, 1e-6);
+
+      // Anything else that changes the pose changes the key
+      boolCheck(key == PoseCache::Key(modelB, 0, 0.5f, POSE_BONE_TREE), false);
+      boolCheck(key == PoseCache::Key(modelA, 1, 0.5f, POSE_BONE_TREE), false);
+      boolCheck(key == PoseCache::Key(modelA, 0, 0.5f, POSE_UNCHAINED), false);
+   }
+
+   {
+      // The first to ask in a frame evaluates, everyone after shares it
+      PoseCache cache;
+      PoseKey key = PoseCache::Key(modelA, 0, 0.25f, POSE_BONE_TREE);
+      bool evaluate;
+
+      cache.beginFrame();
+      PaletteHandle first = cache.acquire(key, evaluate);
+      boolCheck(evaluate, true);
+      for (int i = 0; i < 9; i++) {
+         boolCheck(cache.acquire(key, evaluate) == first, true);
+         boolCheck(evaluate, false);
+      }
+      equalityIntCheck(cache.evaluated, 1);
+      equalityIntCheck(cache.shared, 9);
+      unsigned int version = first->version;
+      boolCheck(version != 0, true);
+
+      PaletteHandle other = cache.acquire(PoseCache::Key(modelB, 0, 0.25f, POSE_BONE_TREE), evaluate);
+      boolCheck(evaluate, true);
+      boolCheck(other != first, true);
+      boolCheck(other->version != version, true);
+      equalityIntCheck(cache.size(), 2);
+
+      // Next frame the same palette is evaluated again, under a new version
+      cache.beginFrame();
+      boolCheck(cache.acquire(key, evaluate) == first, true);
+      boolCheck(evaluate, true);
+      boolCheck(first->version != version, true);
+      equalityIntCheck(cache.evaluated, 1);
+      equalityIntCheck(cache.shared, 0);
+
+      // Poses nobody asked for last frame are dropped, but whoever holds one keeps it
+      cache.beginFrame();
+      equalityIntCheck(cache.size(), 1);
+      cache.beginFrame();
+      equalityIntCheck(cache.size(), 0);
+      equalityIntCheck(other.use_count(), 1);
+   }
+}
@@ -0,0 +1,101 @@
+#include "test.h"
+#include "model.h"
+#include "progressive.h"
+
+#include <algorithm>
+
+using namespace Eigen;
+
+void testProgressive() {
+   {
+      // A 4x4 vertex grid of 18 faces with uneven spacing, so the collapses
+      // happen in a well defined order
+      const int side = 4;
+      std::vector<Vector3f> positions;
+      std::vector<unsigned int> indices;
+
+      for (int y = 0; y < side; y++)
+         for (int x = 0; x < side; x++)
+            positions.push_back(Vector3f(x + 0.1f * y, y * (1 + 0.05f * x), 0));
+
+      for (int y = 0; y < side-1; y++)
+         for (int x = 0; x < side-1; x++) {
+            unsigned int a = y*side + x, b = a + 1, c = a + side, d = c + 1;
+            unsigned int quad[6] = {a, b, d, a, d, c};
+            indices.insert(indices.end(), quad, quad + 6);
+         }
+
+      std::vector<unsigned int> order, faces;
+      std::vector<PM::VertexSplit> splits;
+      PM::BuildProgressiveMesh(positions, indices, order, splits, faces);
+
+      equalityIntCheck(order.size(), side*side);
+      equalityIntCheck(splits.size(), side*side);
+      equalityIntCheck(faces.size(), indices.size());
+
+      // One connected piece collapses down to a single vertex with no faces
+      equalityIntCheck(splits[0].baseVertex, 0);
+      equalityIntCheck(splits[0].newFaces.size(), 0);
+
+      // Every vertex shows up once in the order, and splits only refer back
+      std::vector<bool> seen = std::vector<bool>(order.size(), false);
+      for (unsigned int i = 0; i < order.size(); i++) {
+         seen[order[i]] = true;
+         boolCheck(splits[i].baseVertex <= i, true);
+      }
+      equalityIntCheck(std::count(seen.begin(), seen.end(), true), side*side);
+
+      // Fully refined, the faces are the original faces with renamed vertices
+      std::vector<std::vector<unsigned int> > original, refined;
+      for (unsigned int i = 0; i < indices.size(); i += NUM_FACE_EDGES) {
+         std::vector<unsigned int> a, b;
+         for (int j = 0; j < NUM_FACE_EDGES; j++) {
+            a.push_back(indices[i+j]);
+            b.push_back(order[faces[i+j]]);
+         }
+         // Same winding, maybe a different starting corner
+         std::rotate(a.begin(), std::min_element(a.begin(), a.end()), a.end());
+         std::rotate(b.begin(), std::min_element(b.begin(), b.end()), b.end());
+         original.push_back(a);
+         refined.push_back(b);
+      }
+      std::sort(original.begin(), original.end());
+      std::sort(refined.begin(), refined.end());
+      boolCheck(original == refined, true);
+
+      // Stream the splits into a runtime mesh and move between levels of detail
+      ProgressiveMesh pm = ProgressiveMesh(order.size(), faces.size() / NUM_FACE_EDGES);
+      for (unsigned int i = 0; i < 6; i++)
+         boolCheck(pm.addSplit(splits[i]), true);
+
+      pm.setVertexCount(side*side);
+      equalityIntCheck(pm.activeVertices, 6);
+      equalityIntCheck(pm.targetVertices, side*side);
+
+      for (unsigned int i = 6; i < splits.size(); i++)
+         pm.addSplit(splits[i]);
+      pm.refresh();
+      equalityIntCheck(pm.activeVertices, side*side);
+      equalityIntCheck(pm.activeFaces, faces.size() / NUM_FACE_EDGES);
+      boolCheck(pm.indices == faces, true);
+
+      for (unsigned int count = side*side; count > 0; count--) {
+         pm.setVertexCount(count);
+         for (unsigned int i = 0; i < NUM_FACE_EDGES * pm.activeFaces; i++)
+            boolCheck(pm.indices[i] < count, true);
+      }
+      equalityIntCheck(pm.activeFaces, 0);
+
+      // Refining again after coarsening ends on the same faces
+      pm.clearDirty();
+      pm.setVertexCount(side*side);
+      boolCheck(pm.indices == faces, true);
+      boolCheck(pm.dirtyEnd > pm.dirtyBegin, true);
+
+      // Splits that refer to vertices not read yet are rejected
+      ProgressiveMesh bad = ProgressiveMesh(2, 1);
+      PM::VertexSplit s;
+      s.baseVertex = 1;
+      boolCheck(bad.addSplit(s), false);
+   }
+}
@@ -0,0 +1,132 @@
+#include "test.h"
+#include "model.h"
+#include "reducer.h"
+
+using namespace Eigen;
+
+// Flat side x side vertex grid on the xy plane, with a bump of the given height in the middle
+static void makeGrid(Mesh& mesh, int side, float bump) {
+   mesh.resize(side*side, 2*(side-1)*(side-1));
+
+   for (int y = 0; y < side; y++)
+      for (int x = 0; x < side; x++) {
+         bool middle = x == side/2 && y == side/2;
+         mesh.positions[y*side + x] = Vector3f(x, y, middle ? bump : 0);
+      }
+
+   unsigned int * c = mesh.indices.data();
+   for (int y = 0; y < side-1; y++)
+      for (int x = 0; x < side-1; x++) {
+         unsigned int a = y*side + x, b = a + 1, d = a + side, e = d + 1;
+         *c++ = a; *c++ = b; *c++ = e;
+         *c++ = a; *c++ = e; *c++ = d;
+      }
+}
+
+void testReducer() {
+   {
+      // A flat grid simplifies to a handful of faces without any error
+      Mesh mesh;
+      makeGrid(mesh, 9, 0);
+
+      std::vector<unsigned int> indices;
+      float error = MR::SimplifyIndices(mesh, 0, 1e-4, indices);
+      equalityFloatCheck(error, 0, 1e-4);
+      boolCheck(indices.size() / NUM_FACE_EDGES <= 4, true);
+      boolCheck(indices.size() > 0, true);
+
+      // The border holds, so the corners survive and the area is unchanged
+      float area = 0;
+      bool corners[4] = {false, false, false, false};
+      for (unsigned int i = 0; i < indices.size(); i += NUM_FACE_EDGES) {
+         Vector3f& p0 = mesh.positions[indices[i]];
+         Vector3f& p1 = mesh.positions[indices[i+1]];
+         Vector3f& p2 = mesh.positions[indices[i+2]];
+         Vector3f n = (p1 - p0).cross(p2 - p0);
+         boolCheck(n(2) > 0, true);
+         area += 0.5f * n.norm();
+
+         for (int j = 0; j < NUM_FACE_EDGES; j++) {
+            unsigned int v = indices[i+j];
+            corners[0] |= v == 0;
+            corners[1] |= v == 8;
+            corners[2] |= v == 72;
+            corners[3] |= v == 80;
+         }
+      }
+      equalityFloatCheck(area, 64, 1e-3);
+      boolCheck(corners[0] && corners[1] && corners[2] && corners[3], true);
+   }
+
+   {
+      // The error bound stops before the bump gets flattened
+      Mesh mesh;
+      makeGrid(mesh, 9, 2);
+      unsigned int bump = 4*9 + 4;
+
+      std::vector<unsigned int> indices;
+      float error = MR::SimplifyIndices(mesh, 0, 1e-3, indices);
+      boolCheck(error <= 1e-3, true);
+
+      bool hasBump = false;
+      for (unsigned int i = 0; i < indices.size(); i++)
+         hasBump |= indices[i] == bump;
+      boolCheck(hasBump, true);
+   }
+
+   {
+      // Keeping skinned vertices apart holds on to the seam between two bones
+      Mesh mesh;
+      makeGrid(mesh, 9, 0);
+      for (int i = 0; i < 81; i++) {
+         int column = i % 9;
+         mesh.boneIndices[MAX_INFLUENCES*i] = 0;
+         mesh.boneIndices[MAX_INFLUENCES*i+1] = 1;
+         mesh.boneWeights[MAX_INFLUENCES*i] = column < 4 ? 1 : column == 4 ? 0.5f : 0;
+         mesh.boneWeights[MAX_INFLUENCES*i+1] = 1 - mesh.boneWeights[MAX_INFLUENCES*i];
+      }
+
+      std::vector<unsigned int> rigid, skinned;
+      MR::SimplifyIndices(mesh, 0, 1e-4, rigid);
+      MR::SimplifyIndices(mesh, 0, 1e-4, skinned, true);
+      boolCheck(skinned.size() > rigid.size(), true);
+
+      // No vertex crossed the seam, so no face reaches from one bone's side to the other
+      bool crossed = false;
+      for (unsigned int i = 0; i < skinned.size(); i += NUM_FACE_EDGES) {
+         bool left = false, right = false;
+         for (int j = 0; j < NUM_FACE_EDGES; j++) {
+            left |= skinned[i+j] % 9 < 4;
+            right |= skinned[i+j] % 9 > 4;
+         }
+         crossed |= left && right;
+      }
+      boolCheck(crossed, false);
+   }
+
+   {
+      // Simplifying in place stops at the face target (a collapse removes up
+      // to two faces) and drops unused vertices
+      Mesh mesh;
+      makeGrid(mesh, 9, 2);
+      mesh.uvs[80] = Vector2f(1, 1);
+
+      MR::Simplify(mesh, 40);
+      boolCheck(mesh.faceCount() <= 40 && mesh.faceCount() >= 39, true);
+      boolCheck(mesh.vertexCount() < 81, true);
+      equalityIntCheck(mesh.faceNormals.size(), mesh.faceCount());
+
+      std::vector<bool> used = std::vector<bool>(mesh.vertexCount(), false);
+      for (unsigned int i = 0; i < mesh.indices.size(); i++) {
+         boolCheck(mesh.indices[i] < mesh.vertexCount(), true);
+         used[mesh.indices[i]] = true;
+      }
+      for (unsigned int i = 0; i < used.size(); i++)
+         boolCheck(used[i], true);
+
+      // The last corner is kept and its attributes move with it
+      equalityFloatCheck(mesh.positions.back()(0), 8, 1e-5);
+      equalityFloatCheck(mesh.positions.back()(1), 8, 1e-5);
+      equalityFloatCheck(mesh.uvs.back()(0), 1, 1e-5);
+   }
+}
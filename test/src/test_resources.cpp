@@ -0,0 +1,64 @@
+#include "test.h"
+#include "resources.h"
+
+#include <stdio.h>
+
+// A 2x2, 24 bit bitmap for the registry to load
+static void writeBitmap(const char * path) {
+   unsigned char header[54] = {
+      'B', 'M', 70, 0, 0, 0, 0, 0, 0, 0, 54, 0, 0, 0,
+      40, 0, 0, 0, 2, 0, 0, 0, 2, 0, 0, 0, 1, 0, 24, 0,
+      0, 0, 0, 0, 16, 0, 0, 0, 0x13, 0x0B, 0, 0, 0x13, 0x0B, 0, 0,
+      0, 0, 0, 0, 0, 0, 0, 0
+   };
+   // Rows are padded to 4 bytes
+   unsigned char pixels[16] = {
+      255, 0, 0,   0, 255, 0,   0, 0,
+      0, 0, 255,   255, 255, 255, 0, 0
+   };
+
+   FILE * fp = fopen(path, "wb");
+   fwrite(header, 1, sizeof(header), fp);
+   fwrite(pixels, 1, sizeof(pixels), fp);
+   fclose(fp);
+}
+
+void testResources() {
+   const char * path = "/tmp/mountaineer_test_resources.bmp";
+   writeBitmap(path);
+
+   {
+      // Nothing here is uploaded, update() needs a GL context. The loader
+      // finishes decoding the file before it is destroyed.
+      AssetLoader loader(2);
+      ResourceRegistry registry(& loader);
+
+      {
+         // The same file through any path and with the same options is loaded once
+         AssetHandle firstReady, secondReady;
+         TextureHandle first = registry.texture(path, true, & firstReady);
+         TextureHandle second = registry.texture("/tmp/../tmp/mountaineer_test_resources.bmp", true, & secondReady);
+
+         boolCheck(first == second, true);
+         boolCheck(firstReady.valid() && secondReady.valid(), true);
+         equalityIntCheck(loader.pendingCount(), 1);
+         equalityIntCheck(registry.size(), 1);
+
+         // Different sampling makes a different texture object
+         TextureHandle clamped = registry.texture(path, false);
+         boolCheck(clamped == first, false);
+         equalityIntCheck(registry.size(), 2);
+      }
+
+      {
+         // A resource still loading stays in the registry even with no other users
+         equalityIntCheck(registry.releaseUnused(), 0);
+         equalityIntCheck(registry.size(), 2);
+
+         TextureHandle again = registry.texture(path, true);
+         equalityIntCheck(loader.pendingCount(), 2);
+      }
+   }
+
+   remove(path);
+}
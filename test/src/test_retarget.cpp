@@ -0,0 +1,150 @@
+#include "test.h"
+#include "retarget.h"
+
+#include <math.h>
+#include <vector>
+
+#define CLIP_FPS 30
+
+static Bone boneAt(const Eigen::Matrix4f& bind, int parent) {
+   Bone bone;
+   bone.parentIndex = parent;
+   bone.invBonePose = bind.inverse();
+   bone.parentOffset = Eigen::Matrix4f::Identity();
+   return bone;
+}
+
+// Chains a pose relative to parents into model space, parents first
+static std::vector<Eigen::Matrix4f> chain(const std::vector<BoneStep>& order, const LocalTransform * pose) {
+   std::vector<Eigen::Matrix4f> world = std::vector<Eigen::Matrix4f>(order.size());
+   for (unsigned int i = 0; i < order.size(); i++) {
+      const BoneStep& step = order[i];
+      Eigen::Matrix4f local = Mmath::TransformationMatrix(pose[step.bone].position,
+                              Eigen::Quaternionf(pose[step.bone].rotation), pose[step.bone].scale);
+      world[step.bone] = step.parent < 0 ? local : world[step.parent] * local;
+   }
+   return world;
+}
+
+static float rotationDifference(const Eigen::Matrix4f& a, const Eigen::Matrix4f& b) {
+   return (a.topLeftCorner<3,3>() - b.topLeftCorner<3,3>()).cwiseAbs().maxCoeff();
+}
+
+void testRetarget() {
+   Eigen::Vector3f one = Eigen::Vector3f(1, 1, 1);
+   Eigen::Vector3f zAxis = Eigen::Vector3f(0, 0, 1), xAxis = Eigen::Vector3f(1, 0, 0);
+
+   // A mocap style source with its keyframes in model space, hips and a spine
+   // whose axes point another way than the target's
+   std::vector<Bone> source;
+   source.push_back(boneAt(Mmath::TransformationMatrix(Eigen::Vector3f(0, 1, 0), Eigen::Quaternionf::Identity(), one), -1));
+   source.push_back(boneAt(Mmath::TransformationMatrix(Eigen::Vector3f(0, 1.5f, 0), Mmath::AngleAxisQuat<float>(M_PI / 2, zAxis), one), -1));
+
+   // A target twice as tall, chained, with a third bone nothing drives
+   std::vector<Bone> target;
+   Eigen::Matrix4f rootBind = Mmath::TransformationMatrix(Eigen::Vector3f(0, 2, 0), Mmath::AngleAxisQuat<float>(M_PI / 2, xAxis), one);
+   Eigen::Matrix4f spineOffset = Mmath::TransformationMatrix(Eigen::Vector3f(0, 0, 1), Mmath::AngleAxisQuat<float>(0.3f, zAxis), one);
+   Eigen::Matrix4f headOffset = Mmath::TransformationMatrix(Eigen::Vector3f(0, 0.5f, 0), Mmath::AngleAxisQuat<float>(-0.2f, xAxis), one);
+   target.push_back(boneAt(rootBind, -1));
+   target.push_back(boneAt(rootBind * spineOffset, 0));
+   target.push_back(boneAt(rootBind * spineOffset * headOffset, 1));
+   target[1].parentOffset = spineOffset;
+   target[2].parentOffset = headOffset;
+
+   std::vector<BoneStep> order;
+   BoneStep steps[] = {{0, -1}, {1, 0}, {2, 1}};
+   order.assign(steps, steps + 3);
+
+   std::vector<int> sourceOf;
+   sourceOf.push_back(0);
+   sourceOf.push_back(1);
+   sourceOf.push_back(-1);
+
+   RetargetMap map = RT::BuildMap(source, std::vector<BoneStep>(), target, order, sourceOf);
+   equalityIntCheck(map.bones.size(), 3);
+   equalityFloatCheck(map.rootScale, 2, 1e-6);
+
+   PoseArena arena;
+   std::vector<LocalTransform> pose = std::vector<LocalTransform>(3);
+   std::vector<Mmath::Matrix3x4f> sourceMs = std::vector<Mmath::Matrix3x4f>(2);
+
+   {
+      // The source's bind pose gives the target's
+      for (int j = 0; j < 2; j++)
+         sourceMs[j] = source[j].invBonePose.inverse().topRows<3>();
+      RT::RetargetPose(map, sourceMs.data(), & arena, pose.data());
+
+      std::vector<Eigen::Matrix4f> world = chain(order, pose.data());
+      for (int j = 0; j < 3; j++)
+         equalityFloatCheck((world[j] - target[j].invBonePose.inverse()).cwiseAbs().maxCoeff(), 0, 1e-5);
+   }
+
+   {
+      // Turning and moving the whole source turns every target bone with it,
+      // and moves the root twice as far
+      Eigen::Matrix4f moved = Mmath::TransformationMatrix(Eigen::Vector3f(1, 0, 0.5f),
+                              Mmath::AngleAxisQuat<float>(0.7f, Eigen::Vector3f(0, 1, 0)), one);
+      for (int j = 0; j < 2; j++)
+         sourceMs[j] = (moved * source[j].invBonePose.inverse()).topRows<3>();
+
+      arena.reset();
+      RT::RetargetPose(map, sourceMs.data(), & arena, pose.data());
+      std::vector<Eigen::Matrix4f> world = chain(order, pose.data());
+
+      for (int j = 0; j < 3; j++)
+         equalityFloatCheck(rotationDifference(world[j], moved * target[j].invBonePose.inverse()), 0, 1e-5);
+
+      Eigen::Vector3f sourceMoved = sourceMs[0].col(3) - Eigen::Vector3f(0, 1, 0);
+      Eigen::Vector3f rootExpected = Eigen::Vector3f(0, 2, 0) + 2 * sourceMoved;
+      equalityFloatCheck((world[0].block<3,1>(0,3) - rootExpected).norm(), 0, 1e-5);
+
+      // Bones keep the target's lengths
+      float spineLength = (world[1].block<3,1>(0,3) - world[0].block<3,1>(0,3)).norm();
+      equalityFloatCheck(spineLength, 1, 1e-5);
+   }
+
+   {
+      // A baked clip samples like retargeting each frame as it plays
+      unsigned int frameCount = 31;
+      std::vector<LocalTransform> frames = std::vector<LocalTransform>(2 * frameCount);
+      for (unsigned int f = 0; f < frameCount; f++) {
+         for (int j = 0; j < 2; j++) {
+            Eigen::Matrix4f bind = source[j].invBonePose.inverse();
+            Eigen::Quaternionf turn = Mmath::AngleAxisQuat<float>(0.05f * f * (j + 1), Eigen::Vector3f(0, 1, 0));
+            LocalTransform * t = & frames[j * frameCount + f];
+            t->position = bind.block<3,1>(0,3) + Eigen::Vector3f(0.02f * f, 0, 0);
+            t->rotation = turn * Eigen::Quaternionf(Eigen::Matrix3f(bind.topLeftCorner<3,3>()));
+            t->scale = one;
+         }
+      }
+
+      Animation clip;
+      clip.fps = CLIP_FPS;
+      clip.keyCount = frameCount;
+      clip.duration = 1.0f * (frameCount-1) / CLIP_FPS;
+      AC::Compress(frames.data(), 2, frameCount, CLIP_FPS, AC::DefaultTolerance(), clip.compressed);
+
+      Animation baked;
+      RT::RetargetAnimation(map, clip, & baked);
+      equalityIntCheck(baked.keyCount, frameCount);
+      equalityFloatCheck(baked.duration, clip.duration, 1e-6);
+
+      std::vector<LocalTransform> sampled = std::vector<LocalTransform>(3);
+      float worstRotation = 0, worstPosition = 0;
+      for (unsigned int f = 0; f < frameCount; f += 3) {
+         float time = 1.0f * f / CLIP_FPS;
+         AN::SampleAnimation(clip, time, sourceMs.data());
+         arena.reset();
+         RT::RetargetPose(map, sourceMs.data(), & arena, pose.data());
+         AN::SamplePose(baked, time, sampled.data());
+
+         for (int j = 0; j < 3; j++) {
+            Eigen::Quaternionf a = pose[j].rotation, b = sampled[j].rotation;
+            worstRotation = fmax(worstRotation, 1 - fabs(a.dot(b)));
+            worstPosition = fmax(worstPosition, (pose[j].position - sampled[j].position).norm());
+         }
+      }
+      equalityFloatCheck(worstRotation, 0, 1e-5);
+      equalityFloatCheck(worstPosition, 0, 2e-3);
+   }
+}
@@ -0,0 +1,136 @@
+#include "test.h"
+#include "skinning.h"
+
+#include <stdlib.h>
+#include <vector>
+
+#define SKIN_TEST_BONES 5
+
+static float randomFloat() {
+   return 1.0f * rand() / RAND_MAX;
+}
+
+// Vertices on up to MAX_INFLUENCES random bones with weights summing to 1
+static Mesh weightedMesh(unsigned int vertexCount) {
+   Mesh mesh;
+   mesh.resize(vertexCount, 0);
+
+   for (unsigned int v = 0; v < vertexCount; v++) {
+      mesh.positions[v] = Eigen::Vector3f::Random() * 3;
+      mesh.normals[v] = Eigen::Vector3f::Random().normalized();
+      mesh.boneInfCounts[v] = 1 + v % MAX_INFLUENCES;
+
+      float total = 0;
+      for (unsigned int i = 0; i < mesh.boneInfCounts[v]; i++) {
+         mesh.boneIndices[MAX_INFLUENCES * v + i] = rand() % SKIN_TEST_BONES;
+         mesh.boneWeights[MAX_INFLUENCES * v + i] = 0.1f + randomFloat();
+         total += mesh.boneWeights[MAX_INFLUENCES * v + i];
+      }
+      for (unsigned int i = 0; i < mesh.boneInfCounts[v]; i++)
+         mesh.boneWeights[MAX_INFLUENCES * v + i] /= total;
+   }
+   return mesh;
+}
+
+// What the animated shader does
+static Eigen::Vector3f linearReference(const Mesh& mesh, const Mmath::Matrix3x4f * animMs, unsigned int v) {
+   Mmath::Matrix3x4f m = Mmath::Matrix3x4f::Zero();
+   for (unsigned int i = 0; i < mesh.boneInfCounts[v]; i++)
+      m += mesh.boneWeights[MAX_INFLUENCES * v + i] * animMs[mesh.boneIndices[MAX_INFLUENCES * v + i]];
+   return m * Eigen::Vector4f(mesh.positions[v](0), mesh.positions[v](1), mesh.positions[v](2), 1);
+}
+
+void testSkinning() {
+   srand(11);
+
+   // Rigid bones turned well apart, so blending them bends the vertices a lot
+   Mmath::Matrix3x4f animMs[SKIN_TEST_BONES];
+   for (int j = 0; j < SKIN_TEST_BONES; j++)
+      animMs[j] = Mmath::TransformationMatrix(Eigen::Vector3f(Eigen::Vector3f::Random() * 2),
+                  Mmath::AngleAxisQuat<float>(0.5f * j, Eigen::Vector3f::Random().normalized()),
+                  Eigen::Vector3f(1, 1, 1)).topRows<3>();
+
+   {
+      // Linear blending matches the shader, including the vertices past the last full group
+      Mesh mesh = weightedMesh(37);
+      SkinPalette palette;
+      SK::BuildPalette(animMs, SKIN_TEST_BONES, SKIN_LINEAR, & palette);
+
+      std::vector<Eigen::Vector3f> positions = std::vector<Eigen::Vector3f>(37), normals = std::vector<Eigen::Vector3f>(37);
+      SK::SkinVertices(mesh, palette, 0, 37, positions.data(), normals.data());
+
+      float worst = 0, worstNormal = 0;
+      for (unsigned int v = 0; v < 37; v++) {
+         worst = fmax(worst, (positions[v] - linearReference(mesh, animMs, v)).norm());
+         worstNormal = fmax(worstNormal, fabs(normals[v].norm() - 1));
+      }
+      equalityFloatCheck(worst, 0, 1e-4);
+      equalityFloatCheck(worstNormal, 0, 1e-5);
+
+      // Only the range asked for is written
+      std::vector<Eigen::Vector3f> part = std::vector<Eigen::Vector3f>(37, Eigen::Vector3f(9, 9, 9));
+      SK::SkinVertices(mesh, palette, 5, 3, part.data(), NULL);
+      equalityFloatCheck((part[4] - Eigen::Vector3f(9, 9, 9)).norm(), 0, 1e-6);
+      equalityFloatCheck((part[8] - Eigen::Vector3f(9, 9, 9)).norm(), 0, 1e-6);
+      equalityFloatCheck((part[6] - positions[6]).norm(), 0, 1e-5);
+   }
+
+   {
+      // Dual quaternions move a vertex on one bone rigidly with it, and keep
+      // vertices between two bones at their distance from the joint
+      Mesh mesh = weightedMesh(16);
+      SkinPalette palette;
+      SK::BuildPalette(animMs, SKIN_TEST_BONES, SKIN_DUAL_QUATERNION, & palette);
+
+      std::vector<Eigen::Vector3f> positions, normals;
+      SK::SkinMesh(mesh, palette, NULL, positions, normals);
+      equalityIntCheck(positions.size(), 16);
+
+      for (unsigned int v = 0; v < 16; v += MAX_INFLUENCES) {
+         Eigen::Vector3f expected = linearReference(mesh, animMs, v);
+         equalityFloatCheck((positions[v] - expected).norm(), 0, 1e-4);
+         Eigen::Vector3f normal = animMs[mesh.boneIndices[MAX_INFLUENCES * v]].topLeftCorner<3,3>() * mesh.normals[v];
+         equalityFloatCheck((normals[v] - normal).norm(), 0, 1e-4);
+      }
+
+      // Half way between a bone and its copy turned a half turn, where linear
+      // blending collapses to the axis
+      Mmath::Matrix3x4f twisted[2];
+      twisted[0] = Mmath::Matrix3x4f::Identity();
+      twisted[1] = Mmath::TransformationMatrix(Eigen::Vector3f(0, 0, 0),
+                   Mmath::AngleAxisQuat<float>(0.9f * M_PI, Eigen::Vector3f(1, 0, 0)), Eigen::Vector3f(1, 1, 1)).topRows<3>();
+      Mesh joint;
+      joint.resize(1, 0);
+      joint.positions[0] = Eigen::Vector3f(0, 1, 0);
+      joint.normals[0] = Eigen::Vector3f(0, 1, 0);
+      joint.boneInfCounts[0] = 2;
+      joint.boneIndices[1] = 1;
+      joint.boneWeights[0] = 0.5f;
+      joint.boneWeights[1] = 0.5f;
+
+      SK::BuildPalette(twisted, 2, SKIN_DUAL_QUATERNION, & palette);
+      SK::SkinMesh(joint, palette, NULL, positions, normals);
+      equalityFloatCheck(positions[0].norm(), 1, 1e-5);
+
+      SK::BuildPalette(twisted, 2, SKIN_LINEAR, & palette);
+      SK::SkinMesh(joint, palette, NULL, positions, normals);
+      boolCheck(positions[0].norm() < 0.2f, true);
+   }
+
+   {
+      // Chunks skinned on a pool come out as skinning it all here
+      Mesh mesh = weightedMesh(3 * SKIN_CHUNK_VERTICES + 100);
+      SkinPalette palette;
+      SK::BuildPalette(animMs, SKIN_TEST_BONES, SKIN_DUAL_QUATERNION, & palette);
+
+      std::vector<Eigen::Vector3f> here, hereNormals, pooled, pooledNormals;
+      SK::SkinMesh(mesh, palette, NULL, here, hereNormals);
+      ThreadPool pool(4);
+      SK::SkinMesh(mesh, palette, & pool, pooled, pooledNormals);
+
+      float worst = 0;
+      for (unsigned int v = 0; v < here.size(); v++)
+         worst = fmax(worst, (here[v] - pooled[v]).norm() + (hereNormals[v] - pooledNormals[v]).norm());
+      equalityFloatCheck(worst, 0, 0);
+   }
+}
@@ -0,0 +1,91 @@
+#include "test.h"
+#include "spring_system.h"
+
+#include <math.h>
+
+#define ROPE_PARTICLE_MASS 0.1
+#define ROPE_SPACING 0.1
+
+// Hanging straight down from its first particle
+static void buildRope(SpringSystem * rope, int particleCount, double stiffness) {
+   for (int i = 0; i < particleCount; i++)
+      rope->addParticle(Eigen::Vector3d(0, -ROPE_SPACING * i, 0), ROPE_PARTICLE_MASS, i == 0);
+   for (int i = 1; i < particleCount; i++)
+      rope->addSpring(i - 1, i, stiffness);
+}
+
+void testSprings() {
+   {
+      // At rest each spring holds up the rope below it, whichever solver is used
+      SpringSystem direct, iterative;
+      direct.method = SPRING_DIRECT;
+      buildRope(& direct, 20, 1000);
+      buildRope(& iterative, 20, 1000);
+
+      for (int i = 0; i < 600; i++) {
+         direct.step(1.0 / 60);
+         iterative.step(1.0 / 60);
+      }
+      equalityIntCheck(direct.patternBuildCount(), 1);
+      equalityIntCheck(iterative.patternBuildCount(), 1);
+
+      for (int i = 0; i < 19; i++) {
+         const Spring * spring = & direct.springs[i];
+         double length = (direct.particles[spring->p1].position - direct.particles[spring->p0].position).norm();
+         double below = (19 - i) * ROPE_PARTICLE_MASS * 9.8;
+         equalityFloatCheck(spring->stiffness * (length - spring->restLength), below, 1e-3 * below);
+      }
+
+      Eigen::Vector3d end = direct.particles[19].position;
+      equalityFloatCheck((iterative.particles[19].position - end).norm(), 0, 1e-5);
+      boolCheck(iterative.lastIterations() <= SPRING_CG_ITERATIONS, true);
+
+      // Pinning a particle changes the pattern, after that it stays put
+      direct.particles[10].fixed = true;
+      Eigen::Vector3d pinned = direct.particles[10].position;
+      direct.step(1.0 / 60);
+      direct.step(1.0 / 60);
+      equalityIntCheck(direct.patternBuildCount(), 2);
+      equalityFloatCheck((direct.particles[10].position - pinned).norm(), 0, 1e-12);
+   }
+
+   {
+      // Contacts pull on a particle without rebuilding anything
+      SpringSystem rope;
+      buildRope(& rope, 5, 1000);
+      rope.step(1.0 / 60);
+
+      for (int i = 0; i < 120; i++) {
+         rope.addContact(4, Eigen::Vector3d(0.2, -0.4, 0), 500);
+         rope.step(1.0 / 60);
+      }
+      equalityIntCheck(rope.patternBuildCount(), 1);
+      boolCheck(rope.particles[4].position(0) > 0.1, true);
+   }
+
+   {
+      // Two ropes side by side, pushed apart by a collision spring between their
+      // ends, without the pair ever joining the pattern
+      SpringSystem ropes;
+      buildRope(& ropes, 5, 1000);
+      for (int i = 0; i < 5; i++)
+         ropes.addParticle(Eigen::Vector3d(0.1, -ROPE_SPACING * i, 0), ROPE_PARTICLE_MASS, i == 0);
+      for (int i = 6; i < 10; i++)
+         ropes.addSpring(i - 1, i, 1000);
+      ropes.step(1.0 / 60);
+
+      for (int i = 0; i < 120; i++) {
+         ropes.addCollisionSpring(4, 9, 200, 0.3);
+         ropes.step(1.0 / 60);
+      }
+      equalityIntCheck(ropes.patternBuildCount(), 1);
+      boolCheck((ropes.particles[9].position - ropes.particles[4].position).norm() > 0.2, true);
+
+      // Much stiffer collisions settle just as well
+      for (int i = 0; i < 300; i++) {
+         ropes.addCollisionSpring(4, 9, 1e5, 0.3);
+         ropes.step(1.0 / 60);
+      }
+      equalityFloatCheck((ropes.particles[9].position - ropes.particles[4].position).norm(), 0.3, 1e-3);
+   }
+}